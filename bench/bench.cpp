@@ -0,0 +1,127 @@
+#include "bench.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace bench {
+
+namespace {
+struct Entry {
+    const char* name;
+    Benchmark benchmark;
+};
+
+std::vector<Entry>& registry() {
+    static std::vector<Entry> entries;
+    return entries;
+}
+
+volatile size_t size_sink;
+volatile double double_sink;
+const void* volatile pointer_sink;
+}
+
+bool add(const char* name, Benchmark benchmark) {
+    registry().push_back(Entry{name, benchmark});
+    return true;
+}
+
+void consume(size_t value) {
+    size_sink = size_sink + value;
+}
+
+void consume(double value) {
+    double_sink = double_sink + value;
+}
+
+void consume(const void* value) {
+    pointer_sink = value;
+}
+
+} // namespace bench
+} // namespace numu
+
+namespace {
+struct Options {
+    const char* filter = "";
+    bool json = false;
+    double min_seconds = 0.2;
+};
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (std::strcmp(arg, "--json") == 0) {
+            options.json = true;
+        } else if (std::strncmp(arg, "--min-time=", 11) == 0) {
+            options.min_seconds = std::atof(arg + 11);
+        } else if (arg[0] == '-') {
+            std::fprintf(stderr, "usage: %s [--json] [--min-time=SECONDS] [FILTER]\n", argv[0]);
+            std::exit(2);
+        } else {
+            options.filter = arg;
+        }
+    }
+    return options;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace numu::bench;
+    using clock = std::chrono::steady_clock;
+
+    Options options = parse_options(argc, argv);
+
+    // The JSON form is one object per benchmark in a "benchmarks" array,
+    // with rates per second, for regression tracking across builds
+    if (options.json) {
+        std::printf("{\n  \"benchmarks\": [");
+    } else {
+        std::printf("%-32s %12s %14s %12s %14s\n", "benchmark", "iterations", "ns/iter", "MB/s", "items/s");
+    }
+    bool first = true;
+    for (const auto& entry : registry()) {
+        if (!std::strstr(entry.name, options.filter)) {
+            continue;
+        }
+
+        // One untimed run first, so corpora built on first use and cold
+        // caches are not charged to short measurements
+        State state;
+        state.iterations = 1;
+        entry.benchmark(state);
+
+        double seconds = 0;
+        for (state.iterations = 1;; state.iterations *= 4) {
+            auto start = clock::now();
+            entry.benchmark(state);
+            seconds = std::chrono::duration<double>(clock::now() - start).count();
+            if (seconds >= options.min_seconds) {
+                break;
+            }
+        }
+
+        double ns = seconds * 1e9 / static_cast<double>(state.iterations);
+        double bytes = static_cast<double>(state.bytes) * state.iterations / seconds;
+        double items = static_cast<double>(state.items) * state.iterations / seconds;
+        if (options.json) {
+            std::printf("%s\n    {\"name\": \"%s\", \"iterations\": %zu, \"ns_per_iteration\": %.1f, "
+                        "\"bytes_per_second\": %.0f, \"items_per_second\": %.0f}",
+                        first ? "" : ",", entry.name, state.iterations, ns, bytes, items);
+        } else {
+            std::printf("%-32s %12zu %14.1f %12.1f %14.0f\n", entry.name, state.iterations, ns,
+                        bytes / (1024.0 * 1024.0), items);
+        }
+        std::fflush(stdout);
+        first = false;
+    }
+    if (options.json) {
+        std::printf("\n  ]\n}\n");
+    }
+    return 0;
+}
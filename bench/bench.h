@@ -0,0 +1,32 @@
+#ifndef NUMU_BENCH_BENCH_H
+#define NUMU_BENCH_BENCH_H
+
+#include <cstddef>
+
+namespace numu {
+namespace bench {
+
+struct State {
+    size_t iterations = 0;
+    size_t bytes = 0; // processed per iteration, for throughput
+    size_t items = 0; // e.g. tokens or nodes per iteration
+};
+
+using Benchmark = void (*)(State&);
+
+bool add(const char* name, Benchmark benchmark);
+
+// Keeps a result observable so the measured work is not optimized away
+void consume(size_t value);
+void consume(double value);
+void consume(const void* value);
+
+} // namespace bench
+} // namespace numu
+
+#define NUMU_BENCHMARK(name) \
+    static void name(::numu::bench::State& state); \
+    static const bool name##_registered = ::numu::bench::add(#name, name); \
+    static void name(::numu::bench::State& state)
+
+#endif // NUMU_BENCH_BENCH_H
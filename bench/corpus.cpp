@@ -0,0 +1,89 @@
+#include "corpus.h"
+
+namespace numu {
+namespace bench {
+
+const std::vector<std::string> corpus_variables = {"x", "y", "z", "t"};
+
+core::Frame corpus_frame() {
+    core::builtin::initialize();
+    core::Frame frame(core::default_registry());
+    double value = 0.25;
+    for (const auto& name : corpus_variables) {
+        frame.set(name, value);
+        value += 0.5;
+    }
+    return frame;
+}
+
+std::vector<std::string> formulas(size_t count) {
+    std::vector<std::string> sources;
+    sources.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string n = std::to_string(i % 97 + 1);
+        switch(i % 5) {
+            case 0:
+                sources.push_back("sin(x * " + n + ") * 1 + cos(y) ^ 2 + 0 * z");
+                break;
+            case 1:
+                sources.push_back("sqrt(x * x + y * y + z * z) / (1 + 2 * 3 + t / " + n + ")");
+                break;
+            case 2:
+                sources.push_back("exp(-t * " + n + ") * (x + x + x) - (y - y) + log(1 + z * z)");
+                break;
+            case 3:
+                sources.push_back("max(min(x, y), 0.5, z * " + n + ") + abs(t - 2) * (4 / 2)");
+                break;
+            default:
+                sources.push_back("(x + " + n + ") * (x + " + n + ") - pow(y, 2) + (t < 1) * z");
+                break;
+        }
+    }
+    return sources;
+}
+
+std::string deep_nesting(size_t depth) {
+    std::string source;
+    for (size_t i = 0; i < depth; ++i) {
+        source += i % 2 ? "(y - " : "((x + ";
+    }
+    source += "t";
+    for (size_t i = depth; i-- > 0;) {
+        source += i % 2 ? ") * 0.5" : " + 1) * z)";
+    }
+    return source;
+}
+
+std::string wide_call(size_t width) {
+    std::string source = "max(";
+    for (size_t i = 0; i < width; ++i) {
+        if (i) {
+            source += ", ";
+        }
+        std::string n = std::to_string(i + 1);
+        source += i % 2 ? "cos(y + " + n + ")" : "sin(x * " + n + ") * t";
+    }
+    return source + ")";
+}
+
+std::string matrix_literal(size_t size) {
+    std::string source = "[";
+    for (size_t i = 0; i < size; ++i) {
+        source += i ? ", [" : "[";
+        for (size_t j = 0; j < size; ++j) {
+            if (j) {
+                source += ", ";
+            }
+            if (i == j) {
+                source += "x + " + std::to_string(size);
+            } else {
+                source += std::to_string((i * 7 + j * 3) % 11) + " / 10";
+            }
+        }
+        source += "]";
+    }
+    return source + "]";
+}
+
+} // namespace bench
+} // namespace numu
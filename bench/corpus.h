@@ -0,0 +1,32 @@
+#ifndef NUMU_BENCH_CORPUS_H
+#define NUMU_BENCH_CORPUS_H
+
+#include "numu/core/eval.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace bench {
+
+// Sources shaped like the expressions users feed numu. All of them read
+// only the variables in corpus_variables and the builtin functions.
+
+// Mixed arithmetic, calls and comparisons with room for simplification,
+// such as x*1, constant subexpressions and repeated terms
+std::vector<std::string> formulas(size_t count);
+// ((x + 1) * (y - 2) + ...) nested `depth` levels
+std::string deep_nesting(size_t depth);
+// max(...) over `width` arguments, each a small call
+std::string wide_call(size_t width);
+// A size x size matrix literal of numbers and variables
+std::string matrix_literal(size_t size);
+
+extern const std::vector<std::string> corpus_variables;
+// Binds every corpus variable, after registering the builtins
+core::Frame corpus_frame();
+
+} // namespace bench
+} // namespace numu
+
+#endif // NUMU_BENCH_CORPUS_H
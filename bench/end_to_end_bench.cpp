@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "corpus.h"
+#include "numu/core/arena.h"
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include "numu/core/lex.h"
+#include "numu/core/matrix.h"
+#include "numu/core/parse.h"
+#include <string>
+#include <vector>
+
+namespace {
+namespace core = numu::core;
+
+// Source text to value: lex, parse, simplify and evaluate, as a caller
+// with a fresh expression does
+double run(const std::string& source, const core::Frame& frame) {
+    numu::lex::Lexer lexer(source);
+    return core::evaluate(numu::ast::simplify(numu::parse::parse(lexer)), frame);
+}
+
+size_t total_size(const std::vector<std::string>& sources) {
+    size_t bytes = 0;
+    for (const auto& source : sources) {
+        bytes += source.size();
+    }
+    return bytes;
+}
+
+NUMU_BENCHMARK(end_to_end_formulas) {
+    static const std::vector<std::string> sources = numu::bench::formulas(5000);
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        for (const auto& source : sources) {
+            numu::bench::consume(run(source, frame));
+        }
+    }
+    state.items = sources.size();
+    state.bytes = total_size(sources);
+}
+
+NUMU_BENCHMARK(end_to_end_deep_nesting) {
+    static const std::string source = numu::bench::deep_nesting(200);
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::bench::consume(run(source, frame));
+    }
+    state.items = 1;
+    state.bytes = source.size();
+}
+
+NUMU_BENCHMARK(end_to_end_wide_call) {
+    static const std::string source = numu::bench::wide_call(1000);
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::bench::consume(run(source, frame));
+    }
+    state.items = 1;
+    state.bytes = source.size();
+}
+
+NUMU_BENCHMARK(end_to_end_matrix_determinant_64) {
+    static const std::string source = "det(" + numu::bench::matrix_literal(64) + ")";
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::bench::consume(run(source, frame));
+    }
+    state.items = 64 * 64;
+    state.bytes = source.size();
+}
+
+NUMU_BENCHMARK(end_to_end_matrix_product_64) {
+    static const std::string literal = numu::bench::matrix_literal(64);
+    static const std::string source = literal + " * transpose(" + literal + ")";
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::lex::Lexer lexer(source);
+        core::Matrix product = core::evaluate_matrix(numu::parse::parse(lexer), frame);
+        numu::bench::consume(product(0, 0));
+    }
+    state.items = 64 * 64;
+    state.bytes = source.size();
+}
+
+} // namespace
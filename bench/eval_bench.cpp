@@ -0,0 +1,158 @@
+#include "bench.h"
+#include "corpus.h"
+#include "numu/core/batch.h"
+#include "numu/core/compile.h"
+#include "numu/core/eval.h"
+#include "numu/core/flat.h"
+#include "numu/core/lex.h"
+#include "numu/core/parse.h"
+#include "numu/core/resolve.h"
+#include <string>
+#include <vector>
+
+namespace {
+using numu::ast::Node;
+namespace core = numu::core;
+
+Node* parse(const std::string& source) {
+    numu::lex::Lexer lexer(source);
+    return numu::parse::parse(lexer);
+}
+
+const std::vector<Node*>& formula_trees() {
+    static const std::vector<Node*> trees = [] {
+        std::vector<Node*> parsed;
+        for (const auto& source : numu::bench::formulas(5000)) {
+            parsed.push_back(parse(source));
+        }
+        return parsed;
+    }();
+    return trees;
+}
+
+Node* deep_tree() {
+    static Node* tree = parse(numu::bench::deep_nesting(200));
+    return tree;
+}
+
+Node* wide_tree() {
+    static Node* tree = parse(numu::bench::wide_call(1000));
+    return tree;
+}
+
+NUMU_BENCHMARK(evaluate_formulas) {
+    const auto& trees = formula_trees();
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        for (auto* tree : trees) {
+            numu::bench::consume(core::evaluate(tree, frame));
+        }
+    }
+    state.items = trees.size();
+}
+
+NUMU_BENCHMARK(evaluate_deep_nesting) {
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::bench::consume(core::evaluate(deep_tree(), frame));
+    }
+    state.items = 1;
+}
+
+NUMU_BENCHMARK(evaluate_wide_call) {
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::bench::consume(core::evaluate(wide_tree(), frame));
+    }
+    state.items = 1;
+}
+
+NUMU_BENCHMARK(evaluate_dag_formulas) {
+    const auto& trees = formula_trees();
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        for (auto* tree : trees) {
+            numu::bench::consume(core::evaluate_dag(tree, frame));
+        }
+    }
+    state.items = trees.size();
+}
+
+NUMU_BENCHMARK(evaluate_flat_formulas) {
+    static const numu::ast::FlatTree flat = [] {
+        numu::ast::FlatTree tree;
+        for (auto* node : formula_trees()) {
+            tree.add_entry("f" + std::to_string(tree.entry_count()), numu::ast::flatten(node, tree));
+        }
+        return tree;
+    }();
+    const core::Frame frame = numu::bench::corpus_frame();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        for (size_t e = 0; e < flat.entry_count(); ++e) {
+            numu::bench::consume(core::evaluate(flat, flat.entry_node(e), frame));
+        }
+    }
+    state.items = flat.entry_count();
+}
+
+NUMU_BENCHMARK(evaluate_resolved_formulas) {
+    const core::Frame frame = numu::bench::corpus_frame();
+    static const std::vector<core::ResolvedExpression> resolved = [&frame] {
+        std::vector<core::ResolvedExpression> all;
+        for (auto* tree : formula_trees()) {
+            all.push_back(core::resolve(tree, numu::bench::corpus_variables, frame));
+        }
+        return all;
+    }();
+    std::vector<double> values = {0.25, 0.75, 1.25, 1.75};
+    for (size_t i = 0; i < state.iterations; ++i) {
+        for (const auto& expr : resolved) {
+            numu::bench::consume(expr.evaluate(values.data()));
+        }
+    }
+    state.items = resolved.size();
+}
+
+NUMU_BENCHMARK(evaluate_compiled_formulas) {
+    const core::Frame frame = numu::bench::corpus_frame();
+    static const std::vector<core::CompiledExpression> compiled = [&frame] {
+        std::vector<core::CompiledExpression> all;
+        for (auto* tree : formula_trees()) {
+            all.push_back(core::compile(tree, numu::bench::corpus_variables, frame));
+        }
+        return all;
+    }();
+    std::vector<double> values = {0.25, 0.75, 1.25, 1.75};
+    for (size_t i = 0; i < state.iterations; ++i) {
+        for (const auto& expr : compiled) {
+            numu::bench::consume(expr.evaluate(values.data()));
+        }
+    }
+    state.items = compiled.size();
+}
+
+NUMU_BENCHMARK(evaluate_batch_64k) {
+    constexpr size_t points = 64 * 1024;
+    const core::Frame frame = numu::bench::corpus_frame();
+    static const core::CompiledExpression expr =
+        core::compile(formula_trees()[1], numu::bench::corpus_variables, frame);
+    static const std::vector<std::vector<double>> data = [] {
+        std::vector<std::vector<double>> columns(4, std::vector<double>(points));
+        for (size_t c = 0; c < columns.size(); ++c) {
+            for (size_t p = 0; p < points; ++p) {
+                columns[c][p] = 0.001 * static_cast<double>(p) + static_cast<double>(c);
+            }
+        }
+        return columns;
+    }();
+    const double* columns[] = {data[0].data(), data[1].data(), data[2].data(), data[3].data()};
+    std::vector<double> out(points);
+    for (size_t i = 0; i < state.iterations; ++i) {
+        core::evaluate_batch(expr, columns, points, out.data());
+        numu::bench::consume(out[points - 1]);
+    }
+    state.items = points;
+    state.bytes = 5 * points * sizeof(double);
+}
+
+} // namespace
@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "numu/core/lex.h"
+#include <string>
+
+namespace {
+using numu::lex::Lexer;
+using numu::lex::TokenType;
+
+std::string make_formulas(size_t count) {
+    std::string source;
+    for (size_t i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        switch(i % 4) {
+            case 0:
+                source += "let x" + n + " = sin(alpha * 3.25e-2) + beta ** 2 >= gamma_" + n + " -> delta;\n";
+                break;
+            case 1:
+                source += "velocity_" + n + " = sqrt(vx * vx + vy * vy + vz * vz) / (1.0 + drag); # magnitude\n";
+                break;
+            case 2:
+                source += "if (t <= 10) { y" + n + " = a[i] * exp(-k * t) } else { y" + n + " = 0 }\n";
+                break;
+            default:
+                source += "result_" + n + " = max(min(p, q), 0.5) != threshold_value; pi * e\n";
+                break;
+        }
+    }
+    return source;
+}
+
+size_t lex_all(const std::string& source) {
+    Lexer lexer(source);
+    size_t tokens = 0;
+    while (lexer.next().type != TokenType::END_OF_FILE) {
+        ++tokens;
+    }
+    return tokens;
+}
+
+NUMU_BENCHMARK(lex_formulas) {
+    static const std::string source = make_formulas(20000);
+    for (size_t i = 0; i < state.iterations; ++i) {
+        state.items = lex_all(source);
+        numu::bench::consume(state.items);
+    }
+    state.bytes = source.size();
+}
+
+NUMU_BENCHMARK(lex_identifiers) {
+    static const std::string source = [] {
+        std::string s;
+        for (size_t i = 0; i < 50000; ++i) {
+            s += "some_rather_long_identifier_" + std::to_string(i) + " while return else ";
+        }
+        return s;
+    }();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        state.items = lex_all(source);
+        numu::bench::consume(state.items);
+    }
+    state.bytes = source.size();
+}
+
+NUMU_BENCHMARK(lex_operators) {
+    static const std::string source = [] {
+        std::string s;
+        for (size_t i = 0; i < 50000; ++i) {
+            s += "(a+b)*c-d/e^f==g!=h<=i>=j->k**l;[m,n]{o:p}\n";
+        }
+        return s;
+    }();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        state.items = lex_all(source);
+        numu::bench::consume(state.items);
+    }
+    state.bytes = source.size();
+}
+
+} // namespace
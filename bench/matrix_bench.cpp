@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "numu/core/matrix.h"
+#include "numu/core/sparse.h"
+#include <random>
+#include <vector>
+
+namespace {
+using numu::core::Matrix;
+using numu::core::SparseMatrix;
+
+Matrix make_matrix(size_t n, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    Matrix m(n, n);
+    for (size_t i = 0; i < m.size(); ++i) {
+        m.data()[i] = dist(gen);
+    }
+    // Diagonally dominant, so inverse never hits a singular pivot
+    for (size_t i = 0; i < n; ++i) {
+        m(i, i) += static_cast<double>(n);
+    }
+    return m;
+}
+
+// Five-point Laplacian on a side x side grid
+SparseMatrix make_poisson(size_t side) {
+    std::vector<SparseMatrix::Entry> entries;
+    for (size_t i = 0; i < side; ++i) {
+        for (size_t j = 0; j < side; ++j) {
+            size_t k = i * side + j;
+            entries.push_back({k, k, 4.0});
+            if (i > 0) entries.push_back({k, k - side, -1.0});
+            if (i + 1 < side) entries.push_back({k, k + side, -1.0});
+            if (j > 0) entries.push_back({k, k - 1, -1.0});
+            if (j + 1 < side) entries.push_back({k, k + 1, -1.0});
+        }
+    }
+    return SparseMatrix(side * side, side * side, std::move(entries));
+}
+
+NUMU_BENCHMARK(matrix_multiply_256) {
+    static const Matrix a = make_matrix(256, 1);
+    static const Matrix b = make_matrix(256, 2);
+    for (size_t i = 0; i < state.iterations; ++i) {
+        Matrix c = numu::core::multiply(a, b);
+        numu::bench::consume(c(0, 0));
+    }
+    state.items = 256 * 256 * 256;
+    state.bytes = 3 * a.size() * sizeof(double);
+}
+
+NUMU_BENCHMARK(matrix_transpose_1024) {
+    static const Matrix a = make_matrix(1024, 3);
+    for (size_t i = 0; i < state.iterations; ++i) {
+        Matrix t = numu::core::transpose(a);
+        numu::bench::consume(t(1, 0));
+    }
+    state.items = a.size();
+    state.bytes = 2 * a.size() * sizeof(double);
+}
+
+NUMU_BENCHMARK(matrix_inverse_128) {
+    static const Matrix a = make_matrix(128, 4);
+    for (size_t i = 0; i < state.iterations; ++i) {
+        Matrix inv = numu::core::inverse(a);
+        numu::bench::consume(inv(0, 0));
+    }
+    state.items = a.size();
+}
+
+NUMU_BENCHMARK(matrix_determinant_256) {
+    static const Matrix a = make_matrix(256, 5);
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::bench::consume(numu::core::determinant(a));
+    }
+    state.items = a.size();
+}
+NUMU_BENCHMARK(sparse_multiply_poisson_316) {
+    static const SparseMatrix a = make_poisson(316);
+    std::vector<double> x(a.cols(), 1.0);
+    std::vector<double> y(a.rows());
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::core::multiply(a, x.data(), y.data());
+        numu::bench::consume(y[0]);
+    }
+    state.items = a.nonzeros();
+    state.bytes = a.nonzeros() * (sizeof(double) + sizeof(uint32_t));
+}
+
+NUMU_BENCHMARK(sparse_conjugate_gradient_poisson_100) {
+    static const SparseMatrix a = make_poisson(100);
+    std::vector<double> b(a.rows(), 1.0);
+    numu::core::SolverOptions options;
+    options.tolerance = 1e-8;
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::bench::consume(numu::core::conjugate_gradient(a, b, options).residual);
+    }
+    state.items = a.rows();
+}
+} // namespace
@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "numu/core/arena.h"
+#include "numu/core/lex.h"
+#include "numu/core/parse.h"
+#include <string>
+#include <vector>
+
+namespace {
+using numu::lex::Lexer;
+
+std::vector<std::string> make_expressions(size_t count) {
+    std::vector<std::string> expressions;
+    expressions.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        switch(i % 4) {
+            case 0:
+                expressions.push_back("sin(alpha * 3.25e-2) + beta ^ 2 * -gamma_" + n);
+                break;
+            case 1:
+                expressions.push_back("sqrt(vx * vx + vy * vy + vz * vz) / (1.0 + drag_" + n + ")");
+                break;
+            case 2:
+                expressions.push_back("y" + n + " = a * exp(-k * t) + (b - c) / (d + " + n + ")");
+                break;
+            default:
+                expressions.push_back("max(min(p, q), 0.5) <= threshold_" + n + " == !flag");
+                break;
+        }
+    }
+    return expressions;
+}
+
+NUMU_BENCHMARK(parse_expressions) {
+    static const std::vector<std::string> expressions = make_expressions(20000);
+    size_t bytes = 0;
+    for (const auto& expr : expressions) {
+        bytes += expr.size();
+    }
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        for (const auto& expr : expressions) {
+            Lexer lexer(expr);
+            numu::bench::consume(numu::parse::parse(lexer));
+        }
+    }
+    state.items = expressions.size();
+    state.bytes = bytes;
+}
+
+NUMU_BENCHMARK(parse_deep_nesting) {
+    static const std::string source = [] {
+        std::string s;
+        for (size_t i = 0; i < 200; ++i) {
+            s += "(x" + std::to_string(i) + " + ";
+        }
+        s += "1";
+        for (size_t i = 0; i < 200; ++i) {
+            s += ") * 2";
+        }
+        return s;
+    }();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        Lexer lexer(source);
+        numu::bench::consume(numu::parse::parse(lexer));
+    }
+    state.items = 1;
+    state.bytes = source.size();
+}
+
+} // namespace
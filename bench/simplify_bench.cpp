@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "corpus.h"
+#include "numu/core/arena.h"
+#include "numu/core/ast.h"
+#include "numu/core/lex.h"
+#include "numu/core/parse.h"
+#include <string>
+#include <vector>
+
+namespace {
+using numu::ast::Node;
+
+// Parsed into the thread's default arena, so the trees outlive the
+// per-iteration scopes that own each simplified copy
+Node* parse(const std::string& source) {
+    numu::lex::Lexer lexer(source);
+    return numu::parse::parse(lexer);
+}
+
+size_t simplify_all(const std::vector<Node*>& trees) {
+    numu::ast::SimplifyStats stats;
+    size_t rewrites = 0;
+    for (auto* tree : trees) {
+        numu::bench::consume(numu::ast::simplify(tree, &stats));
+        rewrites += stats.rewrites;
+    }
+    return rewrites;
+}
+
+NUMU_BENCHMARK(simplify_formulas) {
+    static const std::vector<Node*> trees = [] {
+        std::vector<Node*> parsed;
+        for (const auto& source : numu::bench::formulas(5000)) {
+            parsed.push_back(parse(source));
+        }
+        return parsed;
+    }();
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::bench::consume(simplify_all(trees));
+    }
+    state.items = trees.size();
+}
+
+NUMU_BENCHMARK(simplify_deep_nesting) {
+    static const std::vector<Node*> trees = {parse(numu::bench::deep_nesting(200))};
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::bench::consume(simplify_all(trees));
+    }
+    state.items = 1;
+}
+
+NUMU_BENCHMARK(simplify_wide_call) {
+    static const std::vector<Node*> trees = {parse(numu::bench::wide_call(1000))};
+    for (size_t i = 0; i < state.iterations; ++i) {
+        numu::ast::ArenaScope scope;
+        numu::bench::consume(simplify_all(trees));
+    }
+    state.items = 1;
+}
+
+} // namespace
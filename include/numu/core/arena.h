@@ -0,0 +1,136 @@
+#ifndef NUMU_CORE_ARENA_H
+#define NUMU_CORE_ARENA_H
+
+#include "numu/core/stats.h"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace numu {
+namespace ast {
+
+struct NumberNode;
+struct BooleanNode;
+struct BinaryOpNode;
+struct UnaryOpNode;
+struct IfNode;
+struct WhileNode;
+struct ForNode;
+struct ReturnNode;
+
+// Node types whose members own no heap memory, so reset() may release
+// them without running their destructors.
+template<typename T>
+struct needs_finalizer : std::true_type {};
+template<> struct needs_finalizer<NumberNode> : std::false_type {};
+template<> struct needs_finalizer<BooleanNode> : std::false_type {};
+template<> struct needs_finalizer<BinaryOpNode> : std::false_type {};
+template<> struct needs_finalizer<UnaryOpNode> : std::false_type {};
+template<> struct needs_finalizer<IfNode> : std::false_type {};
+template<> struct needs_finalizer<WhileNode> : std::false_type {};
+template<> struct needs_finalizer<ForNode> : std::false_type {};
+template<> struct needs_finalizer<ReturnNode> : std::false_type {};
+
+// Chunked bump allocator owning every node created through it. Nodes are
+// never freed individually; reset() releases all of them at once.
+class Arena {
+public:
+    static constexpr size_t default_chunk_size = 64 * 1024;
+
+    explicit Arena(size_t chunk_size = default_chunk_size);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        NUMU_STATS_COUNT(NODES, 1);
+        if constexpr (needs_finalizer<T>::value) {
+            auto* finalizer = static_cast<Finalizer*>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+            T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            finalizer->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+            finalizer->object = object;
+            finalizer->next = finalizers_;
+            finalizers_ = finalizer;
+            ++objects_;
+            return object;
+        } else {
+            ++objects_;
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+    }
+
+    // Destroys every object and rewinds to the first chunk. Throws
+    // std::logic_error if the arena holds nodes of a thread that has exited
+    // (see current_arena()), which may still be in use elsewhere.
+    void reset();
+
+    size_t objects() const { return objects_; }
+    size_t bytes_reserved() const { return reserved_; }
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+    };
+
+    struct Finalizer {
+        Finalizer* next;
+        void (*destroy)(void*);
+        void* object;
+    };
+
+    Chunk* chunks_ = nullptr;
+    char* cursor_ = nullptr;
+    char* limit_ = nullptr;
+    Finalizer* finalizers_ = nullptr;
+    size_t chunk_size_;
+    size_t objects_ = 0;
+    size_t reserved_ = 0;
+    bool retired_ = false; // taken over from a thread that has exited
+
+    friend struct DefaultArena;
+
+    void grow(size_t min_size);
+    void run_finalizers();
+};
+
+// The arena that node create() functions allocate from on this thread.
+// Outside any ArenaScope that is the thread's default arena. Its nodes may
+// outlive the thread: when the thread exits, an arena still holding nodes
+// is kept and taken over by the next thread that needs one, and an empty
+// one is freed. An arena taken over this way can no longer be reset, so
+// nodes created outside any ArenaScope by a thread that has exited, or
+// after one did, are never freed; code that builds trees repeatedly should
+// do so inside a scope.
+Arena& current_arena();
+
+// Routes node creation on this thread to an arena until the scope ends.
+// The default constructor makes a private arena whose nodes are all freed
+// when the scope exits.
+class ArenaScope {
+public:
+    ArenaScope();
+    explicit ArenaScope(Arena& arena);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    Arena& arena() { return *arena_; }
+
+private:
+    std::unique_ptr<Arena> owned_;
+    Arena* arena_;
+    Arena* previous_;
+};
+
+} // namespace ast
+} // namespace numu
+
+#endif // NUMU_CORE_ARENA_H
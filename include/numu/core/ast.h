@@ -1,6 +1,8 @@
 #ifndef NUMU_CORE_AST_H
 #define NUMU_CORE_AST_H
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
@@ -43,9 +45,18 @@ enum class UnaryOp {
 
 struct Node {
     NodeType type;
+    // Set when the node is built: a matrix or tensor literal, a transpose or
+    // inverse, or an operator with such an operand anywhere below it.
+    // Evaluators hand these nodes to evaluate_matrix.
+    bool matrix_valued = false;
+    uint32_t intern_id = 0; // Interner that owns this node, 0 if not interned
+    mutable std::atomic<size_t> cached_hash{0}; // 0 until hash() is first called
     virtual ~Node() = default;
 protected:
     Node(NodeType type) : type(type) {}
+    Node(const Node& other)
+        : type(other.type), matrix_valued(other.matrix_valued), intern_id(other.intern_id),
+          cached_hash(other.cached_hash.load(std::memory_order_relaxed)) {}
 };
 
 struct NumberNode : Node {
@@ -152,9 +163,33 @@ struct ReturnNode : Node {
 
 Node* clone(Node* node);
 bool equals(Node* a, Node* b);
+// Cached on the node after the first call. Code that mutates a node in
+// place must invalidate it and every ancestor that was already hashed;
+// builds without NDEBUG check the cache on every call and throw
+// std::logic_error if it is stale.
 size_t hash(Node* node);
+void invalidate_hash(Node* node);
+// The steps hash() is built from, for other layouts of the same tree
+size_t hash_mix(size_t h, size_t value);
+size_t hash_number(double value);
 void traverse(Node* node, const std::function<void(Node*)>& visitor);
-Node* simplify(Node* node);
+
+struct SimplifyStats {
+    size_t nodes_before = 0; // distinct nodes, shared ones counted once
+    size_t nodes_after = 0;
+    size_t rewrites = 0;     // rules applied
+    size_t passes = 0;
+    size_t removed() const;
+};
+
+// Applies algebraic rewrite rules until none matches: constant folding,
+// identities such as x*1, x+0 and x-x, like terms, constant
+// reassociation (2*x*3 -> 6*x) and power rules with integer exponents
+// (x*x -> x^2, (x^2)^3 -> x^6). Operations
+// that would fail at evaluation, such as x/0, are kept; x*0 -> 0 and
+// x/x -> 1 assume x is finite and, for the latter, non-zero. Unchanged
+// subtrees are shared with the input, which is never modified.
+Node* simplify(Node* node, SimplifyStats* stats = nullptr);
 
 } // namespace ast
 } // namespace numu
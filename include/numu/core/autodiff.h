@@ -0,0 +1,43 @@
+#ifndef NUMU_CORE_AUTODIFF_H
+#define NUMU_CORE_AUTODIFF_H
+
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+// Numeric derivatives by automatic differentiation, exact up to rounding.
+// Both modes follow evaluate(): the same values, the same errors. Calls to
+// functions without a known derivative fall back to a central difference
+// of that call alone, with a step of numeric_step relative to |argument|.
+
+constexpr double numeric_step = 1e-5;
+
+struct Dual {
+    double value = 0.0;
+    double derivative = 0.0;
+};
+
+// Forward mode: the value and its derivative with respect to `variable`,
+// in one pass at about twice the cost of evaluate()
+Dual evaluate_dual(ast::Node* node, const Frame& frame, const std::string& variable);
+Dual evaluate_dual(ast::Node* node, const std::string& variable);
+
+struct Gradient {
+    double value = 0.0;
+    std::vector<double> partials; // in the order of the requested variables
+};
+
+// Reverse mode: records one evaluation on a tape, then gets every partial
+// derivative from a single backward sweep, whatever the number of variables
+Gradient evaluate_gradient(ast::Node* node, const Frame& frame,
+                           const std::vector<std::string>& variables);
+Gradient evaluate_gradient(ast::Node* node, const std::vector<std::string>& variables);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_AUTODIFF_H
@@ -0,0 +1,56 @@
+#ifndef NUMU_CORE_BATCH_H
+#define NUMU_CORE_BATCH_H
+
+#include "numu/core/ast.h"
+#include "numu/core/compile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+struct Column {
+    std::string name;
+    const double* data;
+};
+
+// Evaluate `expr` for `count` points. `columns[slot]` holds the values of
+// expr.variables[slot] for every point; results are written to `out`.
+// Arithmetic runs on the widest vectors the CPU supports when built with
+// GCC for x86-64. Other builds use what the compile target enables, so
+// wider vectors there need NUMU_NATIVE_ARCH=ON.
+void evaluate_batch(const CompiledExpression& expr, const double* const* columns,
+                    size_t count, double* out);
+
+void evaluate_batch(ast::Node* node, const std::vector<Column>& columns,
+                    size_t count, double* out);
+std::vector<double> evaluate_batch(ast::Node* node, const std::vector<Column>& columns,
+                                   size_t count);
+
+// As evaluate_batch, but a point that fails gets NaN in `out` and its
+// error in `status`, which holds one entry per point, instead of throwing.
+// Returns the number of failed points.
+size_t try_evaluate_batch(const CompiledExpression& expr, const double* const* columns,
+                          size_t count, double* out, Status* status);
+size_t try_evaluate_batch(ast::Node* node, const std::vector<Column>& columns,
+                          size_t count, double* out, Status* status);
+
+// The instruction sets batch kernels are built for. AUTO, the default,
+// picks the widest the CPU supports.
+enum class BatchKernel : uint8_t {
+    AUTO, BASELINE, AVX, AVX512
+};
+
+namespace detail {
+// Makes later batch evaluations on every thread use `kernel`, for tests and
+// benchmarks. Returns false and changes nothing if this build or CPU lacks
+// it. AVX and AVX512 exist only in GCC builds for x86-64 whose target does
+// not already include AVX-512F.
+bool force_batch_kernel(BatchKernel kernel);
+} // namespace detail
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_BATCH_H
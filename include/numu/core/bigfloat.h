@@ -0,0 +1,137 @@
+#ifndef NUMU_CORE_BIGFLOAT_H
+#define NUMU_CORE_BIGFLOAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace numu {
+namespace core {
+
+// Binary floating point with a mantissa of 64-bit limbs and a 64-bit
+// exponent. Every value carries its precision; an operation's result has
+// the larger precision of its operands. Arithmetic and sqrt are rounded
+// to nearest from the exact result; exp, log, pow and the trigonometric
+// functions are computed with a guard limb and are accurate to within a
+// few units in the last limb. Overflow, NaN and infinities behave as for
+// double.
+class BigFloat {
+public:
+    // Mantissas of up to this many limbs, 57 significant digits with the
+    // guard limb, are stored inline: such values never allocate
+    static constexpr size_t inline_limbs = 4;
+
+    // Limbs, including one guard limb, for `digits` significant digits
+    static size_t limbs_for(size_t digits);
+
+    BigFloat() : BigFloat(0.0) {}
+    explicit BigFloat(double value, size_t limbs = 2);
+    static BigFloat from_int(int64_t value, size_t limbs);
+    // Decimal text such as "-1.25e-3", exact to the given precision. Throws
+    // std::invalid_argument for anything else.
+    static BigFloat parse(std::string_view text, size_t limbs);
+    // The shortest decimal that reads back as `value`, so the literal 0.1
+    // becomes one tenth rather than the double nearest to it
+    static BigFloat from_literal(double value, size_t limbs);
+
+    static BigFloat pi(size_t limbs);
+    static BigFloat ln2(size_t limbs);
+    static BigFloat infinity(bool negative, size_t limbs);
+    static BigFloat nan(size_t limbs);
+
+    size_t limbs() const { return mantissa_.size(); }
+    // Rounded or extended to `limbs`
+    BigFloat with_limbs(size_t limbs) const;
+
+    bool is_zero() const { return kind_ == Kind::ZERO; }
+    bool is_nan() const { return kind_ == Kind::NOT_A_NUMBER; }
+    bool is_inf() const { return kind_ == Kind::INFINITE; }
+    bool is_finite() const { return kind_ == Kind::ZERO || kind_ == Kind::FINITE; }
+    bool negative() const { return negative_; }
+    bool is_integer() const;
+
+    double to_double() const;
+    // Like printf's %.*g: `digits` significant digits, trailing zeros dropped
+    std::string to_string(size_t digits) const;
+
+    BigFloat operator-() const;
+    friend BigFloat operator+(const BigFloat& a, const BigFloat& b);
+    friend BigFloat operator-(const BigFloat& a, const BigFloat& b);
+    friend BigFloat operator*(const BigFloat& a, const BigFloat& b);
+    friend BigFloat operator/(const BigFloat& a, const BigFloat& b);
+
+    // False whenever either side is NaN, as for double
+    friend bool operator==(const BigFloat& a, const BigFloat& b);
+    friend bool operator!=(const BigFloat& a, const BigFloat& b);
+    friend bool operator<(const BigFloat& a, const BigFloat& b);
+    friend bool operator<=(const BigFloat& a, const BigFloat& b);
+    friend bool operator>(const BigFloat& a, const BigFloat& b);
+    friend bool operator>=(const BigFloat& a, const BigFloat& b);
+
+    friend BigFloat abs(const BigFloat& x);
+    friend BigFloat trunc(const BigFloat& x);
+    friend BigFloat ldexp(const BigFloat& x, int64_t exponent);
+    friend BigFloat sqrt(const BigFloat& x);
+    friend BigFloat exp(const BigFloat& x);
+    friend BigFloat log(const BigFloat& x);
+    friend BigFloat pow(const BigFloat& x, const BigFloat& y);
+    friend BigFloat fmod(const BigFloat& x, const BigFloat& y);
+    friend BigFloat sin(const BigFloat& x);
+    friend BigFloat cos(const BigFloat& x);
+    friend BigFloat tan(const BigFloat& x);
+
+private:
+    // A small vector of limbs, least significant first
+    class Limbs {
+    public:
+        explicit Limbs(size_t count);
+        Limbs(const Limbs& other);
+        Limbs& operator=(const Limbs& other);
+        Limbs(Limbs&& other) noexcept;
+        Limbs& operator=(Limbs&& other) noexcept;
+
+        size_t size() const { return size_; }
+        uint64_t* data() { return heap_ ? heap_.get() : local_; }
+        const uint64_t* data() const { return heap_ ? heap_.get() : local_; }
+        uint64_t& operator[](size_t i) { return data()[i]; }
+        uint64_t operator[](size_t i) const { return data()[i]; }
+
+    private:
+        size_t size_;
+        uint64_t local_[inline_limbs];
+        std::unique_ptr<uint64_t[]> heap_;
+    };
+
+    enum class Kind : uint8_t { ZERO, FINITE, INFINITE, NOT_A_NUMBER };
+
+    // FINITE values are mantissa / 2^(64 * limbs) * 2^exponent, with the
+    // mantissa's top bit set
+    Kind kind_ = Kind::ZERO;
+    bool negative_ = false;
+    int64_t exponent_ = 0;
+    Limbs mantissa_;
+
+    BigFloat(Kind kind, bool negative, size_t limbs);
+
+    friend class BigFloatOps;
+};
+
+// So that core::sqrt and the like name them, not only lookups by argument
+BigFloat abs(const BigFloat& x);
+BigFloat trunc(const BigFloat& x);
+BigFloat ldexp(const BigFloat& x, int64_t exponent);
+BigFloat sqrt(const BigFloat& x);
+BigFloat exp(const BigFloat& x);
+BigFloat log(const BigFloat& x);
+BigFloat pow(const BigFloat& x, const BigFloat& y);
+BigFloat fmod(const BigFloat& x, const BigFloat& y);
+BigFloat sin(const BigFloat& x);
+BigFloat cos(const BigFloat& x);
+BigFloat tan(const BigFloat& x);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_BIGFLOAT_H
@@ -0,0 +1,86 @@
+#ifndef NUMU_CORE_BUDGET_H
+#define NUMU_CORE_BUDGET_H
+
+#include "numu/core/config.h"
+#include "numu/core/eval.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+namespace numu {
+namespace core {
+
+// Limits on the work done by the evaluations inside a BudgetScope. One step
+// is one node visited by a tree evaluator, or one instruction executed per
+// point by compiled and batch code.
+struct Budget {
+    size_t max_steps = 0; // 0 for no limit
+    double timeout = 0;   // milliseconds, 0 for no limit
+
+    // Reads core.max_steps and core.timeout
+    static Budget from(const config::Config& config);
+};
+
+struct BudgetExceeded : EvaluationError {
+    enum class Limit { STEPS, TIME };
+
+    BudgetExceeded(Limit limit, const std::string& message)
+        : EvaluationError(message), limit(limit) {}
+
+    Limit limit;
+};
+
+// Applies a budget to every evaluation on this thread until destroyed;
+// the innermost scope wins. Steps are counted locally and settled in
+// blocks of up to `quantum`, and the clock is only read when a block is
+// settled, so limits are enforced late by less than one block.
+// Scheduler::parallel_for charges its workers to the caller's scope.
+class BudgetScope {
+public:
+    static constexpr size_t quantum = 1024;
+
+    explicit BudgetScope(const Budget& budget);
+    // Charges the steps taken on this thread to `shared`, which may belong
+    // to another thread and must outlive this scope. Does nothing if null.
+    // Throws BudgetExceeded if the shared limits are already exceeded.
+    explicit BudgetScope(BudgetScope* shared);
+    ~BudgetScope();
+
+    BudgetScope(const BudgetScope&) = delete;
+    BudgetScope& operator=(const BudgetScope&) = delete;
+
+    // The scope active on this thread, null when there is none
+    static BudgetScope* current();
+
+    // Throws BudgetExceeded once a limit is found to be exceeded
+    void charge(size_t steps) {
+        pending_ += steps;
+        if (pending_ >= threshold_) {
+            settle();
+        }
+    }
+
+    // Steps charged through this scope and those sharing it
+    size_t steps() const;
+
+private:
+    struct Limits {
+        Budget budget;
+        std::chrono::steady_clock::time_point deadline;
+        std::atomic<size_t> steps{0};
+    };
+
+    std::shared_ptr<Limits> limits_;
+    BudgetScope* previous_ = nullptr;
+    size_t pending_ = 0;
+    size_t threshold_ = quantum;
+    bool active_ = false;
+
+    void settle();
+};
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_BUDGET_H
@@ -0,0 +1,103 @@
+#ifndef NUMU_CORE_CACHE_H
+#define NUMU_CORE_CACHE_H
+
+#include "numu/core/ast.h"
+#include "numu/core/config.h"
+#include "numu/core/eval.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Bounded LRU cache of evaluation results keyed by expression structure,
+// the registry its functions come from and the values bound to the
+// variables it reads.
+class EvalCache {
+public:
+    static constexpr size_t default_capacity = 256u * 1024u * 1024u;
+
+    explicit EvalCache(size_t capacity_bytes = default_capacity);
+    // Sized from core.cache_size
+    static size_t capacity_from(const config::Config& config);
+
+    double evaluate(ast::Node* node, const Frame& frame);
+    double evaluate(ast::Node* node);
+
+    void clear();
+    CacheStats stats() const;
+    size_t capacity() const { return capacity_; }
+
+private:
+    // What a lookup needs of an expression, worked out once per node:
+    // the variables it reads, in order, and an exact encoding, compared only
+    // when two keys name different nodes. A miss evaluates with `shared`.
+    struct Shape {
+        size_t hash; // ast::hash of the node
+        std::string expression;
+        std::vector<std::string> variables;
+        std::unordered_map<ast::Node*, size_t> shared; // ast::shared_nodes
+        bool cacheable;
+        size_t bytes;
+    };
+    using ShapePtr = std::shared_ptr<const Shape>;
+
+    struct Key {
+        size_t hash = 0;
+        const Registry* registry = nullptr;
+        ShapePtr shape;
+        std::vector<double> values;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key* key) const { return key->hash; }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key* a, const Key* b) const { return *a == *b; }
+    };
+
+    struct Entry {
+        Key key;
+        double result;
+        size_t bytes;
+        RegistryPtr registry; // keeps the address in the key from being reused
+    };
+
+    using List = std::list<Entry>;
+
+    mutable std::mutex mutex_;
+    List lru_;
+    std::unordered_map<const Key*, List::iterator, KeyHash, KeyEqual> index_;
+    // By node address; a node freed and replaced by another at the same
+    // address is told apart by its hash
+    std::unordered_map<const ast::Node*, ShapePtr> shapes_;
+    Key probe_; // reused by lookups, under mutex_
+    size_t capacity_;
+    size_t bytes_ = 0;
+    CacheStats stats_;
+
+    ShapePtr shape(ast::Node* node, size_t hash);
+    void prune_shapes();
+    void insert(Key key, double result, const RegistryPtr& registry);
+};
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_CACHE_H
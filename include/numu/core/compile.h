@@ -0,0 +1,96 @@
+#ifndef NUMU_CORE_COMPILE_H
+#define NUMU_CORE_COMPILE_H
+
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+enum class OpCode : uint8_t {
+    CONST, LOAD, MOVE,
+    ADD, SUB, MUL, DIV, MOD, POW, BINARY,
+    NEG, SIN, COS, TAN, EXP, LOG, SQRT, UNARY,
+    CALL,
+    JUMP, JUMP_IF_FALSE
+};
+
+struct Instruction {
+    OpCode code;
+    uint8_t op;      // ast::BinaryOp / ast::UnaryOp for BINARY and UNARY
+    uint16_t argc;   // argument count for CALL
+    uint32_t dst;
+    uint32_t a;      // constant index, variable slot, first operand register or jump target
+    uint32_t b;      // second operand register, function index or jump target
+};
+
+// A flat register program lowered from an expression tree. Variables are
+// read from a caller-supplied array indexed by slot, in the order given by
+// `variables`. Common subexpressions are computed once per evaluation.
+struct CompiledExpression {
+    std::vector<Instruction> code;
+    std::vector<double> constants;
+    std::vector<const Callable*> functions;
+    RegistryPtr registry; // owns the entries of `functions`
+    std::vector<std::string> variables;
+    uint32_t registers = 0;
+    uint32_t result = 0;
+
+    size_t slot(const std::string& name) const;
+
+    double evaluate(const double* vars) const;
+    double evaluate(const double* vars, double* frame) const;
+    double evaluate(const std::vector<double>& vars) const {
+        return evaluate(vars.data());
+    }
+    // Stops at the first error and returns it instead of throwing
+    Result try_evaluate(const double* vars) const;
+    Result try_evaluate(const double* vars, double* frame) const;
+};
+
+// Functions come from the frame's registry. Names outside `variables` are
+// bound to the frame's values at compile time.
+CompiledExpression compile(ast::Node* node, const Frame& frame);
+CompiledExpression compile(ast::Node* node, const std::vector<std::string>& variables,
+                           const Frame& frame);
+// As above with default_frame()
+CompiledExpression compile(ast::Node* node);
+CompiledExpression compile(ast::Node* node, const std::vector<std::string>& variables);
+
+// A script compiled once for repeated runs. Every variable lives in a
+// register of its own that run() fills from and copies back to the caller,
+// so a Program is never written after compile and may run on several
+// threads at once.
+class Program {
+public:
+    const std::vector<std::string>& variables() const { return code_.variables; }
+    size_t slot(const std::string& name) const { return code_.slot(name); }
+    const CompiledExpression& code() const { return code_; }
+
+    // `vars` holds one value per entry of variables() and receives the
+    // values assigned by the program. Returns the value of the `return` or
+    // last expression statement executed, NaN if there was none.
+    double run(double* vars) const;
+    double run(std::vector<double>& vars) const;
+
+private:
+    CompiledExpression code_;
+
+    friend Program compile_program(ast::Node* program, RegistryPtr registry);
+};
+
+// Accepts the statement nodes from parse::parse_program. Assignments may
+// only appear as statements, so expressions stay free of side effects.
+// Constants of `registry` that the program never assigns are bound at
+// compile time; every other name is one of variables().
+Program compile_program(ast::Node* program, RegistryPtr registry);
+// As above with default_registry()
+Program compile_program(ast::Node* program);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_COMPILE_H
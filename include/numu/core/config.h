@@ -0,0 +1,52 @@
+#ifndef NUMU_CORE_CONFIG_H
+#define NUMU_CORE_CONFIG_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace config {
+
+struct ConfigError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct Value {
+    std::string scalar;
+    std::vector<std::string> list;
+    bool is_list = false;
+};
+
+// Flattened view of a .numurc file: nested objects become dotted keys such
+// as "core.cache_size". Only the subset of HOCON used by .numurc is read.
+class Config {
+public:
+    static Config parse(std::string_view text);
+    static Config load(const std::string& path);
+
+    bool has(const std::string& key) const;
+    const Value* find(const std::string& key) const;
+
+    std::string get_string(const std::string& key, const std::string& fallback) const;
+    double get_number(const std::string& key, double fallback) const;
+    bool get_bool(const std::string& key, bool fallback) const;
+    // Sizes like "256MB" in bytes (binary units)
+    size_t get_size(const std::string& key, size_t fallback) const;
+    std::vector<std::string> get_list(const std::string& key) const;
+
+    const std::unordered_map<std::string, Value>& values() const { return values_; }
+
+private:
+    std::unordered_map<std::string, Value> values_;
+};
+
+size_t parse_size(std::string_view text);
+
+} // namespace config
+} // namespace numu
+
+#endif // NUMU_CORE_CONFIG_H
@@ -0,0 +1,21 @@
+#ifndef NUMU_CORE_CSE_H
+#define NUMU_CORE_CSE_H
+
+#include "numu/core/ast.h"
+#include <unordered_map>
+
+namespace numu {
+namespace ast {
+
+// Rewrites `node` into a DAG in which structurally equal subexpressions are
+// a single shared node. Unchanged subtrees of the input are reused as-is.
+Node* eliminate_common_subexpressions(Node* node);
+
+// Number of parents of each non-leaf node reachable from `root` that has
+// more than one, i.e. the nodes an evaluator should compute only once.
+std::unordered_map<Node*, size_t> shared_nodes(Node* root);
+
+} // namespace ast
+} // namespace numu
+
+#endif // NUMU_CORE_CSE_H
@@ -0,0 +1,30 @@
+#ifndef NUMU_CORE_DERIVATIVE_H
+#define NUMU_CORE_DERIVATIVE_H
+
+#include "numu/core/ast.h"
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+// Symbolic derivatives. Results are DAGs that point into the input rather
+// than copying it, and every node is simplified as it is built (constants
+// fold, x*1 and x+0 vanish, equal nodes are created once), so no separate
+// simplify pass is needed. The partials of min and max are piecewise, built
+// from comparisons of the arguments. Throws EvaluationError for constructs
+// without a derivative, such as matrices or unknown functions.
+
+ast::Node* differentiate(ast::Node* expr, const std::string& variable);
+
+// All partial derivatives from a single reverse-mode sweep over `expr`
+std::vector<ast::Node*> gradient(ast::Node* expr, const std::vector<std::string>& variables);
+
+// Row i holds the gradient of exprs[i]; rows share common subexpressions
+std::vector<std::vector<ast::Node*>> jacobian(const std::vector<ast::Node*>& exprs,
+                                              const std::vector<std::string>& variables);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_DERIVATIVE_H
@@ -0,0 +1,217 @@
+#ifndef NUMU_CORE_EVAL_H
+#define NUMU_CORE_EVAL_H
+
+#include "numu/core/ast.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+struct EvaluationError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Outcome of a non-throwing evaluation. Any status but OK comes with a NaN
+// value; the first error met is the one reported.
+enum class Status : uint8_t {
+    OK,
+    DIVISION_BY_ZERO,
+    MODULO_BY_ZERO,
+    LOG_DOMAIN,      // logarithm of a non-positive number
+    SQRT_DOMAIN,     // square root of a negative number
+    SINGULAR,        // inverse of zero or of a singular matrix
+    OTHER            // any other EvaluationError, e.g. from a registered function
+};
+
+// The message of the EvaluationError thrown in place of `status`
+const char* status_message(Status status);
+
+// What the throwing evaluators throw in place of a status
+struct DomainError : EvaluationError {
+    Status status;
+    explicit DomainError(Status status) : EvaluationError(status_message(status)), status(status) {}
+};
+
+struct Result {
+    double value = 0.0;
+    Status status = Status::OK;
+
+    bool ok() const { return status == Status::OK; }
+};
+
+using Function = std::function<double(const std::vector<double>&)>;
+
+using UnaryFunction = double (*)(double);
+using BinaryFunction = double (*)(double, double);
+
+// Arity of functions that take any number of arguments
+constexpr size_t variadic = static_cast<size_t>(-1);
+
+// The functions of Registry::standard() and builtin::extend(), which
+// evaluators and rewrites may compute or transform themselves
+enum class Builtin : uint8_t {
+    NONE, SIN, COS, TAN, EXP, LOG, SQRT, POW, ABS, MIN, MAX, SUM, AVG
+};
+
+// A registered function. `function` checks the argument count and takes
+// any; functions registered as plain unary or binary functions also keep
+// that pointer, so callers that resolved the call ahead of time can skip
+// both the check and the argument vector.
+struct Callable {
+    std::string name;
+    Function function;
+    size_t arity = variadic;
+    UnaryFunction unary = nullptr;
+    BinaryFunction binary = nullptr;
+    // Set only by the library's own registries, so a function registered
+    // under a standard name is not mistaken for the standard one
+    Builtin builtin = Builtin::NONE;
+    // sin, cos, tan, exp, log and sqrt compute unary operator `op`
+    bool has_op = false;
+    // log and sqrt have a domain: evaluators run a one-argument call as
+    // `op`, so errors are reported as for the operator instead of as a NaN
+    // result
+    bool checked = false;
+    ast::UnaryOp op = ast::UnaryOp::NEGATE;
+};
+
+class Registry;
+using RegistryPtr = std::shared_ptr<const Registry>;
+
+namespace builtin {
+RegistryPtr extend(const RegistryPtr& registry);
+} // namespace builtin
+
+// Supplies the functions and constants a registry does not hold itself,
+// such as those of modules loaded on first use (see module.h). Called from
+// any thread; what it returns must stay valid while the fallback lives.
+class Fallback {
+public:
+    virtual ~Fallback() = default;
+    virtual const Callable* find_callable(const std::string& name) const = 0;
+    virtual const double* find_constant(const std::string& name) const = 0;
+};
+using FallbackPtr = std::shared_ptr<const Fallback>;
+
+// Functions and named constants shared by all evaluations. Registries are
+// never modified once built: adding an entry returns a new registry, so
+// any number of threads can read one through a RegistryPtr without locks.
+class Registry {
+public:
+    // sin, cos, tan, exp, log, sqrt and pow. log and sqrt outside their
+    // domain are errors, as for the LOG and SQRT operators.
+    static RegistryPtr standard();
+
+    RegistryPtr with_function(const std::string& name, Function func, size_t arity) const;
+    RegistryPtr with_function(const std::string& name, UnaryFunction func) const;
+    RegistryPtr with_function(const std::string& name, BinaryFunction func) const;
+    RegistryPtr with_constant(const std::string& name, double value) const;
+    // Names this registry lacks are looked up in `fallback`
+    RegistryPtr with_fallback(FallbackPtr fallback) const;
+
+    const Function* find_function(const std::string& name) const;
+    const Callable* find_callable(const std::string& name) const;
+    const double* find_constant(const std::string& name) const;
+
+private:
+    std::unordered_map<std::string, Callable> functions_;
+    std::unordered_map<std::string, double> constants_;
+    FallbackPtr fallback_;
+
+    Callable& add_function(const std::string& name, Function func, size_t arity);
+    Callable& add_function(const std::string& name, UnaryFunction func);
+    Callable& add_function(const std::string& name, BinaryFunction func);
+    friend RegistryPtr builtin::extend(const RegistryPtr& registry);
+};
+
+// The function of Registry::standard() or builtin::extend() called `name`,
+// for code that sees only the tree; null for any other name
+const Callable* find_builtin(const std::string& name);
+// The unary operator a one-argument call of `callable` computes, if any
+bool unary_op(const Callable* callable, ast::UnaryOp& op);
+
+// Variable bindings for one evaluation. Names are looked up in the frame,
+// then its parents, then the registry's constants. Frames are cheap to
+// create and belong to a single thread; the registry is shared.
+class Frame {
+public:
+    explicit Frame(RegistryPtr registry, const Frame* parent = nullptr);
+
+    void set(const std::string& name, double value);
+    // Searches this frame and its parents only
+    const double* find(const std::string& name) const;
+    double get(const std::string& name) const;
+
+    const Registry& registry() const { return *registry_; }
+    const RegistryPtr& shared_registry() const { return registry_; }
+
+private:
+    RegistryPtr registry_;
+    const Frame* parent_;
+    std::unordered_map<std::string, double> variables_;
+};
+
+// Walks the tree, so a node with several parents is evaluated once for each;
+// the library's own callers that may see shared nodes use evaluate_dag
+double evaluate(ast::Node* node, const Frame& frame);
+// Evaluates each node shared by several parents once, e.g. after
+// ast::eliminate_common_subexpressions. Small trees without shared nodes
+// are recognised cheaply and cost about as much as evaluate().
+double evaluate_dag(ast::Node* node, const Frame& frame);
+// As above, with `shared` from ast::shared_nodes(node) worked out once for
+// a graph evaluated repeatedly
+double evaluate_dag(ast::Node* node, const Frame& frame,
+                    const std::unordered_map<ast::Node*, size_t>& shared);
+
+// The process-wide registry that register_function and builtin::initialize
+// add to. Frames created before a registration keep the registry they saw.
+RegistryPtr default_registry();
+// A frame over the default registry whose parent holds the bindings made
+// by set_variable on this thread
+Frame default_frame();
+
+double evaluate(ast::Node* node);
+double evaluate_dag(ast::Node* node);
+
+// As evaluate(), but errors are returned as a status instead of thrown.
+// Domain errors cost no more than a successful evaluation, except inside a
+// matrix expression: evaluate_matrix throws, and its DomainError is caught
+// here for its status. BudgetExceeded is still thrown.
+Result try_evaluate(ast::Node* node, const Frame& frame);
+Result try_evaluate(ast::Node* node);
+
+void set_variable(const std::string& name, double value);
+double get_variable(const std::string& name);
+
+void register_function(const std::string& name, Function func, size_t arity);
+void register_function(const std::string& name, UnaryFunction func);
+void register_function(const std::string& name, BinaryFunction func);
+// Makes the default registry fall back to `fallback`, replacing any
+// fallback registered before
+void register_fallback(FallbackPtr fallback);
+
+double eval_binary_op(ast::BinaryOp op, double left, double right);
+double eval_unary_op(ast::UnaryOp op, double operand);
+// Return NaN and set `status` instead of throwing; `status` is only
+// written on error
+double eval_binary_op(ast::BinaryOp op, double left, double right, Status& status);
+double eval_unary_op(ast::UnaryOp op, double operand, Status& status);
+
+namespace builtin {
+// Adds abs, min, max, sum, avg, pi, e and inf to the default registry.
+// Safe to call more than once and from any thread.
+void initialize();
+// `registry` with the entries initialize() adds
+RegistryPtr extend(const RegistryPtr& registry);
+} // namespace builtin
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_EVAL_H
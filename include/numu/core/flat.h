@@ -0,0 +1,175 @@
+#ifndef NUMU_CORE_FLAT_H
+#define NUMU_CORE_FLAT_H
+
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace ast {
+
+using NodeId = uint32_t;
+constexpr NodeId no_node = UINT32_MAX;
+
+// A syntax tree stored as parallel arrays indexed by NodeId, with children
+// in one shared buffer and names interned. A node's children always have
+// smaller ids than the node, so a forward sweep visits operands before the
+// operations that use them. Shared subtrees stay shared.
+//
+// Per node: its type; `op`, the BinaryOp or UnaryOp; `payload`, the
+// constant index for NUMBER, the value for BOOLEAN, the name index for
+// STRING, VARIABLE, FUNCTION and ASSIGNMENT, or the extents offset for
+// MATRIX and TENSOR; and its children. Missing children, such as an IF
+// without an else branch, are no_node. MATRIX children are the elements
+// row by row, with the row count and then each row's length in extents;
+// TENSOR keeps its rank and then its dims there.
+//
+// A tree either owns its arrays or reads them in place from a buffer such
+// as a mapped file (see serialize.h); the accessors are the same for both,
+// and only owned trees can grow.
+class FlatTree {
+public:
+    FlatTree();
+    FlatTree(const FlatTree& other);
+    FlatTree(FlatTree&& other);
+    FlatTree& operator=(FlatTree other) noexcept;
+
+    size_t size() const { return columns_.nodes; }
+    bool empty() const { return columns_.nodes == 0; }
+    bool owned() const { return !buffer_; }
+    NodeId root() const { return root_; }
+    void set_root(NodeId id) { root_ = id; }
+
+    NodeType type(NodeId id) const { return static_cast<NodeType>(columns_.types[id]); }
+    uint8_t op(NodeId id) const { return columns_.ops[id]; }
+    uint32_t payload(NodeId id) const { return columns_.payloads[id]; }
+    const NodeId* children(NodeId id) const { return columns_.children + columns_.first[id]; }
+    uint32_t child_count(NodeId id) const { return columns_.counts[id]; }
+    NodeId child(NodeId id, size_t index) const { return columns_.children[columns_.first[id] + index]; }
+    // The subtree at `id` lies within [lowest(id), id], so work on one
+    // expression in a large tree is bounded by the expression's own extent
+    NodeId lowest(NodeId id) const { return columns_.lows[id]; }
+
+    double number(NodeId id) const { return columns_.constants[columns_.payloads[id]]; }
+    std::string_view name(NodeId id) const { return name_at(columns_.payloads[id]); }
+    const uint32_t* extents(NodeId id) const { return columns_.extents + columns_.payloads[id]; }
+
+    size_t name_count() const { return columns_.names; }
+    std::string_view name_at(uint32_t index) const {
+        const uint32_t* offsets = columns_.name_offsets;
+        return std::string_view(columns_.name_chars + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+
+    // New nodes for the expression subset; children must already exist
+    NodeId add_number(double value);
+    NodeId add_boolean(bool value);
+    NodeId add_variable(const std::string& name);
+    NodeId add_binary(BinaryOp op, NodeId left, NodeId right);
+    NodeId add_unary(UnaryOp op, NodeId operand);
+    NodeId add_function(const std::string& name, const std::vector<NodeId>& args);
+
+    // Named roots, for keeping many expressions in one tree. Lookups are
+    // linear while building and binary searches once loaded, since saving
+    // sorts the entries by name.
+    void add_entry(const std::string& name, NodeId id);
+    NodeId find(std::string_view name) const;
+    size_t entry_count() const { return columns_.entries; }
+    std::string_view entry_name(size_t index) const { return name_at(columns_.entry_table[2 * index]); }
+    NodeId entry_node(size_t index) const { return columns_.entry_table[2 * index + 1]; }
+
+private:
+    // What the accessors read, pointing into storage_ or into buffer_
+    struct Columns {
+        const uint8_t* types = nullptr;
+        const uint8_t* ops = nullptr;
+        const uint32_t* payloads = nullptr;
+        const uint32_t* first = nullptr;
+        const uint32_t* counts = nullptr;
+        const NodeId* lows = nullptr;
+        const NodeId* children = nullptr;
+        const double* constants = nullptr;
+        const uint32_t* extents = nullptr;
+        const uint32_t* name_offsets = nullptr; // names + 1 entries
+        const char* name_chars = nullptr;
+        const uint32_t* entry_table = nullptr;  // name index and node per entry
+        size_t nodes = 0;
+        size_t child_slots = 0;
+        size_t constant_count = 0;
+        size_t extent_count = 0;
+        size_t names = 0;
+        size_t name_bytes = 0;
+        size_t entries = 0;
+        bool sorted = false;
+    };
+
+    struct Storage {
+        std::vector<uint8_t> types;
+        std::vector<uint8_t> ops;
+        std::vector<uint32_t> payloads;
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> counts;
+        std::vector<NodeId> lows;
+        std::vector<NodeId> children;
+        std::vector<double> constants;
+        std::vector<uint32_t> extents;
+        std::vector<uint32_t> name_offsets{0};
+        std::string name_chars;
+        std::vector<uint32_t> entry_table;
+        std::unordered_map<std::string, uint32_t> name_index;
+    };
+
+    Storage storage_;
+    Columns columns_;
+    std::shared_ptr<const void> buffer_; // keeps in-place data alive
+    NodeId root_ = no_node;
+
+    void refresh();
+    Storage& storage();
+    uint32_t intern(std::string_view name);
+    uint32_t add_constant(double value);
+    uint32_t add_extents(const uint32_t* values, size_t count);
+    NodeId add(NodeType type, uint8_t op, uint32_t payload, const NodeId* children, size_t count);
+
+    friend class Flattener;
+    friend class FlatFile;
+};
+
+// Converts a tree of any node types; the root becomes the last node
+FlatTree flatten(Node* root);
+// Adds a tree to an existing flat tree and returns its root, leaving the
+// tree's own root unchanged
+NodeId flatten(Node* root, FlatTree& into);
+// Nodes are made with the ::create functions, so the active interner or
+// arena owns them
+Node* to_node(const FlatTree& tree, NodeId id);
+Node* to_node(const FlatTree& tree);
+
+// The subtree at `id` as a tree of its own, holding nothing else
+FlatTree clone(const FlatTree& tree, NodeId id);
+// Equal to hash() of the same expression as Node*; linear in the subtree
+size_t hash(const FlatTree& tree, NodeId id);
+// Pre-order, left to right, like traverse() on Node*
+void traverse(const FlatTree& tree, NodeId id, const std::function<void(NodeId)>& visitor);
+
+} // namespace ast
+
+namespace core {
+
+// Evaluates the root in one forward sweep over the nodes it reaches, each
+// once, as evaluate_dag does. Names are looked up once per evaluation
+// rather than once per node. Matrix expressions fall back to evaluate().
+double evaluate(const ast::FlatTree& tree, ast::NodeId id, const Frame& frame);
+double evaluate(const ast::FlatTree& tree, const Frame& frame);
+double evaluate(const ast::FlatTree& tree);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_FLAT_H
@@ -0,0 +1,52 @@
+#ifndef NUMU_CORE_INTEGRATE_H
+#define NUMU_CORE_INTEGRATE_H
+
+#include "numu/core/ast.h"
+#include "numu/core/config.h"
+#include "numu/core/eval.h"
+#include "numu/core/parallel.h"
+#include <cstddef>
+#include <string>
+
+namespace numu {
+namespace core {
+
+// Defaults match the shipped .numurc
+struct IntegrationOptions {
+    double relative_tolerance = 1e-6;
+    double absolute_tolerance = 1e-10;
+    size_t max_steps = 1000; // Gauss-Kronrod rules applied, 0 for no limit
+    double timeout = 5000;   // milliseconds, 0 for no limit
+
+    // Reads calculus.integral.relative_tolerance and absolute_tolerance,
+    // core.max_steps and core.timeout
+    static IntegrationOptions from(const config::Config& config);
+};
+
+struct IntegrationResult {
+    double value = 0.0;
+    double error = 0.0;      // estimated absolute error
+    size_t steps = 0;        // subintervals evaluated
+    size_t evaluations = 0;  // integrand values computed
+    // False when a budget ran out first; value and error are then the best
+    // estimate reached
+    bool converged = false;
+};
+
+// Globally adaptive 21-point Gauss-Kronrod quadrature of `integrand` over
+// `variable` from `lower` to `upper`, either of which may be infinite.
+// Each round bisects the subintervals with the largest error and evaluates
+// all their abscissae in one compiled batch, split across `scheduler`'s
+// workers when one is given. Other names are bound from `frame` once.
+IntegrationResult integrate(ast::Node* integrand, const std::string& variable,
+                            double lower, double upper, const Frame& frame,
+                            const IntegrationOptions& options = {},
+                            Scheduler* scheduler = nullptr);
+IntegrationResult integrate(ast::Node* integrand, const std::string& variable,
+                            double lower, double upper,
+                            const IntegrationOptions& options = {});
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_INTEGRATE_H
@@ -0,0 +1,114 @@
+#ifndef NUMU_CORE_INTERN_H
+#define NUMU_CORE_INTERN_H
+
+#include "numu/core/arena.h"
+#include "numu/core/ast.h"
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+namespace numu {
+namespace ast {
+
+template<typename T>
+struct internable : std::false_type {};
+template<> struct internable<NumberNode> : std::true_type {};
+template<> struct internable<VariableNode> : std::true_type {};
+template<> struct internable<BinaryOpNode> : std::true_type {};
+template<> struct internable<UnaryOpNode> : std::true_type {};
+template<> struct internable<FunctionNode> : std::true_type {};
+template<> struct internable<MatrixNode> : std::true_type {};
+template<> struct internable<TensorNode> : std::true_type {};
+
+// Hash-consing node factory. Structurally equal nodes created through the
+// same interner are the same object, so they must never be mutated.
+// Several threads may create nodes through one interner at once, each in
+// an InternScope of its own. reset() frees the nodes other threads may
+// still hold, and allocating from arena() directly takes no lock.
+class Interner {
+public:
+    Interner();
+
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args) {
+        if constexpr (internable<T>::value) {
+            T probe(std::forward<Args>(args)...);
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = nodes_.find(&probe);
+            if (it != nodes_.end()) {
+                ++hits_;
+                return static_cast<T*>(*it);
+            }
+            T* node = arena_.create<T>(std::move(probe));
+            node->intern_id = id_;
+            nodes_.insert(node);
+            return node;
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return arena_.create<T>(std::forward<Args>(args)...);
+        }
+    }
+
+    // Forgets every interned node and releases the backing arena.
+    void reset();
+
+    uint32_t id() const { return id_; }
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return nodes_.size();
+    }
+    size_t hits() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_;
+    }
+    Arena& arena() { return arena_; }
+
+private:
+    struct NodeHash {
+        size_t operator()(Node* node) const { return hash(node); }
+    };
+    // equals() takes -0.0 for 0.0, but sharing one node for both would
+    // change the sign of results like -0.0 ^ -1
+    struct NodeEqual {
+        bool operator()(Node* a, Node* b) const {
+            if (a->type == NodeType::NUMBER && b->type == NodeType::NUMBER &&
+                std::signbit(static_cast<NumberNode*>(a)->value) != std::signbit(static_cast<NumberNode*>(b)->value)) {
+                return false;
+            }
+            return equals(a, b);
+        }
+    };
+
+    mutable std::mutex mutex_;
+    Arena arena_;
+    std::unordered_set<Node*, NodeHash, NodeEqual> nodes_;
+    uint32_t id_;
+    size_t hits_ = 0;
+};
+
+// The interner node create() functions go through on this thread, if any.
+Interner* current_interner();
+
+// Enables interning for node creation on this thread until the scope ends.
+class InternScope {
+public:
+    explicit InternScope(Interner& interner);
+    ~InternScope();
+
+    InternScope(const InternScope&) = delete;
+    InternScope& operator=(const InternScope&) = delete;
+
+private:
+    Interner* previous_;
+};
+
+} // namespace ast
+} // namespace numu
+
+#endif // NUMU_CORE_INTERN_H
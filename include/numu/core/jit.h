@@ -0,0 +1,79 @@
+#ifndef NUMU_CORE_JIT_H
+#define NUMU_CORE_JIT_H
+
+#include "numu/core/compile.h"
+#include <atomic>
+#include <cstddef>
+
+namespace numu {
+namespace core {
+
+// Machine code for one CompiledExpression. Native code never throws: where
+// the interpreter would raise an error it returns NaN instead, so callers
+// re-run the interpreter on a NaN result to get the exact outcome.
+class NativeFunction {
+public:
+    using Entry = double (*)(const double* vars);
+
+    NativeFunction() = default;
+    NativeFunction(NativeFunction&& other) noexcept;
+    NativeFunction& operator=(NativeFunction&& other) noexcept;
+    ~NativeFunction();
+
+    NativeFunction(const NativeFunction&) = delete;
+    NativeFunction& operator=(const NativeFunction&) = delete;
+
+    explicit operator bool() const { return entry_ != nullptr; }
+    Entry entry() const { return entry_; }
+    double operator()(const double* vars) const { return entry_(vars); }
+
+private:
+    void* code_ = nullptr;
+    size_t size_ = 0;
+    Entry entry_ = nullptr;
+
+    friend NativeFunction compile_native(const CompiledExpression& expr);
+};
+
+// True when built with NUMU_ENABLE_JIT for x86-64 System V targets
+bool jit_available();
+
+// Returns an empty function when the JIT is unavailable or the expression
+// contains control flow. The expression must outlive the result.
+NativeFunction compile_native(const CompiledExpression& expr);
+
+// Interprets an expression for its first `threshold` evaluations, then
+// switches to native code if it can be generated. Safe to evaluate from
+// several threads at once.
+class TieredExpression {
+public:
+    static constexpr size_t default_threshold = 1000;
+
+    explicit TieredExpression(CompiledExpression expr, size_t threshold = default_threshold);
+
+    TieredExpression(const TieredExpression&) = delete;
+    TieredExpression& operator=(const TieredExpression&) = delete;
+
+    double evaluate(const double* vars) const;
+    double evaluate(const std::vector<double>& vars) const { return evaluate(vars.data()); }
+    Result try_evaluate(const double* vars) const;
+
+    bool native() const { return entry_.load(std::memory_order_acquire) != nullptr; }
+    const CompiledExpression& expression() const { return expr_; }
+
+private:
+    CompiledExpression expr_;
+    size_t threshold_;
+    mutable std::atomic<size_t> count_{0};
+    mutable std::atomic<NativeFunction::Entry> entry_{nullptr};
+    mutable NativeFunction native_;
+
+    void tier_up() const;
+    // Native code once available; until then counts the evaluation
+    NativeFunction::Entry native_entry() const;
+};
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_JIT_H
@@ -0,0 +1,72 @@
+#ifndef NUMU_CORE_LEX_H
+#define NUMU_CORE_LEX_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace numu {
+namespace lex {
+
+enum class TokenType {
+    NUMBER, IDENTIFIER, STRING,
+
+    PLUS, MINUS, STAR, SLASH, PERCENT, CARET,
+    EQUAL, LESS, GREATER, BANG,
+    LPAREN, RPAREN, LBRACKET, RBRACKET, LBRACE, RBRACE,
+    COMMA, DOT, COLON, SEMI,
+
+    EQEQ, NEQ, LEQ, GEQ, ARROW, POW,
+
+    LET, FN, IF, ELSE, FOR, WHILE, RETURN,
+    TRUE, FALSE, INF, NAN_LITERAL, PI, E,
+
+    END_OF_FILE
+};
+
+struct Token {
+    TokenType type = TokenType::END_OF_FILE;
+    std::string_view text;
+    double value = 0.0;
+    size_t line = 0;
+    size_t column = 0;
+};
+
+struct LexError {
+    std::string message;
+    size_t line;
+    size_t column;
+};
+
+class Lexer {
+public:
+    explicit Lexer(std::string_view source);
+    // Starts counting lines and columns from the given position, for
+    // sources that are a window into a larger input
+    Lexer(std::string_view source, size_t line, size_t column);
+
+    Token next();
+
+    size_t position() const { return pos_; }
+    size_t line() const { return line_; }
+    size_t column() const { return col_; }
+
+private:
+    std::string_view source_;
+    size_t pos_;
+    size_t line_;
+    size_t col_;
+
+    Token lex_number();
+    Token lex_identifier();
+    Token lex_string();
+    void skip_whitespace();
+    void skip_comment();
+    Token make_token(TokenType type) const;
+    [[noreturn]] void throw_error(const std::string& message) const;
+};
+
+} // namespace lex
+} // namespace numu
+
+#endif // NUMU_CORE_LEX_H
@@ -0,0 +1,77 @@
+#ifndef NUMU_CORE_MATRIX_H
+#define NUMU_CORE_MATRIX_H
+
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include <cstddef>
+#include <memory>
+
+namespace numu {
+namespace core {
+
+// Thrown by inverse(); try_evaluate reports it as Status::SINGULAR
+struct SingularMatrix : DomainError {
+    SingularMatrix() : DomainError(Status::SINGULAR) {}
+};
+
+// Dense row-major matrix in one 64-byte aligned allocation
+class Matrix {
+public:
+    static constexpr size_t alignment = 64;
+
+    Matrix() = default;
+    // Zero-filled
+    Matrix(size_t rows, size_t cols);
+    Matrix(size_t rows, size_t cols, double fill);
+    static Matrix identity(size_t n);
+
+    Matrix(const Matrix& other);
+    Matrix& operator=(const Matrix& other);
+    Matrix(Matrix&&) noexcept = default;
+    Matrix& operator=(Matrix&&) noexcept = default;
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t size() const { return rows_ * cols_; }
+    bool square() const { return rows_ == cols_; }
+
+    double* data() { return data_.get(); }
+    const double* data() const { return data_.get(); }
+    double* row(size_t r) { return data_.get() + r * cols_; }
+    const double* row(size_t r) const { return data_.get() + r * cols_; }
+
+    double& operator()(size_t r, size_t c) { return data_[r * cols_ + c]; }
+    double operator()(size_t r, size_t c) const { return data_[r * cols_ + c]; }
+
+private:
+    struct Free {
+        void operator()(double* p) const;
+    };
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    std::unique_ptr<double[], Free> data_;
+};
+
+Matrix operator+(const Matrix& a, const Matrix& b);
+Matrix operator-(const Matrix& a, const Matrix& b);
+Matrix operator*(const Matrix& a, double scale);
+
+// Cache-blocked product
+Matrix multiply(const Matrix& a, const Matrix& b);
+Matrix transpose(const Matrix& m);
+// By LU decomposition with partial pivoting
+double determinant(const Matrix& m);
+// Throws SingularMatrix for singular matrices
+Matrix inverse(const Matrix& m);
+
+// Evaluates a matrix-valued expression: matrix and tensor literals, + - *
+// between matrices, scaling by scalars, negation, transpose, inverse and
+// determinant. Scalar subexpressions become 1x1 matrices.
+Matrix evaluate_matrix(ast::Node* node, const Frame& frame);
+Matrix evaluate_matrix(ast::Node* node);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_MATRIX_H
@@ -0,0 +1,122 @@
+#ifndef NUMU_CORE_MODULE_H
+#define NUMU_CORE_MODULE_H
+
+#include "numu/core/config.h"
+#include "numu/core/eval.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+struct ModuleError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Adds a module's functions and constants to `registry`, which starts
+// empty, and returns the result. `config` is the whole .numurc, so a
+// module reads its own section, e.g. calculus.integral.
+using ModuleInit = std::function<RegistryPtr(RegistryPtr registry, const config::Config& config)>;
+
+struct ModuleInfo {
+    std::string name; // as listed in .numurc, e.g. "linear.basic"
+    // Names the module defines, so it can be found without loading it
+    std::vector<std::string> provides;
+    ModuleInit init;
+};
+
+// Makes a module compiled into the program known to registries created
+// afterwards. "core" (Registry::standard(), always present), "arithmetic"
+// (builtin::extend), "calculus.differential" (dsin, dcos, ... as derivatives
+// of the standard functions), "calculus.integral" (si, fresnels, fresnelc)
+// and "linear.basic" (det of a matrix given entry by entry) are declared
+// already.
+void declare_module(ModuleInfo info);
+
+// Modules found on disk are shared libraries named after the module, e.g.
+// linear.basic.so, that export
+//     extern "C" const numu::core::ModuleInfo* numu_module();
+// They are never unloaded.
+
+// Functions and constants of the modules a .numurc asks for, each module
+// loaded the first time one of its names is looked up. Creating one reads
+// directory listings only; nothing is initialized until it is used.
+//
+// Built-in modules are found through their `provides` lists. Modules on
+// disk are not, so a name no loaded module defines loads the configured
+// disk modules, in order, until one defines it.
+class ModuleRegistry : public Fallback, public std::enable_shared_from_this<ModuleRegistry> {
+public:
+    // Uses modules.required, modules.optional and modules.paths; with
+    // neither list given, every module found is eligible. Relative paths
+    // are taken from `base` and a leading ~ from $HOME. Throws ModuleError
+    // if a required module is neither built in nor on a path.
+    static std::shared_ptr<ModuleRegistry> create(const config::Config& config,
+                                                  const std::string& base = ".");
+    // Reads the .numurc at `path`; relative paths are taken from its directory
+    static std::shared_ptr<ModuleRegistry> open(const std::string& path);
+
+    // Registry::standard() falling back to the modules
+    RegistryPtr registry() const;
+    // Makes the default registry fall back to the modules
+    void install() const;
+
+    // Module names in the order .numurc lists them
+    const std::vector<std::string>& eligible() const { return eligible_; }
+    bool available(const std::string& module) const;
+    bool loaded(const std::string& module) const;
+    // Loads `module` now unless it is loaded already; it need not be eligible
+    void load(const std::string& module) const;
+
+    const config::Config& config() const { return config_; }
+
+    // May load a module, so may throw ModuleError
+    const Callable* find_callable(const std::string& name) const override;
+    const double* find_constant(const std::string& name) const override;
+
+private:
+    // Names found so far, read without locking
+    struct Table {
+        std::unordered_map<std::string, const Callable*> functions;
+        std::unordered_map<std::string, const double*> constants;
+    };
+    // Names no module defined, until another module is loaded; guarded by
+    // mutex_ and emptied when either holds max_misses names
+    struct Misses {
+        std::unordered_set<std::string> functions;
+        std::unordered_set<std::string> constants;
+    };
+    static constexpr size_t max_misses = 4096;
+
+    config::Config config_;
+    std::vector<std::string> eligible_;
+    std::unordered_map<std::string, ModuleInfo> builtin_;
+    std::unordered_map<std::string, std::string> files_;     // module to library path
+    std::unordered_map<std::string, std::string> providers_; // name to built-in module
+
+    mutable std::mutex mutex_;
+    mutable std::shared_ptr<const Table> table_;
+    mutable Misses misses_;
+    mutable std::vector<std::pair<std::string, RegistryPtr>> modules_; // in load order
+    mutable std::vector<void*> libraries_; // never closed
+
+    ModuleRegistry() = default;
+
+    RegistryPtr load_locked(const std::string& module) const;
+    template<typename T, typename Find>
+    const T* resolve(const std::string& name, Find find,
+                     std::unordered_map<std::string, const T*> Table::*column,
+                     std::unordered_set<std::string> Misses::*missed) const;
+};
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_MODULE_H
@@ -0,0 +1,116 @@
+#ifndef NUMU_CORE_NOTEBOOK_H
+#define NUMU_CORE_NOTEBOOK_H
+
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+struct NotebookStats {
+    size_t recomputed = 0; // definitions evaluated again
+    size_t unchanged = 0;  // stale definitions none of whose inputs had changed
+    size_t terms_evaluated = 0;
+    size_t terms_reused = 0; // subexpressions whose inputs had not changed
+};
+
+// Named inputs and definitions that read them, kept up to date as either
+// changes. Values are computed on first read and cached. Changing a name
+// marks what reads it, directly or through other definitions, as stale;
+// reading a stale definition re-evaluates only those of its
+// subexpressions that read a name whose value actually changed, and a
+// definition that comes out the same leaves its readers' caches alone.
+//
+// A notebook belongs to one thread. Defined expressions are not copied
+// and must outlive their definition.
+class Notebook {
+public:
+    explicit Notebook(RegistryPtr registry = default_registry());
+
+    // Binds an input, replacing any definition of `name`
+    void set(const std::string& name, double value);
+    void define(const std::string& name, ast::Node* value);
+    // a = b = expr defines both as expr
+    void define(ast::AssignmentNode* assignment);
+    // Defines each assignment of a program's top-level block, in order.
+    // Other statements throw EvaluationError.
+    void define_all(ast::Node* program);
+    // Forgets the input or definition; names reading it are kept
+    void remove(const std::string& name);
+
+    // Throws EvaluationError for unknown names and circular definitions
+    double get(const std::string& name);
+    // Brings every definition up to date
+    void update();
+
+    bool has(const std::string& name) const;
+    bool stale(const std::string& name) const;
+    // Names the definition of `name` reads, and the definitions reading it
+    std::vector<std::string> reads(const std::string& name) const;
+    std::vector<std::string> readers(const std::string& name) const;
+
+    const NotebookStats& stats() const { return stats_; }
+    void reset_stats() { stats_ = NotebookStats(); }
+
+private:
+    enum class StepKind : uint8_t { CONSTANT, VARIABLE, BINARY, UNARY, CALL, OPAQUE };
+
+    // One subexpression of a definition, children first
+    struct Step {
+        StepKind kind;
+        uint8_t op = 0;
+        uint32_t read = 0;     // VARIABLE: index into reads
+        uint32_t first = 0;    // children in Definition::children
+        uint32_t count = 0;
+        uint64_t mask = 0;     // reads the subexpression depends on, bit 63 shared
+        const ast::Node* node; // CALL and OPAQUE
+        const Callable* callable = nullptr;
+        double value = 0.0;
+        bool valid = false;
+    };
+
+    struct Definition {
+        std::vector<std::string> reads;
+        std::vector<uint64_t> seen; // versions of the reads when last evaluated
+        // Since it was defined; `seen` cannot tell for a definition without reads
+        bool evaluated = false;
+        std::vector<Step> steps;
+        std::vector<uint32_t> children;
+    };
+
+    struct Cell {
+        enum class Kind : uint8_t { UNDEFINED, INPUT, DEFINITION } kind = Kind::UNDEFINED;
+        double value = 0.0;
+        uint64_t version = 0; // changes whenever the value does
+        bool has_value = false;
+        bool stale = false;
+        bool evaluating = false;
+        Definition definition;
+        std::vector<std::string> readers;
+    };
+
+    struct Builder;
+
+    RegistryPtr registry_;
+    std::unordered_map<std::string, Cell> cells_;
+    uint64_t clock_ = 0;
+    NotebookStats stats_;
+
+    Cell& cell(const std::string& name);
+    void unlink(const std::string& name, Cell& cell);
+    void changed(Cell& cell);
+    void mark_readers(const Cell& cell);
+    void refresh(const std::string& name, Cell& cell);
+    double evaluate(Definition& definition, uint64_t changed);
+    uint64_t version(const std::string& name) const;
+};
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_NOTEBOOK_H
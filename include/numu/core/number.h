@@ -0,0 +1,93 @@
+#ifndef NUMU_CORE_NUMBER_H
+#define NUMU_CORE_NUMBER_H
+
+#include "numu/core/ast.h"
+#include "numu/core/bigfloat.h"
+#include "numu/core/config.h"
+#include "numu/core/eval.h"
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace numu {
+namespace core {
+
+using Complex = std::complex<double>;
+
+enum class NumberSystem : uint8_t {
+    REAL,          // double, the evaluators everywhere else
+    COMPLEX,       // std::complex<double>, with the constant i
+    MULTIPRECISION // BigFloat at the configured precision
+};
+
+struct NumberFormat {
+    NumberSystem system = NumberSystem::REAL;
+    size_t precision = 12; // significant digits shown, and kept by MULTIPRECISION
+
+    // Reads core.number_system ("real", "complex" or "multiprecision") and
+    // core.precision. Throws ConfigError for other systems.
+    static NumberFormat from(const config::Config& config);
+};
+
+// Variable bindings for an evaluation over T. Names are looked up in the
+// frame, then in `parent` and its parents, whose doubles are converted,
+// then the registry's constants. Complex frames also know i, and
+// multi-precision frames compute pi and e at their own precision.
+template<typename T>
+class NumberFrame {
+public:
+    explicit NumberFrame(RegistryPtr registry, const Frame* parent = nullptr, size_t digits = 17);
+
+    void set(const std::string& name, T value);
+    T get(const std::string& name) const;
+
+    const Registry& registry() const { return *registry_; }
+    // Limbs for BigFloat values; literals and constants are made at it
+    size_t limbs() const { return limbs_; }
+
+private:
+    RegistryPtr registry_;
+    const Frame* parent_;
+    size_t limbs_;
+    std::unordered_map<std::string, T> variables_;
+};
+
+// Doubles use the ordinary frame, so evaluate_as<double> is evaluate()
+template<>
+class NumberFrame<double> : public Frame {
+public:
+    explicit NumberFrame(RegistryPtr registry, const Frame* parent = nullptr, size_t = 0)
+        : Frame(std::move(registry), parent) {}
+};
+
+// Scalar expressions evaluated over T, for T in double, Complex and
+// BigFloat. Errors are those of evaluate(); complex values cannot be
+// ordered and matrices are real only. Functions outside the standard and
+// builtin sets are called with doubles, so a multi-precision result that
+// passes through one keeps only double precision, and complex arguments to
+// one must be real.
+template<typename T>
+T evaluate_as(ast::Node* node, const NumberFrame<T>& frame);
+
+template<>
+inline double evaluate_as<double>(ast::Node* node, const NumberFrame<double>& frame) {
+    return evaluate(node, frame);
+}
+
+// Like printf's %.*g. Doubles show at most max_digits10 digits, and NaN
+// reads "nan" in every system. Complex values read as 1.5-2i, without a
+// part smaller than the other by more than `digits` orders of magnitude.
+std::string format_number(double value, size_t digits);
+std::string format_number(const Complex& value, size_t digits);
+std::string format_number(const BigFloat& value, size_t digits);
+
+// Evaluates `node` in the format's number system, with `frame`'s bindings,
+// and formats the result at its precision
+std::string evaluate_formatted(ast::Node* node, const Frame& frame, const NumberFormat& format);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_NUMBER_H
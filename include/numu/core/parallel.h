@@ -0,0 +1,98 @@
+#ifndef NUMU_CORE_PARALLEL_H
+#define NUMU_CORE_PARALLEL_H
+
+#include "numu/core/ast.h"
+#include "numu/core/batch.h"
+#include "numu/core/config.h"
+#include "numu/core/eval.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+class BudgetScope;
+
+// A fixed pool of worker threads. Each worker owns a queue of chunks and
+// takes from its front; a worker whose queue is empty steals from the back
+// of the others, so uneven chunks still keep every thread busy.
+class Scheduler {
+public:
+    // 0 starts one worker per hardware thread
+    explicit Scheduler(size_t workers = 0);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Read from core.threads, 0 when unset
+    static size_t workers_from(const config::Config& config);
+
+    size_t workers() const { return threads_.size(); }
+
+    // Calls task(begin, end) over [0, count) in chunks of at most `grain`
+    // and waits for all of them. The first exception thrown by a chunk is
+    // rethrown here; chunks not yet started are then skipped. Called from
+    // inside one of this scheduler's tasks, it runs the chunks in order on
+    // the calling thread instead. Work done by the chunks counts against
+    // the caller's BudgetScope.
+    void parallel_for(size_t count, size_t grain,
+                      const std::function<void(size_t begin, size_t end)>& task);
+
+    // Evaluates every expression for each of `count` binding sets given as
+    // columns. Results are expression-major: out[e * count + i]. Names that
+    // are not columns are bound from `frame` when the expressions compile.
+    std::vector<double> evaluate(const std::vector<ast::Node*>& expressions,
+                                 const std::vector<Column>& bindings, size_t count,
+                                 const Frame& frame);
+    std::vector<double> evaluate(const std::vector<ast::Node*>& expressions,
+                                 const std::vector<Column>& bindings, size_t count);
+
+private:
+    struct Job {
+        const std::function<void(size_t, size_t)>* task;
+        BudgetScope* budget;
+        std::atomic<size_t> remaining{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+    };
+
+    struct Chunk {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+    std::mutex submit_mutex_; // one parallel_for at a time
+
+    void worker(size_t index);
+    bool take(size_t index, Chunk& chunk);
+    void run(const Chunk& chunk);
+};
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_PARALLEL_H
@@ -0,0 +1,30 @@
+#ifndef NUMU_CORE_PARSE_H
+#define NUMU_CORE_PARSE_H
+
+#include "numu/core/ast.h"
+#include "numu/core/lex.h"
+#include "numu/core/stream.h"
+#include <cstddef>
+#include <string>
+
+namespace numu {
+namespace parse {
+
+struct ParseError {
+    std::string message;
+    size_t line;
+    size_t column;
+};
+
+ast::Node* parse(lex::Lexer& lexer);
+// Copies the text of the tokens it holds, since a StreamLexer reuses its
+// buffer; the resulting tree does not refer to the stream
+ast::Node* parse(lex::StreamLexer& lexer);
+// Parses statements up to the end of input into a BlockNode
+ast::Node* parse_program(lex::Lexer& lexer);
+ast::Node* parse_program(lex::StreamLexer& lexer);
+
+} // namespace parse
+} // namespace numu
+
+#endif // NUMU_CORE_PARSE_H
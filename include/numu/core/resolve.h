@@ -0,0 +1,65 @@
+#ifndef NUMU_CORE_RESOLVE_H
+#define NUMU_CORE_RESOLVE_H
+
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+// An expression tree with its names resolved once, for repeated tree
+// evaluation. Variables read slots of a caller-supplied array, in the
+// order given by variables(), and calls go straight to the registry's
+// callables: unary and binary functions without an argument vector or an
+// arity check. Unknown names and wrong argument counts are reported by
+// resolve(); evaluation then gives the same values and errors as evaluate().
+class ResolvedExpression {
+public:
+    const std::vector<std::string>& variables() const { return variables_; }
+    size_t slot(const std::string& name) const;
+
+    double evaluate(const double* vars) const;
+    double evaluate(const std::vector<double>& vars) const { return evaluate(vars.data()); }
+    Result try_evaluate(const double* vars) const;
+
+private:
+    enum class Kind : uint8_t { CONSTANT, SLOT, BINARY, UNARY, CALL1, CALL2, CALL };
+
+    // A node of the resolved tree. Children are indices into terms_; CALL
+    // reads `count` of them from arguments_ starting at `a`.
+    struct Term {
+        Kind kind;
+        uint8_t op;      // ast::BinaryOp / ast::UnaryOp
+        uint32_t a = 0;  // slot, first operand or first argument index
+        uint32_t b = 0;  // second operand or argument count
+        double value = 0.0;
+        const Callable* callable = nullptr;
+    };
+
+    std::vector<Term> terms_;
+    std::vector<uint32_t> arguments_;
+    std::vector<std::string> variables_;
+    RegistryPtr registry_; // owns the callables
+    uint32_t root_ = 0;
+
+    template<bool Throwing> class Evaluator;
+    friend class Resolver;
+};
+
+// Functions come from the frame's registry and must exist with a matching
+// argument count. Every variable gets a slot unless `variables` is given;
+// names outside it are then bound to the frame's values.
+ResolvedExpression resolve(ast::Node* node, const Frame& frame);
+ResolvedExpression resolve(ast::Node* node, const std::vector<std::string>& variables,
+                     const Frame& frame);
+// As above with default_frame()
+ResolvedExpression resolve(ast::Node* node);
+ResolvedExpression resolve(ast::Node* node, const std::vector<std::string>& variables);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_RESOLVE_H
@@ -0,0 +1,41 @@
+#ifndef NUMU_CORE_SERIALIZE_H
+#define NUMU_CORE_SERIALIZE_H
+
+#include "numu/core/flat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace numu {
+namespace ast {
+
+struct FormatError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Files of any other version are rejected rather than converted
+constexpr uint32_t flat_format_version = 1;
+
+// A flat tree as one buffer: a header with the array sizes, then each of
+// the tree's arrays as stored in memory, 8-byte aligned, so a loaded tree
+// reads the buffer in place. Byte order and layout are the host's; a file
+// from a different byte order is rejected. Entries are sorted by name.
+std::string serialize(const FlatTree& tree);
+void save(const FlatTree& tree, const std::string& path);
+
+// A read-only tree over `data`, which must be 8-byte aligned and outlive
+// the tree and its copies. The buffer is checked once, in one pass over
+// the nodes, so a corrupt or truncated one throws FormatError here
+// instead of being read out of bounds later. Nothing is copied.
+FlatTree view(const void* data, size_t size);
+// As above, keeping `owner` alive for as long as the tree or a copy of it
+FlatTree view(std::shared_ptr<const void> owner, const void* data, size_t size);
+// Maps the file and views it, so the tree shares pages with the page cache
+FlatTree load(const std::string& path);
+
+} // namespace ast
+} // namespace numu
+
+#endif // NUMU_CORE_SERIALIZE_H
@@ -0,0 +1,145 @@
+#ifndef NUMU_CORE_SPARSE_H
+#define NUMU_CORE_SPARSE_H
+
+#include "numu/core/config.h"
+#include "numu/core/matrix.h"
+#include <cstddef>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+// Compressed sparse matrix. In CSR the outer dimension is rows and the
+// indices are columns; CSC is the same layout with the roles swapped.
+class SparseMatrix {
+public:
+    enum class Format { CSR, CSC };
+
+    struct Entry {
+        size_t row;
+        size_t col;
+        double value;
+    };
+
+    SparseMatrix() = default;
+    // Duplicate entries are summed and explicit zeros dropped
+    SparseMatrix(size_t rows, size_t cols, std::vector<Entry> entries, Format format = Format::CSR);
+    static SparseMatrix from_dense(const Matrix& m, Format format = Format::CSR);
+    static SparseMatrix identity(size_t n);
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t nonzeros() const { return values_.size(); }
+    double fill() const;
+    Format format() const { return format_; }
+
+    // offsets()[k]..offsets()[k+1] delimit outer row (CSR) or column (CSC) k
+    const std::vector<size_t>& offsets() const { return offsets_; }
+    const std::vector<uint32_t>& indices() const { return indices_; }
+    const std::vector<double>& values() const { return values_; }
+
+    double at(size_t row, size_t col) const;
+    Matrix to_dense() const;
+    SparseMatrix convert(Format format) const;
+    // Reinterprets the storage, so CSR becomes CSC without moving entries
+    SparseMatrix transpose() const;
+
+private:
+    friend SparseMatrix multiply(const SparseMatrix& a, const SparseMatrix& b);
+    friend SparseMatrix add(const SparseMatrix& a, const SparseMatrix& b, double scale);
+    friend SparseMatrix operator*(const SparseMatrix& a, double scale);
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    Format format_ = Format::CSR;
+    std::vector<size_t> offsets_{0};
+    std::vector<uint32_t> indices_;
+    std::vector<double> values_;
+
+    size_t outer() const { return format_ == Format::CSR ? rows_ : cols_; }
+};
+
+// y = a * x; y must not alias x
+void multiply(const SparseMatrix& a, const double* x, double* y);
+std::vector<double> multiply(const SparseMatrix& a, const std::vector<double>& x);
+Matrix multiply(const SparseMatrix& a, const Matrix& b);
+Matrix multiply(const Matrix& a, const SparseMatrix& b);
+// Row by row with a dense accumulator (Gustavson), so the work is
+// proportional to the products of non-zeros. Either operand may be CSC;
+// the result is CSR.
+SparseMatrix multiply(const SparseMatrix& a, const SparseMatrix& b);
+// a + scale * b in CSR, without the entries that cancel
+SparseMatrix add(const SparseMatrix& a, const SparseMatrix& b, double scale = 1.0);
+SparseMatrix operator*(const SparseMatrix& a, double scale);
+
+struct SolverOptions {
+    double tolerance = 1e-10; // on the residual norm relative to |b|
+    size_t max_iterations = 0; // 0 means the matrix dimension
+
+    // Reads linear.solver.tolerance and linear.solver.max_iterations
+    static SolverOptions from(const config::Config& config);
+};
+
+struct SolveResult {
+    std::vector<double> x;
+    size_t iterations = 0;
+    double residual = 0.0; // relative, as compared with the tolerance
+    bool converged = false;
+};
+
+// Jacobi-preconditioned conjugate gradient for symmetric positive definite
+// systems. Throws EvaluationError if the matrix is evidently not SPD.
+SolveResult conjugate_gradient(const SparseMatrix& a, const std::vector<double>& b,
+                               const SolverOptions& options = {});
+
+// A matrix stored dense or sparse, whichever suits its fill ratio. Every
+// operation picks the layout of its result the same way, so sparse values
+// stay sparse through an expression.
+class MatrixValue {
+public:
+    // Matrices with fewer non-zeros than this fraction are stored sparse
+    static constexpr double sparse_fill = 0.1;
+    // unless they have fewer entries than this, dense or not
+    static constexpr size_t sparse_min_size = 1024;
+
+    static MatrixValue make(Matrix dense);
+    static MatrixValue make(size_t rows, size_t cols, std::vector<SparseMatrix::Entry> entries);
+    static MatrixValue make(SparseMatrix sparse);
+
+    bool sparse() const { return std::holds_alternative<SparseMatrix>(value_); }
+    const Matrix* as_dense() const { return std::get_if<Matrix>(&value_); }
+    const SparseMatrix* as_sparse() const { return std::get_if<SparseMatrix>(&value_); }
+
+    size_t rows() const;
+    size_t cols() const;
+    Matrix to_dense() const;
+    // The single entry of a 1x1 matrix
+    double scalar() const;
+
+    std::vector<double> multiply(const std::vector<double>& x) const;
+    // Uses the sparse kernels when either side is stored sparse
+    MatrixValue multiply(const MatrixValue& other) const;
+    // this + scale * other; sparse only when both are
+    MatrixValue add(const MatrixValue& other, double scale = 1.0) const;
+    MatrixValue scale(double factor) const;
+    MatrixValue transpose() const;
+
+private:
+    explicit MatrixValue(Matrix dense) : value_(std::move(dense)) {}
+    explicit MatrixValue(SparseMatrix sparse) : value_(std::move(sparse)) {}
+
+    std::variant<Matrix, SparseMatrix> value_;
+};
+
+// As evaluate_matrix, but literals and intermediate results are stored
+// sparse where that suits them, so a large sparse system is never made
+// dense unless an operation needs it (inverse, determinant, or a sum with
+// a dense matrix)
+MatrixValue evaluate_matrix_value(ast::Node* node, const Frame& frame);
+
+} // namespace core
+} // namespace numu
+
+#endif // NUMU_CORE_SPARSE_H
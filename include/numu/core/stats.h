@@ -0,0 +1,167 @@
+#ifndef NUMU_CORE_STATS_H
+#define NUMU_CORE_STATS_H
+
+#include "numu/core/config.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace numu {
+namespace stats {
+
+// Instrumentation of the library's hot paths. The hooks are the NUMU_STATS_*
+// macros below, which expand to nothing unless the library is built with
+// NUMU_ENABLE_STATS. When built in, nothing is collected until enable() or
+// configure() turns collection on; until then each hook costs one relaxed
+// load. Counters are kept per thread and summed by snapshot().
+
+enum class Stage : uint8_t {
+    LEX,      // one call per token from Lexer::next
+    PARSE,    // parse and parse_program, including the tokens they pull
+    SIMPLIFY,
+    EVALUATE  // the tree, flat, resolved, compiled and batch evaluators
+};
+constexpr size_t stage_count = 4;
+
+const char* stage_name(Stage stage);
+
+enum class Counter : uint8_t {
+    NODES,        // nodes allocated from arenas, including interners' arenas
+    ARENA_CHUNKS, // chunks arenas allocated
+    ARENA_BYTES   // bytes in those chunks
+};
+constexpr size_t counter_count = 3;
+
+// Nested entries into a stage, such as a matrix expression handing back to
+// the tree evaluator, are counted once, by the outermost
+struct StageStats {
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+};
+
+// Bucket k of the histogram counts calls that took fewer than 2^k ns and at
+// least 2^(k-1); the last bucket also takes everything slower. Batch
+// evaluation records a block's calls at their average duration.
+constexpr size_t histogram_buckets = 32;
+
+struct FunctionStats {
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+    std::array<uint64_t, histogram_buckets> histogram{};
+};
+
+struct Snapshot {
+    std::array<StageStats, stage_count> stages{};
+    std::array<uint64_t, counter_count> counters{};
+    std::map<std::string, FunctionStats> functions; // by registered name
+
+    const StageStats& stage(Stage s) const { return stages[static_cast<size_t>(s)]; }
+    uint64_t counter(Counter c) const { return counters[static_cast<size_t>(c)]; }
+};
+
+// True when built with NUMU_ENABLE_STATS
+bool available();
+
+// Has no effect unless available()
+void enable(bool on);
+// Enables collection if developer.timing is true
+void configure(const config::Config& config);
+
+namespace detail {
+extern std::atomic<bool> active;
+
+uint64_t enter(Stage stage);
+void leave(Stage stage, uint64_t start);
+uint64_t now();
+void add(Counter counter, uint64_t amount);
+void record_call(const std::string& function, uint64_t calls, uint64_t nanoseconds);
+} // namespace detail
+
+inline bool enabled() {
+    return detail::active.load(std::memory_order_relaxed);
+}
+
+// Totals over every thread, including threads that have exited
+Snapshot snapshot();
+// Zeroes every total. Counts taken while it runs may survive it.
+void reset();
+
+inline void count(Counter counter, uint64_t amount) {
+    if (enabled()) {
+        detail::add(counter, amount);
+    }
+}
+
+// Times a stage from construction to destruction
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage_(stage), running_(enabled()) {
+        if (running_) {
+            start_ = detail::enter(stage);
+        }
+    }
+    ~StageTimer() {
+        if (running_) {
+            detail::leave(stage_, start_);
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Stage stage_;
+    bool running_;
+    uint64_t start_ = 0;
+};
+
+// Times `calls` calls of a registered function, made between construction
+// and destruction. `function` must outlive the timer.
+class CallTimer {
+public:
+    CallTimer(const std::string& function, uint64_t calls)
+        : function_(function), calls_(calls), running_(enabled()) {
+        if (running_) {
+            start_ = detail::now();
+        }
+    }
+    ~CallTimer() {
+        if (running_) {
+            detail::record_call(function_, calls_, detail::now() - start_);
+        }
+    }
+
+    CallTimer(const CallTimer&) = delete;
+    CallTimer& operator=(const CallTimer&) = delete;
+
+private:
+    const std::string& function_;
+    uint64_t calls_;
+    bool running_;
+    uint64_t start_ = 0;
+};
+
+} // namespace stats
+} // namespace numu
+
+// Timers run to the end of the enclosing scope; each gets a name of its
+// own, so several may share one
+#ifdef NUMU_ENABLE_STATS
+#define NUMU_STATS_CONCAT_(a, b) a##b
+#define NUMU_STATS_CONCAT(a, b) NUMU_STATS_CONCAT_(a, b)
+#define NUMU_STATS_STAGE(stage) \
+    ::numu::stats::StageTimer NUMU_STATS_CONCAT(numu_stage_timer_, __LINE__)(::numu::stats::Stage::stage)
+#define NUMU_STATS_CALL(function, calls) \
+    ::numu::stats::CallTimer NUMU_STATS_CONCAT(numu_call_timer_, __LINE__)(function, calls)
+#define NUMU_STATS_COUNT(counter, amount) \
+    ::numu::stats::count(::numu::stats::Counter::counter, amount)
+#else
+#define NUMU_STATS_STAGE(stage) ((void)0)
+#define NUMU_STATS_CALL(function, calls) ((void)0)
+#define NUMU_STATS_COUNT(counter, amount) ((void)0)
+#endif
+
+#endif // NUMU_CORE_STATS_H
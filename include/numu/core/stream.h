@@ -0,0 +1,55 @@
+#ifndef NUMU_CORE_STREAM_H
+#define NUMU_CORE_STREAM_H
+
+#include "numu/core/lex.h"
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace numu {
+namespace lex {
+
+// Read-only memory mapping of a whole file. Tokens lexed from view() point
+// straight into the mapping and stay valid for the lifetime of the object.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string fallback_; // used where mmap is unavailable
+};
+
+// Lexes an input stream through a bounded buffer that is refilled in
+// chunks. A Token's text is only valid until the next call to next();
+// parse::parse accepts a StreamLexer and copies what it keeps.
+class StreamLexer {
+public:
+    static constexpr size_t default_chunk_size = 64 * 1024;
+
+    explicit StreamLexer(std::istream& input, size_t chunk_size = default_chunk_size);
+
+    Token next();
+
+private:
+    std::istream& input_;
+    size_t chunk_size_;
+    std::string buffer_; // unconsumed input; the lexer works on all of it
+    bool exhausted_ = false;
+    Lexer lexer_;
+
+    void refill(size_t keep_from, size_t line, size_t column);
+};
+
+} // namespace lex
+} // namespace numu
+
+#endif // NUMU_CORE_STREAM_H
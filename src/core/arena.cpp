@@ -0,0 +1,163 @@
+#include "numu/core/arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace numu {
+namespace ast {
+
+namespace {
+constexpr size_t chunk_header = (sizeof(void*) * 2 + alignof(std::max_align_t) - 1)
+                                & ~(alignof(std::max_align_t) - 1);
+
+thread_local Arena* active_arena = nullptr;
+
+// Default arenas of threads that exited while they still held nodes. A
+// tree made outside any ArenaScope may be handed to another thread and
+// outlive the one that made it, so these are never destroyed; instead new
+// threads take them over, and there are never more default arenas than
+// threads alive at once. Both are leaked so that threads exiting during
+// static destruction can still use them.
+std::mutex& retired_mutex() {
+    static auto* mutex = new std::mutex();
+    return *mutex;
+}
+
+std::vector<Arena*>& retired_arenas() {
+    static auto* arenas = new std::vector<Arena*>();
+    return *arenas;
+}
+
+} // namespace
+
+// Owns the default arena of one thread, so creating nodes takes no lock
+struct DefaultArena {
+    Arena* arena = nullptr;
+
+    DefaultArena() {
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex());
+            auto& retired = retired_arenas();
+            if (!retired.empty()) {
+                arena = retired.back();
+                retired.pop_back();
+            }
+        }
+        if (!arena) {
+            arena = new Arena();
+        }
+    }
+
+    ~DefaultArena() {
+        if (arena->objects() == 0) {
+            delete arena;
+            return;
+        }
+        arena->retired_ = true;
+        std::lock_guard<std::mutex> lock(retired_mutex());
+        retired_arenas().push_back(arena);
+    }
+};
+
+namespace {
+Arena& default_arena() {
+    thread_local DefaultArena owner;
+    return *owner.arena;
+}
+}
+
+Arena::Arena(size_t chunk_size) : chunk_size_(chunk_size) {}
+
+Arena::~Arena() {
+    run_finalizers();
+    while (chunks_) {
+        Chunk* next = chunks_->next;
+        ::operator delete(chunks_);
+        chunks_ = next;
+    }
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    auto addr = reinterpret_cast<uintptr_t>(cursor_);
+    auto aligned = (addr + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+    if (!cursor_ || aligned + size > reinterpret_cast<uintptr_t>(limit_)) {
+        grow(size + align);
+        addr = reinterpret_cast<uintptr_t>(cursor_);
+        aligned = (addr + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+    }
+    cursor_ = reinterpret_cast<char*>(aligned + size);
+    return reinterpret_cast<void*>(aligned);
+}
+
+void Arena::grow(size_t min_size) {
+    size_t size = std::max(chunk_size_, min_size);
+    auto* chunk = static_cast<Chunk*>(::operator new(chunk_header + size));
+    chunk->size = size;
+    reserved_ += size;
+    NUMU_STATS_COUNT(ARENA_CHUNKS, 1);
+    NUMU_STATS_COUNT(ARENA_BYTES, size);
+
+    // Keep the first chunk at the head of the list so reset() can rewind to it
+    if (chunks_) {
+        chunk->next = chunks_->next;
+        chunks_->next = chunk;
+    } else {
+        chunk->next = nullptr;
+        chunks_ = chunk;
+    }
+
+    cursor_ = reinterpret_cast<char*>(chunk) + chunk_header;
+    limit_ = cursor_ + size;
+}
+
+void Arena::run_finalizers() {
+    while (finalizers_) {
+        finalizers_->destroy(finalizers_->object);
+        finalizers_ = finalizers_->next;
+    }
+}
+
+void Arena::reset() {
+    if (retired_) {
+        throw std::logic_error("Cannot reset an arena holding nodes of a thread that has exited");
+    }
+    run_finalizers();
+    objects_ = 0;
+    if (!chunks_) {
+        return;
+    }
+
+    Chunk* extra = chunks_->next;
+    while (extra) {
+        Chunk* next = extra->next;
+        reserved_ -= extra->size;
+        ::operator delete(extra);
+        extra = next;
+    }
+    chunks_->next = nullptr;
+    cursor_ = reinterpret_cast<char*>(chunks_) + chunk_header;
+    limit_ = cursor_ + chunks_->size;
+}
+
+Arena& current_arena() {
+    return active_arena ? *active_arena : default_arena();
+}
+
+ArenaScope::ArenaScope()
+    : owned_(std::make_unique<Arena>()), arena_(owned_.get()), previous_(active_arena) {
+    active_arena = arena_;
+}
+
+ArenaScope::ArenaScope(Arena& arena) : arena_(&arena), previous_(active_arena) {
+    active_arena = arena_;
+}
+
+ArenaScope::~ArenaScope() {
+    active_arena = previous_;
+}
+
+} // namespace ast
+} // namespace numu
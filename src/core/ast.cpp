@@ -1,4 +1,6 @@
 #include "numu/core/ast.h"
+#include "numu/core/arena.h"
+#include "numu/core/intern.h"
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -8,68 +10,121 @@
 #include <stack>
 #include <queue>
 #include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
 
 namespace numu {
 namespace ast {
 
 namespace {
-struct NodePool {
-    std::vector<std::unique_ptr<Node>> nodes;
-    
-    template<typename T, typename... Args>
-    T* create(Args&&... args) {
-        auto ptr = std::make_unique<T>(std::forward<Args>(args)...);
-        auto* raw = ptr.get();
-        nodes.push_back(std::move(ptr));
-        return raw;
-    }
-};
-
-thread_local NodePool global_pool;
+bool matrix_valued(const Node* node) {
+    return node && node->matrix_valued;
 }
 
-Node::Node(NodeType type) : type(type) {}
-Node::~Node() = default;
+template<typename T, typename... Args>
+T* make(Args&&... args) {
+    if (Interner* interner = current_interner()) {
+        return interner->create<T>(std::forward<Args>(args)...);
+    }
+    return current_arena().create<T>(std::forward<Args>(args)...);
+}
+}
 
 NumberNode::NumberNode(double value) : Node(NodeType::NUMBER), value(value) {}
 NumberNode* NumberNode::create(double value) {
-    return global_pool.create<NumberNode>(value);
+    return make<NumberNode>(value);
+}
+
+BooleanNode::BooleanNode(bool value) : Node(NodeType::BOOLEAN), value(value) {}
+BooleanNode* BooleanNode::create(bool value) {
+    return make<BooleanNode>(value);
+}
+
+StringNode::StringNode(const std::string& value) : Node(NodeType::STRING), value(value) {}
+StringNode* StringNode::create(const std::string& value) {
+    return make<StringNode>(value);
 }
 
 VariableNode::VariableNode(const std::string& name) 
     : Node(NodeType::VARIABLE), name(name) {}
 VariableNode* VariableNode::create(const std::string& name) {
-    return global_pool.create<VariableNode>(name);
+    return make<VariableNode>(name);
 }
 
 BinaryOpNode::BinaryOpNode(BinaryOp op, Node* left, Node* right)
-    : Node(NodeType::BINARY_OP), op(op), left(left), right(right) {}
+    : Node(NodeType::BINARY_OP), op(op), left(left), right(right) {
+    this->matrix_valued = ast::matrix_valued(left) || ast::matrix_valued(right);
+}
 BinaryOpNode* BinaryOpNode::create(BinaryOp op, Node* left, Node* right) {
-    return global_pool.create<BinaryOpNode>(op, left, right);
+    return make<BinaryOpNode>(op, left, right);
 }
 
 UnaryOpNode::UnaryOpNode(UnaryOp op, Node* operand)
-    : Node(NodeType::UNARY_OP), op(op), operand(operand) {}
+    : Node(NodeType::UNARY_OP), op(op), operand(operand) {
+    this->matrix_valued = op == UnaryOp::TRANSPOSE || op == UnaryOp::INVERSE ||
+                          (op != UnaryOp::DETERMINANT && ast::matrix_valued(operand));
+}
 UnaryOpNode* UnaryOpNode::create(UnaryOp op, Node* operand) {
-    return global_pool.create<UnaryOpNode>(op, operand);
+    return make<UnaryOpNode>(op, operand);
 }
 
 FunctionNode::FunctionNode(const std::string& name, std::vector<Node*> args)
     : Node(NodeType::FUNCTION), name(name), args(std::move(args)) {}
 FunctionNode* FunctionNode::create(const std::string& name, std::vector<Node*> args) {
-    return global_pool.create<FunctionNode>(name, std::move(args));
+    return make<FunctionNode>(name, std::move(args));
 }
 
 MatrixNode::MatrixNode(std::vector<std::vector<Node*>> elements)
-    : Node(NodeType::MATRIX), elements(std::move(elements)) {}
+    : Node(NodeType::MATRIX), elements(std::move(elements)) {
+    matrix_valued = true;
+}
 MatrixNode* MatrixNode::create(std::vector<std::vector<Node*>> elements) {
-    return global_pool.create<MatrixNode>(std::move(elements));
+    return make<MatrixNode>(std::move(elements));
 }
 
 TensorNode::TensorNode(std::vector<size_t> dims, std::vector<Node*> values)
-    : Node(NodeType::TENSOR), dims(std::move(dims)), values(std::move(values)) {}
+    : Node(NodeType::TENSOR), dims(std::move(dims)), values(std::move(values)) {
+    matrix_valued = true;
+}
 TensorNode* TensorNode::create(std::vector<size_t> dims, std::vector<Node*> values) {
-    return global_pool.create<TensorNode>(std::move(dims), std::move(values));
+    return make<TensorNode>(std::move(dims), std::move(values));
+}
+
+AssignmentNode::AssignmentNode(const std::string& name, Node* value)
+    : Node(NodeType::ASSIGNMENT), name(name), value(value) {}
+AssignmentNode* AssignmentNode::create(const std::string& name, Node* value) {
+    return make<AssignmentNode>(name, value);
+}
+
+BlockNode::BlockNode(std::vector<Node*> statements)
+    : Node(NodeType::BLOCK), statements(std::move(statements)) {}
+BlockNode* BlockNode::create(std::vector<Node*> statements) {
+    return make<BlockNode>(std::move(statements));
+}
+
+IfNode::IfNode(Node* condition, Node* then_branch, Node* else_branch)
+    : Node(NodeType::IF), condition(condition), then_branch(then_branch), else_branch(else_branch) {}
+IfNode* IfNode::create(Node* condition, Node* then_branch, Node* else_branch) {
+    return make<IfNode>(condition, then_branch, else_branch);
+}
+
+WhileNode::WhileNode(Node* condition, Node* body)
+    : Node(NodeType::WHILE), condition(condition), body(body) {}
+WhileNode* WhileNode::create(Node* condition, Node* body) {
+    return make<WhileNode>(condition, body);
+}
+
+ForNode::ForNode(Node* initializer, Node* condition, Node* increment, Node* body)
+    : Node(NodeType::FOR), initializer(initializer), condition(condition),
+      increment(increment), body(body) {}
+ForNode* ForNode::create(Node* initializer, Node* condition, Node* increment, Node* body) {
+    return make<ForNode>(initializer, condition, increment, body);
+}
+
+ReturnNode::ReturnNode(Node* value) : Node(NodeType::RETURN), value(value) {}
+ReturnNode* ReturnNode::create(Node* value) {
+    return make<ReturnNode>(value);
 }
 
 Node* clone(Node* node) {
@@ -128,6 +183,8 @@ Node* clone(Node* node) {
 bool equals(Node* a, Node* b) {
     if (a == b) return true;
     if (!a || !b) return false;
+    // Two distinct nodes from the same interner are never structurally equal
+    if (a->intern_id != 0 && a->intern_id == b->intern_id) return false;
     if (a->type != b->type) return false;
     
     switch(a->type) {
@@ -136,6 +193,10 @@ bool equals(Node* a, Node* b) {
             auto* nb = static_cast<NumberNode*>(b);
             return na->value == nb->value;
         }
+        case NodeType::BOOLEAN:
+            return static_cast<BooleanNode*>(a)->value == static_cast<BooleanNode*>(b)->value;
+        case NodeType::STRING:
+            return static_cast<StringNode*>(a)->value == static_cast<StringNode*>(b)->value;
         case NodeType::VARIABLE: {
             auto* va = static_cast<VariableNode*>(a);
             auto* vb = static_cast<VariableNode*>(b);
@@ -203,70 +264,136 @@ bool equals(Node* a, Node* b) {
     }
 }
 
-size_t hash(Node* node) {
-    if (!node) return 0;
-    
-    static constexpr size_t prime = 0x100000001B3ull;
-    size_t h = static_cast<size_t>(node->type);
-    
+// splitmix64 finalizer; folding children in sequence keeps the hash
+// sensitive to argument order
+size_t hash_mix(size_t h, size_t value) {
+    uint64_t x = static_cast<uint64_t>(h) + 0x9e3779b97f4a7c15ull + static_cast<uint64_t>(value);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<size_t>(x ^ (x >> 31));
+}
+
+size_t hash_number(double value) {
+    if (value == 0.0) value = 0.0; // -0.0 equals 0.0
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return static_cast<size_t>(bits);
+}
+
+namespace {
+
+// `child` gives the hashes of the children
+template<typename ChildHash>
+size_t compute_hash(Node* node, ChildHash&& child) {
+    size_t h = hash_mix(0, static_cast<size_t>(node->type));
+
     switch(node->type) {
-        case NodeType::NUMBER: {
-            auto* num = static_cast<NumberNode*>(node);
-            h ^= std::hash<double>{}(num->value) + prime;
+        case NodeType::NUMBER:
+            h = hash_mix(h, hash_number(static_cast<NumberNode*>(node)->value));
             break;
-        }
-        case NodeType::VARIABLE: {
-            auto* var = static_cast<VariableNode*>(node);
-            h ^= std::hash<std::string>{}(var->name) + prime;
+        case NodeType::BOOLEAN:
+            h = hash_mix(h, static_cast<BooleanNode*>(node)->value ? 1 : 0);
+            break;
+        case NodeType::STRING:
+            h = hash_mix(h, std::hash<std::string>{}(static_cast<StringNode*>(node)->value));
+            break;
+        case NodeType::VARIABLE:
+            h = hash_mix(h, std::hash<std::string>{}(static_cast<VariableNode*>(node)->name));
             break;
-        }
         case NodeType::BINARY_OP: {
             auto* bin = static_cast<BinaryOpNode*>(node);
-            h ^= (static_cast<size_t>(bin->op) + prime);
-            h ^= (hash(bin->left) * prime);
-            h ^= (hash(bin->right) * prime);
+            h = hash_mix(h, static_cast<size_t>(bin->op));
+            h = hash_mix(h, child(bin->left));
+            h = hash_mix(h, child(bin->right));
             break;
         }
         case NodeType::UNARY_OP: {
             auto* un = static_cast<UnaryOpNode*>(node);
-            h ^= (static_cast<size_t>(un->op) + prime);
-            h ^= (hash(un->operand) * prime);
+            h = hash_mix(h, static_cast<size_t>(un->op));
+            h = hash_mix(h, child(un->operand));
             break;
         }
         case NodeType::FUNCTION: {
             auto* fn = static_cast<FunctionNode*>(node);
-            h ^= std::hash<std::string>{}(fn->name) + prime;
+            h = hash_mix(h, std::hash<std::string>{}(fn->name));
+            h = hash_mix(h, fn->args.size());
             for (auto* arg : fn->args) {
-                h ^= (hash(arg) * prime);
+                h = hash_mix(h, child(arg));
             }
             break;
         }
         case NodeType::MATRIX: {
             auto* mat = static_cast<MatrixNode*>(node);
+            h = hash_mix(h, mat->elements.size());
             for (const auto& row : mat->elements) {
+                h = hash_mix(h, row.size());
                 for (auto* elem : row) {
-                    h ^= (hash(elem) * prime);
+                    h = hash_mix(h, child(elem));
                 }
             }
             break;
         }
         case NodeType::TENSOR: {
             auto* tensor = static_cast<TensorNode*>(node);
+            h = hash_mix(h, tensor->dims.size());
             for (auto dim : tensor->dims) {
-                h ^= (std::hash<size_t>{}(dim) + prime);
+                h = hash_mix(h, dim);
             }
             for (auto* val : tensor->values) {
-                h ^= (hash(val) * prime);
+                h = hash_mix(h, child(val));
             }
             break;
         }
         default:
             throw std::runtime_error("Unknown node type in hash");
     }
-    
+
+    // 0 marks an empty cache slot
+    return h == 0 ? 1 : h;
+}
+
+#ifndef NDEBUG
+// Recomputes every hash below `node`, ignoring and checking the cached ones
+size_t verify_hash(Node* node, std::unordered_map<Node*, size_t>& fresh) {
+    if (!node) return 0;
+    auto it = fresh.find(node);
+    if (it != fresh.end()) return it->second;
+    size_t h = compute_hash(node, [&fresh](Node* child) { return verify_hash(child, fresh); });
+    size_t cached = node->cached_hash.load(std::memory_order_relaxed);
+    if (cached != 0 && cached != h) {
+        throw std::logic_error("Stale hash: a node was changed without invalidate_hash()");
+    }
+    fresh.emplace(node, h);
+    return h;
+}
+#endif
+} // namespace
+
+size_t hash(Node* node) {
+    if (!node) return 0;
+
+    size_t h = node->cached_hash.load(std::memory_order_relaxed);
+    if (h == 0) {
+        h = compute_hash(node, [](Node* child) { return hash(child); });
+        node->cached_hash.store(h, std::memory_order_relaxed);
+    }
+#ifndef NDEBUG
+    // Catches nodes changed in place without invalidate_hash(), at the
+    // cost of making every call linear in the subtree
+    else {
+        std::unordered_map<Node*, size_t> fresh;
+        verify_hash(node, fresh);
+    }
+#endif
     return h;
 }
 
+void invalidate_hash(Node* node) {
+    if (node) {
+        node->cached_hash.store(0, std::memory_order_relaxed);
+    }
+}
+
 void traverse(Node* node, const std::function<void(Node*)>& visitor) {
     if (!node) return;
     
@@ -320,62 +447,5 @@ void traverse(Node* node, const std::function<void(Node*)>& visitor) {
     }
 }
 
-Node* simplify(Node* node) {
-    if (!node) return nullptr;
-    
-    switch(node->type) {
-        case NodeType::BINARY_OP: {
-            auto* bin = static_cast<BinaryOpNode*>(node);
-            Node* left = simplify(bin->left);
-            Node* right = simplify(bin->right);
-            
-            if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER) {
-                double lval = static_cast<NumberNode*>(left)->value;
-                double rval = static_cast<NumberNode*>(right)->value;
-                double result = 0;
-                
-                switch(bin->op) {
-                    case BinaryOp::ADD: result = lval + rval; break;
-                    case BinaryOp::SUB: result = lval - rval; break;
-                    case BinaryOp::MUL: result = lval * rval; break;
-                    case BinaryOp::DIV: result = lval / rval; break;
-                    case BinaryOp::POW: result = std::pow(lval, rval); break;
-                    default: break;
-                }
-                
-                return NumberNode::create(result);
-            }
-            
-            return BinaryOpNode::create(bin->op, left, right);
-        }
-        case NodeType::UNARY_OP: {
-            auto* un = static_cast<UnaryOpNode*>(node);
-            Node* operand = simplify(un->operand);
-            
-            if (operand->type == NodeType::NUMBER) {
-                double val = static_cast<NumberNode*>(operand)->value;
-                double result = 0;
-                
-                switch(un->op) {
-                    case UnaryOp::NEGATE: result = -val; break;
-                    case UnaryOp::SIN: result = std::sin(val); break;
-                    case UnaryOp::COS: result = std::cos(val); break;
-                    case UnaryOp::TAN: result = std::tan(val); break;
-                    case UnaryOp::EXP: result = std::exp(val); break;
-                    case UnaryOp::LOG: result = std::log(val); break;
-                    case UnaryOp::SQRT: result = std::sqrt(val); break;
-                    default: break;
-                }
-                
-                return NumberNode::create(result);
-            }
-            
-            return UnaryOpNode::create(un->op, operand);
-        }
-        default:
-            return clone(node);
-    }
-}
-
 } // namespace ast
 } // namespace numu
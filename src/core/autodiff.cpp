@@ -0,0 +1,396 @@
+#include "numu/core/autodiff.h"
+#include "numu/core/budget.h"
+#include "numu/core/cse.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace numu {
+namespace core {
+
+namespace {
+// Each of these returns the value of an operation and writes its partial
+// derivative with respect to each operand to `p`
+
+double binary_partials(ast::BinaryOp op, double a, double b, double* p) {
+    double value = eval_binary_op(op, a, b);
+    switch(op) {
+        case ast::BinaryOp::ADD: p[0] = 1.0; p[1] = 1.0; break;
+        case ast::BinaryOp::SUB: p[0] = 1.0; p[1] = -1.0; break;
+        case ast::BinaryOp::MUL: p[0] = b; p[1] = a; break;
+        case ast::BinaryOp::DIV: p[0] = 1.0 / b; p[1] = -value / b; break;
+        case ast::BinaryOp::POW:
+            p[0] = b == 0.0 ? 0.0 : b * std::pow(a, b - 1.0);
+            // Only defined for positive bases; elsewhere the exponent is
+            // in practice a constant and the partial is never used
+            p[1] = a > 0.0 ? value * std::log(a) : 0.0;
+            break;
+        case ast::BinaryOp::MOD: p[0] = 1.0; p[1] = -std::trunc(a / b); break;
+        default:
+            // Comparisons and logic are piecewise constant
+            p[0] = 0.0;
+            p[1] = 0.0;
+            break;
+    }
+    return value;
+}
+
+double unary_partials(ast::UnaryOp op, double a, double* p) {
+    double value = eval_unary_op(op, a);
+    switch(op) {
+        case ast::UnaryOp::NEGATE: p[0] = -1.0; break;
+        case ast::UnaryOp::SIN: p[0] = std::cos(a); break;
+        case ast::UnaryOp::COS: p[0] = -std::sin(a); break;
+        case ast::UnaryOp::TAN: p[0] = 1.0 + value * value; break;
+        case ast::UnaryOp::EXP: p[0] = value; break;
+        case ast::UnaryOp::LOG: p[0] = 1.0 / a; break;
+        case ast::UnaryOp::SQRT: p[0] = 0.5 / value; break;
+        case ast::UnaryOp::TRANSPOSE:
+        case ast::UnaryOp::DETERMINANT: p[0] = 1.0; break;
+        case ast::UnaryOp::INVERSE: p[0] = -value * value; break;
+        default: p[0] = 0.0; break;
+    }
+    return value;
+}
+
+// Partials of the standard functions come from their Builtin tag, so a
+// registered function that merely shares a name is differenced numerically
+double call_partials(const Callable& callable, std::vector<double>& args, double* p) {
+    const Function& func = callable.function;
+    double value = func(args);
+    size_t n = args.size();
+    ast::UnaryOp op;
+    if (n == 1 && unary_op(&callable, op)) {
+        unary_partials(op, args[0], p);
+        return value;
+    }
+    switch(callable.builtin) {
+        case Builtin::POW:
+            if (n == 2) {
+                binary_partials(ast::BinaryOp::POW, args[0], args[1], p);
+                return value;
+            }
+            break;
+        case Builtin::ABS:
+            if (n == 1) {
+                p[0] = args[0] > 0.0 ? 1.0 : (args[0] < 0.0 ? -1.0 : 0.0);
+                return value;
+            }
+            break;
+        case Builtin::MIN:
+        case Builtin::MAX: {
+            auto it = std::find(args.begin(), args.end(), value);
+            // A NaN result matches no argument
+            std::fill(p, p + n, it == args.end() ? std::numeric_limits<double>::quiet_NaN() : 0.0);
+            if (it != args.end()) {
+                p[it - args.begin()] = 1.0;
+            }
+            return value;
+        }
+        case Builtin::SUM:
+        case Builtin::AVG:
+            std::fill(p, p + n, callable.builtin == Builtin::SUM ? 1.0 : 1.0 / static_cast<double>(n));
+            return value;
+        default:
+            break;
+    }
+    for (size_t k = 0; k < n; ++k) {
+        double x = args[k];
+        double h = numeric_step * std::max(1.0, std::fabs(x));
+        args[k] = x + h;
+        double up = func(args);
+        args[k] = x - h;
+        double down = func(args);
+        args[k] = x;
+        p[k] = (up - down) / (2.0 * h);
+    }
+    return value;
+}
+
+const Callable& lookup(const Frame& frame, const std::string& name) {
+    const Callable* callable = frame.registry().find_callable(name);
+    if (!callable) {
+        throw EvaluationError("Unknown function: " + name);
+    }
+    return *callable;
+}
+
+[[noreturn]] void unsupported(ast::Node* node) {
+    switch(node->type) {
+        case ast::NodeType::MATRIX:
+        case ast::NodeType::TENSOR:
+            throw EvaluationError("Cannot differentiate matrix expressions");
+        default:
+            throw EvaluationError("Cannot differentiate statements");
+    }
+}
+
+class DualEvaluator {
+public:
+    DualEvaluator(ast::Node* root, const Frame& frame, const std::string& variable)
+        : frame_(frame), variable_(variable), shared_(ast::shared_nodes(root)) {}
+
+    Dual eval(ast::Node* node) {
+        if (!shared_.count(node)) {
+            return compute(node);
+        }
+        auto it = memo_.find(node);
+        if (it != memo_.end()) {
+            return it->second;
+        }
+        Dual result = compute(node);
+        memo_[node] = result;
+        return result;
+    }
+
+private:
+    const Frame& frame_;
+    const std::string& variable_;
+    std::unordered_map<ast::Node*, size_t> shared_;
+    std::unordered_map<ast::Node*, Dual> memo_;
+    BudgetScope* budget_ = BudgetScope::current();
+
+    Dual compute(ast::Node* node) {
+        if (!node) {
+            throw EvaluationError("Null node in evaluation");
+        }
+        if (budget_) {
+            budget_->charge(1);
+        }
+        double p[2];
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+                return Dual{static_cast<ast::NumberNode*>(node)->value, 0.0};
+
+            case ast::NodeType::BOOLEAN:
+                return Dual{static_cast<ast::BooleanNode*>(node)->value ? 1.0 : 0.0, 0.0};
+
+            case ast::NodeType::VARIABLE: {
+                const auto& name = static_cast<ast::VariableNode*>(node)->name;
+                return Dual{frame_.get(name), name == variable_ ? 1.0 : 0.0};
+            }
+
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                Dual a = eval(bin->left);
+                Dual b = eval(bin->right);
+                double value = binary_partials(bin->op, a.value, b.value, p);
+                return Dual{value, chain(p[0], a.derivative) + chain(p[1], b.derivative)};
+            }
+
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                Dual a = eval(un->operand);
+                double value = unary_partials(un->op, a.value, p);
+                return Dual{value, chain(p[0], a.derivative)};
+            }
+
+            case ast::NodeType::FUNCTION: {
+                auto* fn = static_cast<ast::FunctionNode*>(node);
+                std::vector<double> args;
+                std::vector<double> derivatives;
+                args.reserve(fn->args.size());
+                derivatives.reserve(fn->args.size());
+                for (auto* arg : fn->args) {
+                    Dual d = eval(arg);
+                    args.push_back(d.value);
+                    derivatives.push_back(d.derivative);
+                }
+                std::vector<double> partials(args.size());
+                double value = call_partials(lookup(frame_, fn->name), args, partials.data());
+                double derivative = 0.0;
+                for (size_t k = 0; k < args.size(); ++k) {
+                    derivative += chain(partials[k], derivatives[k]);
+                }
+                return Dual{value, derivative};
+            }
+
+            default:
+                unsupported(node);
+        }
+    }
+
+    // Skips inactive operands, whose partial may be infinite, e.g. sqrt at 0
+    static double chain(double partial, double derivative) {
+        return derivative == 0.0 ? 0.0 : partial * derivative;
+    }
+};
+
+// Only operations that depend on a requested variable are recorded; the
+// rest are folded into the weights of the entries that use them
+class Tape {
+public:
+    static constexpr uint32_t constant = UINT32_MAX;
+
+    struct Ref {
+        double value;
+        uint32_t index; // `constant` when the value depends on no variable
+    };
+
+    uint32_t input() {
+        starts_.push_back(static_cast<uint32_t>(from_.size()));
+        return static_cast<uint32_t>(starts_.size() - 1);
+    }
+
+    Ref push(double value, const Ref* operands, const double* partials, size_t count) {
+        uint32_t start = static_cast<uint32_t>(from_.size());
+        for (size_t k = 0; k < count; ++k) {
+            if (operands[k].index != constant && partials[k] != 0.0) {
+                from_.push_back(operands[k].index);
+                weight_.push_back(partials[k]);
+            }
+        }
+        if (from_.size() == start) {
+            return Ref{value, constant};
+        }
+        starts_.push_back(start);
+        return Ref{value, static_cast<uint32_t>(starts_.size() - 1)};
+    }
+
+    std::vector<double> backward(uint32_t root) const {
+        std::vector<double> adjoint(starts_.size(), 0.0);
+        adjoint[root] = 1.0;
+        for (size_t i = root + 1; i-- > 0;) {
+            double a = adjoint[i];
+            if (a == 0.0) {
+                continue;
+            }
+            size_t end = i + 1 < starts_.size() ? starts_[i + 1] : from_.size();
+            for (size_t k = starts_[i]; k < end; ++k) {
+                adjoint[from_[k]] += a * weight_[k];
+            }
+        }
+        return adjoint;
+    }
+
+private:
+    std::vector<uint32_t> starts_;
+    std::vector<uint32_t> from_;
+    std::vector<double> weight_;
+};
+
+class Recorder {
+public:
+    Recorder(ast::Node* root, const Frame& frame, Tape& tape,
+             const std::unordered_map<std::string, uint32_t>& inputs)
+        : frame_(frame), tape_(tape), inputs_(inputs), shared_(ast::shared_nodes(root)) {}
+
+    Tape::Ref record(ast::Node* node) {
+        if (!shared_.count(node)) {
+            return compute(node);
+        }
+        auto it = memo_.find(node);
+        if (it != memo_.end()) {
+            return it->second;
+        }
+        Tape::Ref result = compute(node);
+        memo_[node] = result;
+        return result;
+    }
+
+private:
+    const Frame& frame_;
+    Tape& tape_;
+    const std::unordered_map<std::string, uint32_t>& inputs_;
+    std::unordered_map<ast::Node*, size_t> shared_;
+    std::unordered_map<ast::Node*, Tape::Ref> memo_;
+    BudgetScope* budget_ = BudgetScope::current();
+
+    Tape::Ref compute(ast::Node* node) {
+        if (!node) {
+            throw EvaluationError("Null node in evaluation");
+        }
+        if (budget_) {
+            budget_->charge(1);
+        }
+        double p[2];
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+                return Tape::Ref{static_cast<ast::NumberNode*>(node)->value, Tape::constant};
+
+            case ast::NodeType::BOOLEAN:
+                return Tape::Ref{static_cast<ast::BooleanNode*>(node)->value ? 1.0 : 0.0, Tape::constant};
+
+            case ast::NodeType::VARIABLE: {
+                const auto& name = static_cast<ast::VariableNode*>(node)->name;
+                auto it = inputs_.find(name);
+                return Tape::Ref{frame_.get(name), it == inputs_.end() ? Tape::constant : it->second};
+            }
+
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                Tape::Ref operands[2] = {record(bin->left), record(bin->right)};
+                double value = binary_partials(bin->op, operands[0].value, operands[1].value, p);
+                return tape_.push(value, operands, p, 2);
+            }
+
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                Tape::Ref operand = record(un->operand);
+                double value = unary_partials(un->op, operand.value, p);
+                return tape_.push(value, &operand, p, 1);
+            }
+
+            case ast::NodeType::FUNCTION: {
+                auto* fn = static_cast<ast::FunctionNode*>(node);
+                std::vector<Tape::Ref> operands;
+                std::vector<double> args;
+                operands.reserve(fn->args.size());
+                args.reserve(fn->args.size());
+                for (auto* arg : fn->args) {
+                    operands.push_back(record(arg));
+                    args.push_back(operands.back().value);
+                }
+                std::vector<double> partials(args.size());
+                double value = call_partials(lookup(frame_, fn->name), args, partials.data());
+                return tape_.push(value, operands.data(), partials.data(), operands.size());
+            }
+
+            default:
+                unsupported(node);
+        }
+    }
+};
+} // namespace
+
+Dual evaluate_dual(ast::Node* node, const Frame& frame, const std::string& variable) {
+    return DualEvaluator(node, frame, variable).eval(node);
+}
+
+Dual evaluate_dual(ast::Node* node, const std::string& variable) {
+    return evaluate_dual(node, default_frame(), variable);
+}
+
+Gradient evaluate_gradient(ast::Node* node, const Frame& frame,
+                           const std::vector<std::string>& variables) {
+    Tape tape;
+    std::unordered_map<std::string, uint32_t> inputs;
+    for (const auto& name : variables) {
+        if (!inputs.count(name)) {
+            inputs.emplace(name, tape.input());
+        }
+    }
+
+    Tape::Ref root = Recorder(node, frame, tape, inputs).record(node);
+    Gradient result;
+    result.value = root.value;
+    result.partials.assign(variables.size(), 0.0);
+    if (root.index == Tape::constant) {
+        return result;
+    }
+
+    std::vector<double> adjoint = tape.backward(root.index);
+    for (size_t k = 0; k < variables.size(); ++k) {
+        result.partials[k] = adjoint[inputs.at(variables[k])];
+    }
+    return result;
+}
+
+Gradient evaluate_gradient(ast::Node* node, const std::vector<std::string>& variables) {
+    return evaluate_gradient(node, default_frame(), variables);
+}
+
+} // namespace core
+} // namespace numu
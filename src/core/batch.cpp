@@ -0,0 +1,340 @@
+#include "numu/core/batch.h"
+#include "numu/core/budget.h"
+#include "numu/core/compile.h"
+#include "numu/core/eval.h"
+#include "numu/core/stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// With GCC on x86-64, kernels for AVX and AVX-512 are built as well unless
+// the target has them anyway, and the widest the CPU supports is used
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && !defined(__AVX512F__)
+#define NUMU_BATCH_DISPATCH 1
+#endif
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace numu {
+namespace core {
+
+namespace {
+constexpr size_t kBlock = 256;
+
+#if defined(__AVX512F__) || defined(NUMU_BATCH_DISPATCH)
+#ifdef NUMU_BATCH_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+struct Avx512 {
+    using type = __m512d;
+    static constexpr size_t width = 8;
+    static type load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, type v) { _mm512_storeu_pd(p, v); }
+    static type add(type a, type b) { return _mm512_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm512_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm512_mul_pd(a, b); }
+    static type div(type a, type b) { return _mm512_div_pd(a, b); }
+    // The zero-masked form; GCC's _mm512_sqrt_pd trips -Wmaybe-uninitialized
+    static type sqrt(type a) { return _mm512_maskz_sqrt_pd(0xff, a); }
+    static type neg(type a) { return _mm512_sub_pd(_mm512_setzero_pd(), a); }
+    static bool any_zero(type a) {
+        return _mm512_cmp_pd_mask(a, _mm512_setzero_pd(), _CMP_EQ_OQ) != 0;
+    }
+    static bool any_negative(type a) {
+        return _mm512_cmp_pd_mask(a, _mm512_setzero_pd(), _CMP_LT_OQ) != 0;
+    }
+    static bool any_non_positive(type a) {
+        return _mm512_cmp_pd_mask(a, _mm512_setzero_pd(), _CMP_LE_OQ) != 0;
+    }
+};
+#ifdef NUMU_BATCH_DISPATCH
+#pragma GCC pop_options
+#endif
+#endif
+
+#if defined(__AVX__) || defined(NUMU_BATCH_DISPATCH)
+#ifdef NUMU_BATCH_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("avx")
+#endif
+struct Avx {
+    using type = __m256d;
+    static constexpr size_t width = 4;
+    static type load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, type v) { _mm256_storeu_pd(p, v); }
+    static type add(type a, type b) { return _mm256_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+    static type div(type a, type b) { return _mm256_div_pd(a, b); }
+    static type sqrt(type a) { return _mm256_sqrt_pd(a); }
+    static type neg(type a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+    static bool any_zero(type a) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_EQ_OQ)) != 0;
+    }
+    static bool any_negative(type a) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_LT_OQ)) != 0;
+    }
+    static bool any_non_positive(type a) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_LE_OQ)) != 0;
+    }
+};
+#ifdef NUMU_BATCH_DISPATCH
+#pragma GCC pop_options
+#endif
+#endif
+
+#if defined(__SSE2__)
+struct Sse2 {
+    using type = __m128d;
+    static constexpr size_t width = 2;
+    static type load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, type v) { _mm_storeu_pd(p, v); }
+    static type add(type a, type b) { return _mm_add_pd(a, b); }
+    static type sub(type a, type b) { return _mm_sub_pd(a, b); }
+    static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+    static type div(type a, type b) { return _mm_div_pd(a, b); }
+    static type sqrt(type a) { return _mm_sqrt_pd(a); }
+    static type neg(type a) { return _mm_xor_pd(a, _mm_set1_pd(-0.0)); }
+    static bool any_zero(type a) {
+        return _mm_movemask_pd(_mm_cmpeq_pd(a, _mm_setzero_pd())) != 0;
+    }
+    static bool any_negative(type a) {
+        return _mm_movemask_pd(_mm_cmplt_pd(a, _mm_setzero_pd())) != 0;
+    }
+    static bool any_non_positive(type a) {
+        return _mm_movemask_pd(_mm_cmple_pd(a, _mm_setzero_pd())) != 0;
+    }
+};
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+struct Neon {
+    using type = float64x2_t;
+    static constexpr size_t width = 2;
+    static type load(const double* p) { return vld1q_f64(p); }
+    static void store(double* p, type v) { vst1q_f64(p, v); }
+    static type add(type a, type b) { return vaddq_f64(a, b); }
+    static type sub(type a, type b) { return vsubq_f64(a, b); }
+    static type mul(type a, type b) { return vmulq_f64(a, b); }
+    static type div(type a, type b) { return vdivq_f64(a, b); }
+    static type sqrt(type a) { return vsqrtq_f64(a); }
+    static type neg(type a) { return vnegq_f64(a); }
+    static bool any_zero(type a) { return vmaxvq_u32(vreinterpretq_u32_u64(vceqzq_f64(a))) != 0; }
+    static bool any_negative(type a) { return vmaxvq_u32(vreinterpretq_u32_u64(vcltzq_f64(a))) != 0; }
+    static bool any_non_positive(type a) { return vmaxvq_u32(vreinterpretq_u32_u64(vclezq_f64(a))) != 0; }
+};
+#endif
+
+struct Scalar {
+    using type = double;
+    static constexpr size_t width = 1;
+    static type load(const double* p) { return *p; }
+    static void store(double* p, type v) { *p = v; }
+    static type add(type a, type b) { return a + b; }
+    static type sub(type a, type b) { return a - b; }
+    static type mul(type a, type b) { return a * b; }
+    static type div(type a, type b) { return a / b; }
+    static type sqrt(type a) { return std::sqrt(a); }
+    static type neg(type a) { return -a; }
+    static bool any_zero(type a) { return a == 0.0; }
+    static bool any_negative(type a) { return a < 0.0; }
+    static bool any_non_positive(type a) { return a <= 0.0; }
+};
+
+// The widest vectors the build targets
+#if defined(__AVX512F__)
+using Baseline = Avx512;
+#elif defined(__AVX__)
+using Baseline = Avx;
+#elif defined(__SSE2__)
+using Baseline = Sse2;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+using Baseline = Neon;
+#else
+using Baseline = Scalar;
+#endif
+
+// Calls a registered function for every point. Without `status` its
+// errors are thrown; with it they fail only their own point. The result
+// may overwrite the arguments, one point at a time.
+template<typename Call>
+void call_points(size_t n, double* d, Status* status, Call call) {
+    if (!status) {
+        for (size_t i = 0; i < n; ++i) {
+            d[i] = call(i);
+        }
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        try {
+            d[i] = call(i);
+        } catch (const BudgetExceeded&) {
+            throw;
+        } catch (const EvaluationError&) {
+            d[i] = std::numeric_limits<double>::quiet_NaN();
+            if (status[i] == Status::OK) {
+                status[i] = Status::OTHER;
+            }
+        }
+    }
+}
+
+namespace baseline {
+using Vec = Baseline;
+#include "batch_kernels.inc"
+} // namespace baseline
+
+#ifdef NUMU_BATCH_DISPATCH
+// Vectors only pass between functions of the same target, which all inline
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#pragma GCC push_options
+#pragma GCC target("avx")
+namespace avx {
+using Vec = Avx;
+#include "batch_kernels.inc"
+} // namespace avx
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace avx512 {
+using Vec = Avx512;
+#include "batch_kernels.inc"
+} // namespace avx512
+#pragma GCC pop_options
+#pragma GCC diagnostic pop
+#endif
+
+using BlockKernel = void (*)(const CompiledExpression& expr, const double* const* columns,
+                             size_t offset, size_t n, double* frame, std::vector<double>& args,
+                             double* out, Status* status);
+
+// The kernels for the widest vectors this CPU supports
+BlockKernel select_kernel() {
+#ifdef NUMU_BATCH_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return avx512::run_block;
+    }
+    if (__builtin_cpu_supports("avx")) {
+        return avx::run_block;
+    }
+#endif
+    return baseline::run_block;
+}
+
+std::atomic<BlockKernel>& current_kernel() {
+    static std::atomic<BlockKernel> kernel{select_kernel()};
+    return kernel;
+}
+
+size_t run_blocks(const CompiledExpression& expr, const double* const* columns,
+                  size_t count, double* out, Status* status) {
+    NUMU_STATS_STAGE(EVALUATE);
+    std::vector<double> frame(static_cast<size_t>(expr.registers) * kBlock);
+    std::vector<double> args;
+    BlockKernel run_block = current_kernel().load(std::memory_order_relaxed);
+    BudgetScope* budget = BudgetScope::current();
+    for (size_t offset = 0; offset < count; offset += kBlock) {
+        size_t n = std::min(kBlock, count - offset);
+        if (budget) {
+            budget->charge(n * expr.code.size());
+        }
+        run_block(expr, columns, offset, n, frame.data(), args, out + offset,
+                  status ? status + offset : nullptr);
+    }
+    return status ? count - static_cast<size_t>(std::count(status, status + count, Status::OK)) : 0;
+}
+
+// Binds each column to the slot of its name
+template<typename Run>
+auto with_columns(ast::Node* node, const std::vector<Column>& columns, Run run) {
+    std::vector<std::string> names;
+    std::vector<const double*> data;
+    names.reserve(columns.size());
+    data.reserve(columns.size());
+    for (const auto& column : columns) {
+        names.push_back(column.name);
+        data.push_back(column.data);
+    }
+    return run(compile(node, names), data.data());
+}
+
+} // namespace
+
+namespace detail {
+bool force_batch_kernel(BatchKernel kernel) {
+    BlockKernel run_block = nullptr;
+    switch(kernel) {
+        case BatchKernel::AUTO:
+            run_block = select_kernel();
+            break;
+        case BatchKernel::BASELINE:
+            run_block = baseline::run_block;
+            break;
+#ifdef NUMU_BATCH_DISPATCH
+        case BatchKernel::AVX:
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx")) {
+                run_block = avx::run_block;
+            }
+            break;
+        case BatchKernel::AVX512:
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                run_block = avx512::run_block;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+    if (!run_block) {
+        return false;
+    }
+    current_kernel().store(run_block, std::memory_order_relaxed);
+    return true;
+}
+} // namespace detail
+
+void evaluate_batch(const CompiledExpression& expr, const double* const* columns,
+                    size_t count, double* out) {
+    run_blocks(expr, columns, count, out, nullptr);
+}
+
+size_t try_evaluate_batch(const CompiledExpression& expr, const double* const* columns,
+                          size_t count, double* out, Status* status) {
+    return run_blocks(expr, columns, count, out, status);
+}
+
+void evaluate_batch(ast::Node* node, const std::vector<Column>& columns,
+                    size_t count, double* out) {
+    with_columns(node, columns, [&](const CompiledExpression& expr, const double* const* data) {
+        run_blocks(expr, data, count, out, nullptr);
+    });
+}
+
+size_t try_evaluate_batch(ast::Node* node, const std::vector<Column>& columns,
+                          size_t count, double* out, Status* status) {
+    return with_columns(node, columns, [&](const CompiledExpression& expr, const double* const* data) {
+        return run_blocks(expr, data, count, out, status);
+    });
+}
+
+std::vector<double> evaluate_batch(ast::Node* node, const std::vector<Column>& columns,
+                                   size_t count) {
+    std::vector<double> out(count);
+    evaluate_batch(node, columns, count, out.data());
+    return out;
+}
+
+} // namespace core
+} // namespace numu
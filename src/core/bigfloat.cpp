@@ -0,0 +1,978 @@
+#include "numu/core/bigfloat.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+namespace {
+// Scratch limbs for one operation, on the stack at inline precisions
+class Scratch {
+public:
+    explicit Scratch(size_t count) : size_(count) {
+        if (count > sizeof(local_) / sizeof(local_[0])) {
+            heap_.assign(count, 0);
+        } else {
+            std::fill(local_, local_ + count, 0);
+        }
+    }
+
+    uint64_t* data() { return heap_.empty() ? local_ : heap_.data(); }
+    size_t size() const { return size_; }
+
+private:
+    size_t size_;
+    uint64_t local_[2 * BigFloat::inline_limbs + 4];
+    std::vector<uint64_t> heap_;
+};
+
+// Bits in x, which is not zero
+size_t significant_bits(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 64 - static_cast<size_t>(__builtin_clzll(x));
+#else
+    size_t bits = 0;
+    for (; x; x >>= 1) {
+        ++bits;
+    }
+    return bits;
+#endif
+}
+
+size_t bit_length(const uint64_t* v, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        if (v[i]) {
+            return i * 64 + significant_bits(v[i]);
+        }
+    }
+    return 0;
+}
+
+bool bit_at(const uint64_t* v, size_t n, int64_t bit) {
+    if (bit < 0) return false;
+    auto limb = static_cast<size_t>(bit / 64);
+    return limb < n && ((v[limb] >> (bit % 64)) & 1);
+}
+
+// Bits [pos, pos + 64) of v; bits outside v are zero
+uint64_t bits_at(const uint64_t* v, size_t n, int64_t pos) {
+    if (pos <= -64) return 0;
+    if (pos < 0) {
+        return n ? v[0] << (-pos) : 0;
+    }
+    auto limb = static_cast<size_t>(pos / 64);
+    unsigned offset = static_cast<unsigned>(pos % 64);
+    uint64_t low = limb < n ? v[limb] >> offset : 0;
+    uint64_t high = offset && limb + 1 < n ? v[limb + 1] << (64 - offset) : 0;
+    return low | high;
+}
+
+int compare_limbs(const uint64_t* a, const uint64_t* b, size_t n) {
+    for (size_t i = n; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// a * b + c + d, which always fits in 128 bits; returns the low half
+uint64_t multiply_add(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint64_t& high) {
+#ifdef __SIZEOF_INT128__
+    __extension__ using uint128 = unsigned __int128;
+    uint128 sum = static_cast<uint128>(a) * b + c + d;
+    high = static_cast<uint64_t>(sum >> 64);
+    return static_cast<uint64_t>(sum);
+#else
+    // Schoolbook on 32-bit halves
+    uint64_t a_low = a & 0xffffffffu, a_high = a >> 32;
+    uint64_t b_low = b & 0xffffffffu, b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t middle = (low_low >> 32) + (high_low & 0xffffffffu) + (low_high & 0xffffffffu);
+    uint64_t low = (middle << 32) | (low_low & 0xffffffffu);
+    high = a_high * b_high + (high_low >> 32) + (low_high >> 32) + (middle >> 32);
+    low += c;
+    high += low < c;
+    low += d;
+    high += low < d;
+    return low;
+#endif
+}
+
+void add_limbs(uint64_t* a, const uint64_t* b, size_t n) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t sum = a[i] + b[i];
+        uint64_t overflow = sum < a[i];
+        a[i] = sum + carry;
+        carry = overflow | (a[i] < sum);
+    }
+}
+
+// a -= b, a >= b
+void subtract_limbs(uint64_t* a, const uint64_t* b, size_t n) {
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t next = a[i] < b[i] || (a[i] == b[i] && borrow) ? 1 : 0;
+        a[i] = a[i] - b[i] - borrow;
+        borrow = next;
+    }
+}
+
+void shift_left_one(uint64_t* v, size_t n) {
+    for (size_t i = n; i-- > 1;) {
+        v[i] = (v[i] << 1) | (v[i - 1] >> 63);
+    }
+    v[0] <<= 1;
+}
+
+int64_t clamp_exponent(int64_t e) {
+    constexpr int64_t limit = std::numeric_limits<int64_t>::max() / 4;
+    return std::max(-limit, std::min(limit, e));
+}
+} // namespace
+
+// Arithmetic on the representation. Each operation forms its result as an
+// exact integer times a power of two where it can and rounds it once.
+class BigFloatOps {
+public:
+    using Kind = BigFloat::Kind;
+
+    static BigFloat special(Kind kind, bool negative, size_t limbs) {
+        return BigFloat(kind, negative, limbs);
+    }
+
+    // integer * 2^scale, rounded to nearest at `limbs`
+    static BigFloat make(bool negative, const uint64_t* integer, size_t length, int64_t scale, size_t limbs) {
+        size_t bits = bit_length(integer, length);
+        if (!bits) {
+            return special(Kind::ZERO, false, limbs);
+        }
+        BigFloat out(Kind::FINITE, negative, limbs);
+        int64_t width = static_cast<int64_t>(64 * limbs);
+        int64_t shift = static_cast<int64_t>(bits) - width;
+        for (size_t i = 0; i < limbs; ++i) {
+            out.mantissa_[i] = bits_at(integer, length, shift + static_cast<int64_t>(64 * i));
+        }
+        out.exponent_ = clamp_exponent(static_cast<int64_t>(bits) + scale);
+        if (shift > 0 && bit_at(integer, length, shift - 1)) {
+            size_t i = 0;
+            while (i < limbs && ++out.mantissa_[i] == 0) {
+                ++i;
+            }
+            if (i == limbs) {
+                out.mantissa_[limbs - 1] = uint64_t(1) << 63;
+                ++out.exponent_;
+            }
+        }
+        return out;
+    }
+
+    // v's mantissa, extended to `limbs`, shifted left by `shift` bits and
+    // or-ed into out
+    static void load(const BigFloat& v, size_t limbs, uint64_t* out, size_t length, size_t shift = 0) {
+        size_t base = shift + 64 * (limbs - v.limbs());
+        for (size_t j = 0; j < v.limbs(); ++j) {
+            size_t bit = base + 64 * j;
+            size_t index = bit / 64;
+            unsigned offset = static_cast<unsigned>(bit % 64);
+            if (index < length) {
+                out[index] |= v.mantissa_[j] << offset;
+            }
+            if (offset && index + 1 < length) {
+                out[index + 1] |= v.mantissa_[j] >> (64 - offset);
+            }
+        }
+    }
+
+    static BigFloat add(const BigFloat& a, const BigFloat& b, bool b_negative) {
+        size_t limbs = std::max(a.limbs(), b.limbs());
+        if (a.is_nan() || b.is_nan()) {
+            return BigFloat::nan(limbs);
+        }
+        if (a.is_inf() || b.is_inf()) {
+            if (a.is_inf() && b.is_inf() && a.negative_ != b_negative) {
+                return BigFloat::nan(limbs);
+            }
+            return BigFloat::infinity(a.is_inf() ? a.negative_ : b_negative, limbs);
+        }
+        if (b.is_zero()) {
+            return a.with_limbs(limbs);
+        }
+        if (a.is_zero()) {
+            BigFloat out = b.with_limbs(limbs);
+            out.negative_ = b_negative;
+            return out;
+        }
+
+        const BigFloat* x = &a;
+        const BigFloat* y = &b;
+        bool x_negative = a.negative_;
+        bool y_negative = b_negative;
+        if (a.exponent_ < b.exponent_) {
+            std::swap(x, y);
+            std::swap(x_negative, y_negative);
+        }
+        uint64_t gap = static_cast<uint64_t>(x->exponent_) - static_cast<uint64_t>(y->exponent_);
+        if (gap > 64 * limbs + 64) {
+            BigFloat out = x->with_limbs(limbs);
+            out.negative_ = x_negative;
+            return out;
+        }
+
+        size_t length = limbs + static_cast<size_t>(gap / 64) + 2;
+        Scratch first(length);
+        Scratch second(length);
+        load(*x, limbs, first.data(), length, static_cast<size_t>(gap));
+        load(*y, limbs, second.data(), length);
+        int64_t scale = y->exponent_ - static_cast<int64_t>(64 * limbs);
+        if (x_negative == y_negative) {
+            add_limbs(first.data(), second.data(), length);
+            return make(x_negative, first.data(), length, scale, limbs);
+        }
+        int order = compare_limbs(first.data(), second.data(), length);
+        if (order == 0) {
+            return special(Kind::ZERO, false, limbs);
+        }
+        if (order > 0) {
+            subtract_limbs(first.data(), second.data(), length);
+            return make(x_negative, first.data(), length, scale, limbs);
+        }
+        subtract_limbs(second.data(), first.data(), length);
+        return make(y_negative, second.data(), length, scale, limbs);
+    }
+
+    static BigFloat multiply(const BigFloat& a, const BigFloat& b) {
+        size_t limbs = std::max(a.limbs(), b.limbs());
+        bool negative = a.negative_ != b.negative_;
+        if (a.is_nan() || b.is_nan()) {
+            return BigFloat::nan(limbs);
+        }
+        if (a.is_inf() || b.is_inf()) {
+            if (a.is_zero() || b.is_zero()) {
+                return BigFloat::nan(limbs);
+            }
+            return BigFloat::infinity(negative, limbs);
+        }
+        if (a.is_zero() || b.is_zero()) {
+            return special(Kind::ZERO, false, limbs);
+        }
+
+        size_t length = a.limbs() + b.limbs();
+        Scratch product(length);
+        uint64_t* p = product.data();
+        for (size_t i = 0; i < a.limbs(); ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < b.limbs(); ++j) {
+                p[i + j] = multiply_add(a.mantissa_[i], b.mantissa_[j], p[i + j], carry, carry);
+            }
+            p[i + b.limbs()] = carry;
+        }
+        int64_t scale = a.exponent_ + b.exponent_ - static_cast<int64_t>(64 * length);
+        return make(negative, p, length, scale, limbs);
+    }
+
+    // Restoring division, one quotient bit per step
+    static BigFloat divide(const BigFloat& a, const BigFloat& b) {
+        size_t limbs = std::max(a.limbs(), b.limbs());
+        bool negative = a.negative_ != b.negative_;
+        if (a.is_nan() || b.is_nan() || (a.is_inf() && b.is_inf()) || (a.is_zero() && b.is_zero())) {
+            return BigFloat::nan(limbs);
+        }
+        if (a.is_inf() || b.is_zero()) {
+            return BigFloat::infinity(negative, limbs);
+        }
+        if (a.is_zero() || b.is_inf()) {
+            return special(Kind::ZERO, false, limbs);
+        }
+
+        size_t length = limbs + 1;
+        Scratch remainder(length);
+        Scratch divisor(length);
+        Scratch quotient(length);
+        load(a, limbs, remainder.data(), length);
+        load(b, limbs, divisor.data(), length);
+        // The mantissas' ratio is in (1/2, 2), so the first bit is its units
+        size_t bits = 64 * limbs + 2;
+        for (size_t i = bits; i-- > 0;) {
+            if (compare_limbs(remainder.data(), divisor.data(), length) >= 0) {
+                subtract_limbs(remainder.data(), divisor.data(), length);
+                quotient.data()[i / 64] |= uint64_t(1) << (i % 64);
+            }
+            shift_left_one(remainder.data(), length);
+        }
+        int64_t scale = a.exponent_ - b.exponent_ - static_cast<int64_t>(bits - 1);
+        return make(negative, quotient.data(), length, scale, limbs);
+    }
+
+    static int compare_magnitude(const BigFloat& a, const BigFloat& b) {
+        if (a.exponent_ != b.exponent_) {
+            return a.exponent_ < b.exponent_ ? -1 : 1;
+        }
+        size_t limbs = std::max(a.limbs(), b.limbs());
+        Scratch x(limbs);
+        Scratch y(limbs);
+        load(a, limbs, x.data(), limbs);
+        load(b, limbs, y.data(), limbs);
+        return compare_limbs(x.data(), y.data(), limbs);
+    }
+
+    // -1, 0 or 1; NaN is handled by the callers
+    static int compare(const BigFloat& a, const BigFloat& b) {
+        auto sign = [](const BigFloat& v) { return v.is_zero() ? 0 : v.negative_ ? -1 : 1; };
+        int sa = sign(a);
+        int sb = sign(b);
+        if (sa != sb) {
+            return sa < sb ? -1 : 1;
+        }
+        if (sa == 0) {
+            return 0;
+        }
+        int magnitude;
+        if (a.is_inf() || b.is_inf()) {
+            magnitude = a.is_inf() == b.is_inf() ? 0 : a.is_inf() ? 1 : -1;
+        } else {
+            magnitude = compare_magnitude(a, b);
+        }
+        return sa < 0 ? -magnitude : magnitude;
+    }
+
+    static BigFloat truncate(const BigFloat& x) {
+        if (x.kind_ != Kind::FINITE || x.exponent_ >= static_cast<int64_t>(64 * x.limbs())) {
+            return x;
+        }
+        if (x.exponent_ <= 0) {
+            return special(Kind::ZERO, false, x.limbs());
+        }
+        BigFloat out = x;
+        auto fraction = static_cast<size_t>(static_cast<int64_t>(64 * x.limbs()) - x.exponent_);
+        for (size_t i = 0; i < fraction / 64; ++i) {
+            out.mantissa_[i] = 0;
+        }
+        if (fraction % 64) {
+            out.mantissa_[fraction / 64] &= ~uint64_t(0) << (fraction % 64);
+        }
+        return out;
+    }
+
+    static BigFloat scale(const BigFloat& x, int64_t exponent) {
+        BigFloat out = x;
+        if (out.kind_ == Kind::FINITE) {
+            out.exponent_ = clamp_exponent(out.exponent_ + exponent);
+        }
+        return out;
+    }
+
+    static int64_t exponent(const BigFloat& x) { return x.exponent_; }
+
+    // The mantissa as a value in [1/2, 1)
+    static BigFloat fraction(const BigFloat& x) {
+        BigFloat out = x;
+        out.negative_ = false;
+        out.exponent_ = 0;
+        return out;
+    }
+};
+
+size_t BigFloat::limbs_for(size_t digits) {
+    auto bits = static_cast<size_t>(std::ceil(static_cast<double>(digits) * 3.321928094887362));
+    return std::max<size_t>(1, (bits + 63) / 64) + 1;
+}
+
+BigFloat::Limbs::Limbs(size_t count) : size_(std::max<size_t>(count, 1)) {
+    if (size_ > inline_limbs) {
+        heap_.reset(new uint64_t[size_]());
+    } else {
+        std::fill(local_, local_ + inline_limbs, 0);
+    }
+}
+
+BigFloat::Limbs::Limbs(const Limbs& other) : size_(other.size_) {
+    if (other.heap_) {
+        heap_.reset(new uint64_t[size_]);
+    }
+    std::copy(other.data(), other.data() + size_, data());
+}
+
+BigFloat::Limbs& BigFloat::Limbs::operator=(const Limbs& other) {
+    if (this != &other) {
+        if (other.size_ > inline_limbs) {
+            if (!heap_ || size_ < other.size_) {
+                heap_.reset(new uint64_t[other.size_]);
+            }
+        } else {
+            heap_.reset();
+        }
+        size_ = other.size_;
+        std::copy(other.data(), other.data() + size_, data());
+    }
+    return *this;
+}
+
+BigFloat::Limbs::Limbs(Limbs&& other) noexcept : size_(other.size_), heap_(std::move(other.heap_)) {
+    if (!heap_) {
+        std::copy(other.local_, other.local_ + inline_limbs, local_);
+    }
+}
+
+BigFloat::Limbs& BigFloat::Limbs::operator=(Limbs&& other) noexcept {
+    size_ = other.size_;
+    heap_ = std::move(other.heap_);
+    if (!heap_) {
+        std::copy(other.local_, other.local_ + inline_limbs, local_);
+    }
+    return *this;
+}
+
+BigFloat::BigFloat(Kind kind, bool negative, size_t limbs)
+    : kind_(kind), negative_(negative), mantissa_(limbs) {}
+
+BigFloat::BigFloat(double value, size_t limbs) : mantissa_(limbs) {
+    if (std::isnan(value)) {
+        kind_ = Kind::NOT_A_NUMBER;
+    } else if (std::isinf(value)) {
+        kind_ = Kind::INFINITE;
+        negative_ = value < 0;
+    } else if (value != 0.0) {
+        int exponent;
+        double fraction = std::frexp(std::fabs(value), &exponent);
+        kind_ = Kind::FINITE;
+        negative_ = value < 0;
+        exponent_ = exponent;
+        mantissa_[mantissa_.size() - 1] = static_cast<uint64_t>(std::ldexp(fraction, 64));
+    }
+}
+
+BigFloat BigFloat::from_int(int64_t value, size_t limbs) {
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    return BigFloatOps::make(value < 0, &magnitude, 1, 0, limbs);
+}
+
+BigFloat BigFloat::infinity(bool negative, size_t limbs) {
+    return BigFloat(Kind::INFINITE, negative, limbs);
+}
+
+BigFloat BigFloat::nan(size_t limbs) {
+    return BigFloat(Kind::NOT_A_NUMBER, false, limbs);
+}
+
+BigFloat BigFloat::with_limbs(size_t limbs) const {
+    if (limbs == this->limbs()) {
+        return *this;
+    }
+    if (kind_ != Kind::FINITE) {
+        return BigFloat(kind_, negative_, limbs);
+    }
+    return BigFloatOps::make(negative_, mantissa_.data(), this->limbs(),
+                             exponent_ - static_cast<int64_t>(64 * this->limbs()), limbs);
+}
+
+bool BigFloat::is_integer() const {
+    return is_zero() || (kind_ == Kind::FINITE && trunc(*this) == *this);
+}
+
+double BigFloat::to_double() const {
+    switch(kind_) {
+        case Kind::ZERO: return 0.0;
+        case Kind::INFINITE: return negative_ ? -HUGE_VAL : HUGE_VAL;
+        case Kind::NOT_A_NUMBER: return std::numeric_limits<double>::quiet_NaN();
+        default: break;
+    }
+    BigFloat rounded = with_limbs(1);
+    if (rounded.kind_ != Kind::FINITE) {
+        return rounded.to_double();
+    }
+    int64_t exponent = std::max<int64_t>(-4000, std::min<int64_t>(4000, rounded.exponent_));
+    double value = std::ldexp(static_cast<double>(rounded.mantissa_[0]), static_cast<int>(exponent - 64));
+    return negative_ ? -value : value;
+}
+
+BigFloat BigFloat::operator-() const {
+    BigFloat out = *this;
+    if (!out.is_zero() && !out.is_nan()) {
+        out.negative_ = !out.negative_;
+    }
+    return out;
+}
+
+BigFloat operator+(const BigFloat& a, const BigFloat& b) {
+    return BigFloatOps::add(a, b, b.negative_);
+}
+
+BigFloat operator-(const BigFloat& a, const BigFloat& b) {
+    return BigFloatOps::add(a, b, b.is_zero() || b.is_nan() ? b.negative_ : !b.negative_);
+}
+
+BigFloat operator*(const BigFloat& a, const BigFloat& b) {
+    return BigFloatOps::multiply(a, b);
+}
+
+BigFloat operator/(const BigFloat& a, const BigFloat& b) {
+    return BigFloatOps::divide(a, b);
+}
+
+bool operator==(const BigFloat& a, const BigFloat& b) {
+    return !a.is_nan() && !b.is_nan() && BigFloatOps::compare(a, b) == 0;
+}
+
+bool operator!=(const BigFloat& a, const BigFloat& b) {
+    return !(a == b);
+}
+
+bool operator<(const BigFloat& a, const BigFloat& b) {
+    return !a.is_nan() && !b.is_nan() && BigFloatOps::compare(a, b) < 0;
+}
+
+bool operator<=(const BigFloat& a, const BigFloat& b) {
+    return !a.is_nan() && !b.is_nan() && BigFloatOps::compare(a, b) <= 0;
+}
+
+bool operator>(const BigFloat& a, const BigFloat& b) {
+    return b < a;
+}
+
+bool operator>=(const BigFloat& a, const BigFloat& b) {
+    return b <= a;
+}
+
+BigFloat abs(const BigFloat& x) {
+    return x.negative() ? -x : x;
+}
+
+BigFloat trunc(const BigFloat& x) {
+    return BigFloatOps::truncate(x);
+}
+
+BigFloat ldexp(const BigFloat& x, int64_t exponent) {
+    return BigFloatOps::scale(x, exponent);
+}
+
+namespace {
+BigFloat one(size_t limbs) {
+    return BigFloat(1.0, limbs);
+}
+
+// Stops a series once a term no longer changes the sum at `limbs`
+bool negligible(const BigFloat& term, const BigFloat& sum, size_t limbs) {
+    return term.is_zero() ||
+           BigFloatOps::exponent(term) < BigFloatOps::exponent(sum) - static_cast<int64_t>(64 * limbs) - 2;
+}
+
+// atanh(x) = x + x^3/3 + x^5/5 + ..., for small |x|
+BigFloat atanh_series(const BigFloat& x, size_t limbs) {
+    BigFloat square = x * x;
+    BigFloat power = x;
+    BigFloat sum = x;
+    for (int64_t k = 3;; k += 2) {
+        power = power * square;
+        BigFloat term = power / BigFloat::from_int(k, limbs);
+        sum = sum + term;
+        if (negligible(term, sum, limbs)) break;
+    }
+    return sum;
+}
+
+// atan(1/n) = 1/n - 1/(3n^3) + 1/(5n^5) - ...
+BigFloat atan_inverse(int64_t n, size_t limbs) {
+    BigFloat square = BigFloat::from_int(n * n, limbs);
+    BigFloat power = one(limbs) / BigFloat::from_int(n, limbs);
+    BigFloat sum = power;
+    for (int64_t k = 3;; k += 2) {
+        power = power / square;
+        BigFloat term = power / BigFloat::from_int(k, limbs);
+        sum = (k % 4 == 3) ? sum - term : sum + term;
+        if (negligible(term, sum, limbs)) break;
+    }
+    return sum;
+}
+
+template<typename Compute>
+BigFloat cached(std::unordered_map<size_t, BigFloat>& cache, size_t limbs, Compute compute) {
+    auto it = cache.find(limbs);
+    if (it == cache.end()) {
+        it = cache.emplace(limbs, compute(limbs + 1).with_limbs(limbs)).first;
+    }
+    return it->second;
+}
+
+// sin and cos of r, |r| <= pi, at `limbs`
+void sin_cos(const BigFloat& r, size_t limbs, BigFloat& s, BigFloat& c) {
+    // Halved eight times for the series, then doubled back
+    constexpr int halvings = 8;
+    BigFloat x = ldexp(r, -halvings);
+    BigFloat square = x * x;
+    BigFloat term = x;
+    s = x;
+    for (int64_t k = 2;; k += 2) {
+        term = -(term * square) / BigFloat::from_int(k * (k + 1), limbs);
+        s = s + term;
+        if (negligible(term, s, limbs)) break;
+    }
+    term = one(limbs);
+    c = term;
+    for (int64_t k = 1;; k += 2) {
+        term = -(term * square) / BigFloat::from_int(k * (k + 1), limbs);
+        c = c + term;
+        if (negligible(term, c, limbs)) break;
+    }
+    for (int i = 0; i < halvings; ++i) {
+        BigFloat doubled = ldexp(s * c, 1);
+        c = one(limbs) - ldexp(s * s, 1);
+        s = doubled;
+    }
+}
+
+// x reduced to [-pi, pi], with pi carried far enough for x's magnitude
+BigFloat reduce_angle(const BigFloat& x, size_t limbs) {
+    int64_t magnitude = std::max<int64_t>(0, BigFloatOps::exponent(x));
+    size_t working = limbs + static_cast<size_t>(magnitude / 64) + 1;
+    BigFloat wide = x.with_limbs(working);
+    BigFloat two_pi = ldexp(BigFloat::pi(working), 1);
+    BigFloat turns = trunc(wide / two_pi + BigFloat(x.negative() ? -0.5 : 0.5, working));
+    return (wide - turns * two_pi).with_limbs(limbs);
+}
+} // namespace
+
+BigFloat BigFloat::pi(size_t limbs) {
+    thread_local std::unordered_map<size_t, BigFloat> cache;
+    return cached(cache, limbs, [](size_t working) {
+        // Machin: pi/4 = 4 atan(1/5) - atan(1/239)
+        return ldexp(ldexp(atan_inverse(5, working), 2) - atan_inverse(239, working), 2);
+    });
+}
+
+BigFloat BigFloat::ln2(size_t limbs) {
+    thread_local std::unordered_map<size_t, BigFloat> cache;
+    return cached(cache, limbs, [](size_t working) {
+        // ln 2 = 2 atanh(1/3)
+        return ldexp(atanh_series(one(working) / BigFloat::from_int(3, working), working), 1);
+    });
+}
+
+BigFloat sqrt(const BigFloat& x) {
+    size_t limbs = x.limbs();
+    if (x.is_nan() || (x.negative() && !x.is_zero())) {
+        return BigFloat::nan(limbs);
+    }
+    if (x.is_zero() || x.is_inf()) {
+        return x;
+    }
+    // Newton from a double estimate of the mantissa's root; each step
+    // doubles the correct bits
+    size_t working = limbs + 1;
+    int64_t exponent = BigFloatOps::exponent(x);
+    int64_t half = exponent >= 0 ? exponent / 2 : -((1 - exponent) / 2);
+    BigFloat scaled = ldexp(x.with_limbs(working), -2 * half);
+    BigFloat root(std::sqrt(scaled.to_double()), working);
+    for (size_t correct = 50; correct < 128 * working; correct *= 2) {
+        root = ldexp(root + scaled / root, -1);
+    }
+    root = ldexp(root + scaled / root, -1);
+    return ldexp(root, half).with_limbs(limbs);
+}
+
+BigFloat exp(const BigFloat& x) {
+    size_t limbs = x.limbs();
+    if (x.is_nan()) {
+        return x;
+    }
+    if (x.is_inf()) {
+        return x.negative() ? BigFloat(0.0, limbs) : x;
+    }
+    if (x.is_zero()) {
+        return one(limbs);
+    }
+    if (BigFloatOps::exponent(x) > 40) {
+        return x.negative() ? BigFloat(0.0, limbs) : BigFloat::infinity(false, limbs);
+    }
+    // x = k ln 2 + r with |r| <= ln 2 / 2, and exp(r) from its series at r / 256
+    size_t working = limbs + 1;
+    BigFloat wide = x.with_limbs(working);
+    BigFloat ln2 = BigFloat::ln2(working);
+    double k = std::nearbyint(x.to_double() / 0.6931471805599453);
+    BigFloat r = wide - BigFloat(k, working) * ln2;
+    constexpr int halvings = 8;
+    r = ldexp(r, -halvings);
+    BigFloat term = one(working);
+    BigFloat sum = term;
+    for (int64_t i = 1;; ++i) {
+        term = term * r / BigFloat::from_int(i, working);
+        sum = sum + term;
+        if (negligible(term, sum, working)) break;
+    }
+    for (int i = 0; i < halvings; ++i) {
+        sum = sum * sum;
+    }
+    return ldexp(sum, static_cast<int64_t>(k)).with_limbs(limbs);
+}
+
+BigFloat log(const BigFloat& x) {
+    size_t limbs = x.limbs();
+    if (x.is_nan() || (x.negative() && !x.is_zero())) {
+        return BigFloat::nan(limbs);
+    }
+    if (x.is_zero()) {
+        return BigFloat::infinity(true, limbs);
+    }
+    if (x.is_inf()) {
+        return x;
+    }
+    // x = f 2^e with f in [sqrt(1/2), sqrt(2)), log f = 2 atanh((f-1)/(f+1))
+    size_t working = limbs + 1;
+    BigFloat f = BigFloatOps::fraction(x).with_limbs(working);
+    int64_t e = BigFloatOps::exponent(x);
+    if (f.to_double() < 0.7071067811865476) {
+        f = ldexp(f, 1);
+        --e;
+    }
+    BigFloat t = (f - one(working)) / (f + one(working));
+    BigFloat result = ldexp(atanh_series(t, working), 1);
+    if (e != 0) {
+        result = result + BigFloat(static_cast<double>(e), working) * BigFloat::ln2(working);
+    }
+    return result.with_limbs(limbs);
+}
+
+BigFloat pow(const BigFloat& x, const BigFloat& y) {
+    size_t limbs = std::max(x.limbs(), y.limbs());
+    if (y.is_zero()) {
+        return one(limbs);
+    }
+    if (!x.is_finite() || !y.is_finite() || x.is_zero()) {
+        return BigFloat(std::pow(x.to_double(), y.to_double()), limbs);
+    }
+    if (y.is_integer() && abs(y) < BigFloat(9.2e18, 1)) {
+        // Square and multiply
+        auto n = static_cast<int64_t>(y.to_double());
+        uint64_t bits = n < 0 ? 0 - static_cast<uint64_t>(n) : static_cast<uint64_t>(n);
+        size_t working = limbs + 1;
+        BigFloat base = x.with_limbs(working);
+        BigFloat result = one(working);
+        while (bits) {
+            if (bits & 1) result = result * base;
+            bits >>= 1;
+            if (bits) base = base * base;
+        }
+        if (n < 0) result = one(working) / result;
+        return result.with_limbs(limbs);
+    }
+    if (x.negative()) {
+        return BigFloat::nan(limbs);
+    }
+    size_t working = limbs + 1;
+    BigFloat product = y.with_limbs(working) * log(x.with_limbs(working));
+    return exp(product).with_limbs(limbs);
+}
+
+BigFloat fmod(const BigFloat& x, const BigFloat& y) {
+    size_t limbs = std::max(x.limbs(), y.limbs());
+    if (x.is_nan() || y.is_nan() || x.is_inf() || y.is_zero()) {
+        return BigFloat::nan(limbs);
+    }
+    if (y.is_inf() || x.is_zero()) {
+        return x.with_limbs(limbs);
+    }
+    // The quotient's integer part needs as many bits as the exponents differ by
+    int64_t gap = std::max<int64_t>(0, BigFloatOps::exponent(x) - BigFloatOps::exponent(y));
+    size_t working = limbs + static_cast<size_t>(gap / 64) + 1;
+    BigFloat a = x.with_limbs(working);
+    BigFloat b = y.with_limbs(working);
+    return (a - trunc(a / b) * b).with_limbs(limbs);
+}
+
+BigFloat sin(const BigFloat& x) {
+    size_t limbs = x.limbs();
+    if (!x.is_finite()) {
+        return BigFloat::nan(limbs);
+    }
+    if (x.is_zero()) {
+        return x;
+    }
+    size_t working = limbs + 1;
+    BigFloat s, c;
+    sin_cos(reduce_angle(x, working), working, s, c);
+    return s.with_limbs(limbs);
+}
+
+BigFloat cos(const BigFloat& x) {
+    size_t limbs = x.limbs();
+    if (!x.is_finite()) {
+        return BigFloat::nan(limbs);
+    }
+    if (x.is_zero()) {
+        return one(limbs);
+    }
+    size_t working = limbs + 1;
+    BigFloat s, c;
+    sin_cos(reduce_angle(x, working), working, s, c);
+    return c.with_limbs(limbs);
+}
+
+BigFloat tan(const BigFloat& x) {
+    size_t limbs = x.limbs();
+    if (!x.is_finite()) {
+        return BigFloat::nan(limbs);
+    }
+    if (x.is_zero()) {
+        return x;
+    }
+    size_t working = limbs + 1;
+    BigFloat s, c;
+    sin_cos(reduce_angle(x, working), working, s, c);
+    return (s / c).with_limbs(limbs);
+}
+
+BigFloat BigFloat::parse(std::string_view text, size_t limbs) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos++] == '-';
+    }
+    if (text.substr(pos) == "inf") {
+        return infinity(negative, limbs);
+    }
+    if (text.substr(pos) == "nan") {
+        return nan(limbs);
+    }
+
+    // The digits are gathered exactly, 19 at a time, then scaled once
+    size_t working = limbs + 1;
+    BigFloat mantissa(0.0, working);
+    BigFloat chunk_scale = from_int(10000000000000000000ull / 10, working) * from_int(10, working);
+    int64_t exponent10 = 0;
+    uint64_t chunk = 0;
+    int chunk_digits = 0;
+    bool digits = false;
+    bool point = false;
+    auto flush = [&] {
+        if (chunk_digits) {
+            BigFloat scale = chunk_digits == 19 ? chunk_scale : pow(BigFloat(10.0, working), BigFloat(chunk_digits, 1));
+            BigFloat part = BigFloatOps::make(false, &chunk, 1, 0, working);
+            mantissa = mantissa * scale + part;
+            chunk = 0;
+            chunk_digits = 0;
+        }
+    };
+    for (; pos < text.size(); ++pos) {
+        char c = text[pos];
+        if (c >= '0' && c <= '9') {
+            digits = true;
+            chunk = chunk * 10 + static_cast<uint64_t>(c - '0');
+            if (++chunk_digits == 19) flush();
+            if (point) --exponent10;
+        } else if (c == '.' && !point) {
+            point = true;
+        } else {
+            break;
+        }
+    }
+    flush();
+    if (!digits) {
+        throw std::invalid_argument("Not a number: " + std::string(text));
+    }
+    if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+        int64_t value = 0;
+        auto result = std::from_chars(text.data() + pos + 1 + (pos + 1 < text.size() && text[pos + 1] == '+'),
+                                      text.data() + text.size(), value);
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+            throw std::invalid_argument("Not a number: " + std::string(text));
+        }
+        exponent10 += value;
+    } else if (pos != text.size()) {
+        throw std::invalid_argument("Not a number: " + std::string(text));
+    }
+
+    if (exponent10 != 0) {
+        BigFloat scale = pow(BigFloat(10.0, working), from_int(exponent10 < 0 ? -exponent10 : exponent10, working));
+        mantissa = exponent10 < 0 ? mantissa / scale : mantissa * scale;
+    }
+    BigFloat out = mantissa.with_limbs(limbs);
+    return negative ? -out : out;
+}
+
+BigFloat BigFloat::from_literal(double value, size_t limbs) {
+    if (!std::isfinite(value) || value == 0.0) {
+        return BigFloat(value, limbs);
+    }
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return parse(std::string_view(buffer, static_cast<size_t>(result.ptr - buffer)), limbs);
+}
+
+std::string BigFloat::to_string(size_t digits) const {
+    if (is_nan()) return "nan";
+    if (is_inf()) return negative_ ? "-inf" : "inf";
+    if (is_zero()) return "0";
+    digits = std::max<size_t>(digits, 1);
+
+    // Scale into [1, 10), then take one digit at a time
+    size_t working = std::max(limbs(), limbs_for(digits)) + 1;
+    BigFloat value = abs(*this).with_limbs(working);
+    auto exponent10 = static_cast<int64_t>(std::floor(static_cast<double>(exponent_ - 1) * 0.30102999566398120));
+    BigFloat ten(10.0, working);
+    BigFloat power = pow(ten, from_int(exponent10 < 0 ? -exponent10 : exponent10, working));
+    value = exponent10 < 0 ? value * power : value / power;
+    while (value >= ten) {
+        value = value / ten;
+        ++exponent10;
+    }
+    while (value < BigFloat(1.0, working)) {
+        value = value * ten;
+        --exponent10;
+    }
+
+    std::string mantissa;
+    for (size_t i = 0; i < digits; ++i) {
+        BigFloat digit = trunc(value);
+        int d = std::min(9, std::max(0, static_cast<int>(digit.to_double())));
+        mantissa += static_cast<char>('0' + d);
+        value = (value - BigFloat(d, working)) * ten;
+    }
+    if (value >= BigFloat(5.0, working)) {
+        size_t i = mantissa.size();
+        while (i > 0 && mantissa[i - 1] == '9') {
+            mantissa[--i] = '0';
+        }
+        if (i == 0) {
+            mantissa.insert(mantissa.begin(), '1');
+            mantissa.pop_back();
+            ++exponent10;
+        } else {
+            ++mantissa[i - 1];
+        }
+    }
+
+    std::string out = negative_ ? "-" : "";
+    auto trim = [](std::string& text) {
+        if (text.find('.') != std::string::npos) {
+            text.erase(text.find_last_not_of('0') + 1);
+            if (text.back() == '.') text.pop_back();
+        }
+    };
+    if (exponent10 < -4 || exponent10 >= static_cast<int64_t>(digits)) {
+        std::string body = mantissa.substr(0, 1) + "." + mantissa.substr(1);
+        trim(body);
+        std::string exponent = std::to_string(exponent10 < 0 ? -exponent10 : exponent10);
+        if (exponent.size() < 2) exponent.insert(exponent.begin(), '0');
+        out += body + (exponent10 < 0 ? "e-" : "e+") + exponent;
+    } else if (exponent10 < 0) {
+        std::string body = "0." + std::string(static_cast<size_t>(-exponent10 - 1), '0') + mantissa;
+        trim(body);
+        out += body;
+    } else {
+        auto whole = static_cast<size_t>(exponent10 + 1);
+        std::string body = mantissa.substr(0, whole) + "." + mantissa.substr(whole);
+        trim(body);
+        out += body;
+    }
+    return out;
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,97 @@
+#include "numu/core/budget.h"
+#include <algorithm>
+#include <limits>
+
+namespace numu {
+namespace core {
+
+namespace {
+thread_local BudgetScope* active_scope = nullptr;
+
+std::string format_limit(double value) {
+    std::string text = std::to_string(value);
+    text.erase(text.find_last_not_of('0') + 1);
+    if (text.back() == '.') {
+        text.pop_back();
+    }
+    return text;
+}
+} // namespace
+
+Budget Budget::from(const config::Config& config) {
+    Budget budget;
+    budget.max_steps = static_cast<size_t>(
+        config.get_number("core.max_steps", static_cast<double>(budget.max_steps)));
+    budget.timeout = config.get_number("core.timeout", budget.timeout);
+    return budget;
+}
+
+BudgetScope::BudgetScope(const Budget& budget)
+    : limits_(std::make_shared<Limits>()), previous_(active_scope), active_(true) {
+    using clock = std::chrono::steady_clock;
+    limits_->budget = budget;
+    limits_->deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                           std::chrono::duration<double, std::milli>(budget.timeout));
+    if (budget.max_steps) {
+        threshold_ = std::min(quantum, budget.max_steps + 1);
+    } else if (budget.timeout <= 0) {
+        threshold_ = std::numeric_limits<size_t>::max();
+    }
+    active_scope = this;
+}
+
+BudgetScope::BudgetScope(BudgetScope* shared) {
+    if (!shared) {
+        return;
+    }
+    limits_ = shared->limits_;
+    threshold_ = shared->threshold_ == std::numeric_limits<size_t>::max()
+                     ? shared->threshold_ : quantum;
+    // Sharing scopes add their last block without a check when they end,
+    // and a scope per small task may never fill a block, so the limits
+    // are checked before taking on more work. Nothing is registered yet
+    // if this throws.
+    settle();
+    previous_ = active_scope;
+    active_ = true;
+    active_scope = this;
+}
+
+BudgetScope::~BudgetScope() {
+    if (!active_) {
+        return;
+    }
+    limits_->steps.fetch_add(pending_, std::memory_order_relaxed);
+    active_scope = previous_;
+}
+
+BudgetScope* BudgetScope::current() {
+    return active_scope;
+}
+
+size_t BudgetScope::steps() const {
+    return limits_ ? limits_->steps.load(std::memory_order_relaxed) + pending_ : 0;
+}
+
+void BudgetScope::settle() {
+    const Budget& budget = limits_->budget;
+    size_t total = limits_->steps.fetch_add(pending_, std::memory_order_relaxed) + pending_;
+    pending_ = 0;
+    if (budget.max_steps) {
+        if (total > budget.max_steps) {
+            threshold_ = 1;
+            throw BudgetExceeded(BudgetExceeded::Limit::STEPS,
+                                 "Step limit of " + std::to_string(budget.max_steps) + " exceeded");
+        }
+        // Exact on a single thread: the next block ends at the limit
+        threshold_ = std::min(quantum, budget.max_steps - total + 1);
+    }
+    if (budget.timeout > 0 && std::chrono::steady_clock::now() >= limits_->deadline) {
+        threshold_ = 1;
+        throw BudgetExceeded(BudgetExceeded::Limit::TIME,
+                             "Time limit of " + format_limit(budget.timeout) + " ms exceeded");
+    }
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,254 @@
+#include "numu/core/cache.h"
+#include "numu/core/ast.h"
+#include "numu/core/cse.h"
+#include "numu/core/eval.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace numu {
+namespace core {
+
+namespace {
+template<typename T>
+void append(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+void append_name(std::string& out, const std::string& name) {
+    append(out, static_cast<uint32_t>(name.size()));
+    out += name;
+}
+
+// Serializes the expression into an exact, self-delimiting key and collects
+// the variables it reads. A node met again is written as a reference to its
+// first occurrence, so shared subtrees are encoded once.
+class Encoder {
+public:
+    Encoder(std::string& out, std::vector<std::string>& variables)
+        : out_(out), variables_(variables) {}
+
+    // False for node kinds that are not cached
+    bool encode(ast::Node* node) {
+        if (!node) return false;
+
+        auto seen = seen_.emplace(node, static_cast<uint32_t>(seen_.size()));
+        if (!seen.second) {
+            out_ += reference;
+            append(out_, seen.first->second);
+            return true;
+        }
+
+        out_ += static_cast<char>(node->type);
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+                append(out_, static_cast<ast::NumberNode*>(node)->value);
+                return true;
+            case ast::NodeType::VARIABLE: {
+                const auto& name = static_cast<ast::VariableNode*>(node)->name;
+                append_name(out_, name);
+                if (std::find(variables_.begin(), variables_.end(), name) == variables_.end()) {
+                    variables_.push_back(name);
+                }
+                return true;
+            }
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                out_ += static_cast<char>(bin->op);
+                return encode(bin->left) && encode(bin->right);
+            }
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                out_ += static_cast<char>(un->op);
+                return encode(un->operand);
+            }
+            case ast::NodeType::FUNCTION: {
+                auto* fn = static_cast<ast::FunctionNode*>(node);
+                append_name(out_, fn->name);
+                append(out_, static_cast<uint32_t>(fn->args.size()));
+                for (auto* arg : fn->args) {
+                    if (!encode(arg)) return false;
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+private:
+    // Not a NodeType value
+    static constexpr char reference = 0x7f;
+
+    std::string& out_;
+    std::vector<std::string>& variables_;
+    std::unordered_map<ast::Node*, uint32_t> seen_;
+};
+
+size_t mix(size_t h, uint64_t bits) {
+    return h ^ (static_cast<size_t>(bits) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+}
+
+size_t mix(size_t h, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return mix(h, bits);
+}
+
+} // namespace
+
+bool EvalCache::Key::operator==(const Key& other) const {
+    return hash == other.hash &&
+           registry == other.registry &&
+           values.size() == other.values.size() &&
+           std::memcmp(values.data(), other.values.data(), values.size() * sizeof(double)) == 0 &&
+           (shape == other.shape || shape->expression == other.shape->expression);
+}
+
+EvalCache::EvalCache(size_t capacity_bytes) : capacity_(capacity_bytes) {}
+
+size_t EvalCache::capacity_from(const config::Config& config) {
+    return config.get_size("core.cache_size", default_capacity);
+}
+
+double EvalCache::evaluate(ast::Node* node) {
+    return evaluate(node, default_frame());
+}
+
+double EvalCache::evaluate(ast::Node* node, const Frame& frame) {
+    if (capacity_ == 0 || !node) {
+        return core::evaluate_dag(node, frame);
+    }
+    size_t node_hash = ast::hash(node);
+
+    Key key;
+    ShapePtr found;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        found = shape(node, node_hash);
+        if (found->cacheable) {
+            probe_.shape = found;
+            probe_.registry = &frame.registry();
+            probe_.hash = mix(node_hash, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(probe_.registry)));
+            probe_.values.clear();
+            for (const auto& name : found->variables) {
+                probe_.values.push_back(frame.get(name));
+                probe_.hash = mix(probe_.hash, probe_.values.back());
+            }
+            auto it = index_.find(&probe_);
+            if (it != index_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                ++stats_.hits;
+                probe_.shape.reset();
+                return it->second->result;
+            }
+            ++stats_.misses;
+            key = probe_;
+            probe_.shape.reset();
+        }
+    }
+    double result = core::evaluate_dag(node, frame, found->shared);
+    if (key.shape) {
+        insert(std::move(key), result, frame.shared_registry());
+    }
+    return result;
+}
+
+EvalCache::ShapePtr EvalCache::shape(ast::Node* node, size_t hash) {
+    auto it = shapes_.find(node);
+    if (it != shapes_.end() && it->second->hash == hash) {
+        return it->second;
+    }
+
+    auto built = std::make_shared<Shape>();
+    built->hash = hash;
+    built->cacheable = Encoder(built->expression, built->variables).encode(node);
+    built->shared = ast::shared_nodes(node);
+    size_t shared_bytes = built->shared.size() * 4 * sizeof(void*);
+    built->bytes = sizeof(Shape) + built->expression.capacity() + shared_bytes +
+                   4 * sizeof(void*); // map node and control block
+    for (const auto& name : built->variables) {
+        built->bytes += sizeof(std::string) + name.capacity();
+    }
+    if (!built->cacheable || built->bytes > capacity_) {
+        // Kept so the node is not encoded again, but without its encoding
+        built->cacheable = false;
+        built->expression = std::string();
+        built->bytes = sizeof(Shape) + shared_bytes + 4 * sizeof(void*);
+    }
+
+    if (it != shapes_.end()) {
+        bytes_ -= it->second->bytes;
+        it->second = built;
+    } else {
+        shapes_.emplace(node, built);
+    }
+    bytes_ += built->bytes;
+    // Shapes outlive their entries until pruned
+    if (shapes_.size() > 2 * lru_.size() + 64) {
+        prune_shapes();
+    }
+    return built;
+}
+
+void EvalCache::prune_shapes() {
+    for (auto it = shapes_.begin(); it != shapes_.end();) {
+        if (it->second.use_count() == 1) {
+            bytes_ -= it->second->bytes;
+            it = shapes_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void EvalCache::insert(Key key, double result, const RegistryPtr& registry) {
+    size_t bytes = sizeof(Entry) + key.values.capacity() * sizeof(double) +
+                   4 * sizeof(void*); // list and index node overhead
+    if (bytes > capacity_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.count(&key)) {
+        return;
+    }
+
+    bool evicted = false;
+    while (bytes_ + bytes > capacity_ && !lru_.empty()) {
+        Entry& victim = lru_.back();
+        index_.erase(&victim.key);
+        bytes_ -= victim.bytes;
+        lru_.pop_back();
+        ++stats_.evictions;
+        evicted = true;
+    }
+    if (evicted) {
+        prune_shapes();
+    }
+
+    lru_.push_front(Entry{std::move(key), result, bytes, registry});
+    index_[&lru_.front().key] = lru_.begin();
+    bytes_ += bytes;
+}
+
+void EvalCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    lru_.clear();
+    shapes_.clear();
+    bytes_ = 0;
+}
+
+CacheStats EvalCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheStats stats = stats_;
+    stats.entries = lru_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,672 @@
+#include "numu/core/compile.h"
+#include "numu/core/arena.h"
+#include "numu/core/ast.h"
+#include "numu/core/budget.h"
+#include "numu/core/cse.h"
+#include "numu/core/eval.h"
+#include "numu/core/stats.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace numu {
+namespace core {
+
+namespace {
+// Per-thread scratch buffers, one per nesting level, so a registered
+// function may itself evaluate a compiled expression.
+thread_local std::deque<std::vector<double>> scratch_buffers;
+thread_local size_t scratch_depth = 0;
+
+struct Scratch {
+    std::vector<double>& buffer;
+
+    explicit Scratch(size_t size) : buffer(acquire()) {
+        if (buffer.size() < size) {
+            buffer.resize(size);
+        }
+    }
+    ~Scratch() { --scratch_depth; }
+
+    static std::vector<double>& acquire() {
+        if (scratch_depth == scratch_buffers.size()) {
+            scratch_buffers.emplace_back();
+        }
+        return scratch_buffers[scratch_depth++];
+    }
+};
+
+class Compiler {
+public:
+    Compiler(CompiledExpression& out, const Frame& frame, bool collect_variables)
+        : out_(out), frame_(frame), collect_variables_(collect_variables) {
+        out_.registry = frame.shared_registry();
+        for (size_t i = 0; i < out_.variables.size(); ++i) {
+            slots_[out_.variables[i]] = static_cast<uint32_t>(i);
+        }
+    }
+
+    void compile(ast::Node* node) {
+        shared_ = ast::shared_nodes(node);
+        out_.result = emit_value(node, 0);
+        assign_shared_registers();
+    }
+
+    // Variables take registers 0..n-1 and the result register n, so
+    // temporaries start above them
+    void compile_program(ast::Node* program) {
+        program_ = true;
+        declare_variables(program);
+        bind_constants();
+        out_.result = static_cast<uint32_t>(out_.variables.size());
+        temporaries_ = out_.result + 1;
+        out_.registers = temporaries_;
+        emit(OpCode::CONST, out_.result, constant(std::numeric_limits<double>::quiet_NaN()));
+        emit_statement(program);
+        for (size_t jump : returns_) {
+            patch(jump);
+        }
+        assign_shared_registers();
+    }
+
+private:
+    // Registers holding shared subexpressions are numbered in their own
+    // space while compiling and moved above the temporaries afterwards
+    static constexpr uint32_t shared_bit = 0x80000000u;
+
+    CompiledExpression& out_;
+    const Frame& frame_;
+    bool collect_variables_;
+    std::unordered_map<ast::Node*, size_t> shared_;
+    std::unordered_map<ast::Node*, uint32_t> computed_;
+    uint32_t shared_registers_ = 0;
+    std::unordered_map<std::string, uint32_t> slots_;
+    std::unordered_set<std::string> assigned_;
+    std::unordered_map<double, uint32_t> constant_index_;
+    std::unordered_map<const Callable*, uint32_t> function_index_;
+    bool program_ = false;
+    uint32_t temporaries_ = 0;
+    std::vector<size_t> returns_;
+
+    void emit(OpCode code, uint32_t dst, uint32_t a = 0, uint32_t b = 0,
+              uint8_t op = 0, uint16_t argc = 0) {
+        out_.code.push_back(Instruction{code, op, argc, dst, a, b});
+        if (!(dst & shared_bit)) {
+            out_.registers = std::max(out_.registers, dst + 1);
+        }
+    }
+
+    void assign_shared_registers() {
+        uint32_t base = out_.registers;
+        auto fix = [base](uint32_t& reg) {
+            if (reg & shared_bit) {
+                reg = base + (reg & ~shared_bit);
+            }
+        };
+        for (auto& ins : out_.code) {
+            fix(ins.dst);
+            if (ins.code != OpCode::CONST && ins.code != OpCode::LOAD && ins.code != OpCode::JUMP) {
+                fix(ins.a);
+            }
+            if (ins.code >= OpCode::ADD && ins.code <= OpCode::BINARY) {
+                fix(ins.b);
+            }
+        }
+        fix(out_.result);
+        out_.registers += shared_registers_;
+    }
+
+    // Returns the register holding the value of `node`, computing it into
+    // `dst` unless it is a shared node that was already evaluated
+    uint32_t emit_value(ast::Node* node, uint32_t dst) {
+        auto done = computed_.find(node);
+        if (done != computed_.end()) {
+            return done->second;
+        }
+        uint32_t reg = emit_node(node, dst);
+        if (shared_.count(node)) {
+            uint32_t saved = shared_bit | shared_registers_++;
+            emit(OpCode::MOVE, saved, reg);
+            computed_[node] = saved;
+        }
+        return reg;
+    }
+
+    uint32_t constant(double value) {
+        // NaN never compares equal to itself, so it always gets a fresh entry
+        if (value == value) {
+            auto it = constant_index_.find(value);
+            if (it != constant_index_.end()) {
+                return it->second;
+            }
+        }
+        auto index = static_cast<uint32_t>(out_.constants.size());
+        out_.constants.push_back(value);
+        if (value == value) {
+            constant_index_[value] = index;
+        }
+        return index;
+    }
+
+    uint32_t emit_variable(const std::string& name, uint32_t dst) {
+        auto it = slots_.find(name);
+        if (it != slots_.end()) {
+            // In a program the variable's own register holds its value
+            if (program_) {
+                return it->second;
+            }
+            emit(OpCode::LOAD, dst, it->second);
+            return dst;
+        }
+        if (collect_variables_) {
+            auto slot = static_cast<uint32_t>(out_.variables.size());
+            out_.variables.push_back(name);
+            slots_[name] = slot;
+            emit(OpCode::LOAD, dst, slot);
+            return dst;
+        }
+        // Names outside the requested slot list are bound now from the frame
+        emit(OpCode::CONST, dst, constant(frame_.get(name)));
+        return dst;
+    }
+
+    void declare(const std::string& name) {
+        if (!slots_.count(name)) {
+            slots_[name] = static_cast<uint32_t>(out_.variables.size());
+            out_.variables.push_back(name);
+        }
+    }
+
+    // Collects every variable read or assigned, in order of first
+    // appearance, and rejects assignments nested inside expressions
+    void declare_variables(ast::Node* node, bool in_expression = false) {
+        if (!node) return;
+
+        switch(node->type) {
+            case ast::NodeType::VARIABLE:
+                declare(static_cast<ast::VariableNode*>(node)->name);
+                break;
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                declare_variables(bin->left, true);
+                declare_variables(bin->right, true);
+                break;
+            }
+            case ast::NodeType::UNARY_OP:
+                declare_variables(static_cast<ast::UnaryOpNode*>(node)->operand, true);
+                break;
+            case ast::NodeType::FUNCTION:
+                for (auto* arg : static_cast<ast::FunctionNode*>(node)->args) {
+                    declare_variables(arg, true);
+                }
+                break;
+            case ast::NodeType::ASSIGNMENT: {
+                if (in_expression) {
+                    throw EvaluationError("Assignment is only allowed as a statement");
+                }
+                auto* assign = static_cast<ast::AssignmentNode*>(node);
+                declare(assign->name);
+                assigned_.insert(assign->name);
+                // a = b = c chains assignments; anything else is an expression
+                bool chained = assign->value && assign->value->type == ast::NodeType::ASSIGNMENT;
+                declare_variables(assign->value, !chained);
+                break;
+            }
+            case ast::NodeType::BLOCK:
+                for (auto* stmt : static_cast<ast::BlockNode*>(node)->statements) {
+                    declare_variables(stmt);
+                }
+                break;
+            case ast::NodeType::IF: {
+                auto* stmt = static_cast<ast::IfNode*>(node);
+                declare_variables(stmt->condition, true);
+                declare_variables(stmt->then_branch);
+                declare_variables(stmt->else_branch);
+                break;
+            }
+            case ast::NodeType::WHILE: {
+                auto* stmt = static_cast<ast::WhileNode*>(node);
+                declare_variables(stmt->condition, true);
+                declare_variables(stmt->body);
+                break;
+            }
+            case ast::NodeType::FOR: {
+                auto* stmt = static_cast<ast::ForNode*>(node);
+                declare_variables(stmt->initializer);
+                declare_variables(stmt->condition, true);
+                declare_variables(stmt->increment);
+                declare_variables(stmt->body);
+                break;
+            }
+            case ast::NodeType::RETURN:
+                declare_variables(static_cast<ast::ReturnNode*>(node)->value, true);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Constants of the registry the program never assigns are not
+    // variables: they are compiled in, as compile() does for unlisted names
+    void bind_constants() {
+        std::vector<std::string> variables;
+        slots_.clear();
+        for (auto& name : out_.variables) {
+            if (assigned_.count(name) || !frame_.registry().find_constant(name)) {
+                slots_[name] = static_cast<uint32_t>(variables.size());
+                variables.push_back(std::move(name));
+            }
+        }
+        out_.variables = std::move(variables);
+    }
+
+    size_t emit_jump(OpCode code = OpCode::JUMP, uint32_t condition = 0) {
+        emit(code, 0, condition);
+        return out_.code.size() - 1;
+    }
+
+    // Points a forward jump at the next instruction to be emitted
+    void patch(size_t jump) {
+        auto target = static_cast<uint32_t>(out_.code.size());
+        auto& ins = out_.code[jump];
+        if (ins.code == OpCode::JUMP) {
+            ins.a = target;
+        } else {
+            ins.b = target;
+        }
+    }
+
+    // Each statement's expression is deduplicated on its own; shared values
+    // never outlive the statement that computed them
+    uint32_t emit_expression(ast::Node* node) {
+        ast::Node* dag = ast::eliminate_common_subexpressions(node);
+        shared_ = ast::shared_nodes(dag);
+        computed_.clear();
+        return emit_value(dag, temporaries_);
+    }
+
+    uint32_t emit_assignment(ast::AssignmentNode* node) {
+        uint32_t target = slots_.at(node->name);
+        uint32_t value = node->value && node->value->type == ast::NodeType::ASSIGNMENT
+            ? emit_assignment(static_cast<ast::AssignmentNode*>(node->value))
+            : emit_expression(node->value);
+        if (value != target) {
+            emit(OpCode::MOVE, target, value);
+        }
+        return target;
+    }
+
+    void emit_statement(ast::Node* node) {
+        if (!node) return;
+
+        switch(node->type) {
+            case ast::NodeType::BLOCK:
+                for (auto* stmt : static_cast<ast::BlockNode*>(node)->statements) {
+                    emit_statement(stmt);
+                }
+                break;
+
+            case ast::NodeType::ASSIGNMENT:
+                emit_assignment(static_cast<ast::AssignmentNode*>(node));
+                break;
+
+            case ast::NodeType::IF: {
+                auto* stmt = static_cast<ast::IfNode*>(node);
+                size_t skip = emit_jump(OpCode::JUMP_IF_FALSE, emit_expression(stmt->condition));
+                emit_statement(stmt->then_branch);
+                if (stmt->else_branch) {
+                    size_t end = emit_jump();
+                    patch(skip);
+                    emit_statement(stmt->else_branch);
+                    patch(end);
+                } else {
+                    patch(skip);
+                }
+                break;
+            }
+
+            case ast::NodeType::WHILE: {
+                auto* stmt = static_cast<ast::WhileNode*>(node);
+                auto top = static_cast<uint32_t>(out_.code.size());
+                size_t exit = emit_jump(OpCode::JUMP_IF_FALSE, emit_expression(stmt->condition));
+                emit_statement(stmt->body);
+                emit(OpCode::JUMP, 0, top);
+                patch(exit);
+                break;
+            }
+
+            case ast::NodeType::FOR: {
+                auto* stmt = static_cast<ast::ForNode*>(node);
+                emit_statement(stmt->initializer);
+                auto top = static_cast<uint32_t>(out_.code.size());
+                size_t exit = 0;
+                if (stmt->condition) {
+                    exit = emit_jump(OpCode::JUMP_IF_FALSE, emit_expression(stmt->condition));
+                }
+                emit_statement(stmt->body);
+                emit_statement(stmt->increment);
+                emit(OpCode::JUMP, 0, top);
+                if (stmt->condition) {
+                    patch(exit);
+                }
+                break;
+            }
+
+            case ast::NodeType::RETURN: {
+                auto* stmt = static_cast<ast::ReturnNode*>(node);
+                if (stmt->value) {
+                    emit(OpCode::MOVE, out_.result, emit_expression(stmt->value));
+                }
+                returns_.push_back(emit_jump());
+                break;
+            }
+
+            default:
+                emit(OpCode::MOVE, out_.result, emit_expression(node));
+                break;
+        }
+    }
+
+    uint32_t emit_node(ast::Node* node, uint32_t dst) {
+        if (!node) {
+            throw EvaluationError("Null node in evaluation");
+        }
+
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+                emit(OpCode::CONST, dst, constant(static_cast<ast::NumberNode*>(node)->value));
+                break;
+
+            case ast::NodeType::BOOLEAN:
+                emit(OpCode::CONST, dst, constant(static_cast<ast::BooleanNode*>(node)->value ? 1.0 : 0.0));
+                break;
+
+            case ast::NodeType::VARIABLE:
+                return emit_variable(static_cast<ast::VariableNode*>(node)->name, dst);
+
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                uint32_t left = emit_value(bin->left, dst);
+                uint32_t right = emit_value(bin->right, dst + 1);
+                emit(binary_opcode(bin->op), dst, left, right, static_cast<uint8_t>(bin->op));
+                break;
+            }
+
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                uint32_t operand = emit_value(un->operand, dst);
+                emit(unary_opcode(un->op), dst, operand, 0, static_cast<uint8_t>(un->op));
+                break;
+            }
+
+            case ast::NodeType::FUNCTION: {
+                auto* fn = static_cast<ast::FunctionNode*>(node);
+                const Callable* func = frame_.registry().find_callable(fn->name);
+                if (!func) {
+                    throw EvaluationError("Unknown function: " + fn->name);
+                }
+                if (func->checked && fn->args.size() == 1) {
+                    uint32_t operand = emit_value(fn->args[0], dst);
+                    emit(unary_opcode(func->op), dst, operand, 0, static_cast<uint8_t>(func->op));
+                    break;
+                }
+                for (size_t i = 0; i < fn->args.size(); ++i) {
+                    auto arg = dst + static_cast<uint32_t>(i);
+                    uint32_t reg = emit_value(fn->args[i], arg);
+                    if (reg != arg) {
+                        emit(OpCode::MOVE, arg, reg);
+                    }
+                }
+                emit(OpCode::CALL, dst, dst, function(func), 0,
+                     static_cast<uint16_t>(fn->args.size()));
+                break;
+            }
+
+            case ast::NodeType::MATRIX:
+            case ast::NodeType::TENSOR:
+                throw EvaluationError("Matrix expressions cannot be compiled; use evaluate_matrix");
+
+            case ast::NodeType::ASSIGNMENT:
+                throw EvaluationError("Assignment is only allowed as a statement");
+
+            default:
+                throw EvaluationError("Unknown node type in evaluation");
+        }
+        return dst;
+    }
+
+    uint32_t function(const Callable* func) {
+        auto it = function_index_.find(func);
+        if (it != function_index_.end()) {
+            return it->second;
+        }
+        auto index = static_cast<uint32_t>(out_.functions.size());
+        out_.functions.push_back(func);
+        function_index_[func] = index;
+        return index;
+    }
+
+    static OpCode binary_opcode(ast::BinaryOp op) {
+        switch(op) {
+            case ast::BinaryOp::ADD: return OpCode::ADD;
+            case ast::BinaryOp::SUB: return OpCode::SUB;
+            case ast::BinaryOp::MUL: return OpCode::MUL;
+            case ast::BinaryOp::DIV: return OpCode::DIV;
+            case ast::BinaryOp::MOD: return OpCode::MOD;
+            case ast::BinaryOp::POW: return OpCode::POW;
+            default: return OpCode::BINARY;
+        }
+    }
+
+    static OpCode unary_opcode(ast::UnaryOp op) {
+        switch(op) {
+            case ast::UnaryOp::NEGATE: return OpCode::NEG;
+            case ast::UnaryOp::SIN: return OpCode::SIN;
+            case ast::UnaryOp::COS: return OpCode::COS;
+            case ast::UnaryOp::TAN: return OpCode::TAN;
+            case ast::UnaryOp::EXP: return OpCode::EXP;
+            case ast::UnaryOp::LOG: return OpCode::LOG;
+            case ast::UnaryOp::SQRT: return OpCode::SQRT;
+            default: return OpCode::UNARY;
+        }
+    }
+};
+
+// Errors are thrown when `Throwing`; otherwise the first one stops the
+// evaluation and is returned in `status` with a NaN result
+template<bool Throwing>
+double raise(Status& status, Status error) {
+    if (Throwing) {
+        throw DomainError(error);
+    }
+    status = error;
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+// Unary and binary functions are called without an argument vector
+double call(const Callable& func, const double* args, size_t argc) {
+    NUMU_STATS_CALL(func.name, 1);
+    if (argc == 1 && func.unary) {
+        return func.unary(args[0]);
+    }
+    if (argc == 2 && func.binary) {
+        return func.binary(args[0], args[1]);
+    }
+    Scratch buffer(0);
+    buffer.buffer.assign(args, args + argc);
+    return func.function(buffer.buffer);
+}
+
+template<bool Throwing>
+double execute(const CompiledExpression& expr, const double* vars, double* r, Status& status) {
+    const Instruction* begin = expr.code.data();
+    const Instruction* end = begin + expr.code.size();
+    // Instructions run since `counted` are charged to the budget at each
+    // taken jump and at the end, so only loops pay for it per iteration
+    BudgetScope* budget = BudgetScope::current();
+    const Instruction* counted = begin;
+    auto jump = [&](const Instruction*& ip, uint32_t target) {
+        if (budget) {
+            budget->charge(static_cast<size_t>(ip - counted));
+            counted = begin + target;
+        }
+        ip = begin + target;
+    };
+    Status error = Status::OK;
+    for (const Instruction* ip = begin; ip != end;) {
+        const Instruction& ins = *ip++;
+        switch(ins.code) {
+            case OpCode::CONST: r[ins.dst] = expr.constants[ins.a]; break;
+            case OpCode::LOAD: r[ins.dst] = vars[ins.a]; break;
+            case OpCode::MOVE: r[ins.dst] = r[ins.a]; break;
+            case OpCode::ADD: r[ins.dst] = r[ins.a] + r[ins.b]; break;
+            case OpCode::SUB: r[ins.dst] = r[ins.a] - r[ins.b]; break;
+            case OpCode::MUL: r[ins.dst] = r[ins.a] * r[ins.b]; break;
+            case OpCode::DIV:
+                if (r[ins.b] == 0.0) {
+                    return raise<Throwing>(status, Status::DIVISION_BY_ZERO);
+                }
+                r[ins.dst] = r[ins.a] / r[ins.b];
+                break;
+            case OpCode::MOD:
+            case OpCode::POW:
+            case OpCode::BINARY:
+                r[ins.dst] = eval_binary_op(static_cast<ast::BinaryOp>(ins.op), r[ins.a], r[ins.b], error);
+                if (error != Status::OK) {
+                    return raise<Throwing>(status, error);
+                }
+                break;
+            case OpCode::NEG: r[ins.dst] = -r[ins.a]; break;
+            case OpCode::SIN: r[ins.dst] = std::sin(r[ins.a]); break;
+            case OpCode::COS: r[ins.dst] = std::cos(r[ins.a]); break;
+            case OpCode::TAN: r[ins.dst] = std::tan(r[ins.a]); break;
+            case OpCode::EXP: r[ins.dst] = std::exp(r[ins.a]); break;
+            case OpCode::LOG:
+            case OpCode::SQRT:
+            case OpCode::UNARY:
+                r[ins.dst] = eval_unary_op(static_cast<ast::UnaryOp>(ins.op), r[ins.a], error);
+                if (error != Status::OK) {
+                    return raise<Throwing>(status, error);
+                }
+                break;
+            case OpCode::CALL: {
+                const Callable& func = *expr.functions[ins.b];
+                if (Throwing) {
+                    r[ins.dst] = call(func, r + ins.a, ins.argc);
+                    break;
+                }
+                try {
+                    r[ins.dst] = call(func, r + ins.a, ins.argc);
+                } catch (const BudgetExceeded&) {
+                    throw;
+                } catch (const EvaluationError&) {
+                    return raise<Throwing>(status, Status::OTHER);
+                }
+                break;
+            }
+            case OpCode::JUMP: jump(ip, ins.a); break;
+            case OpCode::JUMP_IF_FALSE:
+                if (r[ins.a] == 0.0) {
+                    jump(ip, ins.b);
+                }
+                break;
+        }
+    }
+    if (budget) {
+        budget->charge(static_cast<size_t>(end - counted));
+    }
+    return r[expr.result];
+}
+
+} // namespace
+
+size_t CompiledExpression::slot(const std::string& name) const {
+    auto it = std::find(variables.begin(), variables.end(), name);
+    if (it == variables.end()) {
+        throw EvaluationError("Undefined variable: " + name);
+    }
+    return static_cast<size_t>(it - variables.begin());
+}
+
+double CompiledExpression::evaluate(const double* vars) const {
+    Scratch frame(registers);
+    return evaluate(vars, frame.buffer.data());
+}
+
+double CompiledExpression::evaluate(const double* vars, double* r) const {
+    NUMU_STATS_STAGE(EVALUATE);
+    Status status = Status::OK;
+    return execute<true>(*this, vars, r, status);
+}
+
+Result CompiledExpression::try_evaluate(const double* vars) const {
+    Scratch frame(registers);
+    return try_evaluate(vars, frame.buffer.data());
+}
+
+Result CompiledExpression::try_evaluate(const double* vars, double* frame) const {
+    NUMU_STATS_STAGE(EVALUATE);
+    Result result;
+    result.value = execute<false>(*this, vars, frame, result.status);
+    return result;
+}
+
+double Program::run(double* vars) const {
+    size_t count = code_.variables.size();
+    Scratch frame(code_.registers);
+    double* r = frame.buffer.data();
+    std::copy(vars, vars + count, r);
+    double value = code_.evaluate(nullptr, r);
+    std::copy(r, r + count, vars);
+    return value;
+}
+
+double Program::run(std::vector<double>& vars) const {
+    if (vars.size() != code_.variables.size()) {
+        throw EvaluationError("Program expects " + std::to_string(code_.variables.size()) +
+                              " variables, got " + std::to_string(vars.size()));
+    }
+    return run(vars.data());
+}
+
+CompiledExpression compile(ast::Node* node, const Frame& frame) {
+    CompiledExpression out;
+    ast::ArenaScope scratch;
+    Compiler(out, frame, true).compile(ast::eliminate_common_subexpressions(node));
+    return out;
+}
+
+CompiledExpression compile(ast::Node* node, const std::vector<std::string>& variables,
+                           const Frame& frame) {
+    CompiledExpression out;
+    out.variables = variables;
+    ast::ArenaScope scratch;
+    Compiler(out, frame, false).compile(ast::eliminate_common_subexpressions(node));
+    return out;
+}
+
+CompiledExpression compile(ast::Node* node) {
+    return compile(node, default_frame());
+}
+
+CompiledExpression compile(ast::Node* node, const std::vector<std::string>& variables) {
+    return compile(node, variables, default_frame());
+}
+
+Program compile_program(ast::Node* program, RegistryPtr registry) {
+    Program out;
+    Frame frame(std::move(registry));
+    ast::ArenaScope scratch;
+    Compiler(out.code_, frame, false).compile_program(program);
+    return out;
+}
+
+Program compile_program(ast::Node* program) {
+    return compile_program(program, default_registry());
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,288 @@
+#include "numu/core/config.h"
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace numu {
+namespace config {
+
+namespace {
+class Reader {
+public:
+    Reader(std::string_view text, std::unordered_map<std::string, Value>& out)
+        : text_(text), out_(out) {}
+
+    void read() {
+        read_object("", false);
+    }
+
+private:
+    std::string_view text_;
+    std::unordered_map<std::string, Value>& out_;
+    size_t pos_ = 0;
+    size_t line_ = 1;
+
+    [[noreturn]] void throw_error(const std::string& message) const {
+        throw ConfigError("line " + std::to_string(line_) + ": " + message);
+    }
+
+    bool at_end() const { return pos_ >= text_.size(); }
+    char peek() const { return at_end() ? '\0' : text_[pos_]; }
+
+    void skip_comment() {
+        while (!at_end() && text_[pos_] != '\n') {
+            pos_++;
+        }
+    }
+
+    // Skips spaces, comments and, when `newlines` is set, line breaks
+    void skip_space(bool newlines = true) {
+        while (!at_end()) {
+            char c = text_[pos_];
+            if (c == '\n') {
+                if (!newlines) return;
+                line_++;
+                pos_++;
+            } else if (c == ' ' || c == '\t' || c == '\r') {
+                pos_++;
+            } else if (c == '#' || (c == '/' && pos_ + 1 < text_.size() && text_[pos_ + 1] == '/')) {
+                skip_comment();
+            } else {
+                return;
+            }
+        }
+    }
+
+    std::string read_quoted() {
+        pos_++; // Skip opening quote
+        std::string value;
+        while (!at_end() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                pos_++;
+            }
+            if (text_[pos_] == '\n') {
+                throw_error("Unterminated string");
+            }
+            value += text_[pos_++];
+        }
+        if (at_end()) {
+            throw_error("Unterminated string");
+        }
+        pos_++; // Skip closing quote
+        return value;
+    }
+
+    std::string read_key() {
+        if (peek() == '"') {
+            return read_quoted();
+        }
+        size_t start = pos_;
+        while (!at_end()) {
+            char c = text_[pos_];
+            if (std::isspace(static_cast<unsigned char>(c)) || c == '=' || c == ':' || c == '{') {
+                break;
+            }
+            pos_++;
+        }
+        if (start == pos_) {
+            throw_error("Expected key");
+        }
+        return std::string(text_.substr(start, pos_ - start));
+    }
+
+    std::string read_scalar() {
+        skip_space(false);
+        if (peek() == '"') {
+            return read_quoted();
+        }
+        size_t start = pos_;
+        while (!at_end()) {
+            char c = text_[pos_];
+            if (c == '\n' || c == '#' || c == ',' || c == ']' || c == '}') {
+                break;
+            }
+            if (c == '/' && pos_ + 1 < text_.size() && text_[pos_ + 1] == '/') {
+                break;
+            }
+            pos_++;
+        }
+        size_t end = pos_;
+        while (end > start && std::isspace(static_cast<unsigned char>(text_[end - 1]))) {
+            end--;
+        }
+        return std::string(text_.substr(start, end - start));
+    }
+
+    void read_list(const std::string& key) {
+        pos_++; // Skip '['
+        Value value;
+        value.is_list = true;
+        skip_space();
+        while (peek() != ']') {
+            if (at_end()) {
+                throw_error("Unterminated list for " + key);
+            }
+            value.list.push_back(read_scalar());
+            skip_space();
+            if (peek() == ',') {
+                pos_++;
+                skip_space();
+            }
+        }
+        pos_++; // Skip ']'
+        out_[key] = std::move(value);
+    }
+
+    void read_object(const std::string& prefix, bool braced) {
+        while (true) {
+            skip_space();
+            if (at_end()) {
+                if (braced) {
+                    throw_error("Expected '}'");
+                }
+                return;
+            }
+            if (peek() == '}') {
+                if (!braced) {
+                    throw_error("Unexpected '}'");
+                }
+                pos_++;
+                return;
+            }
+            if (peek() == ',') {
+                pos_++;
+                continue;
+            }
+
+            std::string key = prefix + read_key();
+            skip_space(false);
+            if (peek() == '=' || peek() == ':') {
+                pos_++;
+                skip_space(false);
+            }
+
+            if (peek() == '{') {
+                pos_++;
+                read_object(key + ".", true);
+            } else if (peek() == '[') {
+                read_list(key);
+            } else {
+                Value value;
+                value.scalar = read_scalar();
+                out_[key] = std::move(value);
+            }
+        }
+    }
+};
+
+} // namespace
+
+Config Config::parse(std::string_view text) {
+    Config config;
+    Reader(text, config.values_).read();
+    return config;
+}
+
+Config Config::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw ConfigError("Cannot open config file: " + path);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return parse(buffer.str());
+}
+
+bool Config::has(const std::string& key) const {
+    return values_.count(key) != 0;
+}
+
+const Value* Config::find(const std::string& key) const {
+    auto it = values_.find(key);
+    return it == values_.end() ? nullptr : &it->second;
+}
+
+std::string Config::get_string(const std::string& key, const std::string& fallback) const {
+    const Value* value = find(key);
+    return value && !value->is_list ? value->scalar : fallback;
+}
+
+double Config::get_number(const std::string& key, double fallback) const {
+    const Value* value = find(key);
+    if (!value || value->is_list) {
+        return fallback;
+    }
+    const char* start = value->scalar.c_str();
+    char* end;
+    double result = std::strtod(start, &end);
+    if (end == start || *end != '\0') {
+        throw ConfigError("Expected a number for " + key + ": " + value->scalar);
+    }
+    return result;
+}
+
+bool Config::get_bool(const std::string& key, bool fallback) const {
+    const Value* value = find(key);
+    if (!value || value->is_list) {
+        return fallback;
+    }
+    if (value->scalar == "true" || value->scalar == "on" || value->scalar == "yes") {
+        return true;
+    }
+    if (value->scalar == "false" || value->scalar == "off" || value->scalar == "no") {
+        return false;
+    }
+    throw ConfigError("Expected a boolean for " + key + ": " + value->scalar);
+}
+
+size_t Config::get_size(const std::string& key, size_t fallback) const {
+    const Value* value = find(key);
+    if (!value || value->is_list) {
+        return fallback;
+    }
+    return parse_size(value->scalar);
+}
+
+std::vector<std::string> Config::get_list(const std::string& key) const {
+    const Value* value = find(key);
+    if (!value) {
+        return {};
+    }
+    return value->is_list ? value->list : std::vector<std::string>{value->scalar};
+}
+
+size_t parse_size(std::string_view text) {
+    std::string digits(text);
+    const char* start = digits.c_str();
+    char* end;
+    double amount = std::strtod(start, &end);
+    if (end == start || amount < 0) {
+        throw ConfigError("Invalid size: " + digits);
+    }
+
+    std::string unit(end);
+    while (!unit.empty() && std::isspace(static_cast<unsigned char>(unit.front()))) {
+        unit.erase(unit.begin());
+    }
+    for (auto& c : unit) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+
+    double scale = 1;
+    if (unit.empty() || unit == "B") {
+        scale = 1;
+    } else if (unit == "K" || unit == "KB" || unit == "KIB") {
+        scale = 1024.0;
+    } else if (unit == "M" || unit == "MB" || unit == "MIB") {
+        scale = 1024.0 * 1024.0;
+    } else if (unit == "G" || unit == "GB" || unit == "GIB") {
+        scale = 1024.0 * 1024.0 * 1024.0;
+    } else {
+        throw ConfigError("Invalid size unit: " + digits);
+    }
+    return static_cast<size_t>(amount * scale);
+}
+
+} // namespace config
+} // namespace numu
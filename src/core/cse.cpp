@@ -0,0 +1,211 @@
+#include "numu/core/cse.h"
+#include "numu/core/ast.h"
+#include <unordered_set>
+#include <vector>
+
+namespace numu {
+namespace ast {
+
+namespace {
+struct NodeHash {
+    size_t operator()(Node* node) const { return hash(node); }
+};
+struct NodeEqual {
+    bool operator()(Node* a, Node* b) const { return equals(a, b); }
+};
+
+class Eliminator {
+public:
+    Node* rewrite(Node* node) {
+        if (!node) return nullptr;
+
+        auto done = rewritten_.find(node);
+        if (done != rewritten_.end()) {
+            return done->second;
+        }
+
+        Node* result = rebuild(node);
+        if (hashable(result)) {
+            result = canonical(result);
+        }
+        rewritten_[node] = result;
+        return result;
+    }
+
+private:
+    std::unordered_set<Node*, NodeHash, NodeEqual> canonical_;
+    std::unordered_map<Node*, Node*> rewritten_;
+
+    static bool hashable(Node* node) {
+        switch(node->type) {
+            case NodeType::NUMBER:
+            case NodeType::VARIABLE:
+            case NodeType::BINARY_OP:
+            case NodeType::UNARY_OP:
+            case NodeType::FUNCTION:
+            case NodeType::MATRIX:
+            case NodeType::TENSOR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    Node* canonical(Node* node) {
+        return *canonical_.insert(node).first;
+    }
+
+    // Probes the table with a stack copy so duplicates cost no allocation
+    template<typename T>
+    Node* lookup_or_create(T& probe, Node* (*create)(T&)) {
+        auto it = canonical_.find(&probe);
+        if (it != canonical_.end()) {
+            return *it;
+        }
+        return create(probe);
+    }
+
+    Node* rebuild(Node* node) {
+        switch(node->type) {
+            case NodeType::BINARY_OP: {
+                auto* bin = static_cast<BinaryOpNode*>(node);
+                Node* left = rewrite(bin->left);
+                Node* right = rewrite(bin->right);
+                if (left == bin->left && right == bin->right) {
+                    return node;
+                }
+                BinaryOpNode probe(bin->op, left, right);
+                return lookup_or_create<BinaryOpNode>(probe, [](BinaryOpNode& p) -> Node* {
+                    return BinaryOpNode::create(p.op, p.left, p.right);
+                });
+            }
+            case NodeType::UNARY_OP: {
+                auto* un = static_cast<UnaryOpNode*>(node);
+                Node* operand = rewrite(un->operand);
+                if (operand == un->operand) {
+                    return node;
+                }
+                UnaryOpNode probe(un->op, operand);
+                return lookup_or_create<UnaryOpNode>(probe, [](UnaryOpNode& p) -> Node* {
+                    return UnaryOpNode::create(p.op, p.operand);
+                });
+            }
+            case NodeType::FUNCTION: {
+                auto* fn = static_cast<FunctionNode*>(node);
+                std::vector<Node*> args;
+                args.reserve(fn->args.size());
+                bool changed = false;
+                for (auto* arg : fn->args) {
+                    args.push_back(rewrite(arg));
+                    changed |= args.back() != arg;
+                }
+                if (!changed) {
+                    return node;
+                }
+                FunctionNode probe(fn->name, std::move(args));
+                return lookup_or_create<FunctionNode>(probe, [](FunctionNode& p) -> Node* {
+                    return FunctionNode::create(p.name, std::move(p.args));
+                });
+            }
+            case NodeType::MATRIX: {
+                auto* mat = static_cast<MatrixNode*>(node);
+                std::vector<std::vector<Node*>> elems;
+                elems.reserve(mat->elements.size());
+                bool changed = false;
+                for (const auto& row : mat->elements) {
+                    std::vector<Node*> new_row;
+                    new_row.reserve(row.size());
+                    for (auto* elem : row) {
+                        new_row.push_back(rewrite(elem));
+                        changed |= new_row.back() != elem;
+                    }
+                    elems.push_back(std::move(new_row));
+                }
+                if (!changed) {
+                    return node;
+                }
+                MatrixNode probe(std::move(elems));
+                return lookup_or_create<MatrixNode>(probe, [](MatrixNode& p) -> Node* {
+                    return MatrixNode::create(std::move(p.elements));
+                });
+            }
+            case NodeType::TENSOR: {
+                auto* tensor = static_cast<TensorNode*>(node);
+                std::vector<Node*> vals;
+                vals.reserve(tensor->values.size());
+                bool changed = false;
+                for (auto* val : tensor->values) {
+                    vals.push_back(rewrite(val));
+                    changed |= vals.back() != val;
+                }
+                if (!changed) {
+                    return node;
+                }
+                TensorNode probe(tensor->dims, std::move(vals));
+                return lookup_or_create<TensorNode>(probe, [](TensorNode& p) -> Node* {
+                    return TensorNode::create(std::move(p.dims), std::move(p.values));
+                });
+            }
+            default:
+                return node;
+        }
+    }
+};
+
+bool is_leaf(Node* node) {
+    return node->type == NodeType::NUMBER || node->type == NodeType::VARIABLE;
+}
+
+void count_parents(Node* node, std::unordered_map<Node*, size_t>& parents) {
+    if (!node || is_leaf(node)) return;
+    if (parents[node]++ > 0) return;
+
+    switch(node->type) {
+        case NodeType::BINARY_OP: {
+            auto* bin = static_cast<BinaryOpNode*>(node);
+            count_parents(bin->left, parents);
+            count_parents(bin->right, parents);
+            break;
+        }
+        case NodeType::UNARY_OP:
+            count_parents(static_cast<UnaryOpNode*>(node)->operand, parents);
+            break;
+        case NodeType::FUNCTION:
+            for (auto* arg : static_cast<FunctionNode*>(node)->args) {
+                count_parents(arg, parents);
+            }
+            break;
+        case NodeType::MATRIX:
+            for (const auto& row : static_cast<MatrixNode*>(node)->elements) {
+                for (auto* elem : row) {
+                    count_parents(elem, parents);
+                }
+            }
+            break;
+        case NodeType::TENSOR:
+            for (auto* val : static_cast<TensorNode*>(node)->values) {
+                count_parents(val, parents);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+} // namespace
+
+Node* eliminate_common_subexpressions(Node* node) {
+    return Eliminator().rewrite(node);
+}
+
+std::unordered_map<Node*, size_t> shared_nodes(Node* root) {
+    std::unordered_map<Node*, size_t> parents;
+    count_parents(root, parents);
+    for (auto it = parents.begin(); it != parents.end();) {
+        it = it->second > 1 ? std::next(it) : parents.erase(it);
+    }
+    return parents;
+}
+
+} // namespace ast
+} // namespace numu
@@ -0,0 +1,470 @@
+#include "numu/core/derivative.h"
+#include "numu/core/eval.h"
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace numu {
+namespace core {
+
+namespace {
+using ast::BinaryOp;
+using ast::Node;
+using ast::NodeType;
+using ast::UnaryOp;
+
+const double* constant(Node* node) {
+    return node->type == NodeType::NUMBER ? &static_cast<ast::NumberNode*>(node)->value : nullptr;
+}
+
+bool is(Node* node, double value) {
+    const double* c = constant(node);
+    return c && *c == value;
+}
+
+size_t arity(Node* node) {
+    switch(node->type) {
+        case NodeType::NUMBER:
+        case NodeType::BOOLEAN:
+        case NodeType::VARIABLE:
+            return 0;
+        case NodeType::BINARY_OP:
+            return 2;
+        case NodeType::UNARY_OP:
+            return 1;
+        case NodeType::FUNCTION:
+            return static_cast<ast::FunctionNode*>(node)->args.size();
+        case NodeType::MATRIX:
+        case NodeType::TENSOR:
+            throw EvaluationError("Cannot differentiate matrix expressions");
+        default:
+            throw EvaluationError("Cannot differentiate statements");
+    }
+}
+
+Node* child(Node* node, size_t i) {
+    switch(node->type) {
+        case NodeType::BINARY_OP: {
+            auto* bin = static_cast<ast::BinaryOpNode*>(node);
+            return i == 0 ? bin->left : bin->right;
+        }
+        case NodeType::UNARY_OP:
+            return static_cast<ast::UnaryOpNode*>(node)->operand;
+        default:
+            return static_cast<ast::FunctionNode*>(node)->args[i];
+    }
+}
+
+// Creates nodes already simplified against their operands, and each
+// distinct (operator, operands) combination only once
+class Builder {
+public:
+    Node* number(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto& node = numbers_[bits];
+        if (!node) {
+            node = ast::NumberNode::create(value);
+        }
+        return node;
+    }
+
+    Node* add(Node* a, Node* b) {
+        if (is(a, 0.0)) return b;
+        if (is(b, 0.0)) return a;
+        if (constant(a) && constant(b)) return number(*constant(a) + *constant(b));
+        if (a == b) return mul(number(2.0), a);
+        if (b->type == NodeType::UNARY_OP && static_cast<ast::UnaryOpNode*>(b)->op == UnaryOp::NEGATE) {
+            return sub(a, static_cast<ast::UnaryOpNode*>(b)->operand);
+        }
+        return binary(BinaryOp::ADD, a, b);
+    }
+
+    Node* sub(Node* a, Node* b) {
+        if (is(b, 0.0)) return a;
+        if (is(a, 0.0)) return neg(b);
+        if (constant(a) && constant(b)) return number(*constant(a) - *constant(b));
+        if (a == b) return number(0.0);
+        if (b->type == NodeType::UNARY_OP && static_cast<ast::UnaryOpNode*>(b)->op == UnaryOp::NEGATE) {
+            return add(a, static_cast<ast::UnaryOpNode*>(b)->operand);
+        }
+        return binary(BinaryOp::SUB, a, b);
+    }
+
+    Node* mul(Node* a, Node* b) {
+        if (is(a, 0.0) || is(b, 0.0)) return number(0.0);
+        if (is(a, 1.0)) return b;
+        if (is(b, 1.0)) return a;
+        if (is(a, -1.0)) return neg(b);
+        if (is(b, -1.0)) return neg(a);
+        if (constant(a) && constant(b)) return number(*constant(a) * *constant(b));
+        // Constants go on the left so c*x and x*c are the same node
+        if (constant(b)) std::swap(a, b);
+        if (constant(a) && b->type == NodeType::BINARY_OP) {
+            auto* inner = static_cast<ast::BinaryOpNode*>(b);
+            if (inner->op == BinaryOp::MUL && constant(inner->left)) {
+                return mul(number(*constant(a) * *constant(inner->left)), inner->right);
+            }
+        }
+        if (reciprocal(a)) return div(b, static_cast<ast::BinaryOpNode*>(a)->right);
+        if (reciprocal(b)) return div(a, static_cast<ast::BinaryOpNode*>(b)->right);
+        if (negated(a)) return neg(mul(static_cast<ast::UnaryOpNode*>(a)->operand, b));
+        if (negated(b)) return neg(mul(a, static_cast<ast::UnaryOpNode*>(b)->operand));
+        return binary(BinaryOp::MUL, a, b);
+    }
+
+    Node* div(Node* a, Node* b) {
+        if (is(a, 0.0)) return number(0.0);
+        if (is(b, 1.0)) return a;
+        if (is(b, -1.0)) return neg(a);
+        if (constant(a) && constant(b) && *constant(b) != 0.0) {
+            return number(*constant(a) / *constant(b));
+        }
+        if (negated(a)) return neg(div(static_cast<ast::UnaryOpNode*>(a)->operand, b));
+        return binary(BinaryOp::DIV, a, b);
+    }
+
+    Node* pow(Node* a, Node* b) {
+        if (is(b, 0.0)) return number(1.0);
+        if (is(b, 1.0)) return a;
+        if (constant(a) && constant(b)) return number(std::pow(*constant(a), *constant(b)));
+        return binary(BinaryOp::POW, a, b);
+    }
+
+    // 1 where `op` holds and 0 elsewhere
+    Node* compare(BinaryOp op, Node* a, Node* b) {
+        if (constant(a) && constant(b)) return number(eval_binary_op(op, *constant(a), *constant(b)));
+        return binary(op, a, b);
+    }
+
+    Node* neg(Node* a) {
+        if (constant(a)) return number(-*constant(a));
+        if (negated(a)) return static_cast<ast::UnaryOpNode*>(a)->operand;
+        return unary(UnaryOp::NEGATE, a);
+    }
+
+    Node* unary(UnaryOp op, Node* a) {
+        if (const double* c = constant(a)) {
+            switch(op) {
+                case UnaryOp::NEGATE: return number(-*c);
+                case UnaryOp::SIN: return number(std::sin(*c));
+                case UnaryOp::COS: return number(std::cos(*c));
+                case UnaryOp::EXP: return number(std::exp(*c));
+                case UnaryOp::LOG: if (*c > 0.0) return number(std::log(*c)); break;
+                case UnaryOp::SQRT: if (*c >= 0.0) return number(std::sqrt(*c)); break;
+                default: break;
+            }
+        }
+        Key key{true, static_cast<int>(op), a, nullptr};
+        auto& node = nodes_[key];
+        if (!node) {
+            node = ast::UnaryOpNode::create(op, a);
+        }
+        return node;
+    }
+
+private:
+    struct Key {
+        bool unary;
+        int op;
+        Node* a;
+        Node* b;
+        bool operator==(const Key& other) const {
+            return unary == other.unary && op == other.op && a == other.a && b == other.b;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t h = std::hash<Node*>()(key.a);
+            h ^= std::hash<Node*>()(key.b) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            return h ^ (static_cast<size_t>(key.op) << 1 | key.unary);
+        }
+    };
+
+    std::unordered_map<Key, Node*, KeyHash> nodes_;
+    std::unordered_map<uint64_t, Node*> numbers_;
+
+    static bool negated(Node* node) {
+        return node->type == NodeType::UNARY_OP &&
+               static_cast<ast::UnaryOpNode*>(node)->op == UnaryOp::NEGATE;
+    }
+
+    static bool reciprocal(Node* node) {
+        return node->type == NodeType::BINARY_OP &&
+               static_cast<ast::BinaryOpNode*>(node)->op == BinaryOp::DIV &&
+               is(static_cast<ast::BinaryOpNode*>(node)->left, 1.0);
+    }
+
+    Node* binary(BinaryOp op, Node* a, Node* b) {
+        Key key{false, static_cast<int>(op), a, b};
+        auto& node = nodes_[key];
+        if (!node) {
+            node = ast::BinaryOpNode::create(op, a, b);
+        }
+        return node;
+    }
+};
+
+// Local partial derivatives, shared by forward and reverse mode
+class Rules {
+public:
+    explicit Rules(Builder& build) : build_(build) {}
+
+    // d(node) / d(child i of node), in terms of the existing nodes
+    Node* partial(Node* node, size_t i) {
+        switch(node->type) {
+            case NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                return binary_partial(bin->op, node, bin->left, bin->right, i);
+            }
+            case NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                return unary_partial(un->op, node, un->operand);
+            }
+            default: {
+                auto* fn = static_cast<ast::FunctionNode*>(node);
+                const Callable* callable = find_builtin(fn->name);
+                Builtin builtin = callable ? callable->builtin : Builtin::NONE;
+                UnaryOp op;
+                if (fn->args.size() == 1 && unary_op(callable, op)) {
+                    return unary_partial(op, node, fn->args[0]);
+                }
+                if (fn->args.size() == 2 && builtin == Builtin::POW) {
+                    return binary_partial(BinaryOp::POW, node, fn->args[0], fn->args[1], i);
+                }
+                if (fn->args.size() == 1 && builtin == Builtin::ABS) {
+                    // sign(u), 0 at u = 0 as in autodiff rather than u/|u|
+                    Node* zero = build_.number(0.0);
+                    return build_.sub(build_.compare(BinaryOp::GT, fn->args[0], zero),
+                                      build_.compare(BinaryOp::LT, fn->args[0], zero));
+                }
+                switch(builtin) {
+                    case Builtin::SUM: return build_.number(1.0);
+                    case Builtin::AVG: return build_.number(1.0 / static_cast<double>(fn->args.size()));
+                    case Builtin::MIN: return extremum_partial(BinaryOp::LT, BinaryOp::LEQ, fn->args, i);
+                    case Builtin::MAX: return extremum_partial(BinaryOp::GT, BinaryOp::GEQ, fn->args, i);
+                    default: break;
+                }
+                throw EvaluationError("Cannot differentiate function: " + fn->name);
+            }
+        }
+    }
+
+private:
+    Builder& build_;
+
+    // 1 for the argument min or max returns, the first of equal ones as in
+    // the evaluator and autodiff, and 0 for the others. Every comparison
+    // with a NaN argument is false, so all partials are 0 then.
+    Node* extremum_partial(BinaryOp before, BinaryOp after, const std::vector<Node*>& args, size_t i) {
+        Node* result = build_.number(1.0);
+        for (size_t j = 0; j < args.size(); ++j) {
+            if (j != i && args[j] != args[i]) {
+                result = build_.mul(result, build_.compare(j < i ? before : after, args[i], args[j]));
+            } else if (j < i) {
+                // An identical argument earlier on is the one returned
+                return build_.number(0.0);
+            }
+        }
+        return result;
+    }
+
+    Node* binary_partial(BinaryOp op, Node* node, Node* u, Node* v, size_t i) {
+        switch(op) {
+            case BinaryOp::ADD: return build_.number(1.0);
+            case BinaryOp::SUB: return build_.number(i == 0 ? 1.0 : -1.0);
+            case BinaryOp::MUL: return i == 0 ? v : u;
+            case BinaryOp::DIV:
+                return i == 0 ? build_.div(build_.number(1.0), v) : build_.neg(build_.div(node, v));
+            case BinaryOp::POW:
+                if (i == 1) {
+                    return build_.mul(node, build_.unary(UnaryOp::LOG, u));
+                }
+                if (const double* c = constant(v)) {
+                    return build_.mul(v, build_.pow(u, build_.number(*c - 1.0)));
+                }
+                return build_.mul(v, build_.pow(u, build_.sub(v, build_.number(1.0))));
+            case BinaryOp::MOD:
+                if (i == 1) {
+                    throw EvaluationError("Cannot differentiate % with respect to its divisor");
+                }
+                return build_.number(1.0);
+            default:
+                // Comparisons and logic are piecewise constant
+                return build_.number(0.0);
+        }
+    }
+
+    Node* unary_partial(UnaryOp op, Node* node, Node* u) {
+        switch(op) {
+            case UnaryOp::NEGATE: return build_.number(-1.0);
+            case UnaryOp::NOT: return build_.number(0.0);
+            case UnaryOp::SIN: return build_.unary(UnaryOp::COS, u);
+            case UnaryOp::COS: return build_.neg(build_.unary(UnaryOp::SIN, u));
+            case UnaryOp::TAN: return build_.add(build_.number(1.0), build_.mul(node, node));
+            case UnaryOp::ASIN:
+            case UnaryOp::ACOS: {
+                Node* d = build_.div(build_.number(1.0),
+                                     build_.unary(UnaryOp::SQRT, build_.sub(build_.number(1.0), build_.mul(u, u))));
+                return op == UnaryOp::ASIN ? d : build_.neg(d);
+            }
+            case UnaryOp::ATAN:
+                return build_.div(build_.number(1.0), build_.add(build_.number(1.0), build_.mul(u, u)));
+            case UnaryOp::EXP: return node;
+            case UnaryOp::LOG: return build_.div(build_.number(1.0), u);
+            case UnaryOp::SQRT: return build_.div(build_.number(0.5), node);
+            default:
+                throw EvaluationError("Cannot differentiate matrix expressions");
+        }
+    }
+};
+
+class Forward {
+public:
+    Forward(Builder& build, const std::string& variable)
+        : build_(build), rules_(build), variable_(variable) {}
+
+    Node* derive(Node* node) {
+        auto it = derived_.find(node);
+        if (it != derived_.end()) {
+            return it->second;
+        }
+
+        Node* result = build_.number(0.0);
+        if (node->type == NodeType::VARIABLE) {
+            if (static_cast<ast::VariableNode*>(node)->name == variable_) {
+                result = build_.number(1.0);
+            }
+        } else {
+            size_t n = arity(node);
+            for (size_t i = 0; i < n; ++i) {
+                Node* d = derive(child(node, i));
+                if (!is(d, 0.0)) {
+                    result = build_.add(result, build_.mul(rules_.partial(node, i), d));
+                }
+            }
+        }
+        derived_[node] = result;
+        return result;
+    }
+
+private:
+    Builder& build_;
+    Rules rules_;
+    const std::string& variable_;
+    std::unordered_map<Node*, Node*> derived_;
+};
+
+// Children before parents, each shared node once
+std::vector<Node*> topological_order(Node* root) {
+    std::vector<Node*> order;
+    std::unordered_set<Node*> visited;
+    std::vector<std::pair<Node*, size_t>> stack;
+    stack.push_back({root, 0});
+    visited.insert(root);
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        if (next < arity(node)) {
+            Node* c = child(node, next++);
+            if (visited.insert(c).second) {
+                stack.push_back({c, 0});
+            }
+        } else {
+            order.push_back(node);
+            stack.pop_back();
+        }
+    }
+    return order;
+}
+
+std::vector<Node*> reverse_sweep(Builder& build, Node* expr, const std::vector<std::string>& variables) {
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < variables.size(); ++i) {
+        index.emplace(variables[i], i);
+    }
+    std::vector<Node*> result(variables.size(), build.number(0.0));
+
+    // Only nodes that depend on a requested variable carry an adjoint
+    std::vector<Node*> order = topological_order(expr);
+    std::unordered_set<Node*> active;
+    for (Node* node : order) {
+        bool depends = false;
+        if (node->type == NodeType::VARIABLE) {
+            depends = index.count(static_cast<ast::VariableNode*>(node)->name) > 0;
+        } else {
+            for (size_t i = 0, n = arity(node); i < n && !depends; ++i) {
+                depends = active.count(child(node, i)) > 0;
+            }
+        }
+        if (depends) {
+            active.insert(node);
+        }
+    }
+    if (!active.count(expr)) {
+        return result;
+    }
+
+    Rules rules(build);
+    std::unordered_map<Node*, Node*> adjoint;
+    adjoint[expr] = build.number(1.0);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        Node* node = *it;
+        auto found = adjoint.find(node);
+        if (!active.count(node) || found == adjoint.end() || is(found->second, 0.0)) {
+            continue;
+        }
+        Node* a = found->second;
+        if (node->type == NodeType::VARIABLE) {
+            Node*& slot = result[index[static_cast<ast::VariableNode*>(node)->name]];
+            slot = build.add(slot, a);
+            continue;
+        }
+        for (size_t i = 0, n = arity(node); i < n; ++i) {
+            Node* c = child(node, i);
+            if (!active.count(c)) {
+                continue;
+            }
+            Node* contribution = build.mul(a, rules.partial(node, i));
+            auto [slot, inserted] = adjoint.emplace(c, contribution);
+            if (!inserted) {
+                slot->second = build.add(slot->second, contribution);
+            }
+        }
+    }
+    return result;
+}
+} // namespace
+
+ast::Node* differentiate(ast::Node* expr, const std::string& variable) {
+    if (!expr) {
+        throw EvaluationError("Null node in differentiation");
+    }
+    Builder build;
+    return Forward(build, variable).derive(expr);
+}
+
+std::vector<ast::Node*> gradient(ast::Node* expr, const std::vector<std::string>& variables) {
+    if (!expr) {
+        throw EvaluationError("Null node in differentiation");
+    }
+    Builder build;
+    return reverse_sweep(build, expr, variables);
+}
+
+std::vector<std::vector<ast::Node*>> jacobian(const std::vector<ast::Node*>& exprs,
+                                              const std::vector<std::string>& variables) {
+    Builder build;
+    std::vector<std::vector<ast::Node*>> rows;
+    rows.reserve(exprs.size());
+    for (auto* expr : exprs) {
+        if (!expr) {
+            throw EvaluationError("Null node in differentiation");
+        }
+        rows.push_back(reverse_sweep(build, expr, variables));
+    }
+    return rows;
+}
+
+} // namespace core
+} // namespace numu
@@ -1,205 +1,598 @@
 #include "numu/core/ast.h"
 #include "numu/core/eval.h"
+#include "numu/core/budget.h"
+#include "numu/core/cse.h"
+#include "numu/core/matrix.h"
+#include "numu/core/stats.h"
 #include <unordered_map>
 #include <cmath>
 #include <stdexcept>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
 
 namespace numu {
 namespace core {
 
 namespace {
-struct EvalContext {
-    std::unordered_map<std::string, double> variables;
-    std::unordered_map<std::string, std::function<double(const std::vector<double>&)>> functions;
-    
-    EvalContext() {
-        functions["sin"] = [](const auto& args) { return std::sin(args[0]); };
-        functions["cos"] = [](const auto& args) { return std::cos(args[0]); };
-        functions["tan"] = [](const auto& args) { return std::tan(args[0]); };
-        functions["exp"] = [](const auto& args) { return std::exp(args[0]); };
-        functions["log"] = [](const auto& args) { return std::log(args[0]); };
-        functions["sqrt"] = [](const auto& args) { return std::sqrt(args[0]); };
-        functions["pow"] = [](const auto& args) { return std::pow(args[0], args[1]); };
+void validate_args(const std::string& name, size_t expected, size_t actual) {
+    if (expected != variadic && expected != actual) {
+        throw EvaluationError("Function " + name + " expects " + 
+                            std::to_string(expected) + " arguments, got " + 
+                            std::to_string(actual));
+    }
+}
+
+// Published with atomic_load/atomic_store; writers serialize on the mutex
+// so concurrent registrations are not lost
+RegistryPtr& default_registry_slot() {
+    static RegistryPtr registry = Registry::standard();
+    return registry;
+}
+std::mutex default_registry_mutex;
+
+void require_args(const char* name, const std::vector<double>& args) {
+    if (args.empty()) {
+        throw EvaluationError(std::string("Function ") + name + " expects at least one argument");
+    }
+}
+
+Frame& thread_frame() {
+    thread_local Frame frame(Registry::standard());
+    return frame;
+}
+
+double fail(Status& status, Status error) {
+    status = error;
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+// evaluate_dag starts out as evaluate() does, comparing each node with
+// the first few it has seen. A formula is small enough for that to cost
+// next to nothing; only a node met twice, or a larger graph, makes it work
+// out the shared nodes of the whole graph.
+struct SharingProbe {
+    static constexpr size_t limit = 64;
+    ast::Node* root;
+    ast::Node* seen[limit];
+    size_t count = 0;
+    std::unordered_map<ast::Node*, size_t> shared;
+
+    explicit SharingProbe(ast::Node* root) : root(root) {}
+
+    // False once the graph needs shared_nodes
+    bool visit(ast::Node* node) {
+        if (!node || node->type == ast::NodeType::NUMBER || node->type == ast::NodeType::VARIABLE) {
+            return true;
+        }
+        if (count == limit || std::find(seen, seen + count, node) != seen + count) {
+            return false;
+        }
+        seen[count++] = node;
+        return true;
     }
 };
 
-thread_local EvalContext global_context;
+// State of one evaluation: the values of shared DAG nodes already computed,
+// when evaluating a DAG, the active budget, if any, and the first error
+// when errors are collected rather than thrown
+struct Evaluation {
+    const std::unordered_map<ast::Node*, size_t>* shared = nullptr;
+    SharingProbe* probe = nullptr;
+    std::unordered_map<ast::Node*, double> values;
+    bool throwing = true;
+    Status status = Status::OK;
+    BudgetScope* budget = BudgetScope::current();
 
-struct EvaluationError : std::runtime_error {
-    using std::runtime_error::runtime_error;
+    // Evaluation goes on with NaN after an error that is not thrown
+    double check(double value, Status error) {
+        if (error == Status::OK) {
+            return value;
+        }
+        if (throwing) {
+            throw DomainError(error);
+        }
+        if (status == Status::OK) {
+            status = error;
+        }
+        return value;
+    }
 };
 
-void validate_args(const std::string& name, size_t expected, size_t actual) {
-    if (expected != actual) {
-        throw EvaluationError("Function " + name + " expects " + 
-                            std::to_string(expected) + " arguments, got " + 
-                            std::to_string(actual));
+// Matrix values reach scalar contexts only as 1x1 results
+double eval_matrix_op(ast::Node* node, const Frame& frame) {
+    Matrix value = evaluate_matrix(node, frame);
+    if (value.rows() != 1 || value.cols() != 1) {
+        throw EvaluationError("Matrix value used as a scalar");
     }
+    return value(0, 0);
+}
+
+} // namespace
+
+RegistryPtr Registry::standard() {
+    static const RegistryPtr registry = [] {
+        auto standard = std::make_shared<Registry>();
+        auto add = [&](const char* name, UnaryFunction func, Builtin builtin, ast::UnaryOp op) {
+            Callable& callable = standard->add_function(name, func);
+            callable.builtin = builtin;
+            callable.has_op = true;
+            callable.op = op;
+            return &callable;
+        };
+        add("sin", [](double x) { return std::sin(x); }, Builtin::SIN, ast::UnaryOp::SIN);
+        add("cos", [](double x) { return std::cos(x); }, Builtin::COS, ast::UnaryOp::COS);
+        add("tan", [](double x) { return std::tan(x); }, Builtin::TAN, ast::UnaryOp::TAN);
+        add("exp", [](double x) { return std::exp(x); }, Builtin::EXP, ast::UnaryOp::EXP);
+        add("log", [](double x) { return std::log(x); }, Builtin::LOG, ast::UnaryOp::LOG)->checked = true;
+        add("sqrt", [](double x) { return std::sqrt(x); }, Builtin::SQRT, ast::UnaryOp::SQRT)->checked = true;
+        standard->add_function("pow", [](double x, double y) { return std::pow(x, y); }).builtin = Builtin::POW;
+        return RegistryPtr(std::move(standard));
+    }();
+    return registry;
 }
 
-double eval_binary_op(BinaryOp op, double left, double right) {
+Callable& Registry::add_function(const std::string& name, Function func, size_t arity) {
+    if (functions_.count(name)) {
+        throw EvaluationError("Function already registered: " + name);
+    }
+    Callable& callable = functions_[name];
+    callable.name = name;
+    callable.function = [func = std::move(func), arity, name](const auto& args) {
+        validate_args(name, arity, args.size());
+        return func(args);
+    };
+    callable.arity = arity;
+    return callable;
+}
+
+Callable& Registry::add_function(const std::string& name, UnaryFunction func) {
+    Callable& callable = add_function(name, [func](const auto& args) { return func(args[0]); }, 1);
+    callable.unary = func;
+    return callable;
+}
+
+Callable& Registry::add_function(const std::string& name, BinaryFunction func) {
+    Callable& callable = add_function(name, [func](const auto& args) { return func(args[0], args[1]); }, 2);
+    callable.binary = func;
+    return callable;
+}
+
+RegistryPtr Registry::with_function(const std::string& name, Function func, size_t arity) const {
+    auto copy = std::make_shared<Registry>(*this);
+    copy->add_function(name, std::move(func), arity);
+    return copy;
+}
+
+RegistryPtr Registry::with_function(const std::string& name, UnaryFunction func) const {
+    auto copy = std::make_shared<Registry>(*this);
+    copy->add_function(name, func);
+    return copy;
+}
+
+RegistryPtr Registry::with_function(const std::string& name, BinaryFunction func) const {
+    auto copy = std::make_shared<Registry>(*this);
+    copy->add_function(name, func);
+    return copy;
+}
+
+RegistryPtr Registry::with_constant(const std::string& name, double value) const {
+    auto copy = std::make_shared<Registry>(*this);
+    copy->constants_[name] = value;
+    return copy;
+}
+
+RegistryPtr Registry::with_fallback(FallbackPtr fallback) const {
+    auto copy = std::make_shared<Registry>(*this);
+    copy->fallback_ = std::move(fallback);
+    return copy;
+}
+
+const Function* Registry::find_function(const std::string& name) const {
+    const Callable* callable = find_callable(name);
+    return callable ? &callable->function : nullptr;
+}
+
+const Callable* Registry::find_callable(const std::string& name) const {
+    auto it = functions_.find(name);
+    if (it != functions_.end()) {
+        return &it->second;
+    }
+    return fallback_ ? fallback_->find_callable(name) : nullptr;
+}
+
+const double* Registry::find_constant(const std::string& name) const {
+    auto it = constants_.find(name);
+    if (it != constants_.end()) {
+        return &it->second;
+    }
+    return fallback_ ? fallback_->find_constant(name) : nullptr;
+}
+
+Frame::Frame(RegistryPtr registry, const Frame* parent)
+    : registry_(std::move(registry)), parent_(parent) {}
+
+void Frame::set(const std::string& name, double value) {
+    variables_[name] = value;
+}
+
+const double* Frame::find(const std::string& name) const {
+    for (const Frame* frame = this; frame; frame = frame->parent_) {
+        auto it = frame->variables_.find(name);
+        if (it != frame->variables_.end()) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+double Frame::get(const std::string& name) const {
+    const double* value = find(name);
+    if (!value) {
+        value = registry_->find_constant(name);
+    }
+    if (!value) {
+        throw EvaluationError("Undefined variable: " + name);
+    }
+    return *value;
+}
+
+const char* status_message(Status status) {
+    switch(status) {
+        case Status::OK: return "No error";
+        case Status::DIVISION_BY_ZERO: return "Division by zero";
+        case Status::MODULO_BY_ZERO: return "Modulo by zero";
+        case Status::LOG_DOMAIN: return "Logarithm of non-positive number";
+        case Status::SQRT_DOMAIN: return "Square root of negative number";
+        case Status::SINGULAR: return "Matrix is singular";
+        default: return "Evaluation error";
+    }
+}
+
+double eval_binary_op(ast::BinaryOp op, double left, double right, Status& status) {
     switch(op) {
-        case BinaryOp::ADD: return left + right;
-        case BinaryOp::SUB: return left - right;
-        case BinaryOp::MUL: return left * right;
-        case BinaryOp::DIV: 
+        case ast::BinaryOp::ADD: return left + right;
+        case ast::BinaryOp::SUB: return left - right;
+        case ast::BinaryOp::MUL: return left * right;
+        case ast::BinaryOp::DIV: 
             if (right == 0.0) {
-                throw EvaluationError("Division by zero");
+                return fail(status, Status::DIVISION_BY_ZERO);
             }
             return left / right;
-        case BinaryOp::POW: return std::pow(left, right);
-        case BinaryOp::MOD: 
+        case ast::BinaryOp::POW: return std::pow(left, right);
+        case ast::BinaryOp::MOD: 
             if (right == 0.0) {
-                throw EvaluationError("Modulo by zero");
+                return fail(status, Status::MODULO_BY_ZERO);
             }
             return std::fmod(left, right);
+        // Comparisons and logic yield 1 for true and 0 for false
+        case ast::BinaryOp::EQ: return left == right ? 1.0 : 0.0;
+        case ast::BinaryOp::NEQ: return left != right ? 1.0 : 0.0;
+        case ast::BinaryOp::LT: return left < right ? 1.0 : 0.0;
+        case ast::BinaryOp::LEQ: return left <= right ? 1.0 : 0.0;
+        case ast::BinaryOp::GT: return left > right ? 1.0 : 0.0;
+        case ast::BinaryOp::GEQ: return left >= right ? 1.0 : 0.0;
+        case ast::BinaryOp::AND: return left != 0.0 && right != 0.0 ? 1.0 : 0.0;
+        case ast::BinaryOp::OR: return left != 0.0 || right != 0.0 ? 1.0 : 0.0;
         default:
             throw EvaluationError("Unknown binary operator");
     }
 }
 
-double eval_unary_op(UnaryOp op, double operand) {
+double eval_unary_op(ast::UnaryOp op, double operand, Status& status) {
     switch(op) {
-        case UnaryOp::NEGATE: return -operand;
-        case UnaryOp::SIN: return std::sin(operand);
-        case UnaryOp::COS: return std::cos(operand);
-        case UnaryOp::TAN: return std::tan(operand);
-        case UnaryOp::EXP: return std::exp(operand);
-        case UnaryOp::LOG: 
+        case ast::UnaryOp::NEGATE: return -operand;
+        case ast::UnaryOp::NOT: return operand == 0.0 ? 1.0 : 0.0;
+        case ast::UnaryOp::SIN: return std::sin(operand);
+        case ast::UnaryOp::COS: return std::cos(operand);
+        case ast::UnaryOp::TAN: return std::tan(operand);
+        case ast::UnaryOp::EXP: return std::exp(operand);
+        case ast::UnaryOp::LOG: 
             if (operand <= 0.0) {
-                throw EvaluationError("Logarithm of non-positive number");
+                return fail(status, Status::LOG_DOMAIN);
             }
             return std::log(operand);
-        case UnaryOp::SQRT: 
+        case ast::UnaryOp::SQRT: 
             if (operand < 0.0) {
-                throw EvaluationError("Square root of negative number");
+                return fail(status, Status::SQRT_DOMAIN);
             }
             return std::sqrt(operand);
+        // A scalar is its own 1x1 matrix
+        case ast::UnaryOp::TRANSPOSE:
+        case ast::UnaryOp::DETERMINANT:
+            return operand;
+        case ast::UnaryOp::INVERSE:
+            if (operand == 0.0) {
+                return fail(status, Status::SINGULAR);
+            }
+            return 1.0 / operand;
         default:
             throw EvaluationError("Unknown unary operator");
     }
 }
 
-double eval_matrix_op(const MatrixNode* node, const EvalContext& ctx) {
-    throw EvaluationError("Matrix operations not yet implemented");
+double eval_binary_op(ast::BinaryOp op, double left, double right) {
+    Status status = Status::OK;
+    double value = eval_binary_op(op, left, right, status);
+    if (status != Status::OK) {
+        throw DomainError(status);
+    }
+    return value;
 }
 
-double eval_tensor_op(const TensorNode* node, const EvalContext& ctx) {
-    throw EvaluationError("Tensor operations not yet implemented");
+double eval_unary_op(ast::UnaryOp op, double operand) {
+    Status status = Status::OK;
+    double value = eval_unary_op(op, operand, status);
+    if (status != Status::OK) {
+        throw DomainError(status);
+    }
+    return value;
 }
 
-} // namespace
+namespace {
+double evaluate_memo(ast::Node* node, const Frame& frame, Evaluation& state);
 
-double evaluate(ast::Node* node, const EvalContext& ctx) {
+double evaluate_node(ast::Node* node, const Frame& frame, Evaluation& state) {
     if (!node) {
         throw EvaluationError("Null node in evaluation");
     }
+    if (state.budget) {
+        state.budget->charge(1);
+    }
 
     switch(node->type) {
         case ast::NodeType::NUMBER:
             return static_cast<ast::NumberNode*>(node)->value;
+
+        case ast::NodeType::BOOLEAN:
+            return static_cast<ast::BooleanNode*>(node)->value ? 1.0 : 0.0;
             
-        case ast::NodeType::VARIABLE: {
-            const auto& name = static_cast<ast::VariableNode*>(node)->name;
-            auto it = ctx.variables.find(name);
-            if (it == ctx.variables.end()) {
-                throw EvaluationError("Undefined variable: " + name);
-            }
-            return it->second;
-        }
+        case ast::NodeType::VARIABLE:
+            return frame.get(static_cast<ast::VariableNode*>(node)->name);
             
         case ast::NodeType::BINARY_OP: {
             auto* bin = static_cast<ast::BinaryOpNode*>(node);
-            double left = evaluate(bin->left, ctx);
-            double right = evaluate(bin->right, ctx);
-            return eval_binary_op(bin->op, left, right);
+            if (bin->matrix_valued) {
+                return eval_matrix_op(node, frame);
+            }
+            double left = evaluate_memo(bin->left, frame, state);
+            double right = evaluate_memo(bin->right, frame, state);
+            Status error = Status::OK;
+            double value = eval_binary_op(bin->op, left, right, error);
+            return state.check(value, error);
         }
             
         case ast::NodeType::UNARY_OP: {
             auto* un = static_cast<ast::UnaryOpNode*>(node);
-            double operand = evaluate(un->operand, ctx);
-            return eval_unary_op(un->op, operand);
+            if (un->op == ast::UnaryOp::DETERMINANT) {
+                return determinant(evaluate_matrix(un->operand, frame));
+            }
+            if (un->operand && un->operand->matrix_valued) {
+                return eval_matrix_op(node, frame);
+            }
+            double operand = evaluate_memo(un->operand, frame, state);
+            Status error = Status::OK;
+            double value = eval_unary_op(un->op, operand, error);
+            return state.check(value, error);
         }
             
         case ast::NodeType::FUNCTION: {
             auto* fn = static_cast<ast::FunctionNode*>(node);
-            const auto& name = fn->name;
-            
+            const Callable* callable = frame.registry().find_callable(fn->name);
+            if (callable && callable->checked && fn->args.size() == 1) {
+                double operand = evaluate_memo(fn->args[0], frame, state);
+                Status error = Status::OK;
+                double value = eval_unary_op(callable->op, operand, error);
+                return state.check(value, error);
+            }
+            // Unary and binary functions are called without an argument vector
+            if (callable && callable->unary && fn->args.size() == 1) {
+                double operand = evaluate_memo(fn->args[0], frame, state);
+                NUMU_STATS_CALL(callable->name, 1);
+                return callable->unary(operand);
+            }
+            if (callable && callable->binary && fn->args.size() == 2) {
+                double left = evaluate_memo(fn->args[0], frame, state);
+                double right = evaluate_memo(fn->args[1], frame, state);
+                NUMU_STATS_CALL(callable->name, 1);
+                return callable->binary(left, right);
+            }
+
             std::vector<double> args;
             args.reserve(fn->args.size());
             for (auto* arg : fn->args) {
-                args.push_back(evaluate(arg, ctx));
+                args.push_back(evaluate_memo(arg, frame, state));
             }
             
-            auto it = ctx.functions.find(name);
-            if (it != ctx.functions.end()) {
-                return it->second(args);
+            if (callable) {
+                NUMU_STATS_CALL(callable->name, 1);
+                return callable->function(args);
             }
             
-            throw EvaluationError("Unknown function: " + name);
+            throw EvaluationError("Unknown function: " + fn->name);
         }
             
         case ast::NodeType::MATRIX:
-            return eval_matrix_op(static_cast<ast::MatrixNode*>(node), ctx);
-            
         case ast::NodeType::TENSOR:
-            return eval_tensor_op(static_cast<ast::TensorNode*>(node), ctx);
+            return eval_matrix_op(node, frame);
             
         default:
             throw EvaluationError("Unknown node type in evaluation");
     }
 }
 
-void set_variable(const std::string& name, double value) {
-    global_context.variables[name] = value;
+double evaluate_memo(ast::Node* node, const Frame& frame, Evaluation& state) {
+    if (state.probe && !state.probe->visit(node)) {
+        // Nodes evaluated before this one were not memoized; shared ones are
+        // from here on
+        state.probe->shared = ast::shared_nodes(state.probe->root);
+        if (!state.probe->shared.empty()) {
+            state.shared = &state.probe->shared;
+        }
+        state.probe = nullptr;
+    }
+    if (!state.shared || !state.shared->count(node)) {
+        return evaluate_node(node, frame, state);
+    }
+    auto it = state.values.find(node);
+    if (it != state.values.end()) {
+        return it->second;
+    }
+    double value = evaluate_node(node, frame, state);
+    state.values[node] = value;
+    return value;
 }
 
-double get_variable(const std::string& name) {
-    auto it = global_context.variables.find(name);
-    if (it == global_context.variables.end()) {
-        throw EvaluationError("Undefined variable: " + name);
+} // namespace
+
+double evaluate(ast::Node* node, const Frame& frame) {
+    NUMU_STATS_STAGE(EVALUATE);
+    Evaluation state;
+    return evaluate_memo(node, frame, state);
+}
+
+double evaluate_dag(ast::Node* node, const Frame& frame) {
+    NUMU_STATS_STAGE(EVALUATE);
+    SharingProbe probe(node);
+    Evaluation state;
+    state.probe = &probe;
+    return evaluate_memo(node, frame, state);
+}
+
+double evaluate_dag(ast::Node* node, const Frame& frame,
+                    const std::unordered_map<ast::Node*, size_t>& shared) {
+    NUMU_STATS_STAGE(EVALUATE);
+    Evaluation state;
+    if (!shared.empty()) {
+        state.shared = &shared;
     }
-    return it->second;
+    return evaluate_memo(node, frame, state);
 }
 
-void register_function(const std::string& name, 
-                      std::function<double(const std::vector<double>&)> func,
-                      size_t arity) {
-    if (global_context.functions.count(name)) {
-        throw EvaluationError("Function already registered: " + name);
+Result try_evaluate(ast::Node* node, const Frame& frame) {
+    NUMU_STATS_STAGE(EVALUATE);
+    Evaluation state;
+    state.throwing = false;
+    Result result;
+    try {
+        result.value = evaluate_memo(node, frame, state);
+    } catch (const BudgetExceeded&) {
+        throw;
+    } catch (const DomainError& error) {
+        // From a matrix expression
+        state.check(0.0, error.status);
+    } catch (const EvaluationError&) {
+        // Only errors that are not data-dependent domain errors get here:
+        // unknown names, matrix shapes, registered functions
+        state.check(0.0, Status::OTHER);
     }
-    global_context.functions[name] = [func, arity, name](const auto& args) {
-        validate_args(name, arity, args.size());
-        return func(args);
-    };
+    result.status = state.status;
+    if (!result.ok()) {
+        // Comparisons of NaN are not NaN, so the value is replaced
+        result.value = std::numeric_limits<double>::quiet_NaN();
+    }
+    return result;
+}
+
+RegistryPtr default_registry() {
+    return std::atomic_load(&default_registry_slot());
+}
+
+Frame default_frame() {
+    return Frame(default_registry(), &thread_frame());
 }
 
 double evaluate(ast::Node* node) {
-    return evaluate(node, global_context);
+    return evaluate(node, default_frame());
+}
+
+double evaluate_dag(ast::Node* node) {
+    return evaluate_dag(node, default_frame());
+}
+
+Result try_evaluate(ast::Node* node) {
+    return try_evaluate(node, default_frame());
+}
+
+void set_variable(const std::string& name, double value) {
+    thread_frame().set(name, value);
+}
+
+double get_variable(const std::string& name) {
+    return default_frame().get(name);
+}
+
+void register_function(const std::string& name, Function func, size_t arity) {
+    std::lock_guard<std::mutex> lock(default_registry_mutex);
+    auto updated = default_registry()->with_function(name, std::move(func), arity);
+    std::atomic_store(&default_registry_slot(), std::move(updated));
+}
+
+void register_function(const std::string& name, UnaryFunction func) {
+    std::lock_guard<std::mutex> lock(default_registry_mutex);
+    auto updated = default_registry()->with_function(name, func);
+    std::atomic_store(&default_registry_slot(), std::move(updated));
+}
+
+void register_function(const std::string& name, BinaryFunction func) {
+    std::lock_guard<std::mutex> lock(default_registry_mutex);
+    auto updated = default_registry()->with_function(name, func);
+    std::atomic_store(&default_registry_slot(), std::move(updated));
+}
+
+void register_fallback(FallbackPtr fallback) {
+    std::lock_guard<std::mutex> lock(default_registry_mutex);
+    auto updated = default_registry()->with_fallback(std::move(fallback));
+    std::atomic_store(&default_registry_slot(), std::move(updated));
+}
+
+const Callable* find_builtin(const std::string& name) {
+    static const RegistryPtr builtins = builtin::extend(Registry::standard());
+    return builtins->find_callable(name);
+}
+
+bool unary_op(const Callable* callable, ast::UnaryOp& op) {
+    if (!callable || !callable->has_op) {
+        return false;
+    }
+    op = callable->op;
+    return true;
 }
 
 namespace builtin {
 void initialize() {
-    register_function("abs", [](const auto& args) { return std::abs(args[0]); }, 1);
-    register_function("min", [](const auto& args) { 
-        return *std::min_element(args.begin(), args.end()); 
-    }, -1); // -1 means variable arguments
-    register_function("max", [](const auto& args) { 
-        return *std::max_element(args.begin(), args.end()); 
-    }, -1);
-    register_function("sum", [](const auto& args) { 
-        return std::accumulate(args.begin(), args.end(), 0.0); 
-    }, -1);
-    register_function("avg", [](const auto& args) { 
-        return std::accumulate(args.begin(), args.end(), 0.0) / args.size(); 
-    }, -1);
-    
-    // Constants
-    set_variable("pi", 3.14159265358979323846);
-    set_variable("e", 2.71828182845904523536);
-    set_variable("inf", std::numeric_limits<double>::infinity());
+    static std::once_flag once;
+    std::call_once(once, [] {
+        std::lock_guard<std::mutex> lock(default_registry_mutex);
+        std::atomic_store(&default_registry_slot(), extend(default_registry()));
+    });
+}
+
+RegistryPtr extend(const RegistryPtr& registry) {
+    auto extended = std::make_shared<Registry>(*registry);
+    extended->add_function("abs", [](double x) { return std::fabs(x); }).builtin = Builtin::ABS;
+    extended->add_function("min", [](const auto& args) {
+        require_args("min", args);
+        return *std::min_element(args.begin(), args.end());
+    }, variadic).builtin = Builtin::MIN;
+    extended->add_function("max", [](const auto& args) {
+        require_args("max", args);
+        return *std::max_element(args.begin(), args.end());
+    }, variadic).builtin = Builtin::MAX;
+    extended->add_function("sum", [](const auto& args) {
+        return std::accumulate(args.begin(), args.end(), 0.0);
+    }, variadic).builtin = Builtin::SUM;
+    extended->add_function("avg", [](const auto& args) {
+        require_args("avg", args);
+        return std::accumulate(args.begin(), args.end(), 0.0) / args.size();
+    }, variadic).builtin = Builtin::AVG;
+    return RegistryPtr(std::move(extended))
+        // Constants
+        ->with_constant("pi", 3.14159265358979323846)
+        ->with_constant("e", 2.71828182845904523536)
+        ->with_constant("inf", std::numeric_limits<double>::infinity());
 }
 } // namespace builtin
 
@@ -0,0 +1,746 @@
+#include "numu/core/flat.h"
+#include "numu/core/arena.h"
+#include "numu/core/budget.h"
+#include "numu/core/stats.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace numu {
+namespace ast {
+
+namespace {
+// The nodes reachable from a root, all of which lie within [low, root].
+// One backward pass marks them, since children come before their parents.
+struct Reach {
+    NodeId low;
+    std::vector<uint8_t> live; // indexed by id - low
+
+    Reach(const FlatTree& tree, NodeId root)
+        : low(tree.lowest(root)), live(static_cast<size_t>(root - low) + 1, 0) {
+        live.back() = 1;
+        for (NodeId i = root + 1; i-- > low;) {
+            if (!live[i - low]) {
+                continue;
+            }
+            const NodeId* children = tree.children(i);
+            for (uint32_t k = 0; k < tree.child_count(i); ++k) {
+                if (children[k] != no_node) {
+                    live[children[k] - low] = 1;
+                }
+            }
+        }
+    }
+
+    bool contains(NodeId id) const { return live[id - low]; }
+};
+} // namespace
+
+FlatTree::FlatTree() {
+    refresh();
+}
+
+FlatTree::FlatTree(const FlatTree& other)
+    : storage_(other.storage_), columns_(other.columns_), buffer_(other.buffer_), root_(other.root_) {
+    if (owned()) {
+        refresh();
+    }
+}
+
+FlatTree::FlatTree(FlatTree&& other)
+    : storage_(std::move(other.storage_)), columns_(other.columns_),
+      buffer_(std::move(other.buffer_)), root_(other.root_) {
+    if (owned()) {
+        refresh();
+    }
+    other.storage_ = Storage();
+    other.buffer_.reset();
+    other.refresh();
+    other.root_ = no_node;
+}
+
+FlatTree& FlatTree::operator=(FlatTree other) noexcept {
+    std::swap(storage_, other.storage_);
+    std::swap(buffer_, other.buffer_);
+    std::swap(root_, other.root_);
+    columns_ = other.columns_;
+    if (owned()) {
+        refresh();
+    }
+    return *this;
+}
+
+void FlatTree::refresh() {
+    const Storage& s = storage_;
+    columns_.types = s.types.data();
+    columns_.ops = s.ops.data();
+    columns_.payloads = s.payloads.data();
+    columns_.first = s.first.data();
+    columns_.counts = s.counts.data();
+    columns_.lows = s.lows.data();
+    columns_.children = s.children.data();
+    columns_.constants = s.constants.data();
+    columns_.extents = s.extents.data();
+    columns_.name_offsets = s.name_offsets.data();
+    columns_.name_chars = s.name_chars.data();
+    columns_.entry_table = s.entry_table.data();
+    columns_.nodes = s.types.size();
+    columns_.child_slots = s.children.size();
+    columns_.constant_count = s.constants.size();
+    columns_.extent_count = s.extents.size();
+    columns_.names = s.name_offsets.size() - 1;
+    columns_.name_bytes = s.name_chars.size();
+    columns_.entries = s.entry_table.size() / 2;
+    columns_.sorted = false;
+}
+
+FlatTree::Storage& FlatTree::storage() {
+    if (!owned()) {
+        throw std::runtime_error("Flat tree is read-only");
+    }
+    return storage_;
+}
+
+uint32_t FlatTree::intern(std::string_view name) {
+    Storage& s = storage();
+    std::string key(name);
+    auto it = s.name_index.find(key);
+    if (it != s.name_index.end()) {
+        return it->second;
+    }
+    auto index = static_cast<uint32_t>(s.name_offsets.size() - 1);
+    s.name_chars.append(name);
+    s.name_offsets.push_back(static_cast<uint32_t>(s.name_chars.size()));
+    s.name_index.emplace(std::move(key), index);
+    refresh();
+    return index;
+}
+
+uint32_t FlatTree::add_constant(double value) {
+    Storage& s = storage();
+    auto index = static_cast<uint32_t>(s.constants.size());
+    s.constants.push_back(value);
+    refresh();
+    return index;
+}
+
+uint32_t FlatTree::add_extents(const uint32_t* values, size_t count) {
+    Storage& s = storage();
+    auto offset = static_cast<uint32_t>(s.extents.size());
+    s.extents.insert(s.extents.end(), values, values + count);
+    refresh();
+    return offset;
+}
+
+NodeId FlatTree::add(NodeType type, uint8_t op, uint32_t payload, const NodeId* children, size_t count) {
+    Storage& s = storage();
+    auto id = static_cast<NodeId>(s.types.size());
+    NodeId low = id;
+    for (size_t k = 0; k < count; ++k) {
+        if (children[k] == no_node) {
+            continue;
+        }
+        if (children[k] >= id) {
+            throw std::invalid_argument("Flat tree child does not exist yet");
+        }
+        low = std::min(low, s.lows[children[k]]);
+    }
+    s.types.push_back(static_cast<uint8_t>(type));
+    s.ops.push_back(op);
+    s.payloads.push_back(payload);
+    s.first.push_back(static_cast<uint32_t>(s.children.size()));
+    s.counts.push_back(static_cast<uint32_t>(count));
+    s.lows.push_back(low);
+    s.children.insert(s.children.end(), children, children + count);
+    refresh();
+    root_ = id;
+    return id;
+}
+
+NodeId FlatTree::add_number(double value) {
+    return add(NodeType::NUMBER, 0, add_constant(value), nullptr, 0);
+}
+
+NodeId FlatTree::add_boolean(bool value) {
+    return add(NodeType::BOOLEAN, 0, value ? 1 : 0, nullptr, 0);
+}
+
+NodeId FlatTree::add_variable(const std::string& name) {
+    return add(NodeType::VARIABLE, 0, intern(name), nullptr, 0);
+}
+
+NodeId FlatTree::add_binary(BinaryOp op, NodeId left, NodeId right) {
+    NodeId children[2] = {left, right};
+    return add(NodeType::BINARY_OP, static_cast<uint8_t>(op), 0, children, 2);
+}
+
+NodeId FlatTree::add_unary(UnaryOp op, NodeId operand) {
+    return add(NodeType::UNARY_OP, static_cast<uint8_t>(op), 0, &operand, 1);
+}
+
+NodeId FlatTree::add_function(const std::string& name, const std::vector<NodeId>& args) {
+    return add(NodeType::FUNCTION, 0, intern(name), args.data(), args.size());
+}
+
+void FlatTree::add_entry(const std::string& name, NodeId id) {
+    if (id >= size()) {
+        throw std::invalid_argument("Flat tree entry does not exist");
+    }
+    uint32_t index = intern(name);
+    Storage& s = storage();
+    s.entry_table.push_back(index);
+    s.entry_table.push_back(id);
+    refresh();
+}
+
+NodeId FlatTree::find(std::string_view name) const {
+    if (columns_.sorted) {
+        size_t low = 0;
+        size_t high = entry_count();
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (entry_name(middle) < name) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low < entry_count() && entry_name(low) == name ? entry_node(low) : no_node;
+    }
+    for (size_t i = 0; i < entry_count(); ++i) {
+        if (entry_name(i) == name) {
+            return entry_node(i);
+        }
+    }
+    return no_node;
+}
+
+namespace {
+// A node's children in flat order; missing ones are null
+std::vector<Node*> operands(Node* node) {
+    switch(node->type) {
+        case NodeType::BINARY_OP: {
+            auto* bin = static_cast<BinaryOpNode*>(node);
+            return {bin->left, bin->right};
+        }
+        case NodeType::UNARY_OP:
+            return {static_cast<UnaryOpNode*>(node)->operand};
+        case NodeType::FUNCTION:
+            return static_cast<FunctionNode*>(node)->args;
+        case NodeType::MATRIX: {
+            std::vector<Node*> elements;
+            for (const auto& row : static_cast<MatrixNode*>(node)->elements) {
+                elements.insert(elements.end(), row.begin(), row.end());
+            }
+            return elements;
+        }
+        case NodeType::TENSOR:
+            return static_cast<TensorNode*>(node)->values;
+        case NodeType::ASSIGNMENT:
+            return {static_cast<AssignmentNode*>(node)->value};
+        case NodeType::BLOCK:
+            return static_cast<BlockNode*>(node)->statements;
+        case NodeType::IF: {
+            auto* branch = static_cast<IfNode*>(node);
+            return {branch->condition, branch->then_branch, branch->else_branch};
+        }
+        case NodeType::WHILE: {
+            auto* loop = static_cast<WhileNode*>(node);
+            return {loop->condition, loop->body};
+        }
+        case NodeType::FOR: {
+            auto* loop = static_cast<ForNode*>(node);
+            return {loop->initializer, loop->condition, loop->increment, loop->body};
+        }
+        case NodeType::RETURN:
+            return {static_cast<ReturnNode*>(node)->value};
+        default:
+            return {};
+    }
+}
+} // namespace
+
+// Builds flat trees from Node* trees and from subtrees of other flat
+// trees, adding children before their parent. Both work without
+// recursion, so deep chains such as long sums are fine.
+class Flattener {
+public:
+    explicit Flattener(FlatTree& out) : out_(out) {}
+
+    NodeId node(Node* root) {
+        if (!root) {
+            return no_node;
+        }
+        std::vector<Node*> stack{root};
+        while (!stack.empty()) {
+            Node* current = stack.back();
+            if (done_.count(current)) {
+                stack.pop_back();
+                continue;
+            }
+            std::vector<Node*> children = operands(current);
+            bool ready = true;
+            for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                if (*it && !done_.count(*it)) {
+                    stack.push_back(*it);
+                    ready = false;
+                }
+            }
+            if (ready) {
+                done_.emplace(current, convert(current, children));
+                stack.pop_back();
+            }
+        }
+        return done_.at(root);
+    }
+
+    NodeId copy(const FlatTree& tree, NodeId id) {
+        if (id == no_node) {
+            return no_node;
+        }
+        Reach reach(tree, id);
+        std::vector<NodeId> copied(reach.live.size(), no_node);
+        std::vector<NodeId> children;
+        for (NodeId i = reach.low; i <= id; ++i) {
+            if (!reach.contains(i)) {
+                continue;
+            }
+            children.clear();
+            for (uint32_t k = 0; k < tree.child_count(i); ++k) {
+                NodeId child = tree.child(i, k);
+                children.push_back(child == no_node ? no_node : copied[child - reach.low]);
+            }
+
+            uint32_t payload = tree.payload(i);
+            switch(tree.type(i)) {
+                case NodeType::NUMBER:
+                    payload = out_.add_constant(tree.number(i));
+                    break;
+                case NodeType::STRING:
+                case NodeType::VARIABLE:
+                case NodeType::FUNCTION:
+                case NodeType::ASSIGNMENT:
+                    payload = out_.intern(tree.name(i));
+                    break;
+                case NodeType::MATRIX:
+                case NodeType::TENSOR: {
+                    const uint32_t* values = tree.extents(i);
+                    payload = out_.add_extents(values, values[0] + 1);
+                    break;
+                }
+                default:
+                    break;
+            }
+            copied[i - reach.low] = out_.add(tree.type(i), tree.op(i), payload, children.data(), children.size());
+        }
+        return copied.back();
+    }
+
+private:
+    FlatTree& out_;
+    std::unordered_map<Node*, NodeId> done_;
+
+    NodeId convert(Node* node, const std::vector<Node*>& operands) {
+        std::vector<NodeId> children;
+        children.reserve(operands.size());
+        for (auto* operand : operands) {
+            children.push_back(operand ? done_.at(operand) : no_node);
+        }
+
+        uint8_t op = 0;
+        uint32_t payload = 0;
+        switch(node->type) {
+            case NodeType::NUMBER:
+                payload = out_.add_constant(static_cast<NumberNode*>(node)->value);
+                break;
+            case NodeType::BOOLEAN:
+                payload = static_cast<BooleanNode*>(node)->value ? 1 : 0;
+                break;
+            case NodeType::STRING:
+                payload = out_.intern(static_cast<StringNode*>(node)->value);
+                break;
+            case NodeType::VARIABLE:
+                payload = out_.intern(static_cast<VariableNode*>(node)->name);
+                break;
+            case NodeType::BINARY_OP:
+                op = static_cast<uint8_t>(static_cast<BinaryOpNode*>(node)->op);
+                break;
+            case NodeType::UNARY_OP:
+                op = static_cast<uint8_t>(static_cast<UnaryOpNode*>(node)->op);
+                break;
+            case NodeType::FUNCTION:
+                payload = out_.intern(static_cast<FunctionNode*>(node)->name);
+                break;
+            case NodeType::MATRIX: {
+                const auto& elements = static_cast<MatrixNode*>(node)->elements;
+                std::vector<uint32_t> rows{static_cast<uint32_t>(elements.size())};
+                for (const auto& row : elements) {
+                    rows.push_back(static_cast<uint32_t>(row.size()));
+                }
+                payload = out_.add_extents(rows.data(), rows.size());
+                break;
+            }
+            case NodeType::TENSOR: {
+                const auto& shape = static_cast<TensorNode*>(node)->dims;
+                std::vector<uint32_t> dims{static_cast<uint32_t>(shape.size())};
+                for (auto dim : shape) {
+                    dims.push_back(static_cast<uint32_t>(dim));
+                }
+                payload = out_.add_extents(dims.data(), dims.size());
+                break;
+            }
+            case NodeType::ASSIGNMENT:
+                payload = out_.intern(static_cast<AssignmentNode*>(node)->name);
+                break;
+            case NodeType::BLOCK:
+            case NodeType::IF:
+            case NodeType::WHILE:
+            case NodeType::FOR:
+            case NodeType::RETURN:
+                break;
+            default:
+                throw std::runtime_error("Unknown node type in flatten");
+        }
+        return out_.add(node->type, op, payload, children.data(), children.size());
+    }
+};
+
+FlatTree flatten(Node* root) {
+    FlatTree tree;
+    tree.set_root(flatten(root, tree));
+    return tree;
+}
+
+NodeId flatten(Node* root, FlatTree& into) {
+    NodeId previous = into.root();
+    NodeId id = Flattener(into).node(root);
+    into.set_root(previous);
+    return id;
+}
+
+Node* to_node(const FlatTree& tree, NodeId id) {
+    if (id == no_node) {
+        return nullptr;
+    }
+    Reach reach(tree, id);
+    std::vector<Node*> built(reach.live.size(), nullptr);
+    std::vector<Node*> children;
+    for (NodeId i = reach.low; i <= id; ++i) {
+        if (!reach.contains(i)) {
+            continue;
+        }
+        children.clear();
+        for (uint32_t k = 0; k < tree.child_count(i); ++k) {
+            NodeId child = tree.child(i, k);
+            children.push_back(child == no_node ? nullptr : built[child - reach.low]);
+        }
+
+        Node* node = nullptr;
+        switch(tree.type(i)) {
+            case NodeType::NUMBER:
+                node = NumberNode::create(tree.number(i));
+                break;
+            case NodeType::BOOLEAN:
+                node = BooleanNode::create(tree.payload(i) != 0);
+                break;
+            case NodeType::STRING:
+                node = StringNode::create(std::string(tree.name(i)));
+                break;
+            case NodeType::VARIABLE:
+                node = VariableNode::create(std::string(tree.name(i)));
+                break;
+            case NodeType::BINARY_OP:
+                node = BinaryOpNode::create(static_cast<BinaryOp>(tree.op(i)), children[0], children[1]);
+                break;
+            case NodeType::UNARY_OP:
+                node = UnaryOpNode::create(static_cast<UnaryOp>(tree.op(i)), children[0]);
+                break;
+            case NodeType::FUNCTION:
+                node = FunctionNode::create(std::string(tree.name(i)), children);
+                break;
+            case NodeType::MATRIX: {
+                const uint32_t* rows = tree.extents(i);
+                std::vector<std::vector<Node*>> elements(rows[0]);
+                auto next = children.begin();
+                for (uint32_t r = 0; r < rows[0]; ++r) {
+                    elements[r].assign(next, next + rows[r + 1]);
+                    next += rows[r + 1];
+                }
+                node = MatrixNode::create(std::move(elements));
+                break;
+            }
+            case NodeType::TENSOR: {
+                const uint32_t* dims = tree.extents(i);
+                node = TensorNode::create(std::vector<size_t>(dims + 1, dims + 1 + dims[0]), children);
+                break;
+            }
+            case NodeType::ASSIGNMENT:
+                node = AssignmentNode::create(std::string(tree.name(i)), children[0]);
+                break;
+            case NodeType::BLOCK:
+                node = BlockNode::create(children);
+                break;
+            case NodeType::IF:
+                node = IfNode::create(children[0], children[1], children[2]);
+                break;
+            case NodeType::WHILE:
+                node = WhileNode::create(children[0], children[1]);
+                break;
+            case NodeType::FOR:
+                node = ForNode::create(children[0], children[1], children[2], children[3]);
+                break;
+            case NodeType::RETURN:
+                node = ReturnNode::create(children[0]);
+                break;
+        }
+        built[i - reach.low] = node;
+    }
+    return built.back();
+}
+
+Node* to_node(const FlatTree& tree) {
+    return tree.empty() ? nullptr : to_node(tree, tree.root());
+}
+
+FlatTree clone(const FlatTree& tree, NodeId id) {
+    FlatTree out;
+    Flattener flattener(out);
+    out.set_root(flattener.copy(tree, id));
+    return out;
+}
+
+size_t hash(const FlatTree& tree, NodeId id) {
+    if (id == no_node) {
+        return 0;
+    }
+    Reach reach(tree, id);
+    std::vector<size_t> hashes(reach.live.size(), 0);
+    auto of = [&](NodeId child) { return child == no_node ? 0 : hashes[child - reach.low]; };
+
+    for (NodeId i = reach.low; i <= id; ++i) {
+        if (!reach.contains(i)) {
+            continue;
+        }
+        NodeType type = tree.type(i);
+        const NodeId* children = tree.children(i);
+        uint32_t count = tree.child_count(i);
+        size_t h = hash_mix(0, static_cast<size_t>(type));
+        switch(type) {
+            case NodeType::NUMBER:
+                h = hash_mix(h, hash_number(tree.number(i)));
+                break;
+            case NodeType::BOOLEAN:
+                h = hash_mix(h, tree.payload(i));
+                break;
+            case NodeType::STRING:
+            case NodeType::VARIABLE:
+                h = hash_mix(h, std::hash<std::string_view>{}(tree.name(i)));
+                break;
+            case NodeType::BINARY_OP:
+            case NodeType::UNARY_OP:
+                h = hash_mix(h, tree.op(i));
+                for (uint32_t k = 0; k < count; ++k) {
+                    h = hash_mix(h, of(children[k]));
+                }
+                break;
+            case NodeType::FUNCTION:
+                h = hash_mix(h, std::hash<std::string_view>{}(tree.name(i)));
+                h = hash_mix(h, count);
+                for (uint32_t k = 0; k < count; ++k) {
+                    h = hash_mix(h, of(children[k]));
+                }
+                break;
+            case NodeType::MATRIX: {
+                const uint32_t* rows = tree.extents(i);
+                h = hash_mix(h, rows[0]);
+                size_t next = 0;
+                for (uint32_t r = 0; r < rows[0]; ++r) {
+                    h = hash_mix(h, rows[r + 1]);
+                    for (uint32_t c = 0; c < rows[r + 1]; ++c) {
+                        h = hash_mix(h, of(children[next++]));
+                    }
+                }
+                break;
+            }
+            case NodeType::TENSOR: {
+                const uint32_t* dims = tree.extents(i);
+                h = hash_mix(h, dims[0]);
+                for (uint32_t d = 0; d < dims[0]; ++d) {
+                    h = hash_mix(h, dims[d + 1]);
+                }
+                for (uint32_t k = 0; k < count; ++k) {
+                    h = hash_mix(h, of(children[k]));
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type in hash");
+        }
+        // 0 marks an empty cache slot in hash(Node*)
+        hashes[i - reach.low] = h == 0 ? 1 : h;
+    }
+    return hashes.back();
+}
+
+void traverse(const FlatTree& tree, NodeId id, const std::function<void(NodeId)>& visitor) {
+    if (id == no_node) {
+        return;
+    }
+    std::vector<NodeId> stack{id};
+    while (!stack.empty()) {
+        NodeId current = stack.back();
+        stack.pop_back();
+        visitor(current);
+
+        switch(tree.type(current)) {
+            case NodeType::BINARY_OP:
+            case NodeType::UNARY_OP:
+            case NodeType::FUNCTION:
+            case NodeType::MATRIX:
+            case NodeType::TENSOR: {
+                const NodeId* children = tree.children(current);
+                for (uint32_t k = tree.child_count(current); k-- > 0;) {
+                    if (children[k] != no_node) {
+                        stack.push_back(children[k]);
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace ast
+
+namespace core {
+
+double evaluate(const ast::FlatTree& tree, ast::NodeId id, const Frame& frame) {
+    if (id == ast::no_node) {
+        throw EvaluationError("Null node in evaluation");
+    }
+    NUMU_STATS_STAGE(EVALUATE);
+    ast::Reach reach(tree, id);
+    for (ast::NodeId i = reach.low; i <= id; ++i) {
+        if (reach.contains(i) && (tree.type(i) == ast::NodeType::MATRIX || tree.type(i) == ast::NodeType::TENSOR)) {
+            ast::ArenaScope scratch;
+            return evaluate_dag(ast::to_node(tree, id), frame);
+        }
+    }
+
+    // Each name is resolved the first time a node uses it. Expressions use
+    // few distinct names, fewer than a library's whole name table holds.
+    std::vector<std::pair<uint32_t, const double*>> variables;
+    std::vector<std::pair<uint32_t, const Callable*>> functions;
+    auto variable = [&](uint32_t name) {
+        for (const auto& entry : variables) {
+            if (entry.first == name) {
+                return entry.second;
+            }
+        }
+        std::string text(tree.name_at(name));
+        const double* value = frame.find(text);
+        if (!value) {
+            value = frame.registry().find_constant(text);
+        }
+        if (!value) {
+            throw EvaluationError("Undefined variable: " + text);
+        }
+        variables.emplace_back(name, value);
+        return value;
+    };
+    auto function = [&](uint32_t name) {
+        for (const auto& entry : functions) {
+            if (entry.first == name) {
+                return entry.second;
+            }
+        }
+        std::string text(tree.name_at(name));
+        const Callable* callable = frame.registry().find_callable(text);
+        if (!callable) {
+            throw EvaluationError("Unknown function: " + text);
+        }
+        functions.emplace_back(name, callable);
+        return callable;
+    };
+
+    std::vector<double> values(reach.live.size(), 0.0);
+    auto value = [&](ast::NodeId node) -> double& { return values[node - reach.low]; };
+    std::vector<double> args;
+    BudgetScope* budget = BudgetScope::current();
+
+    for (ast::NodeId i = reach.low; i <= id; ++i) {
+        if (!reach.contains(i)) {
+            continue;
+        }
+        if (budget) {
+            budget->charge(1);
+        }
+        const ast::NodeId* children = tree.children(i);
+        switch(tree.type(i)) {
+            case ast::NodeType::NUMBER:
+                value(i) = tree.number(i);
+                break;
+            case ast::NodeType::BOOLEAN:
+                value(i) = tree.payload(i) ? 1.0 : 0.0;
+                break;
+            case ast::NodeType::VARIABLE:
+                value(i) = *variable(tree.payload(i));
+                break;
+            case ast::NodeType::BINARY_OP:
+                if (children[0] == ast::no_node || children[1] == ast::no_node) {
+                    throw EvaluationError("Null node in evaluation");
+                }
+                value(i) = eval_binary_op(static_cast<ast::BinaryOp>(tree.op(i)),
+                                          value(children[0]), value(children[1]));
+                break;
+            case ast::NodeType::UNARY_OP:
+                if (children[0] == ast::no_node) {
+                    throw EvaluationError("Null node in evaluation");
+                }
+                value(i) = eval_unary_op(static_cast<ast::UnaryOp>(tree.op(i)), value(children[0]));
+                break;
+            case ast::NodeType::FUNCTION: {
+                const Callable& func = *function(tree.payload(i));
+                uint32_t count = tree.child_count(i);
+                for (uint32_t k = 0; k < count; ++k) {
+                    if (children[k] == ast::no_node) {
+                        throw EvaluationError("Null node in evaluation");
+                    }
+                }
+                NUMU_STATS_CALL(func.name, 1);
+                if (count == 1 && func.checked) {
+                    value(i) = eval_unary_op(func.op, value(children[0]));
+                } else if (count == 1 && func.unary) {
+                    value(i) = func.unary(value(children[0]));
+                } else if (count == 2 && func.binary) {
+                    value(i) = func.binary(value(children[0]), value(children[1]));
+                } else {
+                    args.resize(count);
+                    for (uint32_t k = 0; k < count; ++k) {
+                        args[k] = value(children[k]);
+                    }
+                    value(i) = func.function(args);
+                }
+                break;
+            }
+            default:
+                throw EvaluationError("Unknown node type in evaluation");
+        }
+    }
+    return values.back();
+}
+
+double evaluate(const ast::FlatTree& tree, const Frame& frame) {
+    return evaluate(tree, tree.root(), frame);
+}
+
+double evaluate(const ast::FlatTree& tree) {
+    return evaluate(tree, tree.root(), default_frame());
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,324 @@
+#include "numu/core/integrate.h"
+#include "numu/core/batch.h"
+#include "numu/core/compile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+namespace {
+// Kronrod abscissae on [-1, 1]; the odd entries are the 10-point Gauss
+// abscissae. The centre point is last.
+constexpr size_t rule_points = 21;
+constexpr double kronrod_nodes[11] = {
+    0.995657163025808080735527280689003, 0.973906528517171720077964012084452,
+    0.930157491355708226001207180059508, 0.865063366688984510732096688423493,
+    0.780817726586416897063717578345042, 0.679409568299024406234327365114874,
+    0.562757134668604683339000099272694, 0.433395394129247190799265943165784,
+    0.294392862701460198131126603103866, 0.148874338981631210884826001129720,
+    0.0,
+};
+constexpr double kronrod_weights[11] = {
+    0.011694638867371874278064396062192, 0.032558162307964727478818972459390,
+    0.054755896574351996031381300244580, 0.075039674810919952767043140916190,
+    0.093125454583697605535065465083366, 0.109387158802297641899210590325805,
+    0.123491976262065851077600525634681, 0.134709217311473325928054001771707,
+    0.142775938577060080797094273138717, 0.147739104901338491374841515972068,
+    0.149445554002916905664936468389821,
+};
+constexpr double gauss_weights[5] = {
+    0.066671344308688137593568809893332, 0.149451349150580593145776339657697,
+    0.219086362515982043995534934228163, 0.269266719309996355091226921569469,
+    0.295524224714752870173892994651338,
+};
+
+// Intervals per round and worker; keeps each batch a few hundred points
+constexpr size_t intervals_per_worker = 8;
+// Fewest integrand points worth handing to another worker
+constexpr size_t parallel_points = 8 * rule_points;
+
+struct Interval {
+    double a;
+    double b;
+    double value;
+    double error;
+};
+
+bool less_error(const Interval& x, const Interval& y) {
+    return x.error < y.error;
+}
+
+// Infinite ranges are integrated over t in a finite range through
+// x = map(t), multiplying the integrand by dx/dt
+class Transform {
+public:
+    Transform(double lower, double upper) : lower_(lower), upper_(upper) {
+        if (std::isinf(lower) && std::isinf(upper)) {
+            kind_ = Kind::BOTH;
+        } else if (std::isinf(upper)) {
+            kind_ = Kind::UPPER;
+        } else if (std::isinf(lower)) {
+            kind_ = Kind::LOWER;
+        }
+    }
+
+    double t_lower() const {
+        switch(kind_) {
+            case Kind::NONE: return lower_;
+            case Kind::BOTH: return -1.0;
+            default: return 0.0;
+        }
+    }
+
+    double t_upper() const {
+        return kind_ == Kind::NONE ? upper_ : 1.0;
+    }
+
+    double x(double t) const {
+        switch(kind_) {
+            case Kind::NONE: return t;
+            case Kind::UPPER: return lower_ + t / (1.0 - t);
+            case Kind::LOWER: return upper_ - (1.0 - t) / t;
+            default: return t / (1.0 - t * t);
+        }
+    }
+
+    double jacobian(double t) const {
+        switch(kind_) {
+            case Kind::NONE: return 1.0;
+            case Kind::UPPER: return 1.0 / ((1.0 - t) * (1.0 - t));
+            case Kind::LOWER: return 1.0 / (t * t);
+            default: return (1.0 + t * t) / ((1.0 - t * t) * (1.0 - t * t));
+        }
+    }
+
+private:
+    enum class Kind { NONE, UPPER, LOWER, BOTH };
+    Kind kind_ = Kind::NONE;
+    double lower_;
+    double upper_;
+};
+
+void abscissae(const Interval& interval, const Transform& transform, double* t, double* x) {
+    double centre = 0.5 * (interval.a + interval.b);
+    double half = 0.5 * (interval.b - interval.a);
+    for (size_t j = 0; j < 10; ++j) {
+        t[j] = centre - half * kronrod_nodes[j];
+        t[10 + j] = centre + half * kronrod_nodes[j];
+    }
+    t[20] = centre;
+    for (size_t j = 0; j < rule_points; ++j) {
+        x[j] = transform.x(t[j]);
+    }
+}
+
+// Error estimate as in QUADPACK's qk21
+void apply_rule(Interval& interval, const double* f) {
+    double half = 0.5 * (interval.b - interval.a);
+    double kronrod = kronrod_weights[10] * f[20];
+    double gauss = 0.0;
+    double absolute = std::fabs(kronrod);
+    for (size_t j = 0; j < 10; ++j) {
+        double pair = f[j] + f[10 + j];
+        kronrod += kronrod_weights[j] * pair;
+        absolute += kronrod_weights[j] * (std::fabs(f[j]) + std::fabs(f[10 + j]));
+        if (j % 2 == 1) {
+            gauss += gauss_weights[j / 2] * pair;
+        }
+    }
+    double mean = 0.5 * kronrod;
+    double spread = kronrod_weights[10] * std::fabs(f[20] - mean);
+    for (size_t j = 0; j < 10; ++j) {
+        spread += kronrod_weights[j] * (std::fabs(f[j] - mean) + std::fabs(f[10 + j] - mean));
+    }
+
+    double scale = std::fabs(half);
+    interval.value = kronrod * half;
+    absolute *= scale;
+    spread *= scale;
+    double error = std::fabs((kronrod - gauss) * half);
+    if (spread != 0.0 && error != 0.0) {
+        error = spread * std::min(1.0, std::pow(200.0 * error / spread, 1.5));
+    }
+    constexpr double epsilon = std::numeric_limits<double>::epsilon();
+    if (absolute > std::numeric_limits<double>::min() / (50.0 * epsilon)) {
+        error = std::max(50.0 * epsilon * absolute, error);
+    }
+    interval.error = error;
+}
+
+class Integrator {
+public:
+    Integrator(CompiledExpression expr, const Transform& transform, Scheduler* scheduler)
+        : expr_(std::move(expr)), transform_(transform), scheduler_(scheduler) {}
+
+    // Applies the rule to every interval, evaluating all abscissae at once
+    void evaluate(std::vector<Interval>& intervals) {
+        size_t count = intervals.size() * rule_points;
+        t_.resize(count);
+        x_.resize(count);
+        f_.resize(count);
+        for (size_t i = 0; i < intervals.size(); ++i) {
+            abscissae(intervals[i], transform_, &t_[i * rule_points], &x_[i * rule_points]);
+        }
+
+        auto run = [this](size_t begin, size_t end) {
+            const double* column = x_.data() + begin;
+            evaluate_batch(expr_, &column, end - begin, f_.data() + begin);
+        };
+        if (scheduler_ && scheduler_->workers() > 1 && count >= 2 * parallel_points) {
+            size_t grain = std::max(parallel_points, count / scheduler_->workers() / rule_points * rule_points);
+            scheduler_->parallel_for(count, grain, run);
+        } else {
+            run(0, count);
+        }
+
+        for (size_t k = 0; k < count; ++k) {
+            double jacobian = transform_.jacobian(t_[k]);
+            // Far out on an infinite range the integrand has to vanish
+            // faster than the substitution grows
+            f_[k] = std::isinf(x_[k]) || std::isinf(jacobian) ? 0.0 : f_[k] * jacobian;
+            if (!std::isfinite(f_[k])) {
+                throw EvaluationError("Integrand is not finite at " + std::to_string(x_[k]));
+            }
+        }
+        for (size_t i = 0; i < intervals.size(); ++i) {
+            apply_rule(intervals[i], &f_[i * rule_points]);
+        }
+        evaluations_ += count;
+    }
+
+    size_t evaluations() const { return evaluations_; }
+
+private:
+    CompiledExpression expr_;
+    Transform transform_;
+    Scheduler* scheduler_;
+    std::vector<double> t_;
+    std::vector<double> x_;
+    std::vector<double> f_;
+    size_t evaluations_ = 0;
+};
+} // namespace
+
+IntegrationOptions IntegrationOptions::from(const config::Config& config) {
+    IntegrationOptions options;
+    options.relative_tolerance = config.get_number("calculus.integral.relative_tolerance",
+                                                   options.relative_tolerance);
+    options.absolute_tolerance = config.get_number("calculus.integral.absolute_tolerance",
+                                                   options.absolute_tolerance);
+    options.max_steps = static_cast<size_t>(
+        config.get_number("core.max_steps", static_cast<double>(options.max_steps)));
+    options.timeout = config.get_number("core.timeout", options.timeout);
+    return options;
+}
+
+IntegrationResult integrate(ast::Node* integrand, const std::string& variable,
+                            double lower, double upper, const Frame& frame,
+                            const IntegrationOptions& options, Scheduler* scheduler) {
+    if (std::isnan(lower) || std::isnan(upper)) {
+        throw EvaluationError("Integration bounds must not be NaN");
+    }
+    IntegrationResult result;
+    if (lower == upper) {
+        result.converged = true;
+        return result;
+    }
+    if (lower > upper) {
+        result = integrate(integrand, variable, upper, lower, frame, options, scheduler);
+        result.value = -result.value;
+        return result;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+                                       std::chrono::duration<double, std::milli>(options.timeout));
+
+    Transform transform(lower, upper);
+    Integrator integrator(compile(integrand, {variable}, frame), transform, scheduler);
+    size_t workers = scheduler ? scheduler->workers() : 1;
+    size_t width = intervals_per_worker * workers;
+
+    std::vector<Interval> heap{Interval{transform.t_lower(), transform.t_upper(), 0.0, 0.0}};
+    integrator.evaluate(heap);
+    result.steps = 1;
+    // Intervals too narrow to split further still count towards the totals
+    double settled_value = 0.0;
+    double settled_error = 0.0;
+    double span = transform.t_upper() - transform.t_lower();
+
+    std::vector<Interval> worst;
+    std::vector<Interval> halves;
+    while (true) {
+        double value = settled_value;
+        double error = settled_error;
+        for (const auto& interval : heap) {
+            value += interval.value;
+            error += interval.error;
+        }
+        result.value = value;
+        result.error = error;
+        double tolerance = std::max(options.absolute_tolerance, options.relative_tolerance * std::fabs(value));
+        if (error <= tolerance || heap.empty()) {
+            result.converged = error <= tolerance;
+            break;
+        }
+        // The clock is read once per round, not per evaluation
+        if (options.timeout > 0 && clock::now() >= deadline) {
+            break;
+        }
+
+        size_t room = width;
+        if (options.max_steps) {
+            room = std::min(room, (options.max_steps - std::min(options.max_steps, result.steps)) / 2);
+        }
+        if (room == 0) {
+            break;
+        }
+
+        // Take the worst interval, then any others whose error exceeds
+        // their share of the tolerance
+        worst.clear();
+        do {
+            std::pop_heap(heap.begin(), heap.end(), less_error);
+            worst.push_back(heap.back());
+            heap.pop_back();
+        } while (worst.size() < room && !heap.empty() &&
+                 heap.front().error > tolerance * (heap.front().b - heap.front().a) / span);
+
+        halves.clear();
+        for (const auto& interval : worst) {
+            double middle = 0.5 * (interval.a + interval.b);
+            if (middle <= interval.a || middle >= interval.b) {
+                settled_value += interval.value;
+                settled_error += interval.error;
+                continue;
+            }
+            halves.push_back(Interval{interval.a, middle, 0.0, 0.0});
+            halves.push_back(Interval{middle, interval.b, 0.0, 0.0});
+        }
+        if (halves.empty()) {
+            continue;
+        }
+        integrator.evaluate(halves);
+        result.steps += halves.size();
+        for (const auto& half : halves) {
+            heap.push_back(half);
+            std::push_heap(heap.begin(), heap.end(), less_error);
+        }
+    }
+    result.evaluations = integrator.evaluations();
+    return result;
+}
+
+IntegrationResult integrate(ast::Node* integrand, const std::string& variable,
+                            double lower, double upper, const IntegrationOptions& options) {
+    return integrate(integrand, variable, lower, upper, default_frame(), options);
+}
+
+} // namespace core
+} // namespace numu
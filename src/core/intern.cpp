@@ -0,0 +1,34 @@
+#include "numu/core/intern.h"
+#include <atomic>
+
+namespace numu {
+namespace ast {
+
+namespace {
+std::atomic<uint32_t> next_interner_id{1};
+thread_local Interner* active_interner = nullptr;
+}
+
+Interner::Interner() : id_(next_interner_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+void Interner::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_.clear();
+    arena_.reset();
+    hits_ = 0;
+}
+
+Interner* current_interner() {
+    return active_interner;
+}
+
+InternScope::InternScope(Interner& interner) : previous_(active_interner) {
+    active_interner = &interner;
+}
+
+InternScope::~InternScope() {
+    active_interner = previous_;
+}
+
+} // namespace ast
+} // namespace numu
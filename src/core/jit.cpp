@@ -0,0 +1,393 @@
+#include "numu/core/jit.h"
+#include "numu/core/budget.h"
+#include "numu/core/eval.h"
+#include "numu/core/stats.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(NUMU_ENABLE_JIT) && defined(__x86_64__) && !defined(_WIN32)
+#define NUMU_JIT_X86_64 1
+#include <sys/mman.h>
+#endif
+
+namespace numu {
+namespace core {
+
+namespace {
+#ifdef NUMU_JIT_X86_64
+// Out-of-line helpers called from generated code. Exceptions cannot unwind
+// through generated frames, so every error becomes NaN.
+double call_sin(double x) { return std::sin(x); }
+double call_cos(double x) { return std::cos(x); }
+double call_tan(double x) { return std::tan(x); }
+double call_exp(double x) { return std::exp(x); }
+
+double call_log(double x) {
+    return x > 0.0 ? std::log(x) : std::numeric_limits<double>::quiet_NaN();
+}
+
+double call_binary(double a, double b, int op) {
+    try {
+        return eval_binary_op(static_cast<ast::BinaryOp>(op), a, b);
+    } catch (...) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+double call_unary(double a, int op) {
+    try {
+        return eval_unary_op(static_cast<ast::UnaryOp>(op), a);
+    } catch (...) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+double call_function(const Callable* func, const double* args, size_t argc) {
+    NUMU_STATS_CALL(func->name, 1);
+    try {
+        if (argc == 1 && func->unary) {
+            return func->unary(args[0]);
+        }
+        if (argc == 2 && func->binary) {
+            return func->binary(args[0], args[1]);
+        }
+        return func->function(std::vector<double>(args, args + argc));
+    } catch (...) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+// Minimal x86-64 encoder for the instructions below. Virtual registers live
+// in a stack frame addressed from rsp; rbx holds the variables pointer.
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    void bytes(std::initializer_list<uint8_t> b) { code.insert(code.end(), b); }
+
+    void imm32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void imm64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    // <prefix> 0F <op> xmm, [rsp + disp32]
+    void sse_rsp(uint8_t prefix, uint8_t op, int xmm, uint32_t disp) {
+        bytes({prefix, 0x0F, op, static_cast<uint8_t>(0x84 | (xmm << 3)), 0x24});
+        imm32(disp);
+    }
+
+    void load(int xmm, uint32_t reg) { sse_rsp(0xF2, 0x10, xmm, reg * 8); }
+    void store(uint32_t reg, int xmm) { sse_rsp(0xF2, 0x11, xmm, reg * 8); }
+
+    // movsd xmm, [rbx + disp32]
+    void load_variable(int xmm, uint32_t slot) {
+        bytes({0xF2, 0x0F, 0x10, static_cast<uint8_t>(0x83 | (xmm << 3))});
+        imm32(slot * 8);
+    }
+
+    void mov_rax(uint64_t value) { bytes({0x48, 0xB8}); imm64(value); }
+    void mov_rdi(uint64_t value) { bytes({0x48, 0xBF}); imm64(value); }
+    void mov_edi(uint32_t value) { code.push_back(0xBF); imm32(value); }
+    void mov_edx(uint32_t value) { code.push_back(0xBA); imm32(value); }
+    void movq_xmm_rax(int xmm) { bytes({0x66, 0x48, 0x0F, 0x6E, static_cast<uint8_t>(0xC0 | (xmm << 3))}); }
+
+    // lea rsi, [rsp + disp32]
+    void lea_rsi(uint32_t disp) { bytes({0x48, 0x8D, 0xB4, 0x24}); imm32(disp); }
+
+    // mov [rsp + disp32], rax
+    void store_rax(uint32_t reg) { bytes({0x48, 0x89, 0x84, 0x24}); imm32(reg * 8); }
+
+    void call(const void* target) {
+        mov_rax(reinterpret_cast<uint64_t>(target));
+        bytes({0xFF, 0xD0});
+    }
+
+    // Conditional jump to the bail-out stub, patched once it is emitted
+    void jump_to_bail(uint8_t condition) {
+        bytes({0x0F, condition});
+        bail_sites.push_back(code.size());
+        imm32(0);
+    }
+
+    void patch_bail(size_t target) {
+        for (size_t site : bail_sites) {
+            auto rel = static_cast<uint32_t>(target - (site + 4));
+            std::memcpy(&code[site], &rel, 4);
+        }
+    }
+
+private:
+    std::vector<size_t> bail_sites;
+};
+
+constexpr uint8_t JE = 0x84;  // ZF: equal or unordered
+constexpr uint8_t JB = 0x82;  // CF: below or unordered
+constexpr uint8_t JP = 0x8A;  // PF: unordered
+
+constexpr uint8_t ADDSD = 0x58;
+constexpr uint8_t MULSD = 0x59;
+constexpr uint8_t SUBSD = 0x5C;
+constexpr uint8_t DIVSD = 0x5E;
+
+bool supported(const CompiledExpression& expr) {
+    for (const auto& ins : expr.code) {
+        if (ins.code == OpCode::JUMP || ins.code == OpCode::JUMP_IF_FALSE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Calls a helper with the first operand in xmm0 and bails on a NaN result
+void emit_checked_call(Assembler& as, const void* helper, uint32_t dst) {
+    as.call(helper);
+    as.bytes({0x66, 0x0F, 0x2E, 0xC0}); // ucomisd xmm0, xmm0
+    as.jump_to_bail(JP);
+    as.store(dst, 0);
+}
+
+std::vector<uint8_t> generate(const CompiledExpression& expr) {
+    Assembler as;
+    // Entry rsp is 8 mod 16; push rbx restores 16-byte alignment for calls
+    auto frame = static_cast<uint32_t>((expr.registers * 8 + 15) & ~15u);
+
+    as.bytes({0x53});             // push rbx
+    as.bytes({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    as.bytes({0x48, 0x81, 0xEC}); // sub rsp, frame
+    as.imm32(frame);
+
+    for (const auto& ins : expr.code) {
+        switch(ins.code) {
+            case OpCode::CONST: {
+                uint64_t bits;
+                std::memcpy(&bits, &expr.constants[ins.a], sizeof(bits));
+                as.mov_rax(bits);
+                as.store_rax(ins.dst);
+                break;
+            }
+            case OpCode::LOAD:
+                as.load_variable(0, ins.a);
+                as.store(ins.dst, 0);
+                break;
+            case OpCode::MOVE:
+                as.load(0, ins.a);
+                as.store(ins.dst, 0);
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL: {
+                uint8_t op = ins.code == OpCode::ADD ? ADDSD : ins.code == OpCode::SUB ? SUBSD : MULSD;
+                as.load(0, ins.a);
+                as.sse_rsp(0xF2, op, 0, ins.b * 8);
+                as.store(ins.dst, 0);
+                break;
+            }
+            case OpCode::DIV:
+                as.load(1, ins.b);
+                as.bytes({0x66, 0x0F, 0x57, 0xD2}); // xorpd xmm2, xmm2
+                as.bytes({0x66, 0x0F, 0x2E, 0xCA}); // ucomisd xmm1, xmm2
+                as.jump_to_bail(JE);
+                as.load(0, ins.a);
+                as.bytes({0xF2, 0x0F, DIVSD, 0xC1}); // divsd xmm0, xmm1
+                as.store(ins.dst, 0);
+                break;
+            case OpCode::NEG:
+                as.mov_rax(0x8000000000000000ull);
+                as.movq_xmm_rax(1);
+                as.load(0, ins.a);
+                as.bytes({0x66, 0x0F, 0x57, 0xC1}); // xorpd xmm0, xmm1
+                as.store(ins.dst, 0);
+                break;
+            case OpCode::SQRT:
+                as.load(0, ins.a);
+                as.bytes({0x66, 0x0F, 0x57, 0xC9}); // xorpd xmm1, xmm1
+                as.bytes({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+                as.jump_to_bail(JB);
+                as.bytes({0xF2, 0x0F, 0x51, 0xC0}); // sqrtsd xmm0, xmm0
+                as.store(ins.dst, 0);
+                break;
+            case OpCode::SIN:
+            case OpCode::COS:
+            case OpCode::TAN:
+            case OpCode::EXP: {
+                double (*helper)(double) = ins.code == OpCode::SIN ? call_sin :
+                                           ins.code == OpCode::COS ? call_cos :
+                                           ins.code == OpCode::TAN ? call_tan : call_exp;
+                as.load(0, ins.a);
+                as.call(reinterpret_cast<const void*>(helper));
+                as.store(ins.dst, 0);
+                break;
+            }
+            case OpCode::LOG:
+                as.load(0, ins.a);
+                emit_checked_call(as, reinterpret_cast<const void*>(call_log), ins.dst);
+                break;
+            case OpCode::MOD:
+            case OpCode::POW:
+            case OpCode::BINARY:
+                as.load(0, ins.a);
+                as.load(1, ins.b);
+                as.mov_edi(ins.op);
+                emit_checked_call(as, reinterpret_cast<const void*>(call_binary), ins.dst);
+                break;
+            case OpCode::UNARY:
+                as.load(0, ins.a);
+                as.mov_edi(ins.op);
+                emit_checked_call(as, reinterpret_cast<const void*>(call_unary), ins.dst);
+                break;
+            case OpCode::CALL:
+                as.mov_rdi(reinterpret_cast<uint64_t>(expr.functions[ins.b]));
+                as.lea_rsi(ins.a * 8);
+                as.mov_edx(ins.argc);
+                emit_checked_call(as, reinterpret_cast<const void*>(call_function), ins.dst);
+                break;
+            case OpCode::JUMP:
+            case OpCode::JUMP_IF_FALSE:
+                return {};
+        }
+    }
+
+    as.load(0, expr.result);
+    auto epilogue = [&as, frame] {
+        as.bytes({0x48, 0x81, 0xC4}); // add rsp, frame
+        as.imm32(frame);
+        as.bytes({0x5B, 0xC3});       // pop rbx; ret
+    };
+    epilogue();
+
+    as.patch_bail(as.code.size());
+    uint64_t nan;
+    double quiet_nan = std::numeric_limits<double>::quiet_NaN();
+    std::memcpy(&nan, &quiet_nan, sizeof(nan));
+    as.mov_rax(nan);
+    as.movq_xmm_rax(0);
+    epilogue();
+    return std::move(as.code);
+}
+#endif
+} // namespace
+
+NativeFunction::NativeFunction(NativeFunction&& other) noexcept
+    : code_(std::exchange(other.code_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      entry_(std::exchange(other.entry_, nullptr)) {}
+
+NativeFunction& NativeFunction::operator=(NativeFunction&& other) noexcept {
+    if (this != &other) {
+        NativeFunction old(std::move(*this));
+        code_ = std::exchange(other.code_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        entry_ = std::exchange(other.entry_, nullptr);
+    }
+    return *this;
+}
+
+NativeFunction::~NativeFunction() {
+#ifdef NUMU_JIT_X86_64
+    if (code_) {
+        munmap(code_, size_);
+    }
+#endif
+}
+
+bool jit_available() {
+#ifdef NUMU_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+NativeFunction compile_native(const CompiledExpression& expr) {
+    NativeFunction native;
+#ifdef NUMU_JIT_X86_64
+    if (!supported(expr)) {
+        return native;
+    }
+    std::vector<uint8_t> code = generate(expr);
+    if (code.empty()) {
+        return native;
+    }
+
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return native;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        return native;
+    }
+    native.code_ = memory;
+    native.size_ = code.size();
+    native.entry_ = reinterpret_cast<NativeFunction::Entry>(memory);
+#else
+    (void)expr;
+#endif
+    return native;
+}
+
+TieredExpression::TieredExpression(CompiledExpression expr, size_t threshold)
+    : expr_(std::move(expr)), threshold_(threshold) {
+    if (threshold_ == 0) {
+        tier_up();
+    }
+}
+
+double TieredExpression::evaluate(const double* vars) const {
+    NUMU_STATS_STAGE(EVALUATE);
+    if (NativeFunction::Entry entry = native_entry()) {
+        double result = entry(vars);
+        if (result == result) {
+            return result;
+        }
+        // NaN may stand for an error; the interpreter decides
+    }
+    return expr_.evaluate(vars);
+}
+
+Result TieredExpression::try_evaluate(const double* vars) const {
+    NUMU_STATS_STAGE(EVALUATE);
+    if (NativeFunction::Entry entry = native_entry()) {
+        double result = entry(vars);
+        if (result == result) {
+            return Result{result, Status::OK};
+        }
+    }
+    return expr_.try_evaluate(vars);
+}
+
+NativeFunction::Entry TieredExpression::native_entry() const {
+    NativeFunction::Entry entry = entry_.load(std::memory_order_acquire);
+    if (entry) {
+        // Native code is straight-line, so its cost is known up front
+        if (BudgetScope* budget = BudgetScope::current()) {
+            budget->charge(expr_.code.size());
+        }
+        return entry;
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) + 1 == threshold_) {
+        tier_up();
+    }
+    return nullptr;
+}
+
+// Reached by exactly one thread, and entry_ is only published after
+// native_ is complete
+void TieredExpression::tier_up() const {
+    native_ = compile_native(expr_);
+    if (native_) {
+        entry_.store(native_.entry(), std::memory_order_release);
+    }
+}
+
+} // namespace core
+} // namespace numu
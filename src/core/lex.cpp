@@ -1,6 +1,7 @@
 #include "numu/core/lex.h"
-#include <cctype>
-#include <unordered_map>
+#include "numu/core/stats.h"
+#include <array>
+#include <cstdint>
 #include <stdexcept>
 #include <string_view>
 #include <charconv>
@@ -9,68 +10,102 @@ namespace numu {
 namespace lex {
 
 namespace {
-const std::unordered_map<std::string_view, TokenType> keywords = {
-    {"let", TokenType::LET},
-    {"fn", TokenType::FN},
-    {"if", TokenType::IF},
-    {"else", TokenType::ELSE},
-    {"for", TokenType::FOR},
-    {"while", TokenType::WHILE},
-    {"return", TokenType::RETURN},
-    {"true", TokenType::TRUE},
-    {"false", TokenType::FALSE},
-    {"inf", TokenType::INF},
-    {"nan", TokenType::NAN},
-    {"pi", TokenType::PI},
-    {"e", TokenType::E}
+enum CharClass : uint8_t {
+    DIGIT = 1 << 0,
+    IDENT_START = 1 << 1,
+    IDENT_CONTINUE = 1 << 2,
+    SINGLE = 1 << 3
 };
 
-const std::unordered_map<char, TokenType> single_char_tokens = {
-    {'+', TokenType::PLUS},
-    {'-', TokenType::MINUS},
-    {'*', TokenType::STAR},
-    {'/', TokenType::SLASH},
-    {'%', TokenType::PERCENT},
-    {'^', TokenType::CARET},
-    {'=', TokenType::EQUAL},
-    {'<', TokenType::LESS},
-    {'>', TokenType::GREATER},
-    {'!', TokenType::BANG},
-    {'(', TokenType::LPAREN},
-    {')', TokenType::RPAREN},
-    {'[', TokenType::LBRACKET},
-    {']', TokenType::RBRACKET},
-    {'{', TokenType::LBRACE},
-    {'}', TokenType::RBRACE},
-    {',', TokenType::COMMA},
-    {'.', TokenType::DOT},
-    {':', TokenType::COLON},
-    {';', TokenType::SEMI}
+struct CharTables {
+    std::array<uint8_t, 256> classes{};
+    std::array<TokenType, 256> tokens{};
 };
 
-const std::unordered_map<std::string_view, TokenType> multi_char_ops = {
-    {"==", TokenType::EQEQ},
-    {"!=", TokenType::NEQ},
-    {"<=", TokenType::LEQ},
-    {">=", TokenType::GEQ},
-    {"->", TokenType::ARROW},
-    {"**", TokenType::POW}
-};
+constexpr CharTables make_char_tables() {
+    CharTables t{};
+    for (int c = '0'; c <= '9'; ++c) t.classes[c] = DIGIT | IDENT_CONTINUE;
+    for (int c = 'a'; c <= 'z'; ++c) t.classes[c] = IDENT_START | IDENT_CONTINUE;
+    for (int c = 'A'; c <= 'Z'; ++c) t.classes[c] = IDENT_START | IDENT_CONTINUE;
+    t.classes['_'] = IDENT_START | IDENT_CONTINUE;
+
+    struct { char c; TokenType type; } singles[] = {
+        {'+', TokenType::PLUS}, {'-', TokenType::MINUS}, {'*', TokenType::STAR},
+        {'/', TokenType::SLASH}, {'%', TokenType::PERCENT}, {'^', TokenType::CARET},
+        {'=', TokenType::EQUAL}, {'<', TokenType::LESS}, {'>', TokenType::GREATER},
+        {'!', TokenType::BANG}, {'(', TokenType::LPAREN}, {')', TokenType::RPAREN},
+        {'[', TokenType::LBRACKET}, {']', TokenType::RBRACKET}, {'{', TokenType::LBRACE},
+        {'}', TokenType::RBRACE}, {',', TokenType::COMMA}, {'.', TokenType::DOT},
+        {':', TokenType::COLON}, {';', TokenType::SEMI}
+    };
+    for (const auto& single : singles) {
+        auto index = static_cast<unsigned char>(single.c);
+        t.classes[index] |= SINGLE;
+        t.tokens[index] = single.type;
+    }
+    return t;
+}
+
+constexpr CharTables char_tables = make_char_tables();
+
+inline uint8_t char_class(char c) {
+    return char_tables.classes[static_cast<unsigned char>(c)];
+}
 
-bool is_identifier_start(char c) {
-    return std::isalpha(c) || c == '_';
+bool is_digit(char c) {
+    return char_class(c) & DIGIT;
 }
 
 bool is_identifier_continue(char c) {
-    return std::isalnum(c) || c == '_';
+    return char_class(c) & IDENT_CONTINUE;
 }
 
-double parse_number(std::string_view text, size_t& pos) {
-    const char* start = text.data() + pos;
-    char* end;
-    double value = std::strtod(start, &end);
-    pos += (end - start);
-    return value;
+// Keywords are few and short, so dispatching on length and comparing in
+// place beats hashing the identifier
+TokenType keyword_or_identifier(std::string_view text) {
+    switch(text.size()) {
+        case 1:
+            if (text[0] == 'e') return TokenType::E;
+            break;
+        case 2:
+            if (text == "fn") return TokenType::FN;
+            if (text == "if") return TokenType::IF;
+            if (text == "pi") return TokenType::PI;
+            break;
+        case 3:
+            if (text == "let") return TokenType::LET;
+            if (text == "for") return TokenType::FOR;
+            if (text == "inf") return TokenType::INF;
+            if (text == "nan") return TokenType::NAN_LITERAL;
+            break;
+        case 4:
+            if (text == "else") return TokenType::ELSE;
+            if (text == "true") return TokenType::TRUE;
+            break;
+        case 5:
+            if (text == "while") return TokenType::WHILE;
+            if (text == "false") return TokenType::FALSE;
+            break;
+        case 6:
+            if (text == "return") return TokenType::RETURN;
+            break;
+        default:
+            break;
+    }
+    return TokenType::IDENTIFIER;
+}
+
+// Two-character operators, keyed on the first character
+bool match_two_char_op(char c, char next, TokenType& type) {
+    switch(c) {
+        case '=': type = TokenType::EQEQ; return next == '=';
+        case '!': type = TokenType::NEQ; return next == '=';
+        case '<': type = TokenType::LEQ; return next == '=';
+        case '>': type = TokenType::GEQ; return next == '=';
+        case '-': type = TokenType::ARROW; return next == '>';
+        case '*': type = TokenType::POW; return next == '*';
+        default: return false;
+    }
 }
 
 } // namespace
@@ -78,21 +113,26 @@ double parse_number(std::string_view text, size_t& pos) {
 Lexer::Lexer(std::string_view source) 
     : source_(source), pos_(0), line_(1), col_(1) {}
 
+Lexer::Lexer(std::string_view source, size_t line, size_t column)
+    : source_(source), pos_(0), line_(line), col_(column) {}
+
 Token Lexer::next() {
+    NUMU_STATS_STAGE(LEX);
     skip_whitespace();
     if (pos_ >= source_.length()) {
-        return make_token(TokenType::EOF);
+        return make_token(TokenType::END_OF_FILE);
     }
 
     char c = source_[pos_];
+    uint8_t cls = char_class(c);
     
     // Handle numbers
-    if (std::isdigit(c) || (c == '.' && pos_ + 1 < source_.length() && std::isdigit(source_[pos_ + 1]))) {
+    if ((cls & DIGIT) || (c == '.' && pos_ + 1 < source_.length() && is_digit(source_[pos_ + 1]))) {
         return lex_number();
     }
     
     // Handle identifiers and keywords
-    if (is_identifier_start(c)) {
+    if (cls & IDENT_START) {
         return lex_identifier();
     }
     
@@ -101,23 +141,20 @@ Token Lexer::next() {
         return lex_string();
     }
     
-    // Handle multi-character operators
-    if (pos_ + 1 < source_.length()) {
-        std::string_view op = source_.substr(pos_, 2);
-        auto it = multi_char_ops.find(op);
-        if (it != multi_char_ops.end()) {
+    if (cls & SINGLE) {
+        // Handle multi-character operators
+        TokenType type;
+        char next = pos_ + 1 < source_.length() ? source_[pos_ + 1] : '\0';
+        if (match_two_char_op(c, next, type)) {
             pos_ += 2;
             col_ += 2;
-            return make_token(it->second);
+            return make_token(type);
         }
-    }
-    
-    // Handle single character tokens
-    auto it = single_char_tokens.find(c);
-    if (it != single_char_tokens.end()) {
+
+        // Handle single character tokens
         pos_++;
         col_++;
-        return make_token(it->second);
+        return make_token(char_tables.tokens[static_cast<unsigned char>(c)]);
     }
     
     // Handle comments
@@ -136,7 +173,7 @@ Token Lexer::lex_number() {
     
     while (pos_ < source_.length()) {
         char c = source_[pos_];
-        if (std::isdigit(c)) {
+        if (is_digit(c)) {
             pos_++;
             col_++;
         } else if (c == '.' && !has_decimal) {
@@ -175,8 +212,7 @@ Token Lexer::lex_identifier() {
     }
     
     std::string_view text = source_.substr(start, pos_ - start);
-    auto it = keywords.find(text);
-    TokenType type = (it != keywords.end()) ? it->second : TokenType::IDENTIFIER;
+    TokenType type = keyword_or_identifier(text);
     
     return Token{type, text, 0.0, line_, col_ - text.length()};
 }
@@ -190,6 +226,10 @@ Token Lexer::lex_string() {
         if (source_[pos_] == '\\') {
             pos_++; // Skip escape character
             col_++;
+            // A source may end right after the backslash, e.g. a mapped file
+            if (pos_ >= source_.length()) {
+                break;
+            }
         }
         if (source_[pos_] == '\n') {
             line_++;
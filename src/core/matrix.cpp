@@ -0,0 +1,359 @@
+#include "numu/core/matrix.h"
+#include "numu/core/sparse.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+namespace {
+// Tile edge for the blocked kernels; three 64x64 tiles of doubles fit in
+// a typical L2 cache
+constexpr size_t tile = 64;
+// Transpose touches one cache line per column it writes, so it wants
+// tiles whose rows stay resident together
+constexpr size_t transpose_tile = 16;
+
+double* allocate(size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+    return static_cast<double*>(
+        ::operator new[](count * sizeof(double), std::align_val_t(Matrix::alignment)));
+}
+
+void require_same_shape(const Matrix& a, const Matrix& b, const char* op) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+        throw EvaluationError(std::string("Matrix ") + op + " needs equal shapes, got " +
+                              std::to_string(a.rows()) + "x" + std::to_string(a.cols()) + " and " +
+                              std::to_string(b.rows()) + "x" + std::to_string(b.cols()));
+    }
+}
+
+void require_square(const Matrix& m, const char* op) {
+    if (!m.square()) {
+        throw EvaluationError(std::string(op) + " needs a square matrix, got " +
+                              std::to_string(m.rows()) + "x" + std::to_string(m.cols()));
+    }
+}
+
+Matrix scalar(double value) {
+    return Matrix(1, 1, value);
+}
+
+// Singular when the pivot is negligible next to the largest entry
+bool negligible(double pivot, double largest, size_t n) {
+    return std::fabs(pivot) <= largest * static_cast<double>(n) * std::numeric_limits<double>::epsilon();
+}
+
+double largest_entry(const Matrix& m) {
+    double largest = 0.0;
+    for (size_t i = 0; i < m.size(); ++i) {
+        largest = std::max(largest, std::fabs(m.data()[i]));
+    }
+    return largest;
+}
+} // namespace
+
+void Matrix::Free::operator()(double* p) const {
+    ::operator delete[](p, std::align_val_t(Matrix::alignment));
+}
+
+Matrix::Matrix(size_t rows, size_t cols) : Matrix(rows, cols, 0.0) {}
+
+Matrix::Matrix(size_t rows, size_t cols, double fill)
+    : rows_(rows), cols_(cols), data_(allocate(rows * cols)) {
+    std::fill(data_.get(), data_.get() + rows * cols, fill);
+}
+
+Matrix Matrix::identity(size_t n) {
+    Matrix m(n, n);
+    for (size_t i = 0; i < n; ++i) {
+        m(i, i) = 1.0;
+    }
+    return m;
+}
+
+Matrix::Matrix(const Matrix& other)
+    : rows_(other.rows_), cols_(other.cols_), data_(allocate(other.size())) {
+    if (other.size()) {
+        std::memcpy(data_.get(), other.data_.get(), other.size() * sizeof(double));
+    }
+}
+
+Matrix& Matrix::operator=(const Matrix& other) {
+    if (this != &other) {
+        Matrix copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Matrix operator+(const Matrix& a, const Matrix& b) {
+    require_same_shape(a, b, "addition");
+    Matrix out(a.rows(), a.cols());
+    for (size_t i = 0; i < a.size(); ++i) {
+        out.data()[i] = a.data()[i] + b.data()[i];
+    }
+    return out;
+}
+
+Matrix operator-(const Matrix& a, const Matrix& b) {
+    require_same_shape(a, b, "subtraction");
+    Matrix out(a.rows(), a.cols());
+    for (size_t i = 0; i < a.size(); ++i) {
+        out.data()[i] = a.data()[i] - b.data()[i];
+    }
+    return out;
+}
+
+Matrix operator*(const Matrix& a, double scale) {
+    Matrix out(a.rows(), a.cols());
+    for (size_t i = 0; i < a.size(); ++i) {
+        out.data()[i] = a.data()[i] * scale;
+    }
+    return out;
+}
+
+// i-k-j order inside each tile so the innermost loop streams a row of b
+// and a row of the result, which the compiler vectorizes
+Matrix multiply(const Matrix& a, const Matrix& b) {
+    if (a.cols() != b.rows()) {
+        throw EvaluationError("Matrix product needs " + std::to_string(a.cols()) +
+                              " rows on the right, got " + std::to_string(b.rows()));
+    }
+    size_t n = a.rows();
+    size_t inner = a.cols();
+    size_t m = b.cols();
+    Matrix c(n, m);
+
+    for (size_t ii = 0; ii < n; ii += tile) {
+        size_t i_end = std::min(ii + tile, n);
+        for (size_t kk = 0; kk < inner; kk += tile) {
+            size_t k_end = std::min(kk + tile, inner);
+            for (size_t jj = 0; jj < m; jj += tile) {
+                size_t j_end = std::min(jj + tile, m);
+                for (size_t i = ii; i < i_end; ++i) {
+                    double* __restrict c_row = c.row(i);
+                    const double* a_row = a.row(i);
+                    for (size_t k = kk; k < k_end; ++k) {
+                        double a_ik = a_row[k];
+                        const double* __restrict b_row = b.row(k);
+                        for (size_t j = jj; j < j_end; ++j) {
+                            c_row[j] += a_ik * b_row[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return c;
+}
+
+Matrix transpose(const Matrix& m) {
+    Matrix out(m.cols(), m.rows());
+    for (size_t ii = 0; ii < m.rows(); ii += transpose_tile) {
+        size_t i_end = std::min(ii + transpose_tile, m.rows());
+        for (size_t jj = 0; jj < m.cols(); jj += transpose_tile) {
+            size_t j_end = std::min(jj + transpose_tile, m.cols());
+            for (size_t i = ii; i < i_end; ++i) {
+                for (size_t j = jj; j < j_end; ++j) {
+                    out(j, i) = m(i, j);
+                }
+            }
+        }
+    }
+    return out;
+}
+
+double determinant(const Matrix& m) {
+    require_square(m, "Determinant");
+    size_t n = m.rows();
+    Matrix lu(m);
+    double det = 1.0;
+
+    for (size_t k = 0; k < n; ++k) {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < n; ++i) {
+            if (std::fabs(lu(i, k)) > std::fabs(lu(pivot, k))) {
+                pivot = i;
+            }
+        }
+        if (lu(pivot, k) == 0.0) {
+            return 0.0;
+        }
+        if (pivot != k) {
+            std::swap_ranges(lu.row(k), lu.row(k) + n, lu.row(pivot));
+            det = -det;
+        }
+        double diagonal = lu(k, k);
+        det *= diagonal;
+        for (size_t i = k + 1; i < n; ++i) {
+            double factor = lu(i, k) / diagonal;
+            double* __restrict target = lu.row(i);
+            const double* __restrict source = lu.row(k);
+            for (size_t j = k + 1; j < n; ++j) {
+                target[j] -= factor * source[j];
+            }
+        }
+    }
+    return det;
+}
+
+// Gauss-Jordan elimination with partial pivoting
+Matrix inverse(const Matrix& m) {
+    require_square(m, "Inverse");
+    size_t n = m.rows();
+    Matrix work(m);
+    Matrix inv = Matrix::identity(n);
+    double largest = largest_entry(m);
+
+    for (size_t k = 0; k < n; ++k) {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < n; ++i) {
+            if (std::fabs(work(i, k)) > std::fabs(work(pivot, k))) {
+                pivot = i;
+            }
+        }
+        if (work(pivot, k) == 0.0 || negligible(work(pivot, k), largest, n)) {
+            throw SingularMatrix();
+        }
+        if (pivot != k) {
+            std::swap_ranges(work.row(k), work.row(k) + n, work.row(pivot));
+            std::swap_ranges(inv.row(k), inv.row(k) + n, inv.row(pivot));
+        }
+
+        double scale = 1.0 / work(k, k);
+        for (size_t j = 0; j < n; ++j) {
+            work(k, j) *= scale;
+            inv(k, j) *= scale;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            double factor = work(i, k);
+            if (i == k || factor == 0.0) {
+                continue;
+            }
+            double* __restrict w = work.row(i);
+            double* __restrict v = inv.row(i);
+            const double* wk = work.row(k);
+            const double* vk = inv.row(k);
+            for (size_t j = 0; j < n; ++j) {
+                w[j] -= factor * wk[j];
+                v[j] -= factor * vk[j];
+            }
+        }
+    }
+    return inv;
+}
+
+// Literals are gathered as non-zero entries so MatrixValue::make picks
+// the layout before either one is built
+MatrixValue evaluate_matrix_value(ast::Node* node, const Frame& frame) {
+    if (!node) {
+        throw EvaluationError("Null node in evaluation");
+    }
+
+    switch(node->type) {
+        case ast::NodeType::MATRIX: {
+            const auto& elements = static_cast<ast::MatrixNode*>(node)->elements;
+            size_t cols = elements.empty() ? 0 : elements[0].size();
+            std::vector<SparseMatrix::Entry> entries;
+            for (size_t i = 0; i < elements.size(); ++i) {
+                if (elements[i].size() != cols) {
+                    throw EvaluationError("Matrix rows must have equal length");
+                }
+                for (size_t j = 0; j < cols; ++j) {
+                    double value = evaluate(elements[i][j], frame);
+                    if (value != 0.0) {
+                        entries.push_back(SparseMatrix::Entry{i, j, value});
+                    }
+                }
+            }
+            return MatrixValue::make(elements.size(), cols, std::move(entries));
+        }
+
+        case ast::NodeType::TENSOR: {
+            auto* tensor = static_cast<ast::TensorNode*>(node);
+            if (tensor->dims.empty() || tensor->dims.size() > 2) {
+                throw EvaluationError("Only tensors of rank 1 or 2 can be evaluated");
+            }
+            size_t rows = tensor->dims[0];
+            size_t cols = tensor->dims.size() == 2 ? tensor->dims[1] : 1;
+            if (rows * cols != tensor->values.size()) {
+                throw EvaluationError("Tensor dimensions do not match its values");
+            }
+            std::vector<SparseMatrix::Entry> entries;
+            for (size_t i = 0; i < tensor->values.size(); ++i) {
+                double value = evaluate(tensor->values[i], frame);
+                if (value != 0.0) {
+                    entries.push_back(SparseMatrix::Entry{i / cols, i % cols, value});
+                }
+            }
+            return MatrixValue::make(rows, cols, std::move(entries));
+        }
+
+        case ast::NodeType::BINARY_OP: {
+            auto* bin = static_cast<ast::BinaryOpNode*>(node);
+            MatrixValue left = evaluate_matrix_value(bin->left, frame);
+            MatrixValue right = evaluate_matrix_value(bin->right, frame);
+            bool left_scalar = left.rows() == 1 && left.cols() == 1;
+            bool right_scalar = right.rows() == 1 && right.cols() == 1;
+            if (left_scalar && right_scalar) {
+                return MatrixValue::make(scalar(eval_binary_op(bin->op, left.scalar(), right.scalar())));
+            }
+            switch(bin->op) {
+                case ast::BinaryOp::ADD: return left.add(right);
+                case ast::BinaryOp::SUB: return left.add(right, -1.0);
+                case ast::BinaryOp::MUL:
+                    if (left_scalar) return right.scale(left.scalar());
+                    if (right_scalar) return left.scale(right.scalar());
+                    return left.multiply(right);
+                case ast::BinaryOp::DIV:
+                    if (right_scalar) {
+                        if (right.scalar() == 0.0) {
+                            throw DomainError(Status::DIVISION_BY_ZERO);
+                        }
+                        return left.scale(1.0 / right.scalar());
+                    }
+                    throw EvaluationError("Matrix division is not defined; multiply by inverse instead");
+                default:
+                    throw EvaluationError("Operator not defined for matrices");
+            }
+        }
+
+        case ast::NodeType::UNARY_OP: {
+            auto* un = static_cast<ast::UnaryOpNode*>(node);
+            MatrixValue operand = evaluate_matrix_value(un->operand, frame);
+            switch(un->op) {
+                case ast::UnaryOp::NEGATE: return operand.scale(-1.0);
+                case ast::UnaryOp::TRANSPOSE: return operand.transpose();
+                case ast::UnaryOp::INVERSE: return MatrixValue::make(inverse(operand.to_dense()));
+                case ast::UnaryOp::DETERMINANT:
+                    return MatrixValue::make(scalar(determinant(operand.to_dense())));
+                default:
+                    if (operand.rows() == 1 && operand.cols() == 1) {
+                        return MatrixValue::make(scalar(eval_unary_op(un->op, operand.scalar())));
+                    }
+                    throw EvaluationError("Operator not defined for matrices");
+            }
+        }
+
+        default:
+            return MatrixValue::make(scalar(evaluate(node, frame)));
+    }
+}
+
+Matrix evaluate_matrix(ast::Node* node, const Frame& frame) {
+    return evaluate_matrix_value(node, frame).to_dense();
+}
+
+Matrix evaluate_matrix(ast::Node* node) {
+    return evaluate_matrix(node, default_frame());
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,387 @@
+#include "numu/core/module.h"
+#include "numu/core/arena.h"
+#include "numu/core/compile.h"
+#include "numu/core/derivative.h"
+#include "numu/core/integrate.h"
+#include "numu/core/matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#define NUMU_HAVE_DLOPEN 1
+#endif
+
+namespace numu {
+namespace core {
+
+namespace {
+#ifdef __APPLE__
+constexpr const char* library_suffix = ".dylib";
+#else
+constexpr const char* library_suffix = ".so";
+#endif
+
+using ModuleEntry = const ModuleInfo* (*)();
+
+// The standard functions differentiate() knows
+const std::vector<std::string> differentiable = {"sin", "cos", "tan", "exp", "log", "sqrt"};
+
+// d<f>(x) is the derivative of the standard function f at x. It is the
+// symbolic derivative compiled once, or a central difference when
+// calculus.differential.default_method is "numeric".
+RegistryPtr differential(RegistryPtr registry, const config::Config& config) {
+    bool numeric = config.get_string("calculus.differential.default_method", "symbolic") == "numeric";
+    double step = config.get_number("calculus.differential.numeric_step", 1e-5);
+    RegistryPtr standard = Registry::standard();
+    Frame frame(standard);
+
+    // Compiled code does not refer back to the tree
+    ast::ArenaScope scope;
+    for (const auto& name : differentiable) {
+        if (numeric) {
+            const Callable* function = standard->find_callable(name);
+            registry = registry->with_function("d" + name, [function, step](const auto& args) {
+                double h = step * std::max(1.0, std::fabs(args[0]));
+                return (function->function({args[0] + h}) - function->function({args[0] - h})) / (2 * h);
+            }, 1);
+            continue;
+        }
+        ast::Node* call = ast::FunctionNode::create(name, {ast::VariableNode::create("x")});
+        auto code = std::make_shared<const CompiledExpression>(
+            compile(differentiate(call, "x"), {"x"}, frame));
+        registry = registry->with_function("d" + name, [code](const auto& args) {
+            return code->evaluate(args);
+        }, 1);
+    }
+    return registry;
+}
+
+// Functions defined by an integral from 0 to x, computed by integrate()
+// with the tolerances in calculus.integral
+RegistryPtr integral(RegistryPtr registry, const config::Config& config) {
+    IntegrationOptions options = IntegrationOptions::from(config);
+    // The integrands live as long as the functions using them
+    auto arena = std::make_shared<ast::Arena>();
+    ast::ArenaScope scope(*arena);
+    auto t = [] { return ast::VariableNode::create("t"); };
+    auto t2 = [&] { return ast::BinaryOpNode::create(ast::BinaryOp::MUL, t(), t()); };
+    std::pair<const char*, ast::Node*> integrands[] = {
+        // Sine integral; the rule never samples the endpoint t = 0
+        {"si", ast::BinaryOpNode::create(ast::BinaryOp::DIV, ast::UnaryOpNode::create(ast::UnaryOp::SIN, t()), t())},
+        // Fresnel integrals
+        {"fresnels", ast::UnaryOpNode::create(ast::UnaryOp::SIN, t2())},
+        {"fresnelc", ast::UnaryOpNode::create(ast::UnaryOp::COS, t2())},
+    };
+    for (const auto& entry : integrands) {
+        ast::Node* integrand = entry.second;
+        registry = registry->with_function(entry.first, [arena, integrand, options](const auto& args) {
+            Frame frame(Registry::standard());
+            return integrate(integrand, "t", 0.0, args[0], frame, options).value;
+        }, 1);
+    }
+    return registry;
+}
+
+// det(a11, a12, ..., ann) is the determinant of the square matrix whose
+// rows are given in order
+RegistryPtr linear_basic(RegistryPtr registry, const config::Config&) {
+    return registry->with_function("det", [](const auto& args) {
+        size_t n = static_cast<size_t>(std::llround(std::sqrt(static_cast<double>(args.size()))));
+        if (n == 0 || n * n != args.size()) {
+            throw EvaluationError("det() takes the entries of a square matrix, got " +
+                                  std::to_string(args.size()));
+        }
+        Matrix m(n, n);
+        std::copy(args.begin(), args.end(), m.data());
+        return determinant(m);
+    }, variadic);
+}
+
+struct Catalog {
+    std::mutex mutex;
+    std::vector<ModuleInfo> modules;
+
+    Catalog() {
+        // Registry::standard() is every registry's base already
+        modules.push_back({"core", {}, [](RegistryPtr registry, const config::Config&) {
+            return registry;
+        }});
+        modules.push_back({"arithmetic", {"abs", "min", "max", "sum", "avg", "pi", "e", "inf"},
+            [](RegistryPtr registry, const config::Config&) {
+                return builtin::extend(registry);
+            }});
+        std::vector<std::string> derivatives;
+        for (const auto& name : differentiable) {
+            derivatives.push_back("d" + name);
+        }
+        modules.push_back({"calculus.differential", derivatives, differential});
+        modules.push_back({"calculus.integral", {"si", "fresnels", "fresnelc"}, integral});
+        modules.push_back({"linear.basic", {"det"}, linear_basic});
+    }
+};
+
+Catalog& catalog() {
+    static Catalog instance;
+    return instance;
+}
+
+std::string expand(const std::string& path, const std::string& base) {
+    if (path == "~" || path.rfind("~/", 0) == 0) {
+        const char* home = std::getenv("HOME");
+        return home ? home + path.substr(1) : std::string();
+    }
+    std::filesystem::path expanded(path);
+    if (expanded.is_relative()) {
+        expanded = std::filesystem::path(base) / expanded;
+    }
+    return expanded.string();
+}
+
+const ModuleInfo* open_library(const std::string& module, const std::string& path,
+                               std::vector<void*>& libraries) {
+#ifdef NUMU_HAVE_DLOPEN
+    void* handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        const char* reason = ::dlerror();
+        throw ModuleError("Cannot load module " + module + ": " + (reason ? reason : path));
+    }
+    auto entry = reinterpret_cast<ModuleEntry>(::dlsym(handle, "numu_module"));
+    if (!entry) {
+        ::dlclose(handle);
+        throw ModuleError("Module " + module + " does not export numu_module: " + path);
+    }
+    libraries.push_back(handle);
+    return entry();
+#else
+    (void)libraries;
+    throw ModuleError("Cannot load module " + module + ": loading from disk is not supported on this platform");
+#endif
+}
+} // namespace
+
+void declare_module(ModuleInfo info) {
+    Catalog& modules = catalog();
+    std::lock_guard<std::mutex> lock(modules.mutex);
+    for (const auto& declared : modules.modules) {
+        if (declared.name == info.name) {
+            throw ModuleError("Module already declared: " + info.name);
+        }
+    }
+    modules.modules.push_back(std::move(info));
+}
+
+std::shared_ptr<ModuleRegistry> ModuleRegistry::create(const config::Config& config,
+                                                       const std::string& base) {
+    std::shared_ptr<ModuleRegistry> modules(new ModuleRegistry());
+    modules->config_ = config;
+
+    std::vector<std::string> all;
+    {
+        Catalog& declared = catalog();
+        std::lock_guard<std::mutex> lock(declared.mutex);
+        for (const auto& info : declared.modules) {
+            modules->builtin_.emplace(info.name, info);
+            all.push_back(info.name);
+        }
+    }
+
+    // Earlier paths win, as do built-in modules over files of the same name
+    std::string suffix = library_suffix;
+    std::vector<std::string> found;
+    for (const auto& entry : config.get_list("modules.paths")) {
+        std::string dir = expand(entry, base);
+        std::error_code error;
+        if (dir.empty() || !std::filesystem::is_directory(dir, error)) {
+            continue;
+        }
+        for (const auto& file : std::filesystem::directory_iterator(dir, error)) {
+            std::string filename = file.path().filename().string();
+            if (filename.size() <= suffix.size() ||
+                filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                continue;
+            }
+            std::string name = filename.substr(0, filename.size() - suffix.size());
+            if (!modules->builtin_.count(name) && modules->files_.emplace(name, file.path().string()).second) {
+                found.push_back(name);
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    std::vector<std::string> required = config.get_list("modules.required");
+    std::vector<std::string> optional = config.get_list("modules.optional");
+    if (required.empty() && optional.empty()) {
+        all.insert(all.end(), found.begin(), found.end());
+        modules->eligible_ = std::move(all);
+    } else {
+        for (const auto* list : {&required, &optional}) {
+            for (const auto& name : *list) {
+                auto& eligible = modules->eligible_;
+                if (modules->available(name) && std::find(eligible.begin(), eligible.end(), name) == eligible.end()) {
+                    eligible.push_back(name);
+                }
+            }
+        }
+    }
+    for (const auto& name : required) {
+        if (!modules->available(name)) {
+            throw ModuleError("Required module not found: " + name);
+        }
+    }
+
+    for (const auto& name : modules->eligible_) {
+        auto it = modules->builtin_.find(name);
+        if (it != modules->builtin_.end()) {
+            for (const auto& provided : it->second.provides) {
+                modules->providers_.emplace(provided, name);
+            }
+        }
+    }
+    return modules;
+}
+
+std::shared_ptr<ModuleRegistry> ModuleRegistry::open(const std::string& path) {
+    std::string base = std::filesystem::path(path).parent_path().string();
+    return create(config::Config::load(path), base.empty() ? "." : base);
+}
+
+RegistryPtr ModuleRegistry::registry() const {
+    return Registry::standard()->with_fallback(shared_from_this());
+}
+
+void ModuleRegistry::install() const {
+    register_fallback(shared_from_this());
+}
+
+bool ModuleRegistry::available(const std::string& module) const {
+    return builtin_.count(module) || files_.count(module);
+}
+
+bool ModuleRegistry::loaded(const std::string& module) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : modules_) {
+        if (entry.first == module) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ModuleRegistry::load(const std::string& module) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    load_locked(module);
+}
+
+RegistryPtr ModuleRegistry::load_locked(const std::string& module) const {
+    for (const auto& entry : modules_) {
+        if (entry.first == module) {
+            return entry.second;
+        }
+    }
+    const ModuleInfo* info = nullptr;
+    auto builtin = builtin_.find(module);
+    if (builtin != builtin_.end()) {
+        info = &builtin->second;
+    } else {
+        auto file = files_.find(module);
+        if (file == files_.end()) {
+            throw ModuleError("Unknown module: " + module);
+        }
+        info = open_library(module, file->second, libraries_);
+    }
+    if (!info || info->name != module) {
+        throw ModuleError("Module " + module + " describes itself as " +
+                          (info ? info->name : std::string("nothing")));
+    }
+    RegistryPtr entries = std::make_shared<const Registry>();
+    if (info->init) {
+        entries = info->init(std::move(entries), config_);
+    }
+    if (!entries) {
+        throw ModuleError("Module " + module + " returned no registry");
+    }
+    modules_.emplace_back(module, entries);
+
+    // Names looked up in vain so far may be defined now
+    misses_ = Misses();
+    return entries;
+}
+
+template<typename T, typename Find>
+const T* ModuleRegistry::resolve(const std::string& name, Find find,
+                                 std::unordered_map<std::string, const T*> Table::*column,
+                                 std::unordered_set<std::string> Misses::*missed) const {
+    std::shared_ptr<const Table> table = std::atomic_load(&table_);
+    if (table) {
+        auto it = ((*table).*column).find(name);
+        if (it != ((*table).*column).end()) {
+            return it->second;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    table = std::atomic_load(&table_);
+    if (table) {
+        auto it = ((*table).*column).find(name);
+        if (it != ((*table).*column).end()) {
+            return it->second;
+        }
+    }
+    // A name no module defines is not searched for again on every lookup
+    std::unordered_set<std::string>& misses = misses_.*missed;
+    if (misses.count(name)) {
+        return nullptr;
+    }
+    const T* found = nullptr;
+    for (const auto& entry : modules_) {
+        if ((found = find(*entry.second, name))) {
+            break;
+        }
+    }
+    if (!found) {
+        auto provider = providers_.find(name);
+        if (provider != providers_.end()) {
+            found = find(*load_locked(provider->second), name);
+        }
+    }
+    // Modules on disk say what they define only once loaded
+    for (size_t i = 0; !found && i < eligible_.size(); ++i) {
+        const std::string& module = eligible_[i];
+        if (files_.count(module) && std::none_of(modules_.begin(), modules_.end(),
+                [&](const auto& entry) { return entry.first == module; })) {
+            found = find(*load_locked(module), name);
+        }
+    }
+
+    if (!found) {
+        if (misses.size() >= max_misses) {
+            misses.clear();
+        }
+        misses.insert(name);
+        return nullptr;
+    }
+    // Only names modules define are copied, so the table stays small
+    table = std::atomic_load(&table_);
+    auto updated = std::make_shared<Table>(table ? *table : Table());
+    ((*updated).*column)[name] = found;
+    std::atomic_store(&table_, std::shared_ptr<const Table>(std::move(updated)));
+    return found;
+}
+
+const Callable* ModuleRegistry::find_callable(const std::string& name) const {
+    return resolve(name, [](const Registry& registry, const std::string& key) {
+        return registry.find_callable(key);
+    }, &Table::functions, &Misses::functions);
+}
+
+const double* ModuleRegistry::find_constant(const std::string& name) const {
+    return resolve(name, [](const Registry& registry, const std::string& key) {
+        return registry.find_constant(key);
+    }, &Table::constants, &Misses::constants);
+}
+
+} // namespace core
+} // namespace numu
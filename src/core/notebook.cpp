@@ -0,0 +1,409 @@
+#include "numu/core/notebook.h"
+#include "numu/core/budget.h"
+#include "numu/core/stats.h"
+#include <algorithm>
+#include <cstring>
+
+namespace numu {
+namespace core {
+
+namespace {
+uint64_t bit(size_t read) {
+    return uint64_t(1) << std::min<size_t>(read, 63);
+}
+
+bool same_bits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+} // namespace
+
+// Lowers a definition to steps, children first. Scalar nodes become one
+// step each, so they can be reused separately; anything the tree evaluator
+// treats specially, such as matrices, is one opaque step it evaluates.
+struct Notebook::Builder {
+    Definition& out;
+    std::unordered_map<const ast::Node*, uint32_t> built;
+
+    uint32_t read(const std::string& name) {
+        auto it = std::find(out.reads.begin(), out.reads.end(), name);
+        if (it != out.reads.end()) {
+            return static_cast<uint32_t>(it - out.reads.begin());
+        }
+        out.reads.push_back(name);
+        out.seen.push_back(0);
+        return static_cast<uint32_t>(out.reads.size() - 1);
+    }
+
+    bool opaque(const ast::Node* node) const {
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+            case ast::NodeType::BOOLEAN:
+            case ast::NodeType::VARIABLE:
+            case ast::NodeType::FUNCTION:
+                return false;
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<const ast::BinaryOpNode*>(node);
+                return !bin->left || !bin->right || bin->matrix_valued;
+            }
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<const ast::UnaryOpNode*>(node);
+                return !un->operand || un->op == ast::UnaryOp::DETERMINANT ||
+                       un->operand->matrix_valued;
+            }
+            default:
+                return true;
+        }
+    }
+
+    uint32_t add(ast::Node* node) {
+        if (!node) {
+            throw EvaluationError("Null node in evaluation");
+        }
+        auto found = built.find(node);
+        if (found != built.end()) {
+            return found->second;
+        }
+
+        Step step{};
+        step.node = node;
+        std::vector<uint32_t> children;
+        if (opaque(node)) {
+            step.kind = StepKind::OPAQUE;
+            ast::traverse(node, [&](ast::Node* child) {
+                if (child && child->type == ast::NodeType::VARIABLE) {
+                    step.mask |= bit(read(static_cast<ast::VariableNode*>(child)->name));
+                }
+            });
+        } else {
+            switch(node->type) {
+                case ast::NodeType::NUMBER:
+                    step.kind = StepKind::CONSTANT;
+                    step.value = static_cast<ast::NumberNode*>(node)->value;
+                    step.valid = true;
+                    break;
+                case ast::NodeType::BOOLEAN:
+                    step.kind = StepKind::CONSTANT;
+                    step.value = static_cast<ast::BooleanNode*>(node)->value ? 1.0 : 0.0;
+                    step.valid = true;
+                    break;
+                case ast::NodeType::VARIABLE:
+                    step.kind = StepKind::VARIABLE;
+                    step.read = read(static_cast<ast::VariableNode*>(node)->name);
+                    step.mask = bit(step.read);
+                    break;
+                case ast::NodeType::BINARY_OP: {
+                    auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                    step.kind = StepKind::BINARY;
+                    step.op = static_cast<uint8_t>(bin->op);
+                    children = {add(bin->left), add(bin->right)};
+                    break;
+                }
+                case ast::NodeType::UNARY_OP: {
+                    auto* un = static_cast<ast::UnaryOpNode*>(node);
+                    step.kind = StepKind::UNARY;
+                    step.op = static_cast<uint8_t>(un->op);
+                    children = {add(un->operand)};
+                    break;
+                }
+                default: {
+                    step.kind = StepKind::CALL;
+                    for (auto* arg : static_cast<ast::FunctionNode*>(node)->args) {
+                        children.push_back(add(arg));
+                    }
+                    break;
+                }
+            }
+        }
+        step.first = static_cast<uint32_t>(out.children.size());
+        step.count = static_cast<uint32_t>(children.size());
+        for (uint32_t child : children) {
+            step.mask |= out.steps[child].mask;
+            out.children.push_back(child);
+        }
+        out.steps.push_back(step);
+        auto index = static_cast<uint32_t>(out.steps.size() - 1);
+        built.emplace(node, index);
+        return index;
+    }
+};
+
+Notebook::Notebook(RegistryPtr registry) : registry_(std::move(registry)) {}
+
+Notebook::Cell& Notebook::cell(const std::string& name) {
+    return cells_[name];
+}
+
+void Notebook::set(const std::string& name, double value) {
+    Cell& target = cell(name);
+    if (target.kind == Cell::Kind::DEFINITION) {
+        unlink(name, target);
+    }
+    // Readers computed with this value stay valid, whatever produced it
+    bool same = target.has_value && same_bits(target.value, value);
+    target.kind = Cell::Kind::INPUT;
+    target.stale = false;
+    if (!same) {
+        target.value = value;
+        changed(target);
+    }
+}
+
+void Notebook::define(const std::string& name, ast::Node* value) {
+    if (!value) {
+        throw EvaluationError("Null node in evaluation");
+    }
+    Definition definition;
+    Builder{definition, {}}.add(value);
+
+    Cell& target = cell(name);
+    if (target.kind == Cell::Kind::DEFINITION) {
+        unlink(name, target);
+    }
+    target.kind = Cell::Kind::DEFINITION;
+    target.definition = std::move(definition);
+    for (const auto& read : target.definition.reads) {
+        cell(read).readers.push_back(name);
+    }
+    target.stale = true;
+    mark_readers(target);
+}
+
+void Notebook::define(ast::AssignmentNode* assignment) {
+    if (!assignment) {
+        throw EvaluationError("Null node in evaluation");
+    }
+    // Both names take the value the statement would assign them
+    ast::Node* value = assignment->value;
+    while (value && value->type == ast::NodeType::ASSIGNMENT) {
+        value = static_cast<ast::AssignmentNode*>(value)->value;
+    }
+    for (ast::Node* target = assignment; target != value;
+         target = static_cast<ast::AssignmentNode*>(target)->value) {
+        define(static_cast<ast::AssignmentNode*>(target)->name, value);
+    }
+}
+
+void Notebook::define_all(ast::Node* program) {
+    std::vector<ast::Node*> statements = {program};
+    if (program && program->type == ast::NodeType::BLOCK) {
+        statements = static_cast<ast::BlockNode*>(program)->statements;
+    }
+    for (auto* statement : statements) {
+        if (!statement || statement->type != ast::NodeType::ASSIGNMENT) {
+            throw EvaluationError("Notebooks hold assignments only");
+        }
+        define(static_cast<ast::AssignmentNode*>(statement));
+    }
+}
+
+void Notebook::remove(const std::string& name) {
+    auto it = cells_.find(name);
+    if (it == cells_.end() || it->second.kind == Cell::Kind::UNDEFINED) {
+        return;
+    }
+    Cell& target = it->second;
+    if (target.kind == Cell::Kind::DEFINITION) {
+        unlink(name, target);
+    }
+    target.kind = Cell::Kind::UNDEFINED;
+    target.stale = false;
+    changed(target);
+    target.has_value = false;
+}
+
+double Notebook::get(const std::string& name) {
+    auto it = cells_.find(name);
+    if (it == cells_.end() || it->second.kind == Cell::Kind::UNDEFINED) {
+        throw EvaluationError("Undefined variable: " + name);
+    }
+    refresh(it->first, it->second);
+    return it->second.value;
+}
+
+void Notebook::update() {
+    for (auto& [name, entry] : cells_) {
+        refresh(name, entry);
+    }
+}
+
+bool Notebook::has(const std::string& name) const {
+    auto it = cells_.find(name);
+    return it != cells_.end() && it->second.kind != Cell::Kind::UNDEFINED;
+}
+
+bool Notebook::stale(const std::string& name) const {
+    auto it = cells_.find(name);
+    return it != cells_.end() && it->second.stale;
+}
+
+std::vector<std::string> Notebook::reads(const std::string& name) const {
+    auto it = cells_.find(name);
+    if (it == cells_.end() || it->second.kind != Cell::Kind::DEFINITION) {
+        return {};
+    }
+    return it->second.definition.reads;
+}
+
+std::vector<std::string> Notebook::readers(const std::string& name) const {
+    auto it = cells_.find(name);
+    return it == cells_.end() ? std::vector<std::string>() : it->second.readers;
+}
+
+void Notebook::unlink(const std::string& name, Cell& target) {
+    for (const auto& read : target.definition.reads) {
+        auto& readers = cell(read).readers;
+        readers.erase(std::remove(readers.begin(), readers.end(), name), readers.end());
+    }
+    target.definition = Definition();
+}
+
+void Notebook::changed(Cell& target) {
+    target.version = ++clock_;
+    target.has_value = true;
+    mark_readers(target);
+}
+
+// A stale cell's readers are stale already, so the walk stops there
+void Notebook::mark_readers(const Cell& target) {
+    for (const auto& reader : target.readers) {
+        Cell& next = cells_[reader];
+        if (!next.stale) {
+            next.stale = true;
+            mark_readers(next);
+        }
+    }
+}
+
+uint64_t Notebook::version(const std::string& name) const {
+    auto it = cells_.find(name);
+    return it == cells_.end() ? 0 : it->second.version;
+}
+
+void Notebook::refresh(const std::string& name, Cell& target) {
+    if (!target.stale) {
+        return;
+    }
+    if (target.evaluating) {
+        throw EvaluationError("Circular definition: " + name);
+    }
+    struct Guard {
+        bool& flag;
+        ~Guard() { flag = false; }
+    } guard{target.evaluating};
+    target.evaluating = true;
+
+    Definition& definition = target.definition;
+    for (const auto& read : definition.reads) {
+        auto it = cells_.find(read);
+        if (it != cells_.end() && it->second.kind == Cell::Kind::DEFINITION) {
+            refresh(it->first, it->second);
+        }
+    }
+    uint64_t changed_reads = 0;
+    for (size_t i = 0; i < definition.reads.size(); ++i) {
+        if (version(definition.reads[i]) != definition.seen[i]) {
+            changed_reads |= bit(i);
+        }
+    }
+    if (!changed_reads && definition.evaluated) {
+        ++stats_.unchanged;
+    } else {
+        double value = evaluate(definition, changed_reads);
+        definition.evaluated = true;
+        ++stats_.recomputed;
+        if (!target.has_value || !same_bits(value, target.value)) {
+            target.value = value;
+            target.version = ++clock_;
+            target.has_value = true;
+        }
+    }
+    for (size_t i = 0; i < definition.reads.size(); ++i) {
+        definition.seen[i] = version(definition.reads[i]);
+    }
+    target.stale = false;
+}
+
+double Notebook::evaluate(Definition& definition, uint64_t changed_reads) {
+    NUMU_STATS_STAGE(EVALUATE);
+    BudgetScope* budget = BudgetScope::current();
+    auto input = [&](uint32_t read) {
+        const std::string& name = definition.reads[read];
+        auto it = cells_.find(name);
+        if (it != cells_.end() && it->second.kind != Cell::Kind::UNDEFINED) {
+            return it->second.value;
+        }
+        if (const double* constant = registry_->find_constant(name)) {
+            return *constant;
+        }
+        throw EvaluationError("Undefined variable: " + name);
+    };
+
+    for (Step& step : definition.steps) {
+        if (step.valid && !(step.mask & changed_reads)) {
+            if (step.kind != StepKind::CONSTANT) {
+                ++stats_.terms_reused;
+            }
+            continue;
+        }
+        if (budget) {
+            budget->charge(1);
+        }
+        const uint32_t* children = definition.children.data() + step.first;
+        auto operand = [&](uint32_t k) { return definition.steps[children[k]].value; };
+        switch(step.kind) {
+            case StepKind::CONSTANT:
+                break;
+            case StepKind::VARIABLE:
+                step.value = input(step.read);
+                break;
+            case StepKind::BINARY:
+                step.value = eval_binary_op(static_cast<ast::BinaryOp>(step.op), operand(0), operand(1));
+                break;
+            case StepKind::UNARY:
+                step.value = eval_unary_op(static_cast<ast::UnaryOp>(step.op), operand(0));
+                break;
+            case StepKind::CALL: {
+                if (!step.callable) {
+                    const auto& name = static_cast<const ast::FunctionNode*>(step.node)->name;
+                    step.callable = registry_->find_callable(name);
+                    if (!step.callable) {
+                        throw EvaluationError("Unknown function: " + name);
+                    }
+                }
+                const Callable& func = *step.callable;
+                NUMU_STATS_CALL(func.name, 1);
+                if (step.count == 1 && func.checked) {
+                    step.value = eval_unary_op(func.op, operand(0));
+                } else if (step.count == 1 && func.unary) {
+                    step.value = func.unary(operand(0));
+                } else if (step.count == 2 && func.binary) {
+                    step.value = func.binary(operand(0), operand(1));
+                } else {
+                    std::vector<double> args(step.count);
+                    for (uint32_t k = 0; k < step.count; ++k) {
+                        args[k] = operand(k);
+                    }
+                    step.value = func.function(args);
+                }
+                break;
+            }
+            case StepKind::OPAQUE: {
+                Frame frame(registry_);
+                for (uint32_t read = 0; read < definition.reads.size(); ++read) {
+                    auto it = cells_.find(definition.reads[read]);
+                    if (it != cells_.end() && it->second.kind != Cell::Kind::UNDEFINED) {
+                        frame.set(it->first, it->second.value);
+                    }
+                }
+                step.value = core::evaluate_dag(const_cast<ast::Node*>(step.node), frame);
+                break;
+            }
+        }
+        step.valid = true;
+        ++stats_.terms_evaluated;
+    }
+    return definition.steps.back().value;
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,507 @@
+#include "numu/core/number.h"
+#include "numu/core/budget.h"
+#include "numu/core/cse.h"
+#include "numu/core/stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace numu {
+namespace core {
+
+namespace {
+[[noreturn]] void fail(Status status) {
+    throw DomainError(status);
+}
+
+[[noreturn]] void matrix_unsupported() {
+    throw EvaluationError("Matrices are only supported by real evaluation");
+}
+
+// The operations evaluate_as needs beyond arithmetic, one specialization
+// per number type
+template<typename T>
+struct NumberTraits;
+
+template<>
+struct NumberTraits<Complex> {
+    static Complex from_double(double value, size_t) { return value; }
+    static Complex literal(double value, size_t) { return value; }
+
+    static bool constant(const std::string& name, const double* registered, size_t, Complex& value) {
+        if (name == "i" && !registered) {
+            value = Complex(0.0, 1.0);
+            return true;
+        }
+        return false;
+    }
+
+    static bool is_zero(const Complex& value) { return value == 0.0; }
+
+    static double to_double(const std::string& name, const Complex& value) {
+        if (value.imag() != 0.0) {
+            throw EvaluationError("Function " + name + " expects real arguments");
+        }
+        return value.real();
+    }
+
+    static double real(const Complex& value) {
+        if (value.imag() != 0.0) {
+            throw EvaluationError("Complex numbers are not ordered");
+        }
+        return value.real();
+    }
+
+    static bool less(const Complex& a, const Complex& b) { return real(a) < real(b); }
+    static bool less_equal(const Complex& a, const Complex& b) { return real(a) <= real(b); }
+
+    // A negated real has a -0 imaginary part, which would put sqrt(-4) at
+    // -2i and log(-1) at -pi i
+    static Complex positive_zero(const Complex& value) {
+        return value.imag() == 0.0 ? Complex(value.real(), 0.0) : value;
+    }
+
+    static Complex power(const Complex& base, const Complex& exponent) {
+        if (base.imag() == 0.0 && exponent.imag() == 0.0 &&
+            (base.real() >= 0.0 || std::trunc(exponent.real()) == exponent.real())) {
+            return std::pow(base.real(), exponent.real());
+        }
+        // i^2 by multiplication is exactly -1
+        if (exponent.imag() == 0.0 && std::trunc(exponent.real()) == exponent.real() &&
+            std::fabs(exponent.real()) <= 64.0 && base != 0.0) {
+            auto bits = static_cast<unsigned>(std::fabs(exponent.real()));
+            Complex result = 1.0;
+            Complex square = base;
+            for (; bits; bits >>= 1) {
+                if (bits & 1) result *= square;
+                square *= square;
+            }
+            return exponent.real() < 0.0 ? 1.0 / result : result;
+        }
+        return std::pow(positive_zero(base), exponent);
+    }
+
+    static Complex modulo(const Complex& a, const Complex& b) {
+        if (a.imag() != 0.0 || b.imag() != 0.0) {
+            throw EvaluationError("Modulo of complex numbers");
+        }
+        return std::fmod(a.real(), b.real());
+    }
+
+    static Complex root(const Complex& value) {
+        if (value.imag() == 0.0 && value.real() >= 0.0) {
+            return std::sqrt(value.real());
+        }
+        return std::sqrt(positive_zero(value));
+    }
+
+    static Complex logarithm(const Complex& value) {
+        if (value.imag() == 0.0 && value.real() > 0.0) {
+            return std::log(value.real());
+        }
+        return std::log(positive_zero(value));
+    }
+
+    // Everything but zero has a logarithm and a root
+    static bool log_domain(const Complex& value) { return value != 0.0; }
+    static bool sqrt_domain(const Complex&) { return true; }
+
+    static Complex magnitude(const Complex& value) { return std::abs(value); }
+    static Complex sin(const Complex& value) { return std::sin(value); }
+    static Complex cos(const Complex& value) { return std::cos(value); }
+    static Complex tan(const Complex& value) { return std::tan(value); }
+    static Complex exp(const Complex& value) { return std::exp(value); }
+};
+
+template<>
+struct NumberTraits<BigFloat> {
+    static BigFloat from_double(double value, size_t limbs) { return BigFloat(value, limbs); }
+
+    // Integers are exact as doubles; other literals are read as written,
+    // except that the parser's pi and e, the doubles nearest them, stand
+    // for the constants themselves
+    static BigFloat literal(double value, size_t limbs) {
+        if (std::trunc(value) == value && std::fabs(value) < 9007199254740992.0) {
+            return BigFloat(value, limbs);
+        }
+        if (value == 3.14159265358979323846) {
+            return BigFloat::pi(limbs);
+        }
+        if (value == 2.71828182845904523536) {
+            return core::exp(BigFloat(1.0, limbs));
+        }
+        return BigFloat::from_literal(value, limbs);
+    }
+
+    static bool constant(const std::string& name, const double* registered, size_t limbs, BigFloat& value) {
+        if (!registered) {
+            return false;
+        }
+        if (name == "pi") {
+            value = BigFloat::pi(limbs);
+            return true;
+        }
+        if (name == "e") {
+            value = core::exp(BigFloat(1.0, limbs));
+            return true;
+        }
+        return false;
+    }
+
+    static bool is_zero(const BigFloat& value) { return value.is_zero(); }
+    static double to_double(const std::string&, const BigFloat& value) { return value.to_double(); }
+
+    static bool less(const BigFloat& a, const BigFloat& b) { return a < b; }
+    static bool less_equal(const BigFloat& a, const BigFloat& b) { return a <= b; }
+
+    static BigFloat power(const BigFloat& base, const BigFloat& exponent) { return pow(base, exponent); }
+    static BigFloat modulo(const BigFloat& a, const BigFloat& b) { return fmod(a, b); }
+    static BigFloat root(const BigFloat& value) { return core::sqrt(value); }
+    static BigFloat logarithm(const BigFloat& value) { return core::log(value); }
+
+    static bool log_domain(const BigFloat& value) { return value > BigFloat(0.0, 1); }
+    static bool sqrt_domain(const BigFloat& value) { return !(value < BigFloat(0.0, 1)); }
+
+    static BigFloat magnitude(const BigFloat& value) { return abs(value); }
+    static BigFloat sin(const BigFloat& value) { return core::sin(value); }
+    static BigFloat cos(const BigFloat& value) { return core::cos(value); }
+    static BigFloat tan(const BigFloat& value) { return core::tan(value); }
+    static BigFloat exp(const BigFloat& value) { return core::exp(value); }
+};
+
+void check_arity(const std::string& name, size_t expected, size_t actual) {
+    if (expected != actual) {
+        throw EvaluationError("Function " + name + " expects " + std::to_string(expected) +
+                              " arguments, got " + std::to_string(actual));
+    }
+}
+
+template<typename T>
+class Evaluator {
+public:
+    using Traits = NumberTraits<T>;
+
+    // Nodes shared under `root` are evaluated once
+    Evaluator(const NumberFrame<T>& frame, ast::Node* root)
+        : frame_(frame), shared_(ast::shared_nodes(root)) {}
+
+    T evaluate(ast::Node* node) {
+        if (!shared_.count(node)) {
+            return evaluate_node(node);
+        }
+        auto it = values_.find(node);
+        if (it != values_.end()) {
+            return it->second;
+        }
+        T value = evaluate_node(node);
+        values_.emplace(node, value);
+        return value;
+    }
+
+private:
+    const NumberFrame<T>& frame_;
+    BudgetScope* budget_ = BudgetScope::current();
+    std::unordered_map<ast::Node*, size_t> shared_;
+    std::unordered_map<ast::Node*, T> values_;
+
+    T evaluate_node(ast::Node* node) {
+        if (!node) {
+            throw EvaluationError("Null node in evaluation");
+        }
+        if (budget_) {
+            budget_->charge(1);
+        }
+
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+                return Traits::literal(static_cast<ast::NumberNode*>(node)->value, frame_.limbs());
+
+            case ast::NodeType::BOOLEAN:
+                return number(static_cast<ast::BooleanNode*>(node)->value);
+
+            case ast::NodeType::VARIABLE:
+                return frame_.get(static_cast<ast::VariableNode*>(node)->name);
+
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                T left = evaluate(bin->left);
+                T right = evaluate(bin->right);
+                return binary(bin->op, left, right);
+            }
+
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                return unary(un->op, evaluate(un->operand));
+            }
+
+            case ast::NodeType::FUNCTION:
+                return call(static_cast<ast::FunctionNode*>(node));
+
+            case ast::NodeType::MATRIX:
+            case ast::NodeType::TENSOR:
+                matrix_unsupported();
+
+            default:
+                throw EvaluationError("Unknown node type in evaluation");
+        }
+    }
+
+    T number(double value) const { return Traits::from_double(value, frame_.limbs()); }
+
+    T binary(ast::BinaryOp op, const T& left, const T& right) const {
+        switch(op) {
+            case ast::BinaryOp::ADD: return left + right;
+            case ast::BinaryOp::SUB: return left - right;
+            case ast::BinaryOp::MUL: return left * right;
+            case ast::BinaryOp::DIV:
+                if (Traits::is_zero(right)) {
+                    fail(Status::DIVISION_BY_ZERO);
+                }
+                return left / right;
+            case ast::BinaryOp::POW: return Traits::power(left, right);
+            case ast::BinaryOp::MOD:
+                if (Traits::is_zero(right)) {
+                    fail(Status::MODULO_BY_ZERO);
+                }
+                return Traits::modulo(left, right);
+            case ast::BinaryOp::EQ: return number(left == right);
+            case ast::BinaryOp::NEQ: return number(left != right);
+            case ast::BinaryOp::LT: return number(Traits::less(left, right));
+            case ast::BinaryOp::LEQ: return number(Traits::less_equal(left, right));
+            case ast::BinaryOp::GT: return number(Traits::less(right, left));
+            case ast::BinaryOp::GEQ: return number(Traits::less_equal(right, left));
+            case ast::BinaryOp::AND: return number(!Traits::is_zero(left) && !Traits::is_zero(right));
+            case ast::BinaryOp::OR: return number(!Traits::is_zero(left) || !Traits::is_zero(right));
+            default:
+                throw EvaluationError("Unknown binary operator");
+        }
+    }
+
+    T unary(ast::UnaryOp op, const T& operand) const {
+        switch(op) {
+            case ast::UnaryOp::NEGATE: return -operand;
+            case ast::UnaryOp::NOT: return number(Traits::is_zero(operand));
+            case ast::UnaryOp::SIN: return Traits::sin(operand);
+            case ast::UnaryOp::COS: return Traits::cos(operand);
+            case ast::UnaryOp::TAN: return Traits::tan(operand);
+            case ast::UnaryOp::EXP: return Traits::exp(operand);
+            case ast::UnaryOp::LOG:
+                if (!Traits::log_domain(operand)) {
+                    fail(Status::LOG_DOMAIN);
+                }
+                return Traits::logarithm(operand);
+            case ast::UnaryOp::SQRT:
+                if (!Traits::sqrt_domain(operand)) {
+                    fail(Status::SQRT_DOMAIN);
+                }
+                return Traits::root(operand);
+            // Matrix operands fail on evaluation, so these see scalars
+            case ast::UnaryOp::TRANSPOSE:
+            case ast::UnaryOp::DETERMINANT:
+                return operand;
+            case ast::UnaryOp::INVERSE:
+                if (Traits::is_zero(operand)) {
+                    fail(Status::SINGULAR);
+                }
+                return number(1.0) / operand;
+            default:
+                throw EvaluationError("Unknown unary operator");
+        }
+    }
+
+    T call(ast::FunctionNode* fn) {
+        const Callable* callable = frame_.registry().find_callable(fn->name);
+        if (!callable) {
+            throw EvaluationError("Unknown function: " + fn->name);
+        }
+        std::vector<T> args;
+        args.reserve(fn->args.size());
+        for (auto* arg : fn->args) {
+            args.push_back(evaluate(arg));
+        }
+        NUMU_STATS_CALL(callable->name, 1);
+
+        // The standard functions and builtins are evaluated in the frame's
+        // number system rather than through doubles
+        if (callable->builtin != Builtin::NONE) {
+            return call_builtin(callable->builtin, fn->name, args);
+        }
+        std::vector<double> values;
+        values.reserve(args.size());
+        for (const auto& arg : args) {
+            values.push_back(Traits::to_double(fn->name, arg));
+        }
+        return number(callable->function(values));
+    }
+
+    T call_builtin(Builtin function, const std::string& name, const std::vector<T>& args) const {
+        switch(function) {
+            case Builtin::SIN: check_arity(name, 1, args.size()); return Traits::sin(args[0]);
+            case Builtin::COS: check_arity(name, 1, args.size()); return Traits::cos(args[0]);
+            case Builtin::TAN: check_arity(name, 1, args.size()); return Traits::tan(args[0]);
+            case Builtin::EXP: check_arity(name, 1, args.size()); return Traits::exp(args[0]);
+            case Builtin::LOG: check_arity(name, 1, args.size()); return unary(ast::UnaryOp::LOG, args[0]);
+            case Builtin::SQRT: check_arity(name, 1, args.size()); return unary(ast::UnaryOp::SQRT, args[0]);
+            case Builtin::ABS: check_arity(name, 1, args.size()); return Traits::magnitude(args[0]);
+            case Builtin::POW:
+                check_arity(name, 2, args.size());
+                return Traits::power(args[0], args[1]);
+            case Builtin::SUM:
+            case Builtin::AVG: {
+                if (args.empty() && function == Builtin::AVG) {
+                    break;
+                }
+                T total = number(0.0);
+                for (const auto& arg : args) {
+                    total = total + arg;
+                }
+                return function == Builtin::SUM ? total
+                                                         : total / number(static_cast<double>(args.size()));
+            }
+            case Builtin::MIN:
+            case Builtin::MAX: {
+                if (args.empty()) {
+                    break;
+                }
+                const T* best = &args[0];
+                for (const auto& arg : args) {
+                    bool better = function == Builtin::MIN ? Traits::less(arg, *best)
+                                                                    : Traits::less(*best, arg);
+                    if (better) {
+                        best = &arg;
+                    }
+                }
+                return *best;
+            }
+            case Builtin::NONE:
+                break;
+        }
+        throw EvaluationError("Function " + name + " expects at least one argument");
+    }
+};
+
+// Past max_digits10 a double has no more digits to show, only the
+// binary expansion of its rounding error. NaN prints without the sign bit
+// printf would show, as BigFloat prints it.
+std::string format_double(double value, size_t digits) {
+    if (std::isnan(value)) {
+        return "nan";
+    }
+    constexpr size_t max_digits = std::numeric_limits<double>::max_digits10;
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.*g", static_cast<int>(std::min(digits, max_digits)), value);
+    return buffer;
+}
+} // namespace
+
+NumberFormat NumberFormat::from(const config::Config& config) {
+    NumberFormat format;
+    std::string system = config.get_string("core.number_system", "real");
+    if (system == "real") {
+        format.system = NumberSystem::REAL;
+    } else if (system == "complex") {
+        format.system = NumberSystem::COMPLEX;
+    } else if (system == "multiprecision") {
+        format.system = NumberSystem::MULTIPRECISION;
+    } else {
+        throw config::ConfigError("Unknown number system for core.number_system: " + system);
+    }
+    double precision = config.get_number("core.precision", static_cast<double>(format.precision));
+    if (!(precision >= 1.0) || precision > 100000.0) {
+        throw config::ConfigError("Invalid precision for core.precision: " + format_double(precision, 17));
+    }
+    format.precision = static_cast<size_t>(precision);
+    return format;
+}
+
+template<typename T>
+NumberFrame<T>::NumberFrame(RegistryPtr registry, const Frame* parent, size_t digits)
+    : registry_(std::move(registry)), parent_(parent), limbs_(BigFloat::limbs_for(digits)) {}
+
+template<typename T>
+void NumberFrame<T>::set(const std::string& name, T value) {
+    variables_[name] = std::move(value);
+}
+
+template<typename T>
+T NumberFrame<T>::get(const std::string& name) const {
+    auto it = variables_.find(name);
+    if (it != variables_.end()) {
+        return it->second;
+    }
+    if (parent_) {
+        if (const double* value = parent_->find(name)) {
+            return NumberTraits<T>::from_double(*value, limbs_);
+        }
+    }
+    const double* registered = registry_->find_constant(name);
+    T value;
+    if (NumberTraits<T>::constant(name, registered, limbs_, value)) {
+        return value;
+    }
+    if (!registered) {
+        throw EvaluationError("Undefined variable: " + name);
+    }
+    return NumberTraits<T>::from_double(*registered, limbs_);
+}
+
+template<typename T>
+T evaluate_as(ast::Node* node, const NumberFrame<T>& frame) {
+    NUMU_STATS_STAGE(EVALUATE);
+    return Evaluator<T>(frame, node).evaluate(node);
+}
+
+template class NumberFrame<Complex>;
+template class NumberFrame<BigFloat>;
+template Complex evaluate_as<Complex>(ast::Node* node, const NumberFrame<Complex>& frame);
+template BigFloat evaluate_as<BigFloat>(ast::Node* node, const NumberFrame<BigFloat>& frame);
+
+std::string format_number(double value, size_t digits) {
+    return format_double(value, digits);
+}
+
+std::string format_number(const Complex& value, size_t digits) {
+    // A part that many orders below the other is rounding noise, as in
+    // exp(i pi)
+    double scale = std::pow(10.0, -static_cast<double>(std::min<size_t>(digits, 300)));
+    double re = value.real();
+    double im = value.imag();
+    if (std::fabs(im) < std::fabs(re) * scale) {
+        im = 0.0;
+    } else if (std::fabs(re) < std::fabs(im) * scale) {
+        re = 0.0;
+    }
+    if (im == 0.0) {
+        return format_double(re, digits);
+    }
+    std::string imaginary = (im == 1.0 ? "" : im == -1.0 ? "-" : format_double(im, digits)) + "i";
+    if (re == 0.0) {
+        return imaginary;
+    }
+    bool sign = imaginary[0] == '-' || imaginary[0] == '+';
+    return format_double(re, digits) + (sign ? "" : "+") + imaginary;
+}
+
+std::string format_number(const BigFloat& value, size_t digits) {
+    return value.to_string(digits);
+}
+
+std::string evaluate_formatted(ast::Node* node, const Frame& frame, const NumberFormat& format) {
+    switch(format.system) {
+        case NumberSystem::COMPLEX: {
+            NumberFrame<Complex> complex(frame.shared_registry(), &frame, format.precision);
+            return format_number(evaluate_as(node, complex), format.precision);
+        }
+        case NumberSystem::MULTIPRECISION: {
+            NumberFrame<BigFloat> precise(frame.shared_registry(), &frame, format.precision);
+            return format_number(evaluate_as(node, precise), format.precision);
+        }
+        default:
+            return format_number(evaluate(node, frame), format.precision);
+    }
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,217 @@
+#include "numu/core/parallel.h"
+#include "numu/core/budget.h"
+#include "numu/core/compile.h"
+#include <algorithm>
+
+namespace numu {
+namespace core {
+
+namespace {
+// Rows per chunk are chosen so a chunk's slice of every column plus its
+// output fits in a typical L2 cache, in whole batch blocks
+constexpr size_t chunk_bytes = 256 * 1024;
+constexpr size_t block_rows = 256;
+constexpr size_t max_chunk_rows = 64 * block_rows;
+
+// The scheduler whose task this thread is running, if any
+thread_local const Scheduler* running_scheduler = nullptr;
+
+struct RunningScope {
+    const Scheduler* saved;
+
+    explicit RunningScope(const Scheduler* scheduler) : saved(running_scheduler) {
+        running_scheduler = scheduler;
+    }
+    ~RunningScope() { running_scheduler = saved; }
+};
+
+size_t chunk_rows(size_t columns) {
+    size_t rows = chunk_bytes / (sizeof(double) * (columns + 1));
+    rows = rows / block_rows * block_rows;
+    return std::min(std::max(rows, block_rows), max_chunk_rows);
+}
+} // namespace
+
+Scheduler::Scheduler(size_t workers) {
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    threads_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        threads_.emplace_back(&Scheduler::worker, this, i);
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t Scheduler::workers_from(const config::Config& config) {
+    return static_cast<size_t>(config.get_number("core.threads", 0));
+}
+
+void Scheduler::parallel_for(size_t count, size_t grain,
+                             const std::function<void(size_t, size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+
+    // From inside one of our own tasks the workers may all be waiting on
+    // this call, so the chunks run here, in order
+    if (running_scheduler == this) {
+        for (size_t begin = 0; begin < count; begin += grain) {
+            task(begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(submit_mutex_);
+    Job job;
+    job.task = &task;
+    job.budget = BudgetScope::current();
+    size_t chunks = (count + grain - 1) / grain;
+    job.remaining = chunks;
+
+    // Neighbouring chunks go to the same worker so each starts on a
+    // contiguous range; stealing evens out the rest
+    size_t workers = queues_.size();
+    for (size_t c = 0; c < chunks; ++c) {
+        Queue& queue = *queues_[c * workers / chunks];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.chunks.push_back(Chunk{&job, c * grain, std::min(count, (c + 1) * grain)});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&job] { return job.remaining.load() == 0; });
+    }
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void Scheduler::worker(size_t index) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_) {
+                return;
+            }
+            seen = generation_;
+        }
+
+        Chunk chunk;
+        while (take(index, chunk)) {
+            run(chunk);
+        }
+    }
+}
+
+bool Scheduler::take(size_t index, Chunk& chunk) {
+    {
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::run(const Chunk& chunk) {
+    Job& job = *chunk.job;
+    if (!job.failed.load(std::memory_order_relaxed)) {
+        try {
+            BudgetScope budget(job.budget);
+            RunningScope running(this);
+            (*job.task)(chunk.begin, chunk.end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.error_mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+            job.failed = true;
+        }
+    }
+    // The job lives on the submitting thread's stack and may be gone once
+    // the count reaches zero, so only the scheduler is touched afterwards
+    if (job.remaining.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.notify_all();
+    }
+}
+
+std::vector<double> Scheduler::evaluate(const std::vector<ast::Node*>& expressions,
+                                        const std::vector<Column>& bindings, size_t count,
+                                        const Frame& frame) {
+    std::vector<std::string> names;
+    std::vector<const double*> data;
+    names.reserve(bindings.size());
+    data.reserve(bindings.size());
+    for (const auto& column : bindings) {
+        names.push_back(column.name);
+        data.push_back(column.data);
+    }
+
+    std::vector<CompiledExpression> compiled(expressions.size());
+    parallel_for(expressions.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t e = begin; e < end; ++e) {
+            compiled[e] = compile(expressions[e], names, frame);
+        }
+    });
+
+    std::vector<double> out(expressions.size() * count);
+    size_t rows = chunk_rows(bindings.size());
+    size_t per_expression = (count + rows - 1) / rows;
+    parallel_for(expressions.size() * per_expression, 1, [&](size_t begin, size_t end) {
+        std::vector<const double*> columns(data.size());
+        for (size_t t = begin; t < end; ++t) {
+            size_t e = t / per_expression;
+            size_t offset = (t % per_expression) * rows;
+            for (size_t k = 0; k < data.size(); ++k) {
+                columns[k] = data[k] + offset;
+            }
+            evaluate_batch(compiled[e], columns.data(), std::min(rows, count - offset),
+                           out.data() + e * count + offset);
+        }
+    });
+    return out;
+}
+
+std::vector<double> Scheduler::evaluate(const std::vector<ast::Node*>& expressions,
+                                        const std::vector<Column>& bindings, size_t count) {
+    return evaluate(expressions, bindings, count, default_frame());
+}
+
+} // namespace core
+} // namespace numu
@@ -1,9 +1,11 @@
 #include "numu/core/parse.h"
 #include "numu/core/ast.h"
+#include "numu/core/stats.h"
+#include <array>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <stdexcept>
-#include <unordered_map>
 #include <algorithm>
 
 namespace numu {
@@ -25,60 +27,119 @@ const Precedence PREC_POWER = 10;
 const Precedence PREC_CALL = 11;
 const Precedence PREC_PRIMARY = 12;
 
+class Parser;
+
+using PrefixFn = ast::Node* (Parser::*)();
+using InfixFn = ast::Node* (Parser::*)(ast::Node*);
+
 struct ParseRule {
-    std::function<ast::Node*(Parser*)> prefix;
-    std::function<ast::Node*(Parser*, ast::Node*)> infix;
+    PrefixFn prefix;
+    InfixFn infix;
     Precedence precedence;
 };
 
+constexpr size_t token_count = static_cast<size_t>(lex::TokenType::END_OF_FILE) + 1;
+
+// Where the parser's tokens come from, behind a plain function pointer so
+// the rule table does not depend on the lexer type
+struct TokenSource {
+    void* lexer;
+    lex::Token (*next)(void* lexer);
+
+    template<typename Lexer>
+    static TokenSource of(Lexer& lexer) {
+        return TokenSource{&lexer, [](void* l) { return static_cast<Lexer*>(l)->next(); }};
+    }
+};
+
+// StreamLexer text is only valid until its next token, but the parser
+// holds two: the current one and one of lookahead. Each token's text is
+// copied into the slot of the token the parser has just dropped.
+class StreamTokens {
+public:
+    explicit StreamTokens(lex::StreamLexer& lexer) : lexer_(lexer) {}
+
+    lex::Token next() {
+        lex::Token token = lexer_.next();
+        std::string& text = texts_[slot_];
+        slot_ ^= 1;
+        text.assign(token.text.data(), token.text.size());
+        token.text = text;
+        return token;
+    }
+
+private:
+    lex::StreamLexer& lexer_;
+    std::array<std::string, 2> texts_;
+    size_t slot_ = 0;
+};
+
 class Parser {
 public:
-    Parser(lex::Lexer& lexer) : lexer_(lexer) {
-        current_ = lexer_.next();
-        next_ = lexer_.next();
-        setup_rules();
+    explicit Parser(TokenSource source) : source_(source) {
+        current_ = source_.next(source_.lexer);
+        next_ = source_.next(source_.lexer);
     }
 
     ast::Node* parse() {
         return parse_expression();
     }
 
+    ast::Node* parse_program() {
+        std::vector<ast::Node*> statements;
+        while (current_.type != lex::TokenType::END_OF_FILE) {
+            if (match(lex::TokenType::SEMI)) {
+                continue;
+            }
+            statements.push_back(statement());
+        }
+        return ast::BlockNode::create(std::move(statements));
+    }
+
 private:
-    lex::Lexer& lexer_;
+    TokenSource source_;
     lex::Token current_;
     lex::Token next_;
-    std::unordered_map<lex::TokenType, ParseRule> rules_;
-
-    void setup_rules() {
-        rules_[lex::TokenType::NUMBER] = {&Parser::number, nullptr, PREC_NONE};
-        rules_[lex::TokenType::IDENTIFIER] = {&Parser::variable, &Parser::call, PREC_CALL};
-        rules_[lex::TokenType::STRING] = {&Parser::string, nullptr, PREC_NONE};
-        rules_[lex::TokenType::LPAREN] = {&Parser::grouping, &Parser::call, PREC_CALL};
-        rules_[lex::TokenType::LBRACKET] = {&Parser::matrix, nullptr, PREC_NONE};
-        rules_[lex::TokenType::MINUS] = {&Parser::unary, &Parser::binary, PREC_TERM};
-        rules_[lex::TokenType::PLUS] = {nullptr, &Parser::binary, PREC_TERM};
-        rules_[lex::TokenType::STAR] = {nullptr, &Parser::binary, PREC_FACTOR};
-        rules_[lex::TokenType::SLASH] = {nullptr, &Parser::binary, PREC_FACTOR};
-        rules_[lex::TokenType::CARET] = {nullptr, &Parser::binary, PREC_POWER};
-        rules_[lex::TokenType::EQUAL] = {nullptr, &Parser::assignment, PREC_ASSIGNMENT};
-        rules_[lex::TokenType::EQEQ] = {nullptr, &Parser::binary, PREC_EQUALITY};
-        rules_[lex::TokenType::NEQ] = {nullptr, &Parser::binary, PREC_EQUALITY};
-        rules_[lex::TokenType::LESS] = {nullptr, &Parser::binary, PREC_COMPARISON};
-        rules_[lex::TokenType::LEQ] = {nullptr, &Parser::binary, PREC_COMPARISON};
-        rules_[lex::TokenType::GREATER] = {nullptr, &Parser::binary, PREC_COMPARISON};
-        rules_[lex::TokenType::GEQ] = {nullptr, &Parser::binary, PREC_COMPARISON};
-        rules_[lex::TokenType::BANG] = {&Parser::unary, nullptr, PREC_NONE};
-        rules_[lex::TokenType::TRUE] = {&Parser::boolean, nullptr, PREC_NONE};
-        rules_[lex::TokenType::FALSE] = {&Parser::boolean, nullptr, PREC_NONE};
-        rules_[lex::TokenType::PI] = {&Parser::constant, nullptr, PREC_NONE};
-        rules_[lex::TokenType::E] = {&Parser::constant, nullptr, PREC_NONE};
-        rules_[lex::TokenType::INF] = {&Parser::constant, nullptr, PREC_NONE};
-        rules_[lex::TokenType::NAN] = {&Parser::constant, nullptr, PREC_NONE};
+
+    // Indexed by TokenType; built at compile time so dispatch is a single load
+    static const std::array<ParseRule, token_count> rules_;
+
+    static constexpr std::array<ParseRule, token_count> make_rules() {
+        std::array<ParseRule, token_count> rules{};
+        auto set = [&rules](lex::TokenType type, PrefixFn prefix, InfixFn infix, Precedence precedence) {
+            rules[static_cast<size_t>(type)] = ParseRule{prefix, infix, precedence};
+        };
+        set(lex::TokenType::NUMBER, &Parser::number, nullptr, PREC_NONE);
+        set(lex::TokenType::IDENTIFIER, &Parser::variable, nullptr, PREC_NONE);
+        set(lex::TokenType::STRING, &Parser::string, nullptr, PREC_NONE);
+        set(lex::TokenType::LPAREN, &Parser::grouping, &Parser::call, PREC_CALL);
+        set(lex::TokenType::LBRACKET, &Parser::matrix, nullptr, PREC_NONE);
+        set(lex::TokenType::MINUS, &Parser::unary, &Parser::binary, PREC_TERM);
+        set(lex::TokenType::PLUS, nullptr, &Parser::binary, PREC_TERM);
+        set(lex::TokenType::STAR, nullptr, &Parser::binary, PREC_FACTOR);
+        set(lex::TokenType::SLASH, nullptr, &Parser::binary, PREC_FACTOR);
+        set(lex::TokenType::PERCENT, nullptr, &Parser::binary, PREC_FACTOR);
+        set(lex::TokenType::CARET, nullptr, &Parser::binary, PREC_POWER);
+        set(lex::TokenType::EQUAL, nullptr, &Parser::assignment, PREC_ASSIGNMENT);
+        set(lex::TokenType::EQEQ, nullptr, &Parser::binary, PREC_EQUALITY);
+        set(lex::TokenType::NEQ, nullptr, &Parser::binary, PREC_EQUALITY);
+        set(lex::TokenType::LESS, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(lex::TokenType::LEQ, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(lex::TokenType::GREATER, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(lex::TokenType::GEQ, nullptr, &Parser::binary, PREC_COMPARISON);
+        set(lex::TokenType::BANG, &Parser::unary, nullptr, PREC_NONE);
+        set(lex::TokenType::TRUE, &Parser::boolean, nullptr, PREC_NONE);
+        set(lex::TokenType::FALSE, &Parser::boolean, nullptr, PREC_NONE);
+        set(lex::TokenType::PI, &Parser::constant, nullptr, PREC_NONE);
+        set(lex::TokenType::E, &Parser::constant, nullptr, PREC_NONE);
+        set(lex::TokenType::INF, &Parser::constant, nullptr, PREC_NONE);
+        set(lex::TokenType::NAN_LITERAL, &Parser::constant, nullptr, PREC_NONE);
+        return rules;
     }
 
     void advance() {
         current_ = next_;
-        next_ = lexer_.next();
+        next_ = source_.next(source_.lexer);
     }
 
     void consume(lex::TokenType type, const std::string& message) {
@@ -110,24 +171,127 @@ private:
     }
 
     ast::Node* parse_prefix() {
-        auto rule = get_rule(current_.type);
-        if (!rule.prefix) {
+        PrefixFn prefix = get_rule(current_.type).prefix;
+        if (!prefix) {
             throw_error("Expected expression");
         }
-        return rule.prefix(this);
+        return (this->*prefix)();
     }
 
     ast::Node* parse_infix(ast::Node* left) {
-        auto rule = get_rule(current_.type);
-        return rule.infix(this, left);
+        return (this->*get_rule(current_.type).infix)(left);
+    }
+
+    static const ParseRule& get_rule(lex::TokenType type) {
+        return rules_[static_cast<size_t>(type)];
+    }
+
+    // Statements may end with ';', which is optional since an expression
+    // ends at the first token that cannot continue it
+    ast::Node* statement() {
+        ast::Node* stmt;
+        switch(current_.type) {
+            case lex::TokenType::LET: stmt = let_statement(); break;
+            case lex::TokenType::IF: return if_statement();
+            case lex::TokenType::WHILE: return while_statement();
+            case lex::TokenType::FOR: return for_statement();
+            case lex::TokenType::RETURN: stmt = return_statement(); break;
+            case lex::TokenType::LBRACE: return block();
+            default: stmt = parse_expression(); break;
+        }
+        match(lex::TokenType::SEMI);
+        return stmt;
+    }
+
+    ast::Node* block() {
+        consume(lex::TokenType::LBRACE, "Expect '{' before block");
+        std::vector<ast::Node*> statements;
+        while (current_.type != lex::TokenType::RBRACE) {
+            if (current_.type == lex::TokenType::END_OF_FILE) {
+                throw_error("Expect '}' after block");
+            }
+            if (match(lex::TokenType::SEMI)) {
+                continue;
+            }
+            statements.push_back(statement());
+        }
+        advance();
+        return ast::BlockNode::create(std::move(statements));
+    }
+
+    ast::Node* body() {
+        return current_.type == lex::TokenType::LBRACE ? block() : statement();
+    }
+
+    ast::Node* let_statement() {
+        advance();
+        if (current_.type != lex::TokenType::IDENTIFIER) {
+            throw_error("Expect variable name after 'let'");
+        }
+        std::string name(current_.text);
+        advance();
+        consume(lex::TokenType::EQUAL, "Expect '=' after variable name");
+        return ast::AssignmentNode::create(name, parse_expression());
     }
 
-    ParseRule get_rule(lex::TokenType type) const {
-        auto it = rules_.find(type);
-        if (it != rules_.end()) {
-            return it->second;
+    ast::Node* if_statement() {
+        advance();
+        ast::Node* condition = parse_expression();
+        ast::Node* then_branch = body();
+        ast::Node* else_branch = nullptr;
+        if (match(lex::TokenType::ELSE)) {
+            else_branch = current_.type == lex::TokenType::IF ? if_statement() : body();
         }
-        return {nullptr, nullptr, PREC_NONE};
+        return ast::IfNode::create(condition, then_branch, else_branch);
+    }
+
+    ast::Node* while_statement() {
+        advance();
+        ast::Node* condition = parse_expression();
+        return ast::WhileNode::create(condition, body());
+    }
+
+    // for (init; condition; increment) body, parentheses optional and each
+    // clause may be empty
+    ast::Node* for_statement() {
+        advance();
+        bool parenthesized = match(lex::TokenType::LPAREN);
+
+        ast::Node* initializer = nullptr;
+        if (current_.type == lex::TokenType::LET) {
+            initializer = let_statement();
+        } else if (current_.type != lex::TokenType::SEMI) {
+            initializer = parse_expression();
+        }
+        consume(lex::TokenType::SEMI, "Expect ';' after loop initializer");
+
+        ast::Node* condition = nullptr;
+        if (current_.type != lex::TokenType::SEMI) {
+            condition = parse_expression();
+        }
+        consume(lex::TokenType::SEMI, "Expect ';' after loop condition");
+
+        ast::Node* increment = nullptr;
+        auto close = parenthesized ? lex::TokenType::RPAREN : lex::TokenType::LBRACE;
+        if (current_.type != close) {
+            increment = parse_expression();
+        }
+        if (parenthesized) {
+            consume(lex::TokenType::RPAREN, "Expect ')' after for clauses");
+        }
+
+        return ast::ForNode::create(initializer, condition, increment, body());
+    }
+
+    ast::Node* return_statement() {
+        advance();
+        ast::Node* value = nullptr;
+        if (current_.type != lex::TokenType::SEMI &&
+            current_.type != lex::TokenType::RBRACE &&
+            current_.type != lex::TokenType::END_OF_FILE) {
+            value = parse_expression();
+        }
+        return ast::ReturnNode::create(value);
     }
 
     ast::Node* number() {
@@ -154,7 +318,7 @@ private:
             case lex::TokenType::PI: value = 3.14159265358979323846; break;
             case lex::TokenType::E: value = 2.71828182845904523536; break;
             case lex::TokenType::INF: value = std::numeric_limits<double>::infinity(); break;
-            case lex::TokenType::NAN: value = std::numeric_limits<double>::quiet_NaN(); break;
+            case lex::TokenType::NAN_LITERAL: value = std::numeric_limits<double>::quiet_NaN(); break;
             default: throw_error("Unknown constant");
         }
         advance();
@@ -219,8 +383,7 @@ private:
         lex::Token op = current_;
         advance();
         
-        ParseRule rule = get_rule(op.type);
-        ast::Node* right = parse_expression(rule.precedence);
+        ast::Node* right = parse_expression(get_rule(op.type).precedence);
         
         switch(op.type) {
             case lex::TokenType::PLUS:
@@ -231,6 +394,8 @@ private:
                 return ast::BinaryOpNode::create(ast::BinaryOp::MUL, left, right);
             case lex::TokenType::SLASH:
                 return ast::BinaryOpNode::create(ast::BinaryOp::DIV, left, right);
+            case lex::TokenType::PERCENT:
+                return ast::BinaryOpNode::create(ast::BinaryOp::MOD, left, right);
             case lex::TokenType::CARET:
                 return ast::BinaryOpNode::create(ast::BinaryOp::POW, left, right);
             case lex::TokenType::EQEQ:
@@ -269,6 +434,7 @@ private:
         
         auto* var = static_cast<ast::VariableNode*>(left);
         std::vector<ast::Node*> args;
+        advance(); // Skip '('
         
         if (!match(lex::TokenType::RPAREN)) {
             do {
@@ -278,16 +444,52 @@ private:
             consume(lex::TokenType::RPAREN, "Expect ')' after arguments");
         }
         
+        // Matrix operators are spelled as calls
+        if (args.size() == 1) {
+            if (var->name == "transpose") {
+                return ast::UnaryOpNode::create(ast::UnaryOp::TRANSPOSE, args[0]);
+            }
+            if (var->name == "det") {
+                return ast::UnaryOpNode::create(ast::UnaryOp::DETERMINANT, args[0]);
+            }
+            if (var->name == "inv" || var->name == "inverse") {
+                return ast::UnaryOpNode::create(ast::UnaryOp::INVERSE, args[0]);
+            }
+        }
+        
         return ast::FunctionNode::create(var->name, std::move(args));
     }
 };
 
+const std::array<ParseRule, token_count> Parser::rules_ = Parser::make_rules();
+
 } // namespace
 
 ast::Node* parse(lex::Lexer& lexer) {
-    Parser parser(lexer);
+    NUMU_STATS_STAGE(PARSE);
+    Parser parser(TokenSource::of(lexer));
+    return parser.parse();
+}
+
+ast::Node* parse(lex::StreamLexer& lexer) {
+    NUMU_STATS_STAGE(PARSE);
+    StreamTokens tokens(lexer);
+    Parser parser(TokenSource::of(tokens));
     return parser.parse();
 }
 
+ast::Node* parse_program(lex::Lexer& lexer) {
+    NUMU_STATS_STAGE(PARSE);
+    Parser parser(TokenSource::of(lexer));
+    return parser.parse_program();
+}
+
+ast::Node* parse_program(lex::StreamLexer& lexer) {
+    NUMU_STATS_STAGE(PARSE);
+    StreamTokens tokens(lexer);
+    Parser parser(TokenSource::of(tokens));
+    return parser.parse_program();
+}
+
 } // namespace parse
 } // namespace numu
@@ -0,0 +1,295 @@
+#include "numu/core/resolve.h"
+#include "numu/core/budget.h"
+#include "numu/core/stats.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace numu {
+namespace core {
+
+class Resolver {
+public:
+    // Collects every variable when `variables` is null
+    Resolver(ResolvedExpression& out, const Frame& frame, const std::vector<std::string>* variables)
+        : out_(out), frame_(frame), collect_variables_(!variables) {
+        out_.registry_ = frame.shared_registry();
+        if (variables) {
+            out_.variables_ = *variables;
+        }
+        for (size_t i = 0; i < out_.variables_.size(); ++i) {
+            slots_[out_.variables_[i]] = static_cast<uint32_t>(i);
+        }
+    }
+
+    void resolve(ast::Node* node) {
+        out_.root_ = term(node);
+    }
+
+private:
+    using Term = ResolvedExpression::Term;
+    using Kind = ResolvedExpression::Kind;
+
+    ResolvedExpression& out_;
+    const Frame& frame_;
+    bool collect_variables_;
+    std::unordered_map<std::string, uint32_t> slots_;
+    // Nodes shared in the input stay shared
+    std::unordered_map<ast::Node*, uint32_t> resolved_;
+
+    uint32_t add(Term term) {
+        auto index = static_cast<uint32_t>(out_.terms_.size());
+        out_.terms_.push_back(term);
+        return index;
+    }
+
+    uint32_t term(ast::Node* node) {
+        if (!node) {
+            throw EvaluationError("Null node in evaluation");
+        }
+        auto it = resolved_.find(node);
+        if (it != resolved_.end()) {
+            return it->second;
+        }
+        uint32_t index = make_term(node);
+        resolved_[node] = index;
+        return index;
+    }
+
+    uint32_t make_term(ast::Node* node) {
+        switch(node->type) {
+            case ast::NodeType::NUMBER:
+                return constant(static_cast<ast::NumberNode*>(node)->value);
+
+            case ast::NodeType::BOOLEAN:
+                return constant(static_cast<ast::BooleanNode*>(node)->value ? 1.0 : 0.0);
+
+            case ast::NodeType::VARIABLE:
+                return variable(static_cast<ast::VariableNode*>(node)->name);
+
+            case ast::NodeType::BINARY_OP: {
+                auto* bin = static_cast<ast::BinaryOpNode*>(node);
+                Term t{Kind::BINARY, static_cast<uint8_t>(bin->op)};
+                t.a = term(bin->left);
+                t.b = term(bin->right);
+                return add(t);
+            }
+
+            case ast::NodeType::UNARY_OP: {
+                auto* un = static_cast<ast::UnaryOpNode*>(node);
+                Term t{Kind::UNARY, static_cast<uint8_t>(un->op)};
+                t.a = term(un->operand);
+                return add(t);
+            }
+
+            case ast::NodeType::FUNCTION:
+                return call(static_cast<ast::FunctionNode*>(node));
+
+            case ast::NodeType::MATRIX:
+            case ast::NodeType::TENSOR:
+                throw EvaluationError("Matrix expressions cannot be resolved; use evaluate_matrix");
+
+            default:
+                throw EvaluationError("Unknown node type in evaluation");
+        }
+    }
+
+    uint32_t constant(double value) {
+        Term t{Kind::CONSTANT, 0};
+        t.value = value;
+        return add(t);
+    }
+
+    uint32_t variable(const std::string& name) {
+        auto it = slots_.find(name);
+        if (it == slots_.end() && collect_variables_) {
+            auto slot = static_cast<uint32_t>(out_.variables_.size());
+            out_.variables_.push_back(name);
+            it = slots_.emplace(name, slot).first;
+        }
+        if (it == slots_.end()) {
+            // Names outside the requested slot list are bound now from the frame
+            return constant(frame_.get(name));
+        }
+        Term t{Kind::SLOT, 0};
+        t.a = it->second;
+        return add(t);
+    }
+
+    uint32_t call(ast::FunctionNode* fn) {
+        const Callable* callable = frame_.registry().find_callable(fn->name);
+        if (!callable) {
+            throw EvaluationError("Unknown function: " + fn->name);
+        }
+        size_t argc = fn->args.size();
+        if (callable->arity != variadic && callable->arity != argc) {
+            throw EvaluationError("Function " + fn->name + " expects " +
+                                  std::to_string(callable->arity) + " arguments, got " +
+                                  std::to_string(argc));
+        }
+        std::vector<uint32_t> args;
+        args.reserve(argc);
+        for (auto* arg : fn->args) {
+            args.push_back(term(arg));
+        }
+
+        Term t{Kind::CALL, 0};
+        t.callable = callable;
+        if (argc == 1 && callable->checked) {
+            t.kind = Kind::UNARY;
+            t.op = static_cast<uint8_t>(callable->op);
+            t.a = args[0];
+        } else if (argc == 1 && callable->unary) {
+            t.kind = Kind::CALL1;
+            t.a = args[0];
+        } else if (argc == 2 && callable->binary) {
+            t.kind = Kind::CALL2;
+            t.a = args[0];
+            t.b = args[1];
+        } else {
+            t.a = static_cast<uint32_t>(out_.arguments_.size());
+            t.b = static_cast<uint32_t>(argc);
+            out_.arguments_.insert(out_.arguments_.end(), args.begin(), args.end());
+        }
+        return add(t);
+    }
+};
+
+// Without `Throwing` the first error is kept in `status` and evaluation
+// goes on with NaN, so domain errors cost no unwinding. Terms come after
+// their children, so one forward sweep computes each of them once, however
+// many parents share it.
+template<bool Throwing>
+class ResolvedExpression::Evaluator {
+public:
+    Evaluator(const ResolvedExpression& expr, const double* vars)
+        : expr_(expr), vars_(vars), budget_(BudgetScope::current()) {}
+
+    double run() {
+        const auto& terms = expr_.terms_;
+        std::vector<double> values(terms.size());
+        std::vector<double> args;
+        for (uint32_t i = 0; i <= expr_.root_; ++i) {
+            if (budget_) {
+                budget_->charge(1);
+            }
+            const Term& t = terms[i];
+            switch(t.kind) {
+                case Kind::CONSTANT:
+                    values[i] = t.value;
+                    break;
+                case Kind::SLOT:
+                    values[i] = vars_[t.a];
+                    break;
+                case Kind::BINARY: {
+                    Status error = Status::OK;
+                    double value = eval_binary_op(static_cast<ast::BinaryOp>(t.op), values[t.a], values[t.b], error);
+                    values[i] = check(value, error);
+                    break;
+                }
+                case Kind::UNARY: {
+                    Status error = Status::OK;
+                    double value = eval_unary_op(static_cast<ast::UnaryOp>(t.op), values[t.a], error);
+                    values[i] = check(value, error);
+                    break;
+                }
+                case Kind::CALL1: {
+                    NUMU_STATS_CALL(t.callable->name, 1);
+                    values[i] = t.callable->unary(values[t.a]);
+                    break;
+                }
+                case Kind::CALL2: {
+                    NUMU_STATS_CALL(t.callable->name, 1);
+                    values[i] = t.callable->binary(values[t.a], values[t.b]);
+                    break;
+                }
+                case Kind::CALL: {
+                    args.resize(t.b);
+                    for (uint32_t k = 0; k < t.b; ++k) {
+                        args[k] = values[expr_.arguments_[t.a + k]];
+                    }
+                    NUMU_STATS_CALL(t.callable->name, 1);
+                    values[i] = t.callable->function(args);
+                    break;
+                }
+            }
+        }
+        return values[expr_.root_];
+    }
+
+    Status status = Status::OK;
+
+private:
+    const ResolvedExpression& expr_;
+    const double* vars_;
+    BudgetScope* budget_;
+
+    double check(double value, Status error) {
+        if (error == Status::OK) {
+            return value;
+        }
+        if (Throwing) {
+            throw DomainError(error);
+        }
+        if (status == Status::OK) {
+            status = error;
+        }
+        return value;
+    }
+};
+
+size_t ResolvedExpression::slot(const std::string& name) const {
+    auto it = std::find(variables_.begin(), variables_.end(), name);
+    if (it == variables_.end()) {
+        throw EvaluationError("Undefined variable: " + name);
+    }
+    return static_cast<size_t>(it - variables_.begin());
+}
+
+double ResolvedExpression::evaluate(const double* vars) const {
+    NUMU_STATS_STAGE(EVALUATE);
+    return Evaluator<true>(*this, vars).run();
+}
+
+Result ResolvedExpression::try_evaluate(const double* vars) const {
+    NUMU_STATS_STAGE(EVALUATE);
+    Evaluator<false> evaluator(*this, vars);
+    Result result;
+    try {
+        result.value = evaluator.run();
+        result.status = evaluator.status;
+    } catch (const BudgetExceeded&) {
+        throw;
+    } catch (const EvaluationError&) {
+        // Raised by a registered function
+        result.status = evaluator.status == Status::OK ? Status::OTHER : evaluator.status;
+    }
+    if (!result.ok()) {
+        result.value = std::numeric_limits<double>::quiet_NaN();
+    }
+    return result;
+}
+
+ResolvedExpression resolve(ast::Node* node, const Frame& frame) {
+    ResolvedExpression out;
+    Resolver(out, frame, nullptr).resolve(node);
+    return out;
+}
+
+ResolvedExpression resolve(ast::Node* node, const std::vector<std::string>& variables,
+                     const Frame& frame) {
+    ResolvedExpression out;
+    Resolver(out, frame, &variables).resolve(node);
+    return out;
+}
+
+ResolvedExpression resolve(ast::Node* node) {
+    return resolve(node, default_frame());
+}
+
+ResolvedExpression resolve(ast::Node* node, const std::vector<std::string>& variables) {
+    return resolve(node, variables, default_frame());
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,332 @@
+#include "numu/core/serialize.h"
+#include "numu/core/stream.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+namespace numu {
+namespace ast {
+
+namespace {
+constexpr char magic[8] = {'N', 'U', 'M', 'U', 'F', 'L', 'A', 'T'};
+constexpr uint32_t byte_order = 0x01020304;
+constexpr size_t alignment = 8;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t root;
+    uint32_t reserved;
+    uint64_t nodes;
+    uint64_t child_slots;
+    uint64_t constants;
+    uint64_t extents;
+    uint64_t names;
+    uint64_t name_bytes;
+    uint64_t entries;
+};
+static_assert(sizeof(Header) % alignment == 0, "sections after the header must stay aligned");
+
+size_t padded(size_t bytes) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+// Section sizes in bytes, in file order
+std::vector<size_t> sections(const Header& header) {
+    return {
+        header.nodes,                          // types
+        header.nodes,                          // ops
+        header.nodes * sizeof(uint32_t),       // payloads
+        header.nodes * sizeof(uint32_t),       // first
+        header.nodes * sizeof(uint32_t),       // counts
+        header.nodes * sizeof(NodeId),         // lows
+        header.child_slots * sizeof(NodeId),
+        header.constants * sizeof(double),
+        header.extents * sizeof(uint32_t),
+        (header.names + 1) * sizeof(uint32_t), // name offsets
+        header.name_bytes,
+        header.entries * 2 * sizeof(uint32_t),
+    };
+}
+
+[[noreturn]] void corrupt(const std::string& what) {
+    throw FormatError("Corrupt flat tree: " + what);
+}
+
+// Child count each node type must have; variadic ones are checked apart
+constexpr uint32_t any_count = UINT32_MAX;
+
+uint32_t expected_children(NodeType type) {
+    switch(type) {
+        case NodeType::NUMBER:
+        case NodeType::BOOLEAN:
+        case NodeType::STRING:
+        case NodeType::VARIABLE:
+            return 0;
+        case NodeType::UNARY_OP:
+        case NodeType::ASSIGNMENT:
+        case NodeType::RETURN:
+            return 1;
+        case NodeType::BINARY_OP:
+        case NodeType::WHILE:
+            return 2;
+        case NodeType::IF:
+            return 3;
+        case NodeType::FOR:
+            return 4;
+        default:
+            return any_count;
+    }
+}
+} // namespace
+
+// Reads and writes the arrays behind a FlatTree
+class FlatFile {
+public:
+    static std::string write(const FlatTree& tree) {
+        const FlatTree::Columns& c = tree.columns_;
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = flat_format_version;
+        header.byte_order = byte_order;
+        header.root = tree.root();
+        header.nodes = c.nodes;
+        header.child_slots = c.child_slots;
+        header.constants = c.constant_count;
+        header.extents = c.extent_count;
+        header.names = c.names;
+        header.name_bytes = c.name_bytes;
+        header.entries = c.entries;
+
+        // Sorted so that lookups in the loaded tree can bisect
+        std::vector<size_t> order(c.entries);
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&tree](size_t a, size_t b) {
+            return tree.entry_name(a) < tree.entry_name(b);
+        });
+        std::vector<uint32_t> entries;
+        entries.reserve(2 * c.entries);
+        for (size_t index : order) {
+            entries.push_back(c.entry_table[2 * index]);
+            entries.push_back(c.entry_table[2 * index + 1]);
+        }
+
+        std::vector<size_t> sizes = sections(header);
+        size_t total = sizeof(Header);
+        for (size_t bytes : sizes) {
+            total += padded(bytes);
+        }
+        std::string out(total, '\0');
+        std::memcpy(&out[0], &header, sizeof(Header));
+
+        const void* sources[] = {
+            c.types, c.ops, c.payloads, c.first, c.counts, c.lows, c.children,
+            c.constants, c.extents, c.name_offsets, c.name_chars, entries.data(),
+        };
+        size_t offset = sizeof(Header);
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            if (sizes[i]) {
+                std::memcpy(&out[offset], sources[i], sizes[i]);
+            }
+            offset += padded(sizes[i]);
+        }
+        return out;
+    }
+
+    static FlatTree read(std::shared_ptr<const void> owner, const void* data, size_t size) {
+        if (reinterpret_cast<uintptr_t>(data) % alignment != 0) {
+            throw FormatError("Flat tree buffer is not 8-byte aligned");
+        }
+        if (size < sizeof(Header)) {
+            corrupt("truncated header");
+        }
+        Header header;
+        std::memcpy(&header, data, sizeof(Header));
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+            throw FormatError("Not a flat tree");
+        }
+        if (header.byte_order != byte_order) {
+            throw FormatError("Flat tree was written with a different byte order");
+        }
+        if (header.version != flat_format_version) {
+            throw FormatError("Unsupported flat tree version " + std::to_string(header.version));
+        }
+        const uint64_t counts[] = {header.nodes, header.child_slots, header.constants, header.extents,
+                                   header.names, header.name_bytes, header.entries};
+        for (uint64_t count : counts) {
+            // Ids and offsets are 32-bit, which also rules out overflow below
+            if (count >= UINT32_MAX) {
+                corrupt("array too large");
+            }
+        }
+
+        std::vector<size_t> sizes = sections(header);
+        std::vector<const char*> starts;
+        const char* bytes = static_cast<const char*>(data);
+        size_t offset = sizeof(Header);
+        for (size_t section : sizes) {
+            starts.push_back(bytes + offset);
+            offset += padded(section);
+        }
+        if (offset != size) {
+            corrupt("size does not match header");
+        }
+
+        FlatTree tree;
+        FlatTree::Columns& c = tree.columns_;
+        c.types = reinterpret_cast<const uint8_t*>(starts[0]);
+        c.ops = reinterpret_cast<const uint8_t*>(starts[1]);
+        c.payloads = reinterpret_cast<const uint32_t*>(starts[2]);
+        c.first = reinterpret_cast<const uint32_t*>(starts[3]);
+        c.counts = reinterpret_cast<const uint32_t*>(starts[4]);
+        c.lows = reinterpret_cast<const NodeId*>(starts[5]);
+        c.children = reinterpret_cast<const NodeId*>(starts[6]);
+        c.constants = reinterpret_cast<const double*>(starts[7]);
+        c.extents = reinterpret_cast<const uint32_t*>(starts[8]);
+        c.name_offsets = reinterpret_cast<const uint32_t*>(starts[9]);
+        c.name_chars = starts[10];
+        c.entry_table = reinterpret_cast<const uint32_t*>(starts[11]);
+        c.nodes = header.nodes;
+        c.child_slots = header.child_slots;
+        c.constant_count = header.constants;
+        c.extent_count = header.extents;
+        c.names = header.names;
+        c.name_bytes = header.name_bytes;
+        c.entries = header.entries;
+        check(c, header.root);
+
+        c.sorted = true;
+        for (size_t i = 1; i < c.entries && c.sorted; ++i) {
+            c.sorted = tree.entry_name(i - 1) <= tree.entry_name(i);
+        }
+        tree.root_ = header.root;
+        tree.buffer_ = owner ? std::move(owner) : std::shared_ptr<const void>(data, [](const void*) {});
+        return tree;
+    }
+
+private:
+    static void check(const FlatTree::Columns& c, NodeId root) {
+        if (c.name_offsets[0] != 0 || c.name_offsets[c.names] != c.name_bytes) {
+            corrupt("name table");
+        }
+        for (size_t i = 0; i < c.names; ++i) {
+            if (c.name_offsets[i] > c.name_offsets[i + 1]) {
+                corrupt("name table");
+            }
+        }
+        for (size_t i = 0; i < c.entries; ++i) {
+            if (c.entry_table[2 * i] >= c.names || c.entry_table[2 * i + 1] >= c.nodes) {
+                corrupt("entry " + std::to_string(i));
+            }
+        }
+        if (root != no_node && root >= c.nodes) {
+            corrupt("root");
+        }
+
+        for (NodeId id = 0; id < c.nodes; ++id) {
+            auto fail = [id](const char* what) { corrupt(std::string(what) + " of node " + std::to_string(id)); };
+            if (c.types[id] > static_cast<uint8_t>(NodeType::RETURN)) {
+                fail("type");
+            }
+            auto type = static_cast<NodeType>(c.types[id]);
+            uint32_t count = c.counts[id];
+            if (c.first[id] > c.child_slots || count > c.child_slots - c.first[id]) {
+                fail("children");
+            }
+            const NodeId* children = c.children + c.first[id];
+            NodeId low = id;
+            for (uint32_t k = 0; k < count; ++k) {
+                if (children[k] == no_node) {
+                    continue;
+                }
+                if (children[k] >= id) {
+                    fail("child order");
+                }
+                low = std::min(low, c.lows[children[k]]);
+            }
+            if (c.lows[id] != low) {
+                fail("lowest id");
+            }
+            uint32_t expected = expected_children(type);
+            if (expected != any_count && count != expected) {
+                fail("child count");
+            }
+
+            uint32_t payload = c.payloads[id];
+            switch(type) {
+                case NodeType::NUMBER:
+                    if (payload >= c.constant_count) fail("constant");
+                    break;
+                case NodeType::BOOLEAN:
+                    if (payload > 1) fail("boolean");
+                    break;
+                case NodeType::STRING:
+                case NodeType::VARIABLE:
+                case NodeType::FUNCTION:
+                case NodeType::ASSIGNMENT:
+                    if (payload >= c.names) fail("name");
+                    break;
+                case NodeType::BINARY_OP:
+                    if (c.ops[id] > static_cast<uint8_t>(BinaryOp::OR)) fail("operator");
+                    if (children[0] == no_node || children[1] == no_node) fail("operand");
+                    break;
+                case NodeType::UNARY_OP:
+                    if (c.ops[id] > static_cast<uint8_t>(UnaryOp::INVERSE)) fail("operator");
+                    if (children[0] == no_node) fail("operand");
+                    break;
+                case NodeType::MATRIX:
+                case NodeType::TENSOR: {
+                    if (payload >= c.extent_count) fail("extents");
+                    uint32_t length = c.extents[payload];
+                    if (length > c.extent_count - payload - 1) fail("extents");
+                    // Rows must add up to the elements; dims are the parser's to check
+                    if (type == NodeType::MATRIX) {
+                        uint64_t elements = 0;
+                        for (uint32_t r = 0; r < length; ++r) {
+                            elements += c.extents[payload + 1 + r];
+                        }
+                        if (elements != count) fail("matrix shape");
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+};
+
+std::string serialize(const FlatTree& tree) {
+    return FlatFile::write(tree);
+}
+
+void save(const FlatTree& tree, const std::string& path) {
+    std::string bytes = FlatFile::write(tree);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+FlatTree view(const void* data, size_t size) {
+    return FlatFile::read(nullptr, data, size);
+}
+
+FlatTree view(std::shared_ptr<const void> owner, const void* data, size_t size) {
+    return FlatFile::read(std::move(owner), data, size);
+}
+
+FlatTree load(const std::string& path) {
+    auto file = std::make_shared<lex::MappedFile>(path);
+    std::string_view bytes = file->view();
+    return FlatFile::read(file, bytes.data(), bytes.size());
+}
+
+} // namespace ast
+} // namespace numu
@@ -0,0 +1,549 @@
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include "numu/core/stats.h"
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace numu {
+namespace ast {
+
+namespace {
+// Rules are applied at one node at most this often before moving on; the
+// rule set terminates well before this, it only guards against mistakes
+constexpr size_t max_local_rewrites = 64;
+constexpr size_t max_passes = 16;
+
+const double* number(Node* node) {
+    return node->type == NodeType::NUMBER ? &static_cast<NumberNode*>(node)->value : nullptr;
+}
+
+bool is(Node* node, double value) {
+    const double* c = number(node);
+    return c && *c == value;
+}
+
+BinaryOpNode* binary(Node* node, BinaryOp op) {
+    if (node->type != NodeType::BINARY_OP) return nullptr;
+    auto* bin = static_cast<BinaryOpNode*>(node);
+    return bin->op == op ? bin : nullptr;
+}
+
+UnaryOpNode* unary(Node* node, UnaryOp op) {
+    if (node->type != NodeType::UNARY_OP) return nullptr;
+    auto* un = static_cast<UnaryOpNode*>(node);
+    return un->op == op ? un : nullptr;
+}
+
+bool hashable(Node* node) {
+    switch(node->type) {
+        case NodeType::NUMBER:
+        case NodeType::BOOLEAN:
+        case NodeType::STRING:
+        case NodeType::VARIABLE:
+        case NodeType::BINARY_OP:
+        case NodeType::UNARY_OP:
+        case NodeType::FUNCTION:
+        case NodeType::MATRIX:
+        case NodeType::TENSOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Structural equality; the cached hashes reject most mismatches cheaply
+bool same(Node* a, Node* b) {
+    if (a == b) return true;
+    if (!hashable(a) || !hashable(b)) return false;
+    return hash(a) == hash(b) && equals(a, b);
+}
+
+// Unary operator behind a call of a standard function, if any
+bool standard_unary(Node* node, UnaryOp& op, Node*& operand) {
+    if (node->type == NodeType::UNARY_OP) {
+        auto* un = static_cast<UnaryOpNode*>(node);
+        op = un->op;
+        operand = un->operand;
+        return true;
+    }
+    if (node->type != NodeType::FUNCTION) return false;
+    auto* fn = static_cast<FunctionNode*>(node);
+    if (fn->args.size() != 1 || !core::unary_op(core::find_builtin(fn->name), op)) return false;
+    operand = fn->args[0];
+    return true;
+}
+
+// Folds only where evaluation could not fail, so errors such as a
+// division by zero still surface when the expression is evaluated
+bool fold_binary(BinaryOp op, double a, double b, double& out) {
+    if ((op == BinaryOp::DIV || op == BinaryOp::MOD) && b == 0.0) return false;
+    out = core::eval_binary_op(op, a, b);
+    return std::isfinite(out) || !std::isfinite(a) || !std::isfinite(b);
+}
+
+bool fold_unary(UnaryOp op, double a, double& out) {
+    switch(op) {
+        case UnaryOp::LOG: if (a <= 0.0) return false; break;
+        case UnaryOp::SQRT: if (a < 0.0) return false; break;
+        case UnaryOp::INVERSE: if (a == 0.0) return false; break;
+        case UnaryOp::ASIN:
+        case UnaryOp::ACOS:
+        case UnaryOp::ATAN:
+            return false;
+        default: break;
+    }
+    out = core::eval_unary_op(op, a);
+    return true;
+}
+
+// c*x as (c, x) and anything else as (1, x), for collecting like terms
+std::pair<double, Node*> term(Node* node) {
+    if (auto* mul = binary(node, BinaryOp::MUL)) {
+        if (const double* c = number(mul->left)) return {*c, mul->right};
+    }
+    return {1.0, node};
+}
+
+// x^c as (x, c) and anything else as (x, 1), for combining powers
+std::pair<Node*, double> power(Node* node) {
+    if (auto* pow = binary(node, BinaryOp::POW)) {
+        if (const double* c = number(pow->right)) return {pow->left, *c};
+    }
+    return {node, 1.0};
+}
+
+// Exponents can only be combined when they are integers: x^0.5*x^0.5 is
+// NaN for negative x, while x is not
+bool integer(double value) {
+    return std::isfinite(value) && std::trunc(value) == value;
+}
+
+bool exact_reciprocal(double value) {
+    int exponent;
+    return std::isfinite(value) && value != 0.0 && std::fabs(std::frexp(value, &exponent)) == 0.5;
+}
+
+class Simplifier {
+public:
+    size_t rewrites = 0;
+
+    Node* rewrite(Node* node) {
+        if (!node || normal_.count(node)) return node;
+        auto it = memo_.find(node);
+        if (it != memo_.end()) return it->second;
+
+        Node* current = rebuild(node);
+        for (size_t i = 0; i < max_local_rewrites; ++i) {
+            Node* next = rules(current);
+            if (!next) break;
+            ++rewrites;
+            // A rule may create nodes that are not yet simplified themselves
+            current = rebuild(next);
+        }
+        memo_[node] = current;
+        normal_.insert(current);
+        return current;
+    }
+
+private:
+    std::unordered_map<Node*, Node*> memo_;
+    std::unordered_set<Node*> normal_; // known to be fully simplified
+
+    Node* num(double value) { return NumberNode::create(value); }
+    Node* bin(BinaryOp op, Node* a, Node* b) { return BinaryOpNode::create(op, a, b); }
+    Node* neg(Node* a) { return UnaryOpNode::create(UnaryOp::NEGATE, a); }
+
+    // Simplifies the children, reusing the node when none of them change
+    Node* rebuild(Node* node) {
+        switch(node->type) {
+            case NodeType::BINARY_OP: {
+                auto* bin = static_cast<BinaryOpNode*>(node);
+                Node* left = rewrite(bin->left);
+                Node* right = rewrite(bin->right);
+                if (left == bin->left && right == bin->right) return node;
+                return BinaryOpNode::create(bin->op, left, right);
+            }
+            case NodeType::UNARY_OP: {
+                auto* un = static_cast<UnaryOpNode*>(node);
+                Node* operand = rewrite(un->operand);
+                if (operand == un->operand) return node;
+                return UnaryOpNode::create(un->op, operand);
+            }
+            case NodeType::FUNCTION: {
+                auto* fn = static_cast<FunctionNode*>(node);
+                std::vector<Node*> args;
+                if (!rewrite_all(fn->args, args)) return node;
+                return FunctionNode::create(fn->name, std::move(args));
+            }
+            case NodeType::MATRIX: {
+                auto* matrix = static_cast<MatrixNode*>(node);
+                std::vector<std::vector<Node*>> rows(matrix->elements.size());
+                bool changed = false;
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    changed |= rewrite_all(matrix->elements[i], rows[i]);
+                }
+                if (!changed) return node;
+                return MatrixNode::create(std::move(rows));
+            }
+            case NodeType::TENSOR: {
+                auto* tensor = static_cast<TensorNode*>(node);
+                std::vector<Node*> values;
+                if (!rewrite_all(tensor->values, values)) return node;
+                return TensorNode::create(tensor->dims, std::move(values));
+            }
+            case NodeType::ASSIGNMENT: {
+                auto* assign = static_cast<AssignmentNode*>(node);
+                Node* value = rewrite(assign->value);
+                if (value == assign->value) return node;
+                return AssignmentNode::create(assign->name, value);
+            }
+            case NodeType::BLOCK: {
+                auto* block = static_cast<BlockNode*>(node);
+                std::vector<Node*> statements;
+                if (!rewrite_all(block->statements, statements)) return node;
+                return BlockNode::create(std::move(statements));
+            }
+            case NodeType::IF: {
+                auto* stmt = static_cast<IfNode*>(node);
+                Node* condition = rewrite(stmt->condition);
+                Node* then_branch = rewrite(stmt->then_branch);
+                Node* else_branch = rewrite(stmt->else_branch);
+                if (condition == stmt->condition && then_branch == stmt->then_branch &&
+                    else_branch == stmt->else_branch) {
+                    return node;
+                }
+                return IfNode::create(condition, then_branch, else_branch);
+            }
+            case NodeType::WHILE: {
+                auto* stmt = static_cast<WhileNode*>(node);
+                Node* condition = rewrite(stmt->condition);
+                Node* body = rewrite(stmt->body);
+                if (condition == stmt->condition && body == stmt->body) return node;
+                return WhileNode::create(condition, body);
+            }
+            case NodeType::FOR: {
+                auto* stmt = static_cast<ForNode*>(node);
+                Node* initializer = rewrite(stmt->initializer);
+                Node* condition = rewrite(stmt->condition);
+                Node* increment = rewrite(stmt->increment);
+                Node* body = rewrite(stmt->body);
+                if (initializer == stmt->initializer && condition == stmt->condition &&
+                    increment == stmt->increment && body == stmt->body) {
+                    return node;
+                }
+                return ForNode::create(initializer, condition, increment, body);
+            }
+            case NodeType::RETURN: {
+                auto* stmt = static_cast<ReturnNode*>(node);
+                Node* value = rewrite(stmt->value);
+                if (value == stmt->value) return node;
+                return ReturnNode::create(value);
+            }
+            default:
+                return node;
+        }
+    }
+
+    bool rewrite_all(const std::vector<Node*>& in, std::vector<Node*>& out) {
+        bool changed = false;
+        out.reserve(in.size());
+        for (auto* node : in) {
+            out.push_back(rewrite(node));
+            changed |= out.back() != node;
+        }
+        return changed;
+    }
+
+    // One rewrite at the root of `node`, or nullptr if no rule applies
+    Node* rules(Node* node) {
+        switch(node->type) {
+            case NodeType::BINARY_OP: return binary_rules(static_cast<BinaryOpNode*>(node));
+            case NodeType::UNARY_OP: return unary_rules(static_cast<UnaryOpNode*>(node));
+            case NodeType::FUNCTION: return function_rules(static_cast<FunctionNode*>(node));
+            default: return nullptr;
+        }
+    }
+
+    Node* binary_rules(BinaryOpNode* node) {
+        Node* l = node->left;
+        Node* r = node->right;
+        const double* lc = number(l);
+        const double* rc = number(r);
+        double folded;
+        if (lc && rc && fold_binary(node->op, *lc, *rc, folded)) return num(folded);
+        // The scalar identities do not hold for matrices: A*A is not A^2
+        // and A-A is not the number 0
+        if (node->matrix_valued) return nullptr;
+
+        switch(node->op) {
+            case BinaryOp::ADD: return add_rules(l, r, lc, rc);
+            case BinaryOp::SUB: return sub_rules(l, r, rc);
+            case BinaryOp::MUL: return mul_rules(l, r, lc, rc);
+            case BinaryOp::DIV: return div_rules(l, r, rc);
+            case BinaryOp::POW: return pow_rules(l, r, rc);
+            default: return nullptr;
+        }
+    }
+
+    // Sums keep their constant as the rightmost operand: x + c
+    Node* add_rules(Node* l, Node* r, const double* lc, const double* rc) {
+        if (is(r, 0.0)) return l;
+        if (is(l, 0.0)) return r;
+        if (lc && !rc) return bin(BinaryOp::ADD, r, l);
+        if (auto* n = unary(r, UnaryOp::NEGATE)) return bin(BinaryOp::SUB, l, n->operand);
+
+        auto* inner = binary(l, BinaryOp::ADD);
+        if (inner && number(inner->right)) {
+            // (x + c1) + c2 -> x + (c1 + c2), (x + c) + y -> (x + y) + c
+            if (rc) return bin(BinaryOp::ADD, inner->left, num(*number(inner->right) + *rc));
+            return bin(BinaryOp::ADD, bin(BinaryOp::ADD, inner->left, r), inner->right);
+        }
+        inner = binary(r, BinaryOp::ADD);
+        if (inner && number(inner->right)) {
+            return bin(BinaryOp::ADD, bin(BinaryOp::ADD, l, inner->left), inner->right);
+        }
+
+        auto [lk, lx] = term(l);
+        auto [rk, rx] = term(r);
+        if (!number(lx) && same(lx, rx)) return bin(BinaryOp::MUL, num(lk + rk), lx);
+        return nullptr;
+    }
+
+    Node* sub_rules(Node* l, Node* r, const double* rc) {
+        if (is(r, 0.0)) return l;
+        if (is(l, 0.0)) return neg(r);
+        if (same(l, r)) return num(0.0);
+        if (rc) return bin(BinaryOp::ADD, l, num(-*rc));
+        if (auto* n = unary(r, UnaryOp::NEGATE)) return bin(BinaryOp::ADD, l, n->operand);
+
+        auto* inner = binary(l, BinaryOp::ADD);
+        if (inner && number(inner->right)) {
+            return bin(BinaryOp::ADD, bin(BinaryOp::SUB, inner->left, r), inner->right);
+        }
+
+        auto [lk, lx] = term(l);
+        auto [rk, rx] = term(r);
+        if (!number(lx) && same(lx, rx)) return bin(BinaryOp::MUL, num(lk - rk), lx);
+        return nullptr;
+    }
+
+    // Products keep their constant as the leftmost operand: c * x
+    Node* mul_rules(Node* l, Node* r, const double* lc, const double* rc) {
+        if (is(l, 0.0) || is(r, 0.0)) return num(0.0);
+        if (is(l, 1.0)) return r;
+        if (is(r, 1.0)) return l;
+        if (is(l, -1.0)) return neg(r);
+        if (is(r, -1.0)) return neg(l);
+        if (rc && !lc) return bin(BinaryOp::MUL, r, l);
+
+        auto* inner = binary(r, BinaryOp::MUL);
+        if (inner && number(inner->left)) {
+            // c1 * (c2 * x) -> (c1 * c2) * x, x * (c * y) -> c * (x * y)
+            if (lc) return bin(BinaryOp::MUL, num(*lc * *number(inner->left)), inner->right);
+            return bin(BinaryOp::MUL, inner->left, bin(BinaryOp::MUL, l, inner->right));
+        }
+        inner = binary(l, BinaryOp::MUL);
+        if (!lc && inner && number(inner->left)) {
+            return bin(BinaryOp::MUL, inner->left, bin(BinaryOp::MUL, inner->right, r));
+        }
+
+        auto* ln = unary(l, UnaryOp::NEGATE);
+        auto* rn = unary(r, UnaryOp::NEGATE);
+        if (ln && rn) return bin(BinaryOp::MUL, ln->operand, rn->operand);
+        if (lc && rn) return bin(BinaryOp::MUL, num(-*lc), rn->operand);
+        if (ln) return neg(bin(BinaryOp::MUL, ln->operand, r));
+        if (rn) return neg(bin(BinaryOp::MUL, l, rn->operand));
+
+        if (!lc) {
+            auto [lx, le] = power(l);
+            auto [rx, re] = power(r);
+            if (same(lx, rx) && integer(le) && integer(re)) {
+                return bin(BinaryOp::POW, lx, num(le + re));
+            }
+        }
+        return nullptr;
+    }
+
+    Node* div_rules(Node* l, Node* r, const double* rc) {
+        // x / 0 is left alone so that it still fails when evaluated
+        if (is(r, 0.0)) return nullptr;
+        if (is(r, 1.0)) return l;
+        if (is(r, -1.0)) return neg(l);
+        if (same(l, r)) return num(1.0);
+        // Multiplying is cheaper and, for powers of two, exact
+        if (rc && exact_reciprocal(*rc)) return bin(BinaryOp::MUL, num(1.0 / *rc), l);
+        if (auto* n = unary(l, UnaryOp::NEGATE)) return neg(bin(BinaryOp::DIV, n->operand, r));
+        // 0/x and x^a/x^b are kept: either fails where the divisor is 0,
+        // which 0 and x^(a-b) would not
+        return nullptr;
+    }
+
+    Node* pow_rules(Node* l, Node* r, const double* rc) {
+        if (is(r, 0.0)) return num(1.0);
+        if (is(r, 1.0)) return l;
+        if (is(l, 1.0)) return num(1.0);
+        // (x^a)^n -> x^(a*n) holds for integer a and n only: (x^0.5)^2 is
+        // NaN for negative x
+        auto* inner = binary(l, BinaryOp::POW);
+        if (rc && inner && number(inner->right) && integer(*number(inner->right)) &&
+            integer(*rc)) {
+            return bin(BinaryOp::POW, inner->left, num(*number(inner->right) * *rc));
+        }
+        return nullptr;
+    }
+
+    Node* unary_rules(UnaryOpNode* node) {
+        Node* operand = node->operand;
+        double folded;
+        if (const double* c = number(operand)) {
+            if (fold_unary(node->op, *c, folded)) return num(folded);
+        }
+        switch(node->op) {
+            case UnaryOp::NEGATE: {
+                if (auto* inner = unary(operand, UnaryOp::NEGATE)) return inner->operand;
+                if (auto* sub = binary(operand, BinaryOp::SUB)) {
+                    return bin(BinaryOp::SUB, sub->right, sub->left);
+                }
+                auto* mul = binary(operand, BinaryOp::MUL);
+                if (mul && number(mul->left)) {
+                    return bin(BinaryOp::MUL, num(-*number(mul->left)), mul->right);
+                }
+                return nullptr;
+            }
+            case UnaryOp::LOG:
+                return log_of_exp(operand);
+            default:
+                return nullptr;
+        }
+    }
+
+    // Calls of the standard functions are folded as the builtins would
+    // evaluate them
+    Node* function_rules(FunctionNode* node) {
+        UnaryOp op;
+        Node* operand;
+        double folded;
+        if (standard_unary(node, op, operand)) {
+            if (const double* c = number(operand)) {
+                if (fold_unary(op, *c, folded)) return num(folded);
+            }
+            return op == UnaryOp::LOG ? log_of_exp(operand) : nullptr;
+        }
+        const core::Callable* callable = core::find_builtin(node->name);
+        core::Builtin builtin = callable ? callable->builtin : core::Builtin::NONE;
+        if (node->args.size() == 2 && builtin == core::Builtin::POW) {
+            return bin(BinaryOp::POW, node->args[0], node->args[1]);
+        }
+        if (node->args.size() == 1 && builtin == core::Builtin::ABS) {
+            if (const double* c = number(node->args[0])) return num(std::fabs(*c));
+        }
+        return nullptr;
+    }
+
+    Node* log_of_exp(Node* operand) {
+        UnaryOp op;
+        Node* inner;
+        if (standard_unary(operand, op, inner) && op == UnaryOp::EXP) return inner;
+        return nullptr;
+    }
+};
+
+template<typename F>
+void for_each_child(Node* node, F&& visit) {
+    switch(node->type) {
+        case NodeType::BINARY_OP: {
+            auto* bin = static_cast<BinaryOpNode*>(node);
+            visit(bin->left);
+            visit(bin->right);
+            break;
+        }
+        case NodeType::UNARY_OP: visit(static_cast<UnaryOpNode*>(node)->operand); break;
+        case NodeType::FUNCTION:
+            for (auto* arg : static_cast<FunctionNode*>(node)->args) visit(arg);
+            break;
+        case NodeType::MATRIX:
+            for (auto& row : static_cast<MatrixNode*>(node)->elements) {
+                for (auto* element : row) visit(element);
+            }
+            break;
+        case NodeType::TENSOR:
+            for (auto* value : static_cast<TensorNode*>(node)->values) visit(value);
+            break;
+        case NodeType::ASSIGNMENT: visit(static_cast<AssignmentNode*>(node)->value); break;
+        case NodeType::BLOCK:
+            for (auto* stmt : static_cast<BlockNode*>(node)->statements) visit(stmt);
+            break;
+        case NodeType::IF: {
+            auto* stmt = static_cast<IfNode*>(node);
+            visit(stmt->condition);
+            visit(stmt->then_branch);
+            visit(stmt->else_branch);
+            break;
+        }
+        case NodeType::WHILE: {
+            auto* stmt = static_cast<WhileNode*>(node);
+            visit(stmt->condition);
+            visit(stmt->body);
+            break;
+        }
+        case NodeType::FOR: {
+            auto* stmt = static_cast<ForNode*>(node);
+            visit(stmt->initializer);
+            visit(stmt->condition);
+            visit(stmt->increment);
+            visit(stmt->body);
+            break;
+        }
+        case NodeType::RETURN: visit(static_cast<ReturnNode*>(node)->value); break;
+        default: break;
+    }
+}
+
+// Distinct nodes, so shared subtrees count once
+size_t count_nodes(Node* root) {
+    std::unordered_set<Node*> seen;
+    std::vector<Node*> stack{root};
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        if (!node || !seen.insert(node).second) continue;
+        for_each_child(node, [&stack](Node* child) { stack.push_back(child); });
+    }
+    return seen.size();
+}
+} // namespace
+
+size_t SimplifyStats::removed() const {
+    return nodes_before > nodes_after ? nodes_before - nodes_after : 0;
+}
+
+Node* simplify(Node* node, SimplifyStats* stats) {
+    if (!node) return nullptr;
+    NUMU_STATS_STAGE(SIMPLIFY);
+    if (stats) {
+        *stats = SimplifyStats{};
+        stats->nodes_before = count_nodes(node);
+    }
+
+    // Each pass starts from scratch, so a pass that rewrites nothing
+    // confirms the fixpoint
+    Node* current = node;
+    for (size_t pass = 0; pass < max_passes; ++pass) {
+        Simplifier simplifier;
+        current = simplifier.rewrite(current);
+        if (stats) {
+            ++stats->passes;
+            stats->rewrites += simplifier.rewrites;
+        }
+        if (simplifier.rewrites == 0) break;
+    }
+
+    if (stats) {
+        stats->nodes_after = count_nodes(current);
+    }
+    return current;
+}
+
+} // namespace ast
+} // namespace numu
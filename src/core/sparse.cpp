@@ -0,0 +1,526 @@
+#include "numu/core/sparse.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace numu {
+namespace core {
+
+namespace {
+double dot(const double* a, const double* b, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void require_index_range(size_t rows, size_t cols) {
+    if (rows > std::numeric_limits<uint32_t>::max() || cols > std::numeric_limits<uint32_t>::max()) {
+        throw EvaluationError("Sparse matrix dimensions exceed 2^32");
+    }
+}
+} // namespace
+
+SparseMatrix::SparseMatrix(size_t rows, size_t cols, std::vector<Entry> entries, Format format)
+    : rows_(rows), cols_(cols), format_(format) {
+    require_index_range(rows, cols);
+    bool csr = format == Format::CSR;
+    for (const auto& entry : entries) {
+        if (entry.row >= rows || entry.col >= cols) {
+            throw EvaluationError("Sparse entry (" + std::to_string(entry.row) + ", " +
+                                  std::to_string(entry.col) + ") outside " + std::to_string(rows) +
+                                  "x" + std::to_string(cols) + " matrix");
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [csr](const Entry& a, const Entry& b) {
+        return csr ? (a.row != b.row ? a.row < b.row : a.col < b.col)
+                   : (a.col != b.col ? a.col < b.col : a.row < b.row);
+    });
+
+    offsets_.assign(outer() + 1, 0);
+    indices_.reserve(entries.size());
+    values_.reserve(entries.size());
+    for (size_t i = 0; i < entries.size();) {
+        size_t outer_index = csr ? entries[i].row : entries[i].col;
+        size_t inner_index = csr ? entries[i].col : entries[i].row;
+        double value = 0.0;
+        for (; i < entries.size() && entries[i].row == (csr ? outer_index : inner_index) &&
+               entries[i].col == (csr ? inner_index : outer_index);
+             ++i) {
+            value += entries[i].value;
+        }
+        if (value != 0.0) {
+            indices_.push_back(static_cast<uint32_t>(inner_index));
+            values_.push_back(value);
+            ++offsets_[outer_index + 1];
+        }
+    }
+    for (size_t k = 0; k < outer(); ++k) {
+        offsets_[k + 1] += offsets_[k];
+    }
+}
+
+SparseMatrix SparseMatrix::from_dense(const Matrix& m, Format format) {
+    std::vector<Entry> entries;
+    for (size_t i = 0; i < m.rows(); ++i) {
+        for (size_t j = 0; j < m.cols(); ++j) {
+            if (m(i, j) != 0.0) {
+                entries.push_back(Entry{i, j, m(i, j)});
+            }
+        }
+    }
+    return SparseMatrix(m.rows(), m.cols(), std::move(entries), format);
+}
+
+SparseMatrix SparseMatrix::identity(size_t n) {
+    std::vector<Entry> entries;
+    entries.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        entries.push_back(Entry{i, i, 1.0});
+    }
+    return SparseMatrix(n, n, std::move(entries));
+}
+
+double SparseMatrix::fill() const {
+    size_t total = rows_ * cols_;
+    return total ? static_cast<double>(nonzeros()) / static_cast<double>(total) : 0.0;
+}
+
+double SparseMatrix::at(size_t row, size_t col) const {
+    if (row >= rows_ || col >= cols_) {
+        throw EvaluationError("Sparse matrix index out of range");
+    }
+    size_t k = format_ == Format::CSR ? row : col;
+    auto inner = static_cast<uint32_t>(format_ == Format::CSR ? col : row);
+    auto begin = indices_.begin() + offsets_[k];
+    auto end = indices_.begin() + offsets_[k + 1];
+    auto it = std::lower_bound(begin, end, inner);
+    return it != end && *it == inner ? values_[it - indices_.begin()] : 0.0;
+}
+
+Matrix SparseMatrix::to_dense() const {
+    Matrix out(rows_, cols_);
+    for (size_t k = 0; k < outer(); ++k) {
+        for (size_t p = offsets_[k]; p < offsets_[k + 1]; ++p) {
+            if (format_ == Format::CSR) {
+                out(k, indices_[p]) = values_[p];
+            } else {
+                out(indices_[p], k) = values_[p];
+            }
+        }
+    }
+    return out;
+}
+
+// Counting-sort transpose of the compressed arrays: entries come out
+// ordered by their new inner index because the old outer loop is ordered
+SparseMatrix SparseMatrix::convert(Format format) const {
+    if (format == format_) {
+        return *this;
+    }
+    SparseMatrix out;
+    out.rows_ = rows_;
+    out.cols_ = cols_;
+    out.format_ = format;
+    size_t new_outer = out.outer();
+    out.offsets_.assign(new_outer + 1, 0);
+    out.indices_.resize(nonzeros());
+    out.values_.resize(nonzeros());
+
+    for (uint32_t index : indices_) {
+        ++out.offsets_[index + 1];
+    }
+    for (size_t k = 0; k < new_outer; ++k) {
+        out.offsets_[k + 1] += out.offsets_[k];
+    }
+    std::vector<size_t> next(out.offsets_.begin(), out.offsets_.end() - 1);
+    for (size_t k = 0; k < outer(); ++k) {
+        for (size_t p = offsets_[k]; p < offsets_[k + 1]; ++p) {
+            size_t q = next[indices_[p]]++;
+            out.indices_[q] = static_cast<uint32_t>(k);
+            out.values_[q] = values_[p];
+        }
+    }
+    return out;
+}
+
+SparseMatrix SparseMatrix::transpose() const {
+    SparseMatrix out(*this);
+    std::swap(out.rows_, out.cols_);
+    out.format_ = format_ == Format::CSR ? Format::CSC : Format::CSR;
+    return out;
+}
+
+void multiply(const SparseMatrix& a, const double* x, double* y) {
+    const auto& offsets = a.offsets();
+    const uint32_t* indices = a.indices().data();
+    const double* values = a.values().data();
+
+    if (a.format() == SparseMatrix::Format::CSR) {
+        for (size_t i = 0; i < a.rows(); ++i) {
+            double sum = 0.0;
+            for (size_t p = offsets[i]; p < offsets[i + 1]; ++p) {
+                sum += values[p] * x[indices[p]];
+            }
+            y[i] = sum;
+        }
+    } else {
+        std::fill(y, y + a.rows(), 0.0);
+        for (size_t j = 0; j < a.cols(); ++j) {
+            double xj = x[j];
+            for (size_t p = offsets[j]; p < offsets[j + 1]; ++p) {
+                y[indices[p]] += values[p] * xj;
+            }
+        }
+    }
+}
+
+std::vector<double> multiply(const SparseMatrix& a, const std::vector<double>& x) {
+    if (x.size() != a.cols()) {
+        throw EvaluationError("Sparse product needs a vector of length " + std::to_string(a.cols()) +
+                              ", got " + std::to_string(x.size()));
+    }
+    std::vector<double> y(a.rows());
+    multiply(a, x.data(), y.data());
+    return y;
+}
+
+// Each non-zero a(i, k) adds a scaled row k of b to row i of the result,
+// so the inner loop is a dense, vectorizable axpy in either format
+Matrix multiply(const SparseMatrix& a, const Matrix& b) {
+    if (a.cols() != b.rows()) {
+        throw EvaluationError("Matrix product needs " + std::to_string(a.cols()) +
+                              " rows on the right, got " + std::to_string(b.rows()));
+    }
+    Matrix c(a.rows(), b.cols());
+    const auto& offsets = a.offsets();
+    const auto& indices = a.indices();
+    const auto& values = a.values();
+    bool csr = a.format() == SparseMatrix::Format::CSR;
+    size_t outer = csr ? a.rows() : a.cols();
+    size_t m = b.cols();
+
+    for (size_t k = 0; k < outer; ++k) {
+        for (size_t p = offsets[k]; p < offsets[k + 1]; ++p) {
+            double v = values[p];
+            double* __restrict target = c.row(csr ? k : indices[p]);
+            const double* __restrict source = b.row(csr ? indices[p] : k);
+            for (size_t j = 0; j < m; ++j) {
+                target[j] += v * source[j];
+            }
+        }
+    }
+    return c;
+}
+
+Matrix multiply(const Matrix& a, const SparseMatrix& b) {
+    if (a.cols() != b.rows()) {
+        throw EvaluationError("Matrix product needs " + std::to_string(a.cols()) +
+                              " rows on the right, got " + std::to_string(b.rows()));
+    }
+    // c^T = b^T a^T, and b^T in the opposite format shares b's storage
+    return transpose(multiply(b.transpose(), transpose(a)));
+}
+
+// Gustavson's row-wise product: row i of c gathers the rows of b picked
+// out by row i of a into a dense accumulator, and the touched columns are
+// sorted once per row rather than the products per entry
+SparseMatrix multiply(const SparseMatrix& a, const SparseMatrix& b) {
+    if (a.cols() != b.rows()) {
+        throw EvaluationError("Matrix product needs " + std::to_string(a.cols()) +
+                              " rows on the right, got " + std::to_string(b.rows()));
+    }
+    SparseMatrix left = a.convert(SparseMatrix::Format::CSR);
+    SparseMatrix right = b.convert(SparseMatrix::Format::CSR);
+
+    SparseMatrix c;
+    c.rows_ = a.rows();
+    c.cols_ = b.cols();
+    c.offsets_.assign(c.rows_ + 1, 0);
+    std::vector<double> accumulator(c.cols_, 0.0);
+    std::vector<bool> touched(c.cols_, false);
+    std::vector<uint32_t> columns;
+
+    for (size_t i = 0; i < c.rows_; ++i) {
+        columns.clear();
+        for (size_t p = left.offsets_[i]; p < left.offsets_[i + 1]; ++p) {
+            double v = left.values_[p];
+            size_t k = left.indices_[p];
+            for (size_t q = right.offsets_[k]; q < right.offsets_[k + 1]; ++q) {
+                uint32_t j = right.indices_[q];
+                if (!touched[j]) {
+                    touched[j] = true;
+                    columns.push_back(j);
+                }
+                accumulator[j] += v * right.values_[q];
+            }
+        }
+        std::sort(columns.begin(), columns.end());
+        for (uint32_t j : columns) {
+            if (accumulator[j] != 0.0) {
+                c.indices_.push_back(j);
+                c.values_.push_back(accumulator[j]);
+            }
+            accumulator[j] = 0.0;
+            touched[j] = false;
+        }
+        c.offsets_[i + 1] = c.indices_.size();
+    }
+    return c;
+}
+
+// Merges each pair of rows; both are sorted by column
+SparseMatrix add(const SparseMatrix& a, const SparseMatrix& b, double scale) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+        throw EvaluationError(std::string("Matrix ") + (scale < 0.0 ? "subtraction" : "addition") +
+                              " needs equal shapes, got " + std::to_string(a.rows()) + "x" +
+                              std::to_string(a.cols()) + " and " + std::to_string(b.rows()) + "x" +
+                              std::to_string(b.cols()));
+    }
+    SparseMatrix left = a.convert(SparseMatrix::Format::CSR);
+    SparseMatrix right = b.convert(SparseMatrix::Format::CSR);
+
+    SparseMatrix c;
+    c.rows_ = a.rows();
+    c.cols_ = a.cols();
+    c.offsets_.assign(c.rows_ + 1, 0);
+    c.indices_.reserve(left.nonzeros() + right.nonzeros());
+    c.values_.reserve(left.nonzeros() + right.nonzeros());
+    auto emit = [&c](uint32_t j, double value) {
+        if (value != 0.0) {
+            c.indices_.push_back(j);
+            c.values_.push_back(value);
+        }
+    };
+
+    for (size_t i = 0; i < c.rows_; ++i) {
+        size_t p = left.offsets_[i];
+        size_t q = right.offsets_[i];
+        size_t p_end = left.offsets_[i + 1];
+        size_t q_end = right.offsets_[i + 1];
+        while (p < p_end || q < q_end) {
+            if (q == q_end || (p < p_end && left.indices_[p] < right.indices_[q])) {
+                emit(left.indices_[p], left.values_[p]);
+                ++p;
+            } else if (p == p_end || right.indices_[q] < left.indices_[p]) {
+                emit(right.indices_[q], scale * right.values_[q]);
+                ++q;
+            } else {
+                emit(left.indices_[p], left.values_[p] + scale * right.values_[q]);
+                ++p;
+                ++q;
+            }
+        }
+        c.offsets_[i + 1] = c.indices_.size();
+    }
+    return c;
+}
+
+SparseMatrix operator*(const SparseMatrix& a, double scale) {
+    if (scale == 0.0) {
+        return SparseMatrix(a.rows(), a.cols(), {}, a.format());
+    }
+    SparseMatrix out(a);
+    for (double& value : out.values_) {
+        value *= scale;
+    }
+    return out;
+}
+
+SolverOptions SolverOptions::from(const config::Config& config) {
+    SolverOptions options;
+    options.tolerance = config.get_number("linear.solver.tolerance", options.tolerance);
+    options.max_iterations = static_cast<size_t>(
+        config.get_number("linear.solver.max_iterations", static_cast<double>(options.max_iterations)));
+    return options;
+}
+
+SolveResult conjugate_gradient(const SparseMatrix& a, const std::vector<double>& b,
+                               const SolverOptions& options) {
+    size_t n = a.rows();
+    if (a.cols() != n) {
+        throw EvaluationError("Conjugate gradient needs a square matrix, got " +
+                              std::to_string(a.rows()) + "x" + std::to_string(a.cols()));
+    }
+    if (b.size() != n) {
+        throw EvaluationError("Right-hand side has length " + std::to_string(b.size()) +
+                              ", expected " + std::to_string(n));
+    }
+
+    std::vector<double> inverse_diagonal(n);
+    for (size_t i = 0; i < n; ++i) {
+        double d = a.at(i, i);
+        if (!(d > 0.0)) {
+            throw EvaluationError("Conjugate gradient needs a symmetric positive definite matrix");
+        }
+        inverse_diagonal[i] = 1.0 / d;
+    }
+
+    SolveResult result;
+    result.x.assign(n, 0.0);
+    double b_norm = std::sqrt(dot(b.data(), b.data(), n));
+    if (b_norm == 0.0) {
+        result.converged = true;
+        return result;
+    }
+
+    // x starts at zero, so the first residual is b itself
+    std::vector<double> r(b);
+    std::vector<double> z(n);
+    std::vector<double> p(n);
+    std::vector<double> q(n);
+    for (size_t i = 0; i < n; ++i) {
+        z[i] = inverse_diagonal[i] * r[i];
+    }
+    p = z;
+    double rz = dot(r.data(), z.data(), n);
+    size_t limit = options.max_iterations ? options.max_iterations : n;
+
+    result.residual = 1.0;
+    while (result.iterations < limit) {
+        multiply(a, p.data(), q.data());
+        double pq = dot(p.data(), q.data(), n);
+        if (!(pq > 0.0)) {
+            throw EvaluationError("Conjugate gradient needs a symmetric positive definite matrix");
+        }
+        double alpha = rz / pq;
+        for (size_t i = 0; i < n; ++i) {
+            result.x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        ++result.iterations;
+
+        result.residual = std::sqrt(dot(r.data(), r.data(), n)) / b_norm;
+        if (result.residual <= options.tolerance) {
+            result.converged = true;
+            break;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            z[i] = inverse_diagonal[i] * r[i];
+        }
+        double rz_next = dot(r.data(), z.data(), n);
+        double beta = rz_next / rz;
+        rz = rz_next;
+        for (size_t i = 0; i < n; ++i) {
+            p[i] = z[i] + beta * p[i];
+        }
+    }
+    return result;
+}
+
+MatrixValue MatrixValue::make(Matrix dense) {
+    if (dense.size() < sparse_min_size) {
+        return MatrixValue(std::move(dense));
+    }
+    size_t nonzeros = 0;
+    for (size_t i = 0; i < dense.size(); ++i) {
+        nonzeros += dense.data()[i] != 0.0;
+    }
+    if (dense.size() && static_cast<double>(nonzeros) < sparse_fill * static_cast<double>(dense.size())) {
+        return MatrixValue(SparseMatrix::from_dense(dense));
+    }
+    return MatrixValue(std::move(dense));
+}
+
+// Decides from the entry count before building either layout, so a large
+// sparse system never materializes densely
+MatrixValue MatrixValue::make(size_t rows, size_t cols, std::vector<SparseMatrix::Entry> entries) {
+    double total = static_cast<double>(rows) * static_cast<double>(cols);
+    if (total < static_cast<double>(sparse_min_size)) {
+        return MatrixValue(SparseMatrix(rows, cols, std::move(entries)).to_dense());
+    }
+    if (static_cast<double>(entries.size()) < sparse_fill * total) {
+        return MatrixValue(SparseMatrix(rows, cols, std::move(entries)));
+    }
+    SparseMatrix sparse(rows, cols, std::move(entries));
+    if (static_cast<double>(sparse.nonzeros()) < sparse_fill * total) {
+        return MatrixValue(std::move(sparse));
+    }
+    return MatrixValue(sparse.to_dense());
+}
+
+MatrixValue MatrixValue::make(SparseMatrix sparse) {
+    size_t size = sparse.rows() * sparse.cols();
+    if (size < sparse_min_size || sparse.fill() >= sparse_fill) {
+        return MatrixValue(sparse.to_dense());
+    }
+    return MatrixValue(std::move(sparse));
+}
+
+size_t MatrixValue::rows() const {
+    return sparse() ? as_sparse()->rows() : as_dense()->rows();
+}
+
+size_t MatrixValue::cols() const {
+    return sparse() ? as_sparse()->cols() : as_dense()->cols();
+}
+
+Matrix MatrixValue::to_dense() const {
+    return sparse() ? as_sparse()->to_dense() : *as_dense();
+}
+
+std::vector<double> MatrixValue::multiply(const std::vector<double>& x) const {
+    if (sparse()) {
+        return core::multiply(*as_sparse(), x);
+    }
+    const Matrix& dense = *as_dense();
+    if (x.size() != dense.cols()) {
+        throw EvaluationError("Matrix product needs a vector of length " + std::to_string(dense.cols()) +
+                              ", got " + std::to_string(x.size()));
+    }
+    std::vector<double> y(dense.rows());
+    for (size_t i = 0; i < dense.rows(); ++i) {
+        y[i] = dot(dense.row(i), x.data(), dense.cols());
+    }
+    return y;
+}
+
+double MatrixValue::scalar() const {
+    return sparse() ? as_sparse()->at(0, 0) : (*as_dense())(0, 0);
+}
+
+MatrixValue MatrixValue::multiply(const MatrixValue& other) const {
+    if (sparse() && other.sparse()) {
+        return make(core::multiply(*as_sparse(), *other.as_sparse()));
+    }
+    if (sparse()) {
+        return make(core::multiply(*as_sparse(), *other.as_dense()));
+    }
+    if (other.sparse()) {
+        return make(core::multiply(*as_dense(), *other.as_sparse()));
+    }
+    return make(core::multiply(*as_dense(), *other.as_dense()));
+}
+
+MatrixValue MatrixValue::add(const MatrixValue& other, double scale) const {
+    if (sparse() && other.sparse()) {
+        return make(core::add(*as_sparse(), *other.as_sparse(), scale));
+    }
+    if (scale == 1.0) {
+        return make(to_dense() + other.to_dense());
+    }
+    if (scale == -1.0) {
+        return make(to_dense() - other.to_dense());
+    }
+    return make(to_dense() + other.to_dense() * scale);
+}
+
+MatrixValue MatrixValue::scale(double factor) const {
+    // The implicit zeros would stay 0 rather than become NaN
+    if (sparse() && std::isfinite(factor)) {
+        return MatrixValue(*as_sparse() * factor);
+    }
+    return make(sparse() ? to_dense() * factor : *as_dense() * factor);
+}
+
+MatrixValue MatrixValue::transpose() const {
+    if (sparse()) {
+        return MatrixValue(as_sparse()->transpose());
+    }
+    return MatrixValue(core::transpose(*as_dense()));
+}
+
+} // namespace core
+} // namespace numu
@@ -0,0 +1,223 @@
+#include "numu/core/stats.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace numu {
+namespace stats {
+
+namespace detail {
+std::atomic<bool> active{false};
+}
+
+namespace {
+// Written only by the owning thread, read by snapshot() from any thread
+struct Cell {
+    std::atomic<uint64_t> value{0};
+
+    void add(uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    void clear() { value.store(0, std::memory_order_relaxed); }
+};
+
+struct FunctionCells {
+    Cell calls;
+    Cell nanoseconds;
+    std::array<Cell, histogram_buckets> histogram;
+};
+
+struct ThreadStats {
+    std::array<Cell, stage_count> stage_calls;
+    std::array<Cell, stage_count> stage_nanoseconds;
+    std::array<Cell, counter_count> counters;
+    std::array<uint32_t, stage_count> depth{};
+
+    // The owner inserts with the lock held and looks up without it; other
+    // threads only read, with the lock held
+    std::mutex functions_mutex;
+    std::unordered_map<std::string, FunctionCells> functions;
+
+    ThreadStats();
+    ~ThreadStats();
+
+    void add_to(Snapshot& totals);
+    void clear();
+};
+
+struct Global {
+    std::mutex mutex;
+    std::vector<ThreadStats*> threads;
+    Snapshot retired; // totals of threads that have exited
+};
+
+Global& global() {
+    static Global instance;
+    return instance;
+}
+
+ThreadStats& local() {
+    thread_local ThreadStats stats;
+    return stats;
+}
+
+ThreadStats::ThreadStats() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.threads.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    add_to(g.retired);
+    for (auto it = g.threads.begin(); it != g.threads.end(); ++it) {
+        if (*it == this) {
+            g.threads.erase(it);
+            break;
+        }
+    }
+}
+
+void ThreadStats::add_to(Snapshot& totals) {
+    for (size_t s = 0; s < stage_count; ++s) {
+        totals.stages[s].calls += stage_calls[s].get();
+        totals.stages[s].nanoseconds += stage_nanoseconds[s].get();
+    }
+    for (size_t c = 0; c < counter_count; ++c) {
+        totals.counters[c] += counters[c].get();
+    }
+    std::lock_guard<std::mutex> lock(functions_mutex);
+    for (const auto& [name, cells] : functions) {
+        if (!cells.calls.get()) {
+            continue;
+        }
+        FunctionStats& out = totals.functions[name];
+        out.calls += cells.calls.get();
+        out.nanoseconds += cells.nanoseconds.get();
+        for (size_t b = 0; b < histogram_buckets; ++b) {
+            out.histogram[b] += cells.histogram[b].get();
+        }
+    }
+}
+
+void ThreadStats::clear() {
+    for (size_t s = 0; s < stage_count; ++s) {
+        stage_calls[s].clear();
+        stage_nanoseconds[s].clear();
+    }
+    for (auto& counter : counters) {
+        counter.clear();
+    }
+    // Cleared rather than erased, as the owner looks entries up unlocked
+    std::lock_guard<std::mutex> lock(functions_mutex);
+    for (auto& entry : functions) {
+        entry.second.calls.clear();
+        entry.second.nanoseconds.clear();
+        for (auto& bucket : entry.second.histogram) {
+            bucket.clear();
+        }
+    }
+}
+
+size_t bucket(uint64_t nanoseconds) {
+    size_t width = 0;
+    while (nanoseconds && width < histogram_buckets - 1) {
+        nanoseconds >>= 1;
+        ++width;
+    }
+    return width;
+}
+} // namespace
+
+const char* stage_name(Stage stage) {
+    switch(stage) {
+        case Stage::LEX: return "lex";
+        case Stage::PARSE: return "parse";
+        case Stage::SIMPLIFY: return "simplify";
+        case Stage::EVALUATE: return "evaluate";
+    }
+    return "unknown";
+}
+
+bool available() {
+#ifdef NUMU_ENABLE_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void enable(bool on) {
+    detail::active.store(on && available(), std::memory_order_relaxed);
+}
+
+void configure(const config::Config& config) {
+    enable(config.get_bool("developer.timing", false));
+}
+
+namespace detail {
+
+uint64_t now() {
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t enter(Stage stage) {
+    ThreadStats& stats = local();
+    return stats.depth[static_cast<size_t>(stage)]++ == 0 ? now() : 0;
+}
+
+void leave(Stage stage, uint64_t start) {
+    ThreadStats& stats = local();
+    auto s = static_cast<size_t>(stage);
+    if (--stats.depth[s] == 0) {
+        stats.stage_calls[s].add(1);
+        stats.stage_nanoseconds[s].add(now() - start);
+    }
+}
+
+void add(Counter counter, uint64_t amount) {
+    local().counters[static_cast<size_t>(counter)].add(amount);
+}
+
+void record_call(const std::string& function, uint64_t calls, uint64_t nanoseconds) {
+    ThreadStats& stats = local();
+    auto it = stats.functions.find(function);
+    if (it == stats.functions.end()) {
+        std::lock_guard<std::mutex> lock(stats.functions_mutex);
+        it = stats.functions.try_emplace(function).first;
+    }
+    FunctionCells& cells = it->second;
+    cells.calls.add(calls);
+    cells.nanoseconds.add(nanoseconds);
+    cells.histogram[bucket(calls ? nanoseconds / calls : 0)].add(calls);
+}
+
+} // namespace detail
+
+Snapshot snapshot() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    Snapshot totals = g.retired;
+    for (ThreadStats* thread : g.threads) {
+        thread->add_to(totals);
+    }
+    return totals;
+}
+
+void reset() {
+    Global& g = global();
+    std::lock_guard<std::mutex> lock(g.mutex);
+    g.retired = Snapshot();
+    for (ThreadStats* thread : g.threads) {
+        thread->clear();
+    }
+}
+
+} // namespace stats
+} // namespace numu
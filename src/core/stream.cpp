@@ -0,0 +1,108 @@
+#include "numu/core/stream.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NUMU_HAVE_MMAP 1
+#endif
+
+namespace numu {
+namespace lex {
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef NUMU_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0) {
+        void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        ::madvise(mapping, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapping);
+    }
+    ::close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    fallback_ = buffer.str();
+    data_ = fallback_.data();
+    size_ = fallback_.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef NUMU_HAVE_MMAP
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+StreamLexer::StreamLexer(std::istream& input, size_t chunk_size)
+    : input_(input), chunk_size_(chunk_size), lexer_(std::string_view()) {
+    refill(0, 1, 1);
+}
+
+void StreamLexer::refill(size_t keep_from, size_t line, size_t column) {
+    // Drop everything already consumed, then append the next chunk
+    buffer_.erase(0, keep_from);
+    size_t old_size = buffer_.size();
+    buffer_.resize(old_size + chunk_size_);
+    input_.read(&buffer_[old_size], static_cast<std::streamsize>(chunk_size_));
+    buffer_.resize(old_size + static_cast<size_t>(input_.gcount()));
+    if (!input_) {
+        exhausted_ = true;
+    }
+
+    lexer_ = Lexer(buffer_, line, column);
+}
+
+Token StreamLexer::next() {
+    while (true) {
+        size_t start = lexer_.position();
+        size_t line = lexer_.line();
+        size_t column = lexer_.column();
+
+        if (exhausted_) {
+            return lexer_.next();
+        }
+
+        // A token that runs into the end of the buffer may continue in the
+        // next chunk, so it only counts once more input has been seen
+        try {
+            Token token = lexer_.next();
+            if (lexer_.position() < buffer_.size()) {
+                return token;
+            }
+        } catch (const LexError&) {
+            // Only an unterminated string cut by the chunk boundary is retried
+            if (lexer_.position() < buffer_.size()) {
+                throw;
+            }
+        }
+
+        refill(start, line, column);
+    }
+}
+
+} // namespace lex
+} // namespace numu
@@ -0,0 +1,73 @@
+#include "numu/core/arena.h"
+#include "numu/core/ast.h"
+#include "test_util.h"
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// Trees built outside any ArenaScope stay valid after their thread exits,
+// and threads started one after another share one default arena instead
+// of leaving one behind each
+void default_arena_outlives_thread() {
+    std::vector<ast::NumberNode*> nodes;
+    std::vector<const ast::Arena*> arenas;
+    for (int i = 0; i < 64; ++i) {
+        std::thread([&, i] {
+            nodes.push_back(ast::NumberNode::create(static_cast<double>(i)));
+            arenas.push_back(&ast::current_arena());
+        }).join();
+    }
+
+    bool valid = true;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        valid = valid && nodes[i]->value == static_cast<double>(i);
+    }
+    expect(valid, "nodes outlive the thread that created them");
+
+    bool reused = true;
+    for (auto* arena : arenas) {
+        reused = reused && arena == arenas.front();
+    }
+    expect(reused, "a later thread takes over a retired default arena");
+}
+
+// Resetting a taken-over arena would free the nodes a dead thread left;
+// a thread's own arena still resets
+void retired_arena_is_not_reset() {
+    ast::NumberNode* left = nullptr;
+    std::thread([&] { left = ast::NumberNode::create(42.0); }).join();
+
+    bool refused = false;
+    bool fresh_reset = false;
+    std::thread([&] {
+        // The retired arena is taken, so this thread's child gets a new one
+        ast::current_arena();
+        std::thread([&] {
+            ast::NumberNode::create(1.0);
+            ast::current_arena().reset();
+            fresh_reset = ast::current_arena().objects() == 0;
+        }).join();
+        try {
+            ast::current_arena().reset();
+        } catch (const std::logic_error&) {
+            refused = true;
+        }
+    }).join();
+    expect(refused, "a taken-over arena refuses reset()");
+    expect(fresh_reset, "a thread's own arena resets");
+    expect(left->value == 42.0, "the dead thread's node survives");
+}
+
+} // namespace
+
+int main() {
+    default_arena_outlives_thread();
+    retired_arena_is_not_reset();
+    return test::exit_code();
+}
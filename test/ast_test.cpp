@@ -0,0 +1,57 @@
+#include "numu/core/ast.h"
+#include "test_util.h"
+#include <stdexcept>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+void hashes() {
+    ast::Node* a = parse_source("x * (y + 1)");
+    ast::Node* b = parse_source("x * (y + 1)");
+    expect(a != b && ast::hash(a) == ast::hash(b), "equal trees hash the same");
+    expect(ast::hash(a) != ast::hash(parse_source("(y + 1) * x")), "the hash is order-sensitive");
+    expect(ast::hash(ast::NumberNode::create(0.0)) == ast::hash(ast::NumberNode::create(-0.0)),
+           "-0 hashes as 0, as it equals it");
+
+    // A chain of doubly shared nodes hashes in linear time
+    ast::Node* chain = ast::VariableNode::create("x");
+    for (int i = 0; i < 64; ++i) {
+        chain = ast::BinaryOpNode::create(ast::BinaryOp::ADD, chain, chain);
+    }
+    expect(ast::hash(chain) == ast::hash(chain), "a shared chain");
+}
+
+// Changing a node in place needs the node and its hashed ancestors invalidated
+void invalidation() {
+    auto* sum = static_cast<ast::BinaryOpNode*>(parse_source("x * (y + 1)"));
+    auto* inner = static_cast<ast::BinaryOpNode*>(sum->right);
+    size_t before = ast::hash(sum);
+    static_cast<ast::NumberNode*>(inner->right)->value = 2.0;
+    ast::invalidate_hash(inner->right);
+    ast::invalidate_hash(inner);
+    ast::invalidate_hash(sum);
+    expect(ast::hash(sum) != before && ast::hash(sum) == ast::hash(parse_source("x * (y + 2)")),
+           "an invalidated hash is recomputed");
+
+#ifndef NDEBUG
+    static_cast<ast::NumberNode*>(inner->right)->value = 3.0;
+    ast::invalidate_hash(inner->right);
+    bool threw = false;
+    try {
+        ast::hash(sum);
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+    expect(threw, "a stale ancestor is caught");
+#endif
+}
+
+} // namespace
+
+int main() {
+    hashes();
+    invalidation();
+    return test::exit_code();
+}
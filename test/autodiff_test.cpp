@@ -0,0 +1,115 @@
+#include "numu/core/autodiff.h"
+#include "test_util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// A NaN result of min or max matches none of its arguments
+void nan_extremum() {
+    for (const char* source : {"min(inf - inf + x, y)", "max(inf - inf + x, y)"}) {
+        ast::Node* node = parse_source(source);
+        core::Frame frame(core::default_registry());
+        frame.set("x", 1.0);
+        frame.set("y", 2.0);
+
+        core::Gradient gradient = core::evaluate_gradient(node, frame, {"x", "y"});
+        expect(gradient.partials.size() == 2, "gradient has one partial per variable");
+        expect(std::isnan(gradient.partials[0]) && std::isnan(gradient.partials[1]),
+               "gradient of a NaN extremum is NaN");
+
+        core::Dual dual = core::evaluate_dual(node, frame, "y");
+        expect(std::isnan(dual.derivative), "derivative of a NaN extremum is NaN");
+    }
+}
+
+void extremum() {
+    ast::Node* node = parse_source("min(x, y) + max(x, 2 * y)");
+    core::Frame frame(core::default_registry());
+    frame.set("x", 1.0);
+    frame.set("y", 2.0);
+
+    core::Gradient gradient = core::evaluate_gradient(node, frame, {"x", "y"});
+    expect(gradient.value == 5.0, "min + max value");
+    expect(gradient.partials[0] == 1.0 && gradient.partials[1] == 2.0, "min + max partials");
+}
+
+bool close(double a, double b, double tolerance) {
+    return std::fabs(a - b) <= tolerance * std::max(1.0, std::fabs(b));
+}
+
+// Both modes against derivatives worked out by hand
+void known_derivatives() {
+    struct Case {
+        const char* source;
+        double value, dx, dy; // at x = 0.5, y = 2
+    };
+    const Case cases[] = {
+        {"x * y + x", 1.5, 3.0, 0.5},
+        {"x / y", 0.25, 0.5, -0.125},
+        {"x ^ y", 0.25, 1.0, 0.25 * std::log(0.5)},
+        {"sin(x) * exp(y)", std::sin(0.5) * std::exp(2.0), std::cos(0.5) * std::exp(2.0),
+         std::sin(0.5) * std::exp(2.0)},
+        {"log(x * y) + sqrt(y)", std::sqrt(2.0), 2.0, 0.5 + 0.5 / std::sqrt(2.0)},
+        {"-x - y", -2.5, -1.0, -1.0},
+        {"sum(x, y, x) + avg(x, y)", 4.25, 2.5, 1.5},
+    };
+    for (const auto& c : cases) {
+        ast::Node* node = parse_source(c.source);
+        core::Frame frame(core::default_registry());
+        frame.set("x", 0.5);
+        frame.set("y", 2.0);
+
+        core::Gradient gradient = core::evaluate_gradient(node, frame, {"x", "y"});
+        core::Dual dx = core::evaluate_dual(node, frame, "x");
+        core::Dual dy = core::evaluate_dual(node, frame, "y");
+        bool ok = close(gradient.value, c.value, 1e-12) && close(gradient.partials[0], c.dx, 1e-12) &&
+                  close(gradient.partials[1], c.dy, 1e-12) && close(dx.value, c.value, 1e-12) &&
+                  close(dx.derivative, c.dx, 1e-12) && close(dy.derivative, c.dy, 1e-12);
+        if (!ok) {
+            std::fprintf(stderr, "  %s\n", c.source);
+            expect(false, "derivative matches the one worked out by hand");
+        }
+    }
+}
+
+// A function without a known derivative is differentiated numerically
+void registered_function() {
+    core::RegistryPtr registry = core::default_registry()->with_function(
+        "cube", [](const std::vector<double>& args) { return args[0] * args[0] * args[0]; }, 1);
+    core::Frame frame(registry);
+    frame.set("x", 2.0);
+    core::Dual dual = core::evaluate_dual(parse_source("cube(x)"), frame, "x");
+    expect(dual.value == 8.0, "value of a registered function");
+    expect(close(dual.derivative, 12.0, 1e-6), "numeric derivative of a registered function");
+}
+
+// Errors are the ones evaluate() reports
+void errors() {
+    core::Frame frame(core::default_registry());
+    frame.set("x", 0.0);
+    bool thrown = false;
+    try {
+        core::evaluate_gradient(parse_source("1 / x"), frame, {"x"});
+    } catch (const core::DomainError& error) {
+        thrown = error.status == core::Status::DIVISION_BY_ZERO;
+    }
+    expect(thrown, "gradient reports a division by zero");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    nan_extremum();
+    extremum();
+    known_derivatives();
+    registered_function();
+    errors();
+    return test::exit_code();
+}
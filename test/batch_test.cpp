@@ -0,0 +1,96 @@
+#include "numu/core/batch.h"
+#include "test_util.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+const char* kernel_name(core::BatchKernel kernel) {
+    switch(kernel) {
+        case core::BatchKernel::BASELINE: return "baseline";
+        case core::BatchKernel::AVX: return "avx";
+        case core::BatchKernel::AVX512: return "avx512";
+        default: return "auto";
+    }
+}
+
+// A point count that is not a multiple of the block size or of any vector
+// width, so the scalar tails run as well
+constexpr size_t points = 1000 + 7;
+
+// Columns with zeros and negative values, so domain checks fail at some
+// points but not at others
+void make_columns(std::vector<double>& x, std::vector<double>& y) {
+    x.resize(points);
+    y.resize(points);
+    for (size_t i = 0; i < points; ++i) {
+        x[i] = static_cast<double>(i % 23) - 5.0;
+        y[i] = static_cast<double>(i % 17) * 0.5 - 2.0;
+    }
+}
+
+// Every kernel computes what the tree evaluator does, point by point
+void matches_evaluate(core::BatchKernel kernel) {
+    std::vector<double> x, y;
+    make_columns(x, y);
+    std::vector<core::Column> columns = {{"x", x.data()}, {"y", y.data()}};
+
+    for (const char* source : {"x * y + x - y * 3", "-x / (y * y + 1) + sqrt(x * x)",
+                               "sin(x) * cos(y) + exp(-x * x) + x ^ 2 % 3"}) {
+        ast::Node* node = parse_source(source);
+        std::vector<double> out = core::evaluate_batch(node, columns, points);
+        for (size_t i = 0; i < points; ++i) {
+            core::Frame frame(core::default_registry());
+            frame.set("x", x[i]);
+            frame.set("y", y[i]);
+            if (!same_value(out[i], core::evaluate(node, frame))) {
+                std::fprintf(stderr, "  %s kernel: %s at point %zu\n", kernel_name(kernel), source, i);
+                expect(false, "evaluate_batch matches evaluate");
+                break;
+            }
+        }
+    }
+
+    for (const char* source : {"log(x) + 1 / y", "sqrt(y) * x / x", "x + y"}) {
+        ast::Node* node = parse_source(source);
+        std::vector<double> out(points);
+        std::vector<core::Status> status(points);
+        size_t failed = core::try_evaluate_batch(node, columns, points, out.data(), status.data());
+        size_t expected_failed = 0;
+        for (size_t i = 0; i < points; ++i) {
+            core::Frame frame(core::default_registry());
+            frame.set("x", x[i]);
+            frame.set("y", y[i]);
+            core::Result expected = core::try_evaluate(node, frame);
+            expected_failed += expected.ok() ? 0 : 1;
+            if (status[i] != expected.status || !same_value(out[i], expected.value)) {
+                std::fprintf(stderr, "  %s kernel: %s at point %zu\n", kernel_name(kernel), source, i);
+                expect(false, "try_evaluate_batch matches try_evaluate");
+                break;
+            }
+        }
+        expect(failed == expected_failed, "try_evaluate_batch counts the failed points");
+    }
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    for (auto kernel : {core::BatchKernel::BASELINE, core::BatchKernel::AVX,
+                        core::BatchKernel::AVX512}) {
+        // Kernels this build or CPU lacks are skipped
+        if (core::detail::force_batch_kernel(kernel)) {
+            matches_evaluate(kernel);
+        }
+    }
+    expect(core::detail::force_batch_kernel(core::BatchKernel::AUTO),
+           "the default kernel is always available");
+    matches_evaluate(core::BatchKernel::AUTO);
+    return test::exit_code();
+}
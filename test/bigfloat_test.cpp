@@ -0,0 +1,120 @@
+#include "numu/core/number.h"
+#include "test_util.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+size_t limbs30 = core::BigFloat::limbs_for(30);
+
+bool prints(const core::BigFloat& value, size_t digits, const std::string& expected) {
+    std::string text = value.to_string(digits);
+    if (text != expected) {
+        std::fprintf(stderr, "  got %s, expected %s\n", text.c_str(), expected.c_str());
+    }
+    return text == expected;
+}
+
+bool parse_error(const char* text) {
+    try {
+        core::BigFloat::parse(text, limbs30);
+    } catch (const std::invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+// Thirty digits of each, past what a double holds
+void reference_constants() {
+    core::BigFloat one(1.0, limbs30);
+    expect(prints(core::BigFloat::pi(limbs30), 30, "3.14159265358979323846264338328"), "pi");
+    expect(prints(exp(one), 30, "2.71828182845904523536028747135"), "e");
+    expect(prints(sqrt(core::BigFloat(2.0, limbs30)), 30, "1.41421356237309504880168872421"), "sqrt(2)");
+    expect(prints(log(core::BigFloat(2.0, limbs30)), 30, "0.693147180559945309417232121458"), "log(2)");
+    expect(prints(core::BigFloat::ln2(limbs30), 30, "0.693147180559945309417232121458"), "ln2");
+    expect(prints(one / core::BigFloat(3.0, limbs30), 30, "0.333333333333333333333333333333"), "1/3");
+
+    core::BigFloat root = sqrt(core::BigFloat(2.0, limbs30));
+    expect(prints(root * root, 30, "2"), "sqrt(2) squared");
+}
+
+void rounding() {
+    expect(prints(core::BigFloat::parse("0.99996", limbs30), 4, "1"), "a carry through every digit");
+    expect(prints(core::BigFloat::parse("1.5", limbs30), 1, "2"), "round half up");
+    expect(prints(core::BigFloat::parse("1.49", limbs30), 1, "1"), "round down");
+    expect(prints(core::BigFloat::parse("-2.71828", limbs30), 3, "-2.72"), "negative values");
+    expect(prints(core::BigFloat::parse("123456", limbs30), 3, "1.23e+05"), "exponent form for large values");
+    expect(prints(core::BigFloat::parse("0.00012345", limbs30), 3, "0.000123"), "small values in place");
+    expect(prints(core::BigFloat::parse("0.000012345", limbs30), 3, "1.23e-05"), "exponent form for small values");
+    expect(prints(core::BigFloat::parse("99.96", limbs30), 3, "100"), "a carry into a new digit");
+
+    // Rounded to the precision it is given, not kept at the source's
+    core::BigFloat third = core::BigFloat(1.0, limbs30) / core::BigFloat(3.0, limbs30);
+    expect(third.with_limbs(1).to_double() == 1.0 / 3.0, "rounded to one limb");
+    expect(prints(core::BigFloat::from_literal(0.1, limbs30), 30, "0.1"), "a literal is its decimal");
+    expect(core::BigFloat(0.1, limbs30).to_string(30) != "0.1", "a double is its binary value");
+}
+
+void parse_text() {
+    expect(core::BigFloat::parse("-1.25e-3", limbs30).to_double() == -1.25e-3, "a negative exponent");
+    expect(core::BigFloat::parse("+42", limbs30).to_double() == 42.0, "a leading plus");
+    expect(core::BigFloat::parse(".5", limbs30).to_double() == 0.5, "no integer part");
+    expect(core::BigFloat::parse("2.", limbs30).to_double() == 2.0, "no fraction");
+    expect(core::BigFloat::parse("1E+2", limbs30).to_double() == 100.0, "an upper-case exponent");
+    expect(prints(core::BigFloat::parse("1e400", limbs30), 3, "1e+400"), "past the range of a double");
+    expect(prints(core::BigFloat::parse("1234567890123456789012345678901234567890", limbs30), 30,
+                  "1.2345678901234567890123456789e+39"),
+           "more digits than one chunk");
+    expect(core::BigFloat::parse("-inf", limbs30).is_inf(), "infinity");
+    expect(core::BigFloat::parse("nan", limbs30).is_nan(), "nan");
+
+    expect(parse_error(""), "empty text");
+    expect(parse_error("abc"), "letters");
+    expect(parse_error("1.2.3"), "two points");
+    expect(parse_error("1e"), "an exponent without digits");
+    expect(parse_error("12x"), "trailing characters");
+}
+
+// A double shows no more than max_digits10 digits, and NaN reads the same
+// in every number system
+void formatting() {
+    expect(core::format_number(1.0 / 3.0, 25) == "0.33333333333333331", "a double is cut at 17 digits");
+    expect(core::format_number(0.1, 40) == "0.10000000000000001", "0.1 at 40 digits");
+    expect(core::format_number(std::nan(""), 12) == "nan", "nan");
+    expect(core::format_number(-std::nan(""), 12) == "nan", "nan with the sign bit set");
+    expect(core::format_number(core::BigFloat::nan(limbs30), 12) == "nan", "BigFloat nan");
+    expect(core::format_number(core::Complex(std::nan(""), 0.0), 12) == "nan", "complex nan");
+
+    core::Frame frame(core::default_registry());
+    frame.set("n", -std::numeric_limits<double>::quiet_NaN());
+    ast::Node* third = parse_source("1/3");
+    ast::Node* nan = parse_source("n");
+    core::NumberSystem systems[] = {core::NumberSystem::REAL, core::NumberSystem::COMPLEX,
+                                    core::NumberSystem::MULTIPRECISION};
+    for (core::NumberSystem system : systems) {
+        core::NumberFormat format;
+        format.system = system;
+        format.precision = 25;
+        expect(core::evaluate_formatted(nan, frame, format) == "nan", "nan in every system");
+        std::string text = core::evaluate_formatted(third, frame, format);
+        bool precise = system == core::NumberSystem::MULTIPRECISION;
+        expect(text == (precise ? "0.3333333333333333333333333" : "0.33333333333333331"),
+               "1/3 at 25 digits");
+    }
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    reference_constants();
+    rounding();
+    parse_text();
+    formatting();
+    return test::exit_code();
+}
@@ -0,0 +1,144 @@
+#include "numu/core/budget.h"
+#include "numu/core/compile.h"
+#include "numu/core/parallel.h"
+#include "test_util.h"
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+core::Budget steps(size_t max_steps) {
+    core::Budget budget;
+    budget.max_steps = max_steps;
+    return budget;
+}
+
+// Steps one evaluation of `node` takes, under a scope without limits
+size_t cost(ast::Node* node) {
+    core::BudgetScope scope(core::Budget{});
+    core::evaluate(node);
+    return scope.steps();
+}
+
+// On one thread the step limit is exact: the evaluation that would pass
+// it throws and none before it does
+void step_limit() {
+    ast::Node* node = parse_source("sin(1) + 2 * 3");
+    size_t each = cost(node);
+    expect(each > 0, "an evaluation takes steps");
+
+    core::BudgetScope scope(steps(10 * each));
+    size_t completed = 0;
+    try {
+        for (int i = 0; i < 100; ++i) {
+            core::evaluate(node);
+            ++completed;
+        }
+    } catch (const core::BudgetExceeded& e) {
+        expect(e.limit == core::BudgetExceeded::Limit::STEPS, "the step limit is reported");
+        expect(std::string(e.what()) == "Step limit of " + std::to_string(10 * each) + " exceeded",
+               "the step limit message");
+    }
+    expect(completed == 10, "exactly the evaluations within the limit complete");
+
+    bool again = false;
+    try {
+        core::evaluate(node);
+    } catch (const core::BudgetExceeded&) {
+        again = true;
+    }
+    expect(again, "an exhausted scope keeps throwing");
+}
+
+// A compiled loop charges as it runs, so the time limit stops it
+void time_limit() {
+    core::Program program = core::compile_program(parse_program("i = 0; while 1 { i = i + 1 }"));
+    std::vector<double> vars(program.variables().size(), 0.0);
+
+    core::Budget budget;
+    budget.timeout = 20;
+    core::BudgetScope scope(budget);
+    bool stopped = false;
+    try {
+        program.run(vars);
+    } catch (const core::BudgetExceeded& e) {
+        stopped = e.limit == core::BudgetExceeded::Limit::TIME &&
+                  std::string(e.what()) == "Time limit of 20 ms exceeded";
+    }
+    expect(stopped, "an endless loop is stopped by the time limit");
+}
+
+void nesting() {
+    expect(core::BudgetScope::current() == nullptr, "no scope at first");
+    {
+        core::BudgetScope outer(steps(1000000));
+        {
+            core::BudgetScope inner(steps(1));
+            expect(core::BudgetScope::current() == &inner, "the innermost scope wins");
+            bool threw = false;
+            try {
+                core::evaluate(parse_source("1 + 2 + 3"));
+            } catch (const core::BudgetExceeded&) {
+                threw = true;
+            }
+            expect(threw, "the inner limit applies");
+        }
+        expect(core::BudgetScope::current() == &outer, "the outer scope is restored");
+        expect(core::evaluate(parse_source("1 + 2 + 3")) == 6.0, "the outer limit applies again");
+
+        core::BudgetScope none(nullptr);
+        expect(core::BudgetScope::current() == &outer, "a scope sharing nothing does nothing");
+    }
+    expect(core::BudgetScope::current() == nullptr, "no scope at the end");
+}
+
+// Work done on scheduler threads counts against the caller's scope
+void shared_by_workers() {
+    core::Scheduler scheduler(4);
+    ast::Node* node = parse_source("sin(1) + 2 * 3");
+    size_t each = cost(node);
+
+    {
+        core::BudgetScope scope(core::Budget{});
+        scheduler.parallel_for(400, 10, [node](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                core::evaluate(node);
+            }
+        });
+        expect(scope.steps() == 400 * each, "workers' steps are charged to the caller");
+    }
+
+    core::BudgetScope scope(steps(100 * each));
+    bool threw = false;
+    try {
+        scheduler.parallel_for(100000, 10, [node](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                core::evaluate(node);
+            }
+        });
+    } catch (const core::BudgetExceeded&) {
+        threw = true;
+    }
+    expect(threw, "workers are stopped by the caller's limit");
+}
+
+void from_config() {
+    core::Budget budget = core::Budget::from(config::Config::parse("core.max_steps = 500\ncore.timeout = 250"));
+    expect(budget.max_steps == 500 && budget.timeout == 250.0, "limits from the config");
+    core::Budget none = core::Budget::from(config::Config::parse(""));
+    expect(none.max_steps == 0 && none.timeout == 0.0, "no limits by default");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    step_limit();
+    time_limit();
+    nesting();
+    shared_by_workers();
+    from_config();
+    return test::exit_code();
+}
@@ -0,0 +1,109 @@
+#include "numu/core/cache.h"
+#include "test_util.h"
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+void hits_and_misses() {
+    core::EvalCache cache;
+    core::Frame frame(core::default_registry());
+    frame.set("x", 2.0);
+    ast::Node* node = parse_source("x * x + 1");
+
+    expect(cache.evaluate(node, frame) == 5.0, "first evaluation");
+    expect(cache.evaluate(node, frame) == 5.0, "cached evaluation");
+    core::CacheStats stats = cache.stats();
+    expect(stats.misses == 1 && stats.hits == 1 && stats.entries == 1, "one miss, then a hit");
+
+    frame.set("x", 3.0);
+    expect(cache.evaluate(node, frame) == 10.0, "a changed variable is not served stale");
+    expect(cache.stats().misses == 2, "a changed variable misses");
+
+    // The same expression parsed again is a different node with the same key
+    expect(cache.evaluate(parse_source("x * x + 1"), frame) == 10.0, "a reparsed expression");
+    expect(cache.stats().hits == 2, "a reparsed expression hits");
+
+    ast::Node* other = parse_source("x * x - 1");
+    expect(cache.evaluate(other, frame) == 8.0, "a different expression");
+    expect(cache.stats().misses == 3, "a different expression misses");
+}
+
+// Keys include the registry, whose constants and functions may differ
+void registries() {
+    core::EvalCache cache;
+    ast::Node* node = parse_source("k * 2");
+    core::Frame one(core::Registry::standard()->with_constant("k", 1.0));
+    core::Frame two(core::Registry::standard()->with_constant("k", 2.0));
+    expect(cache.evaluate(node, one) == 2.0, "first registry");
+    expect(cache.evaluate(node, two) == 4.0, "second registry");
+    expect(cache.stats().hits == 0, "registries do not share entries");
+}
+
+void eviction() {
+    size_t capacity = 8 * 1024;
+    core::EvalCache cache(capacity);
+    core::Frame frame(core::default_registry());
+    ast::Node* node = parse_source("x + 1");
+    for (int i = 0; i < 1000; ++i) {
+        frame.set("x", i);
+        expect(cache.evaluate(node, frame) == i + 1.0, "evaluation under eviction");
+    }
+    core::CacheStats stats = cache.stats();
+    expect(stats.evictions > 0, "entries are evicted");
+    expect(stats.bytes <= capacity, "the cache stays within capacity");
+    expect(stats.entries + stats.evictions == 1000, "every miss was inserted");
+
+    // The most recent entry survives, the first does not
+    expect(cache.evaluate(node, frame) == 1000.0 && cache.stats().hits == 1, "the newest entry");
+    frame.set("x", 0.0);
+    cache.evaluate(node, frame);
+    expect(cache.stats().hits == 1, "the oldest entry was evicted");
+}
+
+void uncached() {
+    core::EvalCache disabled(0);
+    ast::Node* node = parse_source("2 + 3");
+    expect(disabled.evaluate(node) == 5.0, "a disabled cache evaluates");
+    expect(disabled.stats().misses == 0 && disabled.stats().entries == 0, "a disabled cache stores nothing");
+
+    core::EvalCache cache;
+    ast::Node* matrix = parse_source("det([[1,2],[3,4]])");
+    expect(cache.evaluate(matrix) == -2.0, "a matrix expression");
+    expect(cache.stats().entries == 0, "matrix expressions are not cached");
+
+    bool threw = false;
+    try {
+        cache.evaluate(parse_source("1 / 0"));
+    } catch (const core::DomainError&) {
+        threw = true;
+    }
+    expect(threw && cache.stats().entries == 0, "a failed evaluation is not cached");
+
+    cache.evaluate(node);
+    cache.clear();
+    expect(cache.stats().entries == 0 && cache.stats().bytes == 0, "clear empties the cache");
+    cache.evaluate(node);
+    expect(cache.stats().entries == 1, "entries after clear");
+}
+
+void capacity_from_config() {
+    expect(core::EvalCache::capacity_from(config::Config::parse("core.cache_size = 4MB")) == 4u * 1024 * 1024,
+           "core.cache_size");
+    expect(core::EvalCache::capacity_from(config::Config::parse("")) == core::EvalCache::default_capacity,
+           "the default capacity");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    hits_and_misses();
+    registries();
+    eviction();
+    uncached();
+    capacity_from_config();
+    return test::exit_code();
+}
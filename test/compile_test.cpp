@@ -0,0 +1,65 @@
+#include "numu/core/compile.h"
+#include "test_util.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+bool has_variable(const core::Program& program, const std::string& name) {
+    const auto& names = program.variables();
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+// Supplies constants as a module loaded on first use would
+struct ModuleConstants : core::Fallback {
+    double c = 299792458.0;
+
+    const core::Callable* find_callable(const std::string&) const override { return nullptr; }
+    const double* find_constant(const std::string& name) const override {
+        return name == "c" ? &c : nullptr;
+    }
+};
+
+void registry_constants() {
+    core::RegistryPtr registry = core::Registry::standard()->with_constant("g", 9.81);
+    core::Program program = core::compile_program(parse_program("y = g * 2; y"), registry);
+    expect(!has_variable(program, "g"), "a registry constant is not a program variable");
+    expect(has_variable(program, "y"), "an assigned name is a program variable");
+
+    std::vector<double> vars(program.variables().size(), 0.0);
+    expect(program.run(vars) == 19.62, "a program reads registry constants");
+}
+
+void assigned_constants() {
+    core::RegistryPtr registry = core::Registry::standard()->with_constant("g", 9.81);
+    core::Program program = core::compile_program(parse_program("y = g * 2; g = 1; y"), registry);
+    expect(has_variable(program, "g"), "an assigned constant is a program variable");
+
+    std::vector<double> vars(program.variables().size(), 0.0);
+    vars[program.slot("g")] = 3.0;
+    expect(program.run(vars) == 6.0, "an assigned constant is read from its slot");
+    expect(vars[program.slot("g")] == 1.0, "an assigned constant is written back");
+}
+
+void fallback_constants() {
+    core::RegistryPtr registry =
+        core::Registry::standard()->with_fallback(std::make_shared<ModuleConstants>());
+    core::Program program = core::compile_program(parse_program("e0 = c / 2; e0"), registry);
+    expect(!has_variable(program, "c"), "a module constant is not a program variable");
+
+    std::vector<double> vars(program.variables().size(), 0.0);
+    expect(program.run(vars) == 149896229.0, "a program reads module constants");
+}
+
+} // namespace
+
+int main() {
+    registry_constants();
+    assigned_constants();
+    fallback_constants();
+    return test::exit_code();
+}
@@ -0,0 +1,115 @@
+#include "numu/core/config.h"
+#include "test_util.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+bool parse_error(const std::string& text, const char* contains) {
+    try {
+        config::Config::parse(text);
+    } catch (const config::ConfigError& e) {
+        return std::string(e.what()).find(contains) != std::string::npos;
+    }
+    return false;
+}
+
+template<typename F>
+bool config_error(F f) {
+    try {
+        f();
+    } catch (const config::ConfigError&) {
+        return true;
+    }
+    return false;
+}
+
+void syntax() {
+    config::Config config = config::Config::parse(
+        "# a comment\n"
+        "core {\n"
+        "    cache_size = 256MB   // another\n"
+        "    timeout: 250\n"
+        "    \"quoted key\" = \"a \\\"b\\\" # c\"\n"
+        "}\n"
+        "core.max_steps = 1000\n"
+        "modules { required = [core,\n"
+        "    arithmetic, ], optional = [] }\n"
+        "developer.timing = on\n");
+    expect(config.get_string("core.cache_size", "") == "256MB", "a nested key");
+    expect(config.get_number("core.timeout", 0) == 250.0, "a colon separates too");
+    expect(config.get_string("core.quoted key", "") == "a \"b\" # c", "quoted keys and escapes");
+    expect(config.get_number("core.max_steps", 0) == 1000.0, "a dotted key");
+    expect((config.get_list("modules.required") == std::vector<std::string>{"core", "arithmetic"}),
+           "a list over several lines");
+    expect(config.find("modules.optional")->is_list && config.get_list("modules.optional").empty(),
+           "an empty list");
+    expect(config.get_bool("developer.timing", false), "a boolean");
+    expect(config.values().size() == 7, "every key");
+
+    // A later value replaces an earlier one
+    expect(config::Config::parse("a = 1\na = 2").get_number("a", 0) == 2.0, "the last value wins");
+    expect(config::Config::parse("").values().empty(), "an empty file");
+}
+
+void getters() {
+    config::Config config = config::Config::parse("n = 1.5\ns = text\nb = no\nl = [x, y]\nsize = 2 KiB");
+    expect(config.has("n") && !config.has("missing"), "has");
+    expect(config.get_number("missing", 7.0) == 7.0, "a number fallback");
+    expect(config.get_string("l", "fallback") == "fallback", "a list is not a string");
+    expect(config.get_number("l", 3.0) == 3.0, "a list is not a number");
+    expect(!config.get_bool("b", true), "no is false");
+    expect((config.get_list("s") == std::vector<std::string>{"text"}), "a scalar is a list of one");
+    expect(config.get_list("missing").empty(), "a missing list");
+    expect(config.get_size("size", 0) == 2048, "a size");
+    expect(config_error([&] { config.get_number("s", 0); }), "text is not a number");
+    expect(config_error([&] { config.get_bool("n", false); }), "a number is not a boolean");
+}
+
+void sizes() {
+    expect(config::parse_size("10") == 10, "bytes");
+    expect(config::parse_size("10B") == 10, "B");
+    expect(config::parse_size("1.5k") == 1536, "fractional kilobytes");
+    expect(config::parse_size("4 MB") == 4u * 1024 * 1024, "megabytes");
+    expect(config::parse_size("1GiB") == 1024u * 1024 * 1024, "gibibytes");
+    expect(config_error([] { config::parse_size("MB"); }), "no amount");
+    expect(config_error([] { config::parse_size("-1MB"); }), "a negative size");
+    expect(config_error([] { config::parse_size("3 TB"); }), "an unknown unit");
+}
+
+void errors() {
+    expect(parse_error("a = \"open", "line 1: Unterminated string"), "an unterminated string");
+    expect(parse_error("a {\n  b = 1\n", "line 3: Expected '}'"), "an unclosed object");
+    expect(parse_error("a = 1\n}", "line 2: Unexpected '}'"), "a stray brace");
+    expect(parse_error("l = [1, 2", "Unterminated list for l"), "an unterminated list");
+    expect(parse_error("= 1", "Expected key"), "a missing key");
+}
+
+void files() {
+    expect(config_error([] { config::Config::load("/nonexistent/numurc"); }), "a missing file");
+
+    std::string path = "config_test.numurc";
+    {
+        std::ofstream file(path);
+        file << "calculus { integral { relative_tolerance = 1e-6 } }\n";
+    }
+    config::Config config = config::Config::load(path);
+    std::remove(path.c_str());
+    expect(config.get_number("calculus.integral.relative_tolerance", 0) == 1e-6, "a loaded file");
+}
+
+} // namespace
+
+int main() {
+    syntax();
+    getters();
+    sizes();
+    errors();
+    files();
+    return test::exit_code();
+}
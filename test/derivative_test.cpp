@@ -0,0 +1,54 @@
+#include "numu/core/autodiff.h"
+#include "numu/core/derivative.h"
+#include "test_util.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// Symbolic derivatives evaluate to the ones automatic differentiation
+// computes, ties between min and max arguments and abs at 0 included
+void matches_autodiff() {
+    const char* sources[] = {
+        "sin(min(y, 0.5))", "max(x, 2 * y, 1)", "min(x, y, x)",
+        "sum(x, x * y, 3) + avg(x, y)", "max(x, y) * min(x, y)",
+        "abs(x - 1) * y", "abs(x - x) + x", "abs(y * x - 2)",
+    };
+    const double points[][2] = {{0.25, 1.0}, {2.0, 0.25}, {1.0, 1.0}, {-1.0, 0.5}};
+    for (const char* source : sources) {
+        ast::Node* node = parse_source(source);
+        std::vector<ast::Node*> partials = core::gradient(node, {"x", "y"});
+        ast::Node* forward = core::differentiate(node, "x");
+        for (const auto& point : points) {
+            core::Frame frame(core::default_registry());
+            frame.set("x", point[0]);
+            frame.set("y", point[1]);
+            core::Gradient expected = core::evaluate_gradient(node, frame, {"x", "y"});
+            for (size_t i = 0; i < partials.size(); ++i) {
+                core::Result symbolic = core::try_evaluate(partials[i], frame);
+                if (!symbolic.ok() || symbolic.value != expected.partials[i]) {
+                    std::fprintf(stderr, "  d/d%s %s at (%g, %g)\n", i == 0 ? "x" : "y", source,
+                                 point[0], point[1]);
+                    expect(false, "symbolic partial matches autodiff");
+                }
+            }
+            core::Result derivative = core::try_evaluate(forward, frame);
+            if (!derivative.ok() || derivative.value != core::evaluate_dual(node, frame, "x").derivative) {
+                std::fprintf(stderr, "  d/dx %s at (%g, %g)\n", source, point[0], point[1]);
+                expect(false, "differentiate matches evaluate_dual");
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    matches_autodiff();
+    return test::exit_code();
+}
@@ -0,0 +1,181 @@
+#include "numu/core/flat.h"
+#include "test_util.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+const char* expressions[] = {
+    "x * y + 1",
+    "sin(x) / (y - 2) + max(x, y, 3)",
+    "-x ^ 2 + abs(y) % 3",
+    "(x > y) + (x == 1) * 2",
+    "det([[x, 1], [2, y]])",
+};
+
+// Children come before their parents and lowest() covers the subtree
+bool well_formed(const ast::FlatTree& tree) {
+    for (ast::NodeId id = 0; id < tree.size(); ++id) {
+        ast::NodeId low = id;
+        for (uint32_t k = 0; k < tree.child_count(id); ++k) {
+            ast::NodeId child = tree.child(id, k);
+            if (child == ast::no_node) {
+                continue;
+            }
+            if (child >= id) {
+                return false;
+            }
+            low = std::min(low, tree.lowest(child));
+        }
+        if (tree.lowest(id) != low) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void round_trip() {
+    core::Frame frame(core::default_registry());
+    frame.set("x", 1.5);
+    frame.set("y", -2.0);
+    for (const char* source : expressions) {
+        ast::Node* node = parse_source(source);
+        ast::FlatTree tree = ast::flatten(node);
+        std::string what = source;
+        expect(well_formed(tree), ("children first in " + what).c_str());
+        expect(tree.root() == tree.size() - 1, ("the root is the last node of " + what).c_str());
+        expect(ast::hash(tree, tree.root()) == ast::hash(node), ("flat hash of " + what).c_str());
+        expect(ast::hash(ast::to_node(tree)) == ast::hash(node), ("to_node of " + what).c_str());
+        expect(same_value(core::evaluate(tree, frame), core::evaluate(node, frame)),
+               ("flat evaluation of " + what).c_str());
+    }
+
+    // Statements flatten too, though only expressions hash and evaluate
+    ast::Node* program = parse_program("s = 0; for (i = 0; i < 3; i = i + 1) { if i > 1 { s = s + i } else s = 1 }; return s");
+    ast::FlatTree tree = ast::flatten(program);
+    expect(well_formed(tree), "children first in a program");
+    ast::FlatTree again = ast::flatten(ast::to_node(tree));
+    bool same = again.size() == tree.size();
+    for (ast::NodeId id = 0; same && id < tree.size(); ++id) {
+        same = again.type(id) == tree.type(id) && again.op(id) == tree.op(id) &&
+               again.child_count(id) == tree.child_count(id);
+    }
+    expect(same, "to_node of a program");
+}
+
+void traversal() {
+    ast::Node* node = parse_source("sin(x) / (y - 2) + max(x, y, 3)");
+    ast::FlatTree tree = ast::flatten(node);
+    std::vector<ast::NodeType> expected;
+    ast::traverse(node, [&](ast::Node* n) { expected.push_back(n->type); });
+    std::vector<ast::NodeType> actual;
+    ast::traverse(tree, tree.root(), [&](ast::NodeId id) { actual.push_back(tree.type(id)); });
+    expect(actual == expected, "traverse visits in the same order as on nodes");
+}
+
+void shared_subtrees() {
+    ast::Node* part = parse_source("x * y + 1");
+    ast::Node* node = ast::BinaryOpNode::create(ast::BinaryOp::MUL, part, part);
+    ast::FlatTree tree = ast::flatten(node);
+    ast::FlatTree single = ast::flatten(part);
+    expect(tree.size() == single.size() + 1, "a shared subtree is stored once");
+    expect(tree.child(tree.root(), 0) == tree.child(tree.root(), 1), "both operands name one node");
+
+    core::Frame frame(core::default_registry());
+    frame.set("x", 2.0);
+    frame.set("y", 3.0);
+    expect(core::evaluate(tree, frame) == 49.0, "a shared subtree evaluates");
+}
+
+void building() {
+    ast::FlatTree tree;
+    ast::NodeId x = tree.add_variable("x");
+    ast::NodeId two = tree.add_number(2.0);
+    ast::NodeId product = tree.add_binary(ast::BinaryOp::MUL, x, two);
+    ast::NodeId call = tree.add_function("max", {product, tree.add_number(5.0)});
+    ast::NodeId root = tree.add_unary(ast::UnaryOp::NEGATE, call);
+    expect(tree.root() == root, "the newest node is the root");
+    expect(tree.name(x) == "x" && tree.number(two) == 2.0, "accessors");
+
+    core::Frame frame(core::default_registry());
+    frame.set("x", 4.0);
+    expect(core::evaluate(tree, frame) == -8.0, "a built tree evaluates");
+    expect(core::evaluate(tree, product, frame) == 8.0, "a subtree evaluates");
+
+    bool threw = false;
+    try {
+        tree.add_binary(ast::BinaryOp::ADD, x, tree.size());
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    expect(threw, "a child that does not exist yet is rejected");
+    threw = false;
+    try {
+        tree.add_entry("f", tree.size());
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    expect(threw, "an entry for a missing node is rejected");
+
+    // Entries are found before the tree is saved and sorted
+    tree.add_entry("g", product);
+    tree.add_entry("f", root);
+    expect(tree.find("f") == root && tree.find("g") == product && tree.find("h") == ast::no_node,
+           "unsorted entries");
+
+    ast::FlatTree part = ast::clone(tree, product);
+    expect(part.size() == 3 && part.entry_count() == 0, "a clone holds only its subtree");
+    expect(ast::hash(part, part.root()) == ast::hash(tree, product), "a clone hashes the same");
+
+    ast::FlatTree copy = tree;
+    copy.add_number(1.0);
+    expect(copy.size() == tree.size() + 1, "a copy grows on its own");
+    ast::FlatTree moved = std::move(copy);
+    expect(copy.empty() && moved.size() == tree.size() + 1, "a moved-from tree is empty");
+}
+
+void errors() {
+    core::Frame frame(core::default_registry());
+    ast::FlatTree unknown = ast::flatten(parse_source("nosuch(1) + z"));
+    bool threw = false;
+    try {
+        core::evaluate(unknown, frame);
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "an unknown function");
+
+    ast::FlatTree division = ast::flatten(parse_source("1 / (2 - 2)"));
+    threw = false;
+    try {
+        core::evaluate(division, frame);
+    } catch (const core::DomainError& e) {
+        threw = e.status == core::Status::DIVISION_BY_ZERO;
+    }
+    expect(threw, "division by zero");
+
+    threw = false;
+    try {
+        core::evaluate(ast::FlatTree(), frame);
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "an empty tree");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    round_trip();
+    traversal();
+    shared_subtrees();
+    building();
+    errors();
+    return test::exit_code();
+}
@@ -0,0 +1,118 @@
+#include "numu/core/integrate.h"
+#include "test_util.h"
+#include <cmath>
+#include <limits>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+constexpr double inf = std::numeric_limits<double>::infinity();
+
+core::IntegrationResult integral(const std::string& source, double lower, double upper,
+                                 const core::IntegrationOptions& options = {}) {
+    return core::integrate(parse_source(source), "x", lower, upper, options);
+}
+
+bool close(double a, double b, double tolerance = 1e-8) {
+    return std::fabs(a - b) <= tolerance * std::fmax(1.0, std::fabs(b));
+}
+
+void finite_intervals() {
+    core::IntegrationResult square = integral("x ^ 2", 0.0, 1.0);
+    expect(square.converged && close(square.value, 1.0 / 3.0, 1e-14), "x^2 over [0, 1]");
+    expect(square.steps == 1, "a polynomial needs one rule");
+    expect(square.evaluations == 21, "one rule is 21 evaluations");
+
+    core::IntegrationResult reversed = integral("x ^ 2", 1.0, 0.0);
+    expect(reversed.converged && close(reversed.value, -1.0 / 3.0, 1e-14), "reversed bounds");
+
+    core::IntegrationResult empty = integral("x ^ 2", 2.0, 2.0);
+    expect(empty.converged && empty.value == 0.0 && empty.evaluations == 0, "equal bounds");
+
+    core::IntegrationResult wave = integral("sin(x)", 0.0, 10.0);
+    expect(wave.converged && close(wave.value, 1.0 - std::cos(10.0)), "sin over [0, 10]");
+
+    // The rule never evaluates the endpoints, so an integrable singularity
+    // there only costs subdivisions
+    core::IntegrationResult singular = integral("1 / sqrt(x)", 0.0, 1.0);
+    expect(singular.converged && close(singular.value, 2.0, 1e-6), "1/sqrt(x) over [0, 1]");
+    expect(singular.steps > 1, "a singularity is subdivided");
+}
+
+// Within the default relative tolerance, and within the error estimate
+bool accurate(const core::IntegrationResult& result, double exact) {
+    double error = std::fabs(result.value - exact);
+    return result.converged && error <= 1e-6 * std::fabs(exact) && error <= result.error;
+}
+
+void infinite_intervals() {
+    double pi = std::acos(-1.0);
+    expect(accurate(integral("exp(-x * x)", -inf, inf), std::sqrt(pi)), "exp(-x^2) over the line");
+    expect(accurate(integral("exp(-x)", 0.0, inf), 1.0), "exp(-x) over [0, inf)");
+    expect(accurate(integral("exp(x)", -inf, 0.0), 1.0), "exp(x) over (-inf, 0]");
+    expect(accurate(integral("1 / (1 + x ^ 2)", 1.0, inf), pi / 4.0), "1/(1+x^2) over [1, inf)");
+}
+
+void frame_bindings() {
+    core::Frame frame(core::default_registry());
+    frame.set("a", 3.0);
+    frame.set("x", 100.0);
+    core::IntegrationResult result = core::integrate(parse_source("a * x"), "x", 0.0, 2.0, frame);
+    expect(result.converged && close(result.value, 6.0), "other names come from the frame");
+}
+
+void limits() {
+    core::IntegrationOptions options;
+    options.max_steps = 5;
+    core::IntegrationResult capped = integral("1 / sqrt(x)", 0.0, 1.0, options);
+    expect(!capped.converged, "max_steps stops a slow integral");
+    expect(capped.steps <= 5, "no more rules than max_steps");
+    expect(capped.error > 0.0 && std::isfinite(capped.value), "the best estimate is returned");
+
+    options = core::IntegrationOptions::from(config::Config::parse(
+        "calculus.integral.relative_tolerance = 1e-3\ncore.max_steps = 7\ncore.timeout = 0"));
+    expect(options.relative_tolerance == 1e-3 && options.max_steps == 7 && options.timeout == 0.0,
+           "options from the config");
+
+    bool threw = false;
+    try {
+        integral("x", std::nan(""), 1.0);
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "a NaN bound throws");
+
+    // The 21-point rule evaluates the midpoint, here 0
+    threw = false;
+    try {
+        integral("1 / x", -1.0, 1.0);
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "an integrand failing inside the interval throws");
+}
+
+void parallel() {
+    core::Scheduler scheduler(4);
+    core::Frame frame(core::default_registry());
+    ast::Node* node = parse_source("sin(x) / (1 + x * x)");
+    core::IntegrationResult serial = core::integrate(node, "x", 0.0, 50.0, frame);
+    core::IntegrationResult split = core::integrate(node, "x", 0.0, 50.0, frame, {}, &scheduler);
+    expect(serial.converged && split.converged, "both converge");
+    expect(close(serial.value, split.value, 1e-9), "workers give the serial value");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    finite_intervals();
+    infinite_intervals();
+    frame_bindings();
+    limits();
+    parallel();
+    return test::exit_code();
+}
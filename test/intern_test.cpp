@@ -0,0 +1,138 @@
+#include "numu/core/intern.h"
+#include "numu/core/eval.h"
+#include "test_util.h"
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+void sharing() {
+    ast::Interner interner;
+    ast::InternScope scope(interner);
+    expect(ast::current_interner() == &interner, "the scope's interner is current");
+
+    auto* sum = static_cast<ast::BinaryOpNode*>(parse_source("x * y + x * y"));
+    expect(sum->left == sum->right, "equal subtrees are one node");
+    // x, y, x * y and the sum
+    expect(interner.size() == 4, "distinct nodes are kept once");
+    expect(interner.hits() == 3, "the repeated x, y and x * y are hits");
+    expect(sum->intern_id == interner.id(), "nodes record their interner");
+
+    ast::Node* again = parse_source("x * y + x * y");
+    expect(again == sum && interner.size() == 4, "a reparsed expression is the same node");
+
+    ast::Node* other = parse_source("x * y - x * y");
+    expect(other != sum && !ast::equals(other, sum), "distinct nodes of one interner differ");
+    expect(core::evaluate(other, [] {
+        core::Frame frame(core::default_registry());
+        frame.set("x", 2.0);
+        frame.set("y", 3.0);
+        return frame;
+    }()) == 0.0, "interned nodes evaluate");
+}
+
+// Booleans and statements are created in the interner's arena, unshared
+void unshared_types() {
+    ast::Interner interner;
+    ast::InternScope scope(interner);
+    ast::Node* a = ast::BooleanNode::create(true);
+    ast::Node* b = ast::BooleanNode::create(true);
+    expect(a != b && a->intern_id == 0, "booleans are not interned");
+    expect(interner.size() == 0 && interner.arena().objects() == 2, "they come from the interner's arena");
+}
+
+// equals() takes -0.0 for 0.0, the interner must not
+void signed_zero() {
+    ast::Interner interner;
+    ast::InternScope scope(interner);
+    auto* zero = ast::NumberNode::create(0.0);
+    auto* negative = ast::NumberNode::create(-0.0);
+    expect(zero != negative && std::signbit(negative->value), "-0 is kept apart from 0");
+    ast::Node* power = ast::BinaryOpNode::create(ast::BinaryOp::POW, negative, ast::NumberNode::create(-1.0));
+    expect(core::evaluate(power) == -HUGE_VAL, "-0 ^ -1 is -inf");
+    expect(ast::NumberNode::create(-0.0) == negative, "-0 is still interned");
+}
+
+void scopes() {
+    ast::Interner outer;
+    ast::Interner inner;
+    expect(outer.id() != inner.id() && outer.id() != 0, "interners have distinct ids");
+    expect(ast::current_interner() == nullptr, "no interner at first");
+    {
+        ast::InternScope a(outer);
+        ast::Node* first = parse_source("x + 1");
+        {
+            ast::InternScope b(inner);
+            ast::Node* second = parse_source("x + 1");
+            expect(first != second && ast::equals(first, second), "interners compare structurally with each other");
+        }
+        expect(ast::current_interner() == &outer, "the outer interner is restored");
+        expect(parse_source("x + 1") == first, "the outer interner still shares");
+    }
+    expect(ast::current_interner() == nullptr, "no interner after the scopes");
+    ast::Node* plain = parse_source("x + 1");
+    expect(plain->intern_id == 0 && plain != parse_source("x + 1"), "nodes outside a scope are not shared");
+}
+
+void reset() {
+    ast::Interner interner;
+    ast::InternScope scope(interner);
+    parse_source("x * x");
+    interner.reset();
+    expect(interner.size() == 0 && interner.hits() == 0 && interner.arena().objects() == 0, "reset empties it");
+    parse_source("x * x");
+    expect(interner.size() == 2 && interner.hits() == 1, "it interns again after reset");
+}
+
+ast::Node* build_many() {
+    for (int k = 0; k < 200; ++k) {
+        parse_source("sin(x) * " + std::to_string(k) + " + y");
+    }
+    return parse_source("sin(x) * 0 + y");
+}
+
+// Threads interning the same expressions at once get the same nodes
+void threads() {
+    ast::Interner alone;
+    {
+        ast::InternScope scope(alone);
+        build_many();
+    }
+
+    ast::Interner interner;
+    std::vector<ast::Node*> roots(8);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        workers.emplace_back([&interner, &roots, i] {
+            ast::InternScope scope(interner);
+            roots[i] = build_many();
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    bool same = true;
+    for (auto* root : roots) {
+        same = same && root == roots[0];
+    }
+    expect(same, "every thread gets the same node");
+    expect(interner.size() == alone.size(), "each node is interned once");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    sharing();
+    unshared_types();
+    signed_zero();
+    scopes();
+    reset();
+    threads();
+    return test::exit_code();
+}
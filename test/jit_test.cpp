@@ -0,0 +1,127 @@
+#include "numu/core/jit.h"
+#include "test_util.h"
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+core::CompiledExpression compile_xy(const std::string& source) {
+    return core::compile(parse_source(source), {"x", "y"});
+}
+
+// Without NUMU_ENABLE_JIT every check below still runs against the
+// interpreter, which the tiered expression falls back to
+void availability() {
+#if defined(NUMU_ENABLE_JIT) && defined(__x86_64__) && !defined(_WIN32)
+    expect(core::jit_available(), "the JIT is available when enabled");
+#else
+    expect(!core::jit_available(), "the JIT is unavailable when disabled");
+    expect(!core::compile_native(compile_xy("x + y")), "no native code without the JIT");
+#endif
+}
+
+void native_matches_interpreter() {
+    const char* sources[] = {
+        "x + y * 2 - 3",
+        "x / y",
+        "(x - y) * (x + y) / (1 + x * x)",
+        "sin(x) * cos(y) + tan(x / 4)",
+        "exp(-x * x) + log(y * y + 1)",
+        "sqrt(x * x + y * y)",
+        "-x ^ 2 + abs(y)",
+        "max(x, y) - min(x, y)",
+        "(x + y) * (x + y)",
+        "x % 3",
+    };
+    const double values[] = {-2.5, -1.0, -0.25, 0.5, 1.0, 3.0, 10.0};
+
+    for (const char* source : sources) {
+        core::CompiledExpression expr = compile_xy(source);
+        core::NativeFunction native = core::compile_native(expr);
+        expect(!core::jit_available() || native, (std::string("native code for ") + source).c_str());
+        if (!native) {
+            continue;
+        }
+        for (double x : values) {
+            for (double y : values) {
+                double vars[] = {x, y};
+                core::Result interpreted = expr.try_evaluate(vars);
+                if (!interpreted.ok()) {
+                    continue;
+                }
+                expect(same_value(native(vars), interpreted.value),
+                       (std::string("native matches the interpreter for ") + source).c_str());
+            }
+        }
+    }
+}
+
+// Native code returns NaN where the interpreter fails, and the tiered
+// expression asks the interpreter what the error was
+void nan_bail_out() {
+    core::TieredExpression division(compile_xy("x / y"), 0);
+    expect(division.native() == core::jit_available(), "threshold 0 tiers up at construction");
+
+    double zero[] = {1.0, 0.0};
+    core::Result result = division.try_evaluate(zero);
+    expect(result.status == core::Status::DIVISION_BY_ZERO, "native division by zero is reported");
+
+    bool threw = false;
+    try {
+        division.evaluate(zero);
+    } catch (const core::DomainError& e) {
+        threw = e.status == core::Status::DIVISION_BY_ZERO;
+    }
+    expect(threw, "native division by zero throws from evaluate");
+
+    core::TieredExpression logarithm(compile_xy("log(x) + y"), 0);
+    double negative[] = {-1.0, 2.0};
+    expect(logarithm.try_evaluate(negative).status == core::Status::LOG_DOMAIN,
+           "native log of a negative is reported");
+
+    double ok[] = {6.0, 3.0};
+    expect(division.evaluate(ok) == 2.0, "native code still answers after a bail-out");
+}
+
+void tier_up_at_threshold() {
+    core::TieredExpression tiered(compile_xy("x * y + 1"), 3);
+    double vars[] = {2.0, 4.0};
+    for (int i = 0; i < 2; ++i) {
+        expect(tiered.evaluate(vars) == 9.0, "interpreted before the threshold");
+        expect(!tiered.native(), "no native code before the threshold");
+    }
+    expect(tiered.evaluate(vars) == 9.0, "evaluation at the threshold");
+    expect(tiered.native() == core::jit_available(), "native code from the threshold on");
+    expect(tiered.evaluate(vars) == 9.0, "native evaluation");
+}
+
+// Loops and branches compile to jumps, which the JIT leaves to the
+// interpreter. The program reads no variables, so its registers need no
+// seeding from run().
+void control_flow_falls_back() {
+    core::Program program = core::compile_program(
+        parse_program("s = 0; i = 0; while i < 5 { s = s + i; i = i + 1 }; s"));
+    expect(!core::compile_native(program.code()), "no native code for a loop");
+
+    core::TieredExpression tiered(program.code(), 2);
+    std::vector<double> vars(program.variables().size(), 0.0);
+    for (int i = 0; i < 4; ++i) {
+        expect(tiered.evaluate(vars) == 10.0, "a loop is interpreted past the threshold");
+    }
+    expect(!tiered.native(), "a loop stays interpreted");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    availability();
+    native_matches_interpreter();
+    nan_bail_out();
+    tier_up_at_threshold();
+    control_flow_falls_back();
+    return test::exit_code();
+}
@@ -0,0 +1,96 @@
+#include "numu/core/eval.h"
+#include "numu/core/parse.h"
+#include "numu/core/stream.h"
+#include "test_util.h"
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+std::vector<lex::TokenType> token_types(const std::string& source) {
+    lex::Lexer lexer(source);
+    std::vector<lex::TokenType> types;
+    for (lex::Token token = lexer.next(); token.type != lex::TokenType::END_OF_FILE;
+         token = lexer.next()) {
+        types.push_back(token.type);
+    }
+    return types;
+}
+
+// Including the lexer leaves the standard NAN and EOF macros alone
+void standard_macros() {
+    double nan = NAN;
+    expect(std::isnan(nan), "NAN is still the standard macro");
+    expect(EOF < 0, "EOF is still the standard macro");
+}
+
+void tokens() {
+    using T = lex::TokenType;
+    std::vector<T> expected = {T::NUMBER, T::PLUS, T::IDENTIFIER, T::STAR, T::NAN_LITERAL,
+                               T::LEQ, T::INF};
+    expect(token_types("1.5 + x * nan <= inf") == expected, "tokens of an expression");
+    expect(std::isnan(core::evaluate(parse_source("nan + 1"))), "nan evaluates to NaN");
+}
+
+// The stream lexer yields the same tokens as the lexer over the whole
+// input, whatever the chunk size
+void stream_chunks() {
+    std::string source = "alpha + 12.5 * beta - sin(gamma) / 3";
+    std::vector<lex::TokenType> expected = token_types(source);
+    for (size_t chunk : {1, 2, 7, 64}) {
+        std::istringstream input(source);
+        lex::StreamLexer lexer(input, chunk);
+        std::vector<lex::TokenType> types;
+        for (lex::Token token = lexer.next(); token.type != lex::TokenType::END_OF_FILE;
+             token = lexer.next()) {
+            types.push_back(token.type);
+        }
+        expect(types == expected, "stream lexer matches the lexer");
+    }
+}
+
+bool lex_error(std::string_view source) {
+    try {
+        lex::Lexer lexer(source);
+        while (lexer.next().type != lex::TokenType::END_OF_FILE) {
+        }
+    } catch (const lex::LexError&) {
+        return true;
+    }
+    return false;
+}
+
+// A string cut off right after a backslash is unterminated, and is not
+// read past the end of its source
+void trailing_backslash() {
+    std::string buffer = "\"ab\\\"";
+    expect(lex_error(std::string_view(buffer).substr(0, buffer.size() - 1)),
+           "a string ending in a backslash is unterminated");
+
+    std::string path = "numu_lex_test_input.txt";
+    if (std::FILE* file = std::fopen(path.c_str(), "wb")) {
+        std::fputs("\"ab\\", file);
+        std::fclose(file);
+        {
+            lex::MappedFile mapped(path);
+            expect(lex_error(mapped.view()), "a mapped file ending in a backslash is unterminated");
+        }
+        std::remove(path.c_str());
+    }
+}
+
+} // namespace
+
+int main() {
+    standard_macros();
+    tokens();
+    stream_chunks();
+    trailing_backslash();
+    return test::exit_code();
+}
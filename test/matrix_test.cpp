@@ -0,0 +1,42 @@
+#include "numu/core/matrix.h"
+#include "test_util.h"
+#include <cstdio>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// Matrix operands below the immediate children still make the whole
+// expression a matrix one
+void nested_matrix_operands() {
+    ast::Node* node = parse_source("([[1,2]]+[[3,4]])*([1,1]+[1,1])");
+    core::Frame frame(core::default_registry());
+
+    core::Matrix product = core::evaluate_matrix(node, frame);
+    expect(product.rows() == 1 && product.cols() == 1 && product(0, 0) == 20.0,
+           "evaluate_matrix of a product of sums");
+    expect(core::evaluate(node, frame) == 20.0, "evaluate of a product of sums");
+
+    core::Result result = core::try_evaluate(node, frame);
+    expect(result.ok() && result.value == 20.0, "try_evaluate of a product of sums");
+
+    ast::Node* negated = parse_source("-(([[1,2]]+[[3,4]])*([1,1]+[1,1]))");
+    expect(core::evaluate(negated, frame) == -20.0, "evaluate of a negated product");
+}
+
+void scalar_operands() {
+    ast::Node* node = parse_source("det([[1,2],[3,4]]) * 2 + 1");
+    core::Frame frame(core::default_registry());
+    expect(core::evaluate(node, frame) == -3.0, "a determinant is a scalar operand");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    nested_matrix_operands();
+    scalar_operands();
+    return test::exit_code();
+}
@@ -0,0 +1,162 @@
+#include "numu/core/module.h"
+#include "test_util.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+std::shared_ptr<core::ModuleRegistry> modules(const std::string& text) {
+    return core::ModuleRegistry::create(config::Config::parse(text));
+}
+
+double evaluate_with(const std::shared_ptr<core::ModuleRegistry>& modules, const std::string& source) {
+    return core::evaluate(parse_source(source), core::Frame(modules->registry()));
+}
+
+template<typename F>
+bool module_error(F f, const char* contains) {
+    try {
+        f();
+    } catch (const core::ModuleError& e) {
+        return std::string(e.what()).find(contains) != std::string::npos;
+    }
+    return false;
+}
+
+bool close(double a, double b) {
+    return std::fabs(a - b) <= 1e-6 * std::fmax(1.0, std::fabs(b));
+}
+
+// Declared before any registry is created, so every registry knows them
+void declare() {
+    core::declare_module({"test.twice", {"twice", "two"}, [](core::RegistryPtr registry, const config::Config&) {
+        return registry->with_function("twice", [](double x) { return 2 * x; })->with_constant("two", 2.0);
+    }});
+    core::declare_module({"test.empty", {}, [](core::RegistryPtr, const config::Config&) {
+        return core::RegistryPtr();
+    }});
+    expect(module_error([] { core::declare_module({"test.twice", {}, nullptr}); }, "Module already declared: test.twice"),
+           "a module is declared once");
+}
+
+void lazy_loading() {
+    auto all = modules("");
+    std::vector<std::string> expected = {"core", "arithmetic", "calculus.differential", "calculus.integral",
+                                         "linear.basic", "test.twice", "test.empty"};
+    expect(all->eligible() == expected, "every declared module is eligible by default");
+    for (const auto& name : expected) {
+        expect(all->available(name) && !all->loaded(name), "nothing is loaded up front");
+    }
+
+    expect(evaluate_with(all, "twice(two)") == 4.0, "a declared module");
+    expect(all->loaded("test.twice") && !all->loaded("calculus.integral"), "only the provider is loaded");
+    expect(close(evaluate_with(all, "dsin(0) + dexp(1)"), 1.0 + std::exp(1.0)), "symbolic derivatives");
+    expect(close(evaluate_with(all, "si(1)"), 0.946083070367183), "the sine integral");
+    expect(evaluate_with(all, "det(1, 2, 3, 4)") == -2.0, "det by entries");
+    expect(all->loaded("calculus.differential") && all->loaded("calculus.integral") &&
+           all->loaded("linear.basic"), "providers load on first use");
+
+    expect(all->find_callable("nosuch") == nullptr && all->find_constant("nosuch") == nullptr,
+           "a name no module defines");
+    expect(all->find_callable("nosuch") == nullptr, "a miss is stable");
+}
+
+void selection() {
+    auto some = modules("modules.required = [arithmetic]\nmodules.optional = [test.twice, missing, arithmetic]");
+    expect((some->eligible() == std::vector<std::string>{"arithmetic", "test.twice"}),
+           "only listed modules that exist, once each");
+    bool threw = false;
+    try {
+        evaluate_with(some, "dsin(0)");
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "names of other modules are not found");
+
+    expect(module_error([] { modules("modules.required = [missing]"); }, "Required module not found: missing"),
+           "a missing required module");
+
+    // Loading a module by hand makes names looked up in vain before visible
+    auto none = modules("modules.required = [core]");
+    expect(none->find_callable("twice") == nullptr, "twice is not eligible");
+    for (int i = 0; i < 10000; ++i) {
+        none->find_constant("unknown" + std::to_string(i));
+    }
+    expect(none->find_constant("unknown1") == nullptr && none->find_constant("pi") == nullptr,
+           "more misses than are kept");
+    none->load("test.twice");
+    expect(none->find_callable("twice") != nullptr && none->loaded("test.twice"), "a miss is forgotten on load");
+
+    expect(module_error([&] { none->load("nosuch"); }, "Unknown module: nosuch"), "an unknown module");
+    expect(module_error([&] { none->load("test.empty"); }, "Module test.empty returned no registry"),
+           "a module returning nothing");
+}
+
+void numeric_derivatives() {
+    auto numeric = modules("calculus.differential { default_method = numeric, numeric_step = 1e-6 }");
+    expect(close(evaluate_with(numeric, "dcos(1)"), -std::sin(1.0)), "a central difference");
+}
+
+void from_disk() {
+    namespace fs = std::filesystem;
+    fs::path dir = fs::path("module_test_dir");
+    fs::create_directories(dir / "modules");
+    {
+        std::ofstream(dir / "modules" / "bogus.so") << "not a library";
+        std::ofstream(dir / "modules" / "test.twice.so") << "shadowed";
+        std::ofstream(dir / "numurc") << "modules.paths = [modules, /nonexistent]\n";
+    }
+
+    auto found = core::ModuleRegistry::open((dir / "numurc").string());
+    expect(found->available("bogus"), "a library on a relative path");
+    expect(found->eligible().back() == "bogus", "files follow the declared modules");
+    expect(module_error([&] { found->load("bogus"); }, "Cannot load module bogus"), "a file that is not a library");
+    found->load("test.twice");
+    expect(found->find_constant("two") != nullptr, "built-in modules win over files");
+
+    fs::remove_all(dir);
+}
+
+// Concurrent first lookups load each module once and agree
+void threads() {
+    auto shared = modules("");
+    std::vector<const core::Callable*> seen(8);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < seen.size(); ++i) {
+        workers.emplace_back([&shared, &seen, i] {
+            for (int k = 0; k < 100; ++k) {
+                shared->find_callable("miss" + std::to_string(k));
+            }
+            seen[i] = shared->find_callable("fresnelc");
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    bool same = seen[0] != nullptr;
+    for (const auto* callable : seen) {
+        same = same && callable == seen[0];
+    }
+    expect(same, "every thread finds the same function");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    declare();
+    lazy_loading();
+    selection();
+    numeric_derivatives();
+    from_disk();
+    threads();
+    return test::exit_code();
+}
@@ -0,0 +1,145 @@
+#include "numu/core/notebook.h"
+#include "test_util.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// A matrix expression nested below a scalar operator is one opaque step
+void nested_matrix_operands() {
+    core::Notebook notebook;
+    notebook.set("k", 2.0);
+    notebook.define("y", parse_source("k * (([[1,2]]+[[3,4]])*([1,1]+[1,1]))"));
+    expect(notebook.get("y") == 40.0, "notebook evaluates a nested matrix product");
+
+    notebook.set("k", 3.0);
+    expect(notebook.get("y") == 60.0, "notebook re-evaluates after a change");
+}
+
+bool throws(core::Notebook& notebook, const std::string& name, const char* contains) {
+    try {
+        notebook.get(name);
+    } catch (const core::EvaluationError& e) {
+        return std::string(e.what()).find(contains) != std::string::npos;
+    }
+    return false;
+}
+
+// Only the subexpressions reading a changed input are evaluated again
+void reuse_counts() {
+    core::Notebook notebook;
+    notebook.set("x", 1.0);
+    notebook.set("y", 2.0);
+    notebook.define("f", parse_source("x * 2 + sin(y)"));
+    expect(notebook.get("f") == 2.0 + std::sin(2.0), "first evaluation");
+    expect(notebook.stats().recomputed == 1 && notebook.stats().terms_reused == 0, "nothing to reuse at first");
+
+    notebook.reset_stats();
+    notebook.set("x", 3.0);
+    expect(notebook.stale("f"), "a changed input marks its reader stale");
+    expect(notebook.get("f") == 6.0 + std::sin(2.0), "evaluation after a change");
+    expect(notebook.stats().recomputed == 1, "the definition is recomputed");
+    expect(notebook.stats().terms_reused == 2, "y and sin(y) are reused");
+    expect(notebook.stats().terms_evaluated == 3, "x, x * 2 and the sum are evaluated");
+
+    notebook.reset_stats();
+    notebook.set("x", 3.0);
+    expect(!notebook.stale("f"), "setting the same value changes nothing");
+    notebook.get("f");
+    expect(notebook.stats().recomputed == 0, "nothing recomputed for the same value");
+
+    // g comes out the same, so h, which reads only g, is left alone
+    notebook.define("g", parse_source("x * 0 + 1"));
+    notebook.define("h", parse_source("g + 1"));
+    expect(notebook.get("h") == 2.0, "a chain of definitions");
+    notebook.reset_stats();
+    notebook.set("x", 4.0);
+    expect(notebook.get("h") == 2.0, "a chain after a change");
+    expect(notebook.stats().recomputed == 1 && notebook.stats().unchanged == 1,
+           "a reader of an unchanged value is not recomputed");
+}
+
+void circular_definitions() {
+    core::Notebook notebook;
+    notebook.define("a", parse_source("b + 1"));
+    notebook.define("b", parse_source("a + 1"));
+    expect(throws(notebook, "a", "Circular definition"), "a cycle of two");
+    expect(throws(notebook, "b", "Circular definition"), "the cycle from its other end");
+
+    notebook.define("b", parse_source("2"));
+    expect(notebook.get("a") == 3.0, "breaking the cycle");
+
+    notebook.set("x", 4.0);
+    notebook.define("d", parse_source("x + 1"));
+    expect(notebook.get("d") == 5.0, "a definition reading an input");
+    notebook.define("d", parse_source("7"));
+    expect(notebook.get("d") == 7.0, "redefined as a constant");
+
+    notebook.define("c", parse_source("c * 2"));
+    expect(throws(notebook, "c", "Circular definition"), "a definition reading itself");
+}
+
+void removal() {
+    core::Notebook notebook;
+    notebook.set("x", 2.0);
+    notebook.define("y", parse_source("x + 1"));
+    notebook.define("z", parse_source("y * 2"));
+    expect(notebook.get("z") == 6.0, "before removal");
+
+    notebook.remove("x");
+    expect(!notebook.has("x") && notebook.has("y"), "removing an input keeps its readers");
+    expect(notebook.stale("z"), "readers of a removed name are stale");
+    expect(throws(notebook, "z", "Undefined variable: x"), "a reader of a removed input");
+    expect(throws(notebook, "x", "Undefined variable: x"), "a removed input");
+
+    notebook.set("x", 5.0);
+    expect(notebook.get("z") == 12.0, "an input defined again");
+
+    notebook.remove("y");
+    expect(throws(notebook, "z", "Undefined variable: y"), "a reader of a removed definition");
+    expect(notebook.readers("x").empty(), "a removed definition stops reading");
+    notebook.remove("y");
+    notebook.remove("never");
+    expect(!notebook.has("never"), "removing an unknown name does nothing");
+}
+
+// A failed evaluation leaves the definition stale, so nothing computed
+// before the failure is mistaken for up to date
+void recovery() {
+    core::Notebook notebook;
+    notebook.set("x", 1.0);
+    notebook.set("w", 1.0);
+    notebook.define("y", parse_source("w * 3 + 1 / x"));
+    notebook.define("v", parse_source("y + 1"));
+    expect(notebook.get("v") == 5.0, "before the failure");
+
+    notebook.set("w", 2.0);
+    notebook.set("x", 0.0);
+    expect(throws(notebook, "v", "Division by zero"), "a failing definition");
+    expect(notebook.stale("y") && notebook.stale("v"), "a failed definition stays stale");
+
+    notebook.set("x", 1.0);
+    expect(notebook.get("v") == 8.0, "recovered with the change made before the failure");
+    expect(notebook.get("y") == 7.0, "the definition that failed");
+
+    notebook.define("u", parse_source("missing + 1"));
+    expect(throws(notebook, "u", "Undefined variable: missing"), "an unknown name");
+    notebook.set("missing", 1.0);
+    expect(notebook.get("u") == 2.0, "the unknown name defined later");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    nested_matrix_operands();
+    reuse_counts();
+    circular_definitions();
+    removal();
+    recovery();
+    return test::exit_code();
+}
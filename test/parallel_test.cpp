@@ -0,0 +1,50 @@
+#include "numu/core/parallel.h"
+#include "test_util.h"
+#include <atomic>
+#include <cstdio>
+#include <stdexcept>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// A parallel_for inside a task runs inline instead of waiting on the
+// workers that are busy with the outer one
+void nested_parallel_for() {
+    core::Scheduler scheduler(2);
+    std::atomic<size_t> total{0};
+    scheduler.parallel_for(8, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            scheduler.parallel_for(10, 3, [&](size_t inner_begin, size_t inner_end) {
+                total += inner_end - inner_begin;
+            });
+        }
+    });
+    expect(total == 80, "nested parallel_for covers every index");
+}
+
+void nested_exception() {
+    core::Scheduler scheduler(2);
+    bool thrown = false;
+    try {
+        scheduler.parallel_for(4, 1, [&](size_t, size_t) {
+            scheduler.parallel_for(4, 1, [](size_t begin, size_t) {
+                if (begin == 2) {
+                    throw std::runtime_error("inner");
+                }
+            });
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    expect(thrown, "an exception from a nested task reaches the caller");
+}
+
+} // namespace
+
+int main() {
+    nested_parallel_for();
+    nested_exception();
+    return test::exit_code();
+}
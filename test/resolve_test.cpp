@@ -0,0 +1,110 @@
+#include "numu/core/resolve.h"
+#include "test_util.h"
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+double hypotenuse(double a, double b) {
+    return std::sqrt(a * a + b * b);
+}
+
+bool resolve_error(const std::string& source, const char* contains) {
+    try {
+        core::resolve(parse_source(source));
+    } catch (const core::EvaluationError& e) {
+        return std::string(e.what()).find(contains) != std::string::npos;
+    }
+    return false;
+}
+
+// Every value and every error matches the tree evaluator's
+void matches_evaluate() {
+    core::RegistryPtr registry = core::default_registry()->with_function("hyp", hypotenuse);
+    const char* sources[] = {
+        "x + y * 2",
+        "x / y",
+        "log(x) + sqrt(y)",
+        "x ^ y",
+        "-x % y",
+        "pow(x, y) - hyp(x, y)",
+        "max(x, y, 1) + min(x, -y) + sum(x, y) + avg(x, y, 2)",
+        "abs(x - y) * sin(x) / cos(y)",
+        "(x > y) + (y != 0) * (x == 1)",
+        "(x + y) * (x + y) + pi",
+    };
+    const double values[] = {-2.0, -0.5, 0.0, 1.0, 2.5};
+
+    for (const char* source : sources) {
+        ast::Node* node = parse_source(source);
+        core::Frame frame(registry);
+        core::ResolvedExpression resolved = core::resolve(node, frame);
+        for (double x : values) {
+            for (double y : values) {
+                frame.set("x", x);
+                frame.set("y", y);
+                std::vector<double> vars;
+                for (const auto& name : resolved.variables()) {
+                    vars.push_back(frame.get(name));
+                }
+                core::Result expected = core::try_evaluate(node, frame);
+                core::Result actual = resolved.try_evaluate(vars.data());
+                expect(actual.status == expected.status, (std::string("status of ") + source).c_str());
+                expect(same_value(actual.value, expected.value), (std::string("value of ") + source).c_str());
+                if (expected.ok()) {
+                    expect(same_value(resolved.evaluate(vars), expected.value),
+                           (std::string("evaluate of ") + source).c_str());
+                }
+            }
+        }
+    }
+}
+
+void slots() {
+    core::ResolvedExpression all = core::resolve(parse_source("b * a + b - c"));
+    expect((all.variables() == std::vector<std::string>{"b", "a", "c"}), "slots in order of appearance");
+    expect(all.slot("a") == 1 && all.slot("c") == 2, "slot lookup");
+    bool threw = false;
+    try {
+        all.slot("d");
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "an unknown slot throws");
+    expect(all.evaluate({2.0, 3.0, 1.0}) == 7.0, "evaluation from slots");
+
+    // Names outside the list are bound when resolved, not when evaluated
+    core::Frame frame(core::default_registry());
+    frame.set("k", 10.0);
+    core::ResolvedExpression some = core::resolve(parse_source("k * x"), {"x"}, frame);
+    frame.set("k", 20.0);
+    expect(some.variables().size() == 1 && some.evaluate({2.0}) == 20.0, "other names are bound once");
+}
+
+void resolve_errors() {
+    expect(resolve_error("nosuch(1)", "Unknown function: nosuch"), "an unknown function");
+    expect(resolve_error("sin(1, 2)", "expects 1 arguments, got 2"), "a wrong argument count");
+    expect(resolve_error("[[1, 2]] * 2", "Matrix expressions cannot be resolved"), "a matrix expression");
+
+    bool threw = false;
+    try {
+        core::resolve(parse_source("k * x"), {"x"}, core::default_frame());
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "an unbound name outside the slots");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    matches_evaluate();
+    slots();
+    resolve_errors();
+    return test::exit_code();
+}
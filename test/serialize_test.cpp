@@ -0,0 +1,175 @@
+#include "numu/core/serialize.h"
+#include "test_util.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// Size of the file header, and of each section before the children
+constexpr size_t header_size = 80;
+
+size_t padded(size_t bytes) {
+    return (bytes + 7) / 8 * 8;
+}
+
+// An 8-byte aligned copy of a serialized tree, optionally shifted off
+// alignment by `shift` bytes
+struct Buffer {
+    std::vector<uint64_t> words;
+    size_t shift = 0;
+    size_t size = 0;
+
+    explicit Buffer(const std::string& bytes, size_t shift = 0)
+        : words(bytes.size() / 8 + 2), shift(shift), size(bytes.size()) {
+        std::memcpy(data(), bytes.data(), bytes.size());
+    }
+
+    char* data() { return reinterpret_cast<char*>(words.data()) + shift; }
+};
+
+bool format_error(Buffer& buffer, size_t size, const char* contains = "") {
+    try {
+        ast::view(buffer.data(), size);
+    } catch (const ast::FormatError& e) {
+        return std::strstr(e.what(), contains) != nullptr;
+    }
+    return false;
+}
+
+ast::FlatTree sample_tree(std::vector<std::string>& names) {
+    const char* sources[] = {"x * y + 1", "sin(x) / (y - 2)", "max(x, y, 3) ^ 2", "-x + abs(y)"};
+    ast::FlatTree tree;
+    // Added out of order, so only the saved tree is sorted
+    for (int round = 9; round >= 0; --round) {
+        for (size_t i = 0; i < 4; ++i) {
+            std::string name = "f" + std::to_string(round) + "_" + std::to_string(i);
+            ast::NodeId root = ast::flatten(parse_source(sources[i]), tree);
+            tree.add_entry(name, root);
+            names.push_back(name);
+            tree.set_root(root);
+        }
+    }
+    return tree;
+}
+
+void round_trip() {
+    std::vector<std::string> names;
+    ast::FlatTree tree = sample_tree(names);
+    core::Frame frame(core::default_registry());
+    frame.set("x", 0.75);
+    frame.set("y", 4.0);
+
+    std::string path = "numu_serialize_test.flat";
+    ast::save(tree, path);
+    {
+        ast::FlatTree loaded = ast::load(path);
+        expect(!loaded.owned(), "a loaded tree reads the file in place");
+        expect(loaded.size() == tree.size() && loaded.root() == tree.root(), "size and root survive");
+        expect(loaded.entry_count() == names.size(), "entries survive");
+        for (const auto& name : names) {
+            ast::NodeId before = tree.find(name);
+            ast::NodeId after = loaded.find(name);
+            expect(after == before, "a named entry is found by bisection");
+            expect(ast::hash(loaded, after) == ast::hash(tree, before), "a loaded subtree hashes the same");
+            expect(same_value(core::evaluate(loaded, after, frame), core::evaluate(tree, before, frame)),
+                   "a loaded subtree evaluates the same");
+        }
+        expect(loaded.find("missing") == ast::no_node, "a missing name");
+        expect(loaded.find("f0") == ast::no_node && loaded.find("f9_3x") == ast::no_node,
+               "names next to existing ones");
+
+        // A copy keeps the mapping alive
+        ast::FlatTree copy = loaded;
+        loaded = ast::FlatTree();
+        expect(copy.find("f3_1") != ast::no_node, "a copy of a loaded tree");
+    }
+    std::remove(path.c_str());
+
+    std::string bytes = ast::serialize(tree);
+    Buffer buffer(bytes);
+    ast::FlatTree viewed = ast::view(buffer.data(), buffer.size);
+    expect(ast::hash(viewed, viewed.root()) == ast::hash(tree, tree.root()), "view of a buffer");
+}
+
+void rejected_buffers() {
+    std::vector<std::string> names;
+    ast::FlatTree tree = sample_tree(names);
+    std::string bytes = ast::serialize(tree);
+
+    Buffer unaligned(bytes, 1);
+    expect(format_error(unaligned, unaligned.size, "aligned"), "an unaligned buffer is rejected");
+
+    Buffer truncated(bytes);
+    expect(format_error(truncated, truncated.size - 8, "size"), "a truncated buffer is rejected");
+    expect(format_error(truncated, header_size - 1, "header"), "a truncated header is rejected");
+
+    Buffer magic(bytes);
+    magic.data()[0] = 'X';
+    expect(format_error(magic, magic.size, "Not a flat tree"), "wrong magic is rejected");
+
+    Buffer version(bytes);
+    uint32_t next = ast::flat_format_version + 1;
+    std::memcpy(version.data() + 8, &next, sizeof(next));
+    expect(format_error(version, version.size, "version"), "another version is rejected");
+}
+
+// The root's children are the last child slots, since flatten adds a
+// node after its children
+void corrupt_child_order() {
+    ast::FlatTree tree = ast::flatten(parse_source("x * y + 1"));
+    std::string bytes = ast::serialize(tree);
+    size_t n = tree.size();
+    size_t slots = 0;
+    for (ast::NodeId id = 0; id < n; ++id) {
+        slots += tree.child_count(id);
+    }
+    size_t children = header_size + 2 * padded(n) + 4 * padded(4 * n);
+    size_t slot = children + 4 * (slots - tree.child_count(tree.root()));
+
+    Buffer buffer(bytes);
+    ast::NodeId first;
+    std::memcpy(&first, buffer.data() + slot, sizeof(first));
+    expect(first == tree.child(tree.root(), 0), "located the root's first child");
+
+    ast::NodeId self = tree.root();
+    std::memcpy(buffer.data() + slot, &self, sizeof(self));
+    expect(format_error(buffer, buffer.size, "child order"), "a child after its parent is rejected");
+}
+
+// Entries in a hand-edited buffer may be out of order; lookups then scan
+void unsorted_entries() {
+    ast::FlatTree tree;
+    tree.add_entry("a", ast::flatten(parse_source("1"), tree));
+    tree.add_entry("b", ast::flatten(parse_source("2"), tree));
+    std::string bytes = ast::serialize(tree);
+
+    Buffer buffer(bytes);
+    char* table = buffer.data() + buffer.size - 16;
+    char swapped[16];
+    std::memcpy(swapped, table + 8, 8);
+    std::memcpy(swapped + 8, table, 8);
+    std::memcpy(table, swapped, 16);
+
+    ast::FlatTree viewed = ast::view(buffer.data(), buffer.size);
+    expect(viewed.entry_name(0) == "b", "entries kept in buffer order");
+    expect(core::evaluate(viewed, viewed.find("a"), core::default_frame()) == 1.0 &&
+               core::evaluate(viewed, viewed.find("b"), core::default_frame()) == 2.0,
+           "unsorted entries are still found");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    round_trip();
+    rejected_buffers();
+    corrupt_child_order();
+    unsorted_entries();
+    return test::exit_code();
+}
@@ -0,0 +1,98 @@
+#include "numu/core/ast.h"
+#include "numu/core/eval.h"
+#include "test_util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+// Fractional exponents are NaN for negative bases, so they must not be
+// merged into integer ones
+void powers_of_negative_base() {
+    for (const char* source : {"(x^0.5)^2", "x^0.5 * x^0.5", "x^1.5 / x^0.5",
+                               "(x^2)^3", "x * x", "x^3 / x"}) {
+        ast::Node* node = parse_source(source);
+        ast::Node* simplified = ast::simplify(node);
+        for (double x : {-2.0, 3.0}) {
+            core::Frame frame(core::default_registry());
+            frame.set("x", x);
+            core::Result before = core::try_evaluate(node, frame);
+            core::Result after = core::try_evaluate(simplified, frame);
+            if (!same_value(before.value, after.value)) {
+                std::fprintf(stderr, "  %s at x = %g\n", source, x);
+                expect(false, "simplify keeps the value of a power");
+            }
+        }
+    }
+}
+
+void integer_powers_combine() {
+    ast::Node* simplified = ast::simplify(parse_source("(x^2)^3"));
+    auto* pow = static_cast<ast::BinaryOpNode*>(simplified);
+    expect(simplified->type == ast::NodeType::BINARY_OP && pow->op == ast::BinaryOp::POW &&
+           pow->right->type == ast::NodeType::NUMBER &&
+           static_cast<ast::NumberNode*>(pow->right)->value == 6.0,
+           "(x^2)^3 simplifies to x^6");
+}
+
+// A division by a divisor that may be 0 still fails where the original
+// fails
+void division_errors_kept() {
+    for (const char* source : {"0 / x", "x^3 / x", "x^2 / x^3", "(2 * x) / x^2", "x / 0"}) {
+        ast::Node* node = parse_source(source);
+        ast::Node* simplified = ast::simplify(node);
+        core::Frame frame(core::default_registry());
+        frame.set("x", 0.0);
+        core::Result before = core::try_evaluate(node, frame);
+        core::Result after = core::try_evaluate(simplified, frame);
+        if (before.status != after.status || !same_value(before.value, after.value)) {
+            std::fprintf(stderr, "  %s at x = 0\n", source);
+            expect(false, "simplify keeps a division by zero");
+        }
+    }
+}
+
+// The rules keep the value wherever the expression is defined, and do
+// shrink the tree
+void values_kept() {
+    const char* sources[] = {
+        "2 * x + 3 * x - x", "(x + 1) + (y + 2) + 3", "x * 1 + 0 * 1 - (y - y)",
+        "2 * x * 3 * y", "-(-x) - -(y)", "log(exp(x + y))", "((x * x) * x) / y",
+        "(1 + 2) * x ^ (4 - 3)", "sin(x) * 2 + sin(x)",
+    };
+    for (const char* source : sources) {
+        ast::Node* node = parse_source(source);
+        ast::SimplifyStats stats;
+        ast::Node* simplified = ast::simplify(node, &stats);
+        if (stats.nodes_after >= stats.nodes_before) {
+            std::fprintf(stderr, "  %s: %zu nodes, %zu before\n", source, stats.nodes_after, stats.nodes_before);
+            expect(false, "simplify shrinks the tree");
+        }
+        for (double x : {-1.5, 0.5, 2.0}) {
+            core::Frame frame(core::default_registry());
+            frame.set("x", x);
+            frame.set("y", 0.75);
+            double before = core::evaluate(node, frame);
+            double after = core::evaluate(simplified, frame);
+            if (std::fabs(before - after) > 1e-12 * std::max(1.0, std::fabs(before))) {
+                std::fprintf(stderr, "  %s at x = %g\n", source, x);
+                expect(false, "simplify keeps the value");
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    powers_of_negative_base();
+    division_errors_kept();
+    values_kept();
+    integer_powers_combine();
+    return test::exit_code();
+}
@@ -0,0 +1,174 @@
+#include "numu/core/sparse.h"
+#include "test_util.h"
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+using Format = core::SparseMatrix::Format;
+
+bool same_matrix(const core::Matrix& a, const core::Matrix& b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::fabs(a.data()[i] - b.data()[i]) > 1e-12) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The 1-D Poisson matrix: 2 on the diagonal, -1 beside it
+core::SparseMatrix poisson(size_t n, Format format = Format::CSR) {
+    std::vector<core::SparseMatrix::Entry> entries;
+    for (size_t i = 0; i < n; ++i) {
+        entries.push_back({i, i, 2.0});
+        if (i + 1 < n) {
+            entries.push_back({i, i + 1, -1.0});
+            entries.push_back({i + 1, i, -1.0});
+        }
+    }
+    return core::SparseMatrix(n, n, std::move(entries), format);
+}
+
+std::string poisson_source(size_t n) {
+    std::string source = "[";
+    for (size_t i = 0; i < n; ++i) {
+        source += i ? ",[" : "[";
+        for (size_t j = 0; j < n; ++j) {
+            source += j ? "," : "";
+            source += i == j ? "2" : (i == j + 1 || j == i + 1) ? "-1" : "0";
+        }
+        source += "]";
+    }
+    return source + "]";
+}
+
+void construction() {
+    core::SparseMatrix m(2, 3, {{1, 2, 4.0}, {0, 1, 1.0}, {1, 2, 1.0}, {0, 0, 0.0}, {0, 1, -1.0}});
+    expect(m.nonzeros() == 1, "duplicates are summed and zeros dropped");
+    expect(m.at(1, 2) == 5.0 && m.at(0, 1) == 0.0 && m.at(0, 0) == 0.0, "at after summing");
+
+    core::Matrix dense = m.to_dense();
+    expect(dense.rows() == 2 && dense.cols() == 3 && dense(1, 2) == 5.0, "to_dense");
+    expect(same_matrix(core::SparseMatrix::from_dense(dense, Format::CSC).to_dense(), dense),
+           "from_dense round trip");
+}
+
+void convert_and_transpose() {
+    core::Matrix reference = poisson(5).to_dense();
+    reference(0, 4) = 7.0;
+    core::SparseMatrix csr = core::SparseMatrix::from_dense(reference);
+    core::SparseMatrix csc = csr.convert(Format::CSC);
+    expect(csc.format() == Format::CSC, "convert changes the format");
+    expect(same_matrix(csc.to_dense(), reference), "convert keeps the entries");
+    expect(same_matrix(csc.convert(Format::CSR).to_dense(), reference), "convert back");
+    expect(csc.at(0, 4) == 7.0 && csc.at(4, 0) == 0.0, "at in CSC");
+
+    core::SparseMatrix t = csr.transpose();
+    expect(t.rows() == 5 && t.format() == Format::CSC, "transpose swaps the format");
+    expect(same_matrix(t.to_dense(), core::transpose(reference)), "transpose");
+    expect(same_matrix(csc.transpose().to_dense(), core::transpose(reference)), "transpose of CSC");
+}
+
+void products() {
+    core::SparseMatrix a = poisson(6);
+    core::SparseMatrix b(6, 4, {{0, 0, 1.0}, {2, 3, -2.0}, {5, 1, 3.0}, {3, 3, 0.5}});
+    core::Matrix expected = core::multiply(a.to_dense(), b.to_dense());
+
+    expect(same_matrix(core::multiply(a, b).to_dense(), expected), "sparse x sparse");
+    expect(same_matrix(core::multiply(a.convert(Format::CSC), b.convert(Format::CSC)).to_dense(), expected),
+           "sparse x sparse in CSC");
+    expect(same_matrix(core::multiply(a, b.to_dense()), expected), "sparse x dense");
+    expect(same_matrix(core::multiply(a.to_dense(), b), expected), "dense x sparse");
+
+    // Entries that cancel are not stored
+    core::SparseMatrix diagonal(2, 2, {{0, 0, 1.0}, {0, 1, 1.0}});
+    core::SparseMatrix cancel(2, 2, {{0, 0, 1.0}, {1, 0, -1.0}});
+    expect(core::multiply(diagonal, cancel).nonzeros() == 0, "cancelled products are dropped");
+
+    core::SparseMatrix sum = core::add(a, a.transpose(), -1.0);
+    expect(sum.nonzeros() == 0, "a symmetric matrix minus its transpose");
+    expect(same_matrix(core::add(a, core::SparseMatrix::identity(6), 2.0).to_dense(),
+                       a.to_dense() + core::Matrix::identity(6) * 2.0),
+           "sparse add");
+
+    bool threw = false;
+    try {
+        core::multiply(b, a);
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "mismatched sparse product throws");
+}
+
+void solver() {
+    size_t n = 50;
+    core::SparseMatrix a = poisson(n);
+    std::vector<double> b(n, 1.0);
+    core::SolveResult result = core::conjugate_gradient(a, b);
+    expect(result.converged, "conjugate gradient converges");
+    expect(result.iterations <= n, "conjugate gradient within n iterations");
+
+    std::vector<double> residual = core::multiply(a, result.x);
+    double worst = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        worst = std::fmax(worst, std::fabs(residual[i] - b[i]));
+    }
+    expect(worst < 1e-6, "conjugate gradient solves the system");
+
+    core::SolveResult zero = core::conjugate_gradient(a, std::vector<double>(n, 0.0));
+    expect(zero.converged && zero.iterations == 0, "zero right-hand side");
+
+    bool threw = false;
+    try {
+        core::conjugate_gradient(a * -1.0, b);
+    } catch (const core::EvaluationError&) {
+        threw = true;
+    }
+    expect(threw, "a negative definite matrix is rejected");
+}
+
+// A literal large and empty enough is built sparse and stays sparse
+// through products, sums and transposes
+void evaluated_literals() {
+    core::Frame frame(core::default_registry());
+    ast::Node* literal = parse_source(poisson_source(60));
+    core::MatrixValue value = core::evaluate_matrix_value(literal, frame);
+    expect(value.sparse(), "a sparse literal is stored sparse");
+    expect(!core::evaluate_matrix_value(parse_source("[[1,0],[0,1]]"), frame).sparse(),
+           "a small literal is stored dense");
+
+    std::string a = poisson_source(60);
+    ast::Node* product = parse_source(a + "*" + a);
+    core::MatrixValue squared = core::evaluate_matrix_value(product, frame);
+    core::Matrix dense = poisson(60).to_dense();
+    expect(squared.sparse(), "sparse times sparse stays sparse");
+    expect(same_matrix(squared.to_dense(), core::multiply(dense, dense)), "sparse product value");
+    expect(same_matrix(core::evaluate_matrix(product, frame), core::multiply(dense, dense)),
+           "evaluate_matrix of a sparse product");
+
+    ast::Node* combined = parse_source("(" + a + "-transpose(" + a + ")) * 3 + " + a);
+    core::MatrixValue sum = core::evaluate_matrix_value(combined, frame);
+    expect(sum.sparse() && same_matrix(sum.to_dense(), dense), "sums and transposes stay sparse");
+
+    core::Matrix nan = value.scale(std::nan("")).to_dense();
+    expect(std::isnan(nan(0, 59)), "scaling by NaN reaches the implicit zeros");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    construction();
+    convert_and_transpose();
+    products();
+    solver();
+    evaluated_literals();
+    return test::exit_code();
+}
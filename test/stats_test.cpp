@@ -0,0 +1,125 @@
+#include "numu/core/stats.h"
+#include "numu/core/arena.h"
+#include "numu/core/eval.h"
+#include "test_util.h"
+#include <string>
+#include <thread>
+
+using namespace numu;
+using namespace numu::test;
+
+namespace {
+
+uint64_t total(const stats::FunctionStats& function) {
+    uint64_t sum = 0;
+    for (uint64_t bucket : function.histogram) {
+        sum += bucket;
+    }
+    return sum;
+}
+
+// Built without NUMU_ENABLE_STATS, enabling does nothing and the hooks
+// record nothing
+void unavailable() {
+    stats::enable(true);
+    expect(!stats::enabled(), "collection stays off");
+    core::evaluate(parse_source("sin(1) + 2"));
+    stats::Snapshot totals = stats::snapshot();
+    expect(totals.stage(stats::Stage::EVALUATE).calls == 0, "no stage is recorded");
+    expect(totals.counter(stats::Counter::NODES) == 0, "no counter is recorded");
+    expect(totals.functions.empty(), "no function is recorded");
+}
+
+void stages() {
+    stats::enable(true);
+    stats::reset();
+    ast::Node* node = parse_source("sin(1) + 2");
+    core::evaluate(node);
+    stats::Snapshot totals = stats::snapshot();
+    expect(totals.stage(stats::Stage::PARSE).calls == 1, "one parse");
+    expect(totals.stage(stats::Stage::LEX).calls > 0, "tokens are lexed");
+    expect(totals.stage(stats::Stage::EVALUATE).calls == 1, "one evaluation");
+    expect(totals.stage(stats::Stage::SIMPLIFY).calls == 0, "no simplification");
+
+    // The matrix evaluator hands elements back to the tree evaluator
+    stats::reset();
+    core::evaluate(parse_source("det([[1, 2], [3, 4]])"));
+    expect(stats::snapshot().stage(stats::Stage::EVALUATE).calls == 1, "nested entries count once");
+
+    stats::enable(false);
+    core::evaluate(node);
+    expect(stats::snapshot().stage(stats::Stage::EVALUATE).calls == 1, "nothing is recorded when off");
+}
+
+// Domain-checked functions such as sqrt run as operators and are not timed
+void functions() {
+    stats::enable(true);
+    stats::reset();
+    ast::Node* node = parse_source("sin(x) + sin(2) * cos(x)");
+    core::Frame frame(core::default_registry());
+    frame.set("x", 1.0);
+    core::evaluate(node, frame);
+    stats::Snapshot totals = stats::snapshot();
+    expect(totals.functions["sin"].calls == 2 && totals.functions["cos"].calls == 1, "calls by name");
+    expect(total(totals.functions["sin"]) == 2, "each call lands in one bucket");
+
+    stats::reset();
+    stats::Snapshot cleared = stats::snapshot();
+    expect(cleared.functions.empty() && cleared.stage(stats::Stage::EVALUATE).calls == 0, "reset zeroes");
+    stats::enable(false);
+}
+
+void counters() {
+    stats::enable(true);
+    stats::reset();
+    {
+        ast::ArenaScope scope;
+        parse_source("1 + 2 * 3");
+        expect(scope.arena().objects() == 5, "five nodes");
+    }
+    stats::Snapshot totals = stats::snapshot();
+    expect(totals.counter(stats::Counter::NODES) == 5, "nodes are counted");
+    expect(totals.counter(stats::Counter::ARENA_CHUNKS) == 1, "a new arena allocates a chunk");
+    expect(totals.counter(stats::Counter::ARENA_BYTES) >= ast::Arena::default_chunk_size, "chunk bytes");
+    stats::enable(false);
+}
+
+// A thread's totals survive it
+void threads() {
+    stats::enable(true);
+    stats::reset();
+    std::thread worker([] {
+        ast::ArenaScope scope;
+        core::evaluate(parse_source("sin(4)"));
+    });
+    worker.join();
+    core::evaluate(parse_source("sin(9)"));
+    stats::Snapshot totals = stats::snapshot();
+    expect(totals.stage(stats::Stage::EVALUATE).calls == 2, "an exited thread's evaluations");
+    expect(totals.functions["sin"].calls == 2, "an exited thread's calls");
+    stats::enable(false);
+}
+
+void configured() {
+    stats::configure(config::Config::parse("developer.timing = true"));
+    expect(stats::enabled(), "developer.timing turns collection on");
+    stats::configure(config::Config::parse(""));
+    expect(!stats::enabled(), "collection is off by default");
+    expect(std::string(stats::stage_name(stats::Stage::SIMPLIFY)) == "simplify", "stage names");
+}
+
+} // namespace
+
+int main() {
+    core::builtin::initialize();
+    if (!stats::available()) {
+        unavailable();
+        return test::exit_code();
+    }
+    stages();
+    functions();
+    counters();
+    threads();
+    configured();
+    return test::exit_code();
+}
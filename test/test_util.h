@@ -0,0 +1,44 @@
+#ifndef NUMU_TEST_UTIL_H
+#define NUMU_TEST_UTIL_H
+
+#include "numu/core/parse.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+namespace numu {
+namespace test {
+
+// Failed expectations so far; main() returns non-zero if there were any
+inline int failures = 0;
+
+inline void expect(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+inline ast::Node* parse_source(const std::string& source) {
+    lex::Lexer lexer(source);
+    return parse::parse(lexer);
+}
+
+inline ast::Node* parse_program(const std::string& source) {
+    lex::Lexer lexer(source);
+    return parse::parse_program(lexer);
+}
+
+// Equal, or both NaN
+inline bool same_value(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+inline int exit_code() {
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace test
+} // namespace numu
+
+#endif // NUMU_TEST_UTIL_H